@@ -271,9 +271,18 @@ class pmdl:
         
         # Calculate size of header and padding bits
         shader_pointer_space = psize + ((28+psize)%psize)
+        shader_pointer_off = 28 + shader_pointer_space - psize
+        
+        # Shader-pointer relocations [(collection-relative offset, shader idx)]
+        self.shader_relocs = []
+        collection_relocs = []
+        
+        # Mesh references for octree [(collection idx, mesh idx, min, max)]
+        self.mesh_refs = []
         
         # Begin generating individual collection buffers
         for i in range(len(self.draw_gen.collections)):
+            col_idx = i
             header = bytearray()
             
             # Generate platform-specific portion of vertex buffer
@@ -288,9 +297,13 @@ class pmdl:
             
             # Collect mesh headers
             mesh_headers = bytearray()
-            for mesh_primitives in primitive_meshes:
+            mesh_relocs = []
+            for mesh_idx, mesh_primitives in enumerate(primitive_meshes):
                 
                 # Individual mesh bounding box
+                self.mesh_refs.append((col_idx, mesh_idx,
+                                       list(mesh_primitives['mesh'].bound_box[0]),
+                                       list(mesh_primitives['mesh'].bound_box[6])))
                 for comp in mesh_primitives['mesh'].bound_box[0]:
                     mesh_headers += struct.pack(endian_char + 'f', comp)
                 for comp in mesh_primitives['mesh'].bound_box[6]:
@@ -300,9 +313,15 @@ class pmdl:
                 material_name = lookup_pspl_material(mesh_primitives['mesh'])
                 if material_name is not None:
                     shader_idx = self.get_shader_index(material_name)
+                elif self.sub_type == 'PAR2':
+                    shader_idx = 0x7fffffff # MSB reserved as runtime draw bit
                 else:
                     shader_idx = -1
                 mesh_headers += struct.pack(endian_char + 'i', shader_idx)
+                
+                # Relocation of shader pointer (index-buffer-relative)
+                if material_name is not None:
+                    mesh_relocs.append((8 + len(mesh_headers) - 28 + shader_pointer_off, shader_idx))
                     
                 # Individual mesh shader pointer space
                 for i in range(shader_pointer_space):
@@ -324,6 +343,7 @@ class pmdl:
             idx_buf += self.draw_gen.generate_index_buffer(primitive_meshes, endian_char, psize, self.rigging)
             
             collection_index_buffers.append(idx_buf)
+            collection_relocs.append(mesh_relocs)
             
             header += struct.pack(endian_char + 'H', uv_count)
             header += struct.pack(endian_char + 'H', max_bone_count)
@@ -355,6 +375,8 @@ class pmdl:
         
         for i in range(len(collection_header_buffers)):
             collection_header_buffers[i] += struct.pack(endian_char + 'I', cur_buf_offset)
+            for reloc in collection_relocs[i]:
+                self.shader_relocs.append((cur_buf_offset + reloc[0], reloc[1]))
             cur_buf_offset += len(collection_index_buffers[i])
         
         
@@ -415,6 +437,9 @@ class pmdl:
                 rigging_info_buffer = self.rigging.generate_rigging_info(self, endian_char, psize)
             animation_info_buffer = self.rigging.generate_animation_info(self, endian_char, psize)
         
+        if self.sub_type == 'PAR2':
+            octree_buffer = self.octree.generate_octree_buffer(endian_char)
+        
         collection_offset = header_size + len(skeleton_info_buffer) + len(rigging_info_buffer) + len(animation_info_buffer) + len(octree_buffer)
         collection_pre_pad = ROUND_UP_32(collection_offset) - collection_offset
         collection_offset += collection_pre_pad
@@ -431,6 +456,16 @@ class pmdl:
         total_size = bone_names_offset + len(bone_names_buffer)
         total_size_round = ROUND_UP_32(total_size)
         total_size_pad = total_size_round - total_size
+        
+        # Shader-pointer relocation table (absolute offsets)
+        reloc_offset = total_size_round
+        reloc_buffer = bytearray()
+        reloc_buffer += struct.pack(endian_char + 'I', len(self.shader_relocs))
+        for reloc in self.shader_relocs:
+            reloc_buffer += struct.pack(endian_char + 'I', collection_offset + reloc[0])
+            reloc_buffer += struct.pack(endian_char + 'i', reloc[1])
+        reloc_end = reloc_offset + len(reloc_buffer)
+        reloc_pad = ROUND_UP_32(reloc_end) - reloc_end
 
 
         # Open file and write in header
@@ -463,8 +498,7 @@ class pmdl:
 
         pmdl_header += struct.pack(endian_char + 'I', bone_names_offset)
 
-        for i in range(4):
-            pmdl_header.append(0)
+        pmdl_header += struct.pack(endian_char + 'I', reloc_offset)
 
 
         pmdl_file.write(pmdl_header)
@@ -484,6 +518,9 @@ class pmdl:
         pmdl_file.write(bone_names_buffer)
         for i in range(total_size_pad):
             pmdl_file.write(b'\xff')
+        pmdl_file.write(reloc_buffer)
+        for i in range(reloc_pad):
+            pmdl_file.write(b'\xff')
 
 
 
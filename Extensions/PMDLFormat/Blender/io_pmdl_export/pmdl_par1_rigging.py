@@ -50,6 +50,9 @@ class pmdl_par1_rigging:
         self.mesh_vertex_groups = None
     
         self.bone_arrays = []
+        
+        # Bind-pose bounds of vertices weighted to each bone (by name)
+        self.bone_bounds = {}
 
 
     # Augment bone array with loop vert and return weight array
@@ -72,6 +75,16 @@ class pmdl_par1_rigging:
         # Determine which bones (vertex groups) belong to loop_vert
         for group_elem in vertex.groups:
             vertex_group = self.mesh_vertex_groups[group_elem.group]
+            
+            # Accumulate bone bounds
+            if group_elem.weight > 0.0:
+                if vertex_group.name not in self.bone_bounds:
+                    self.bone_bounds[vertex_group.name] = [list(vertex.co), list(vertex.co)]
+                else:
+                    bounds = self.bone_bounds[vertex_group.name]
+                    for i in range(3):
+                        bounds[0][i] = min(bounds[0][i], vertex.co[i])
+                        bounds[1][i] = max(bounds[1][i], vertex.co[i])
 
             if vertex_group.name not in bone_array:
                 
@@ -125,6 +138,16 @@ class pmdl_par1_rigging:
             for child in bone.children:
                 child_idx = self.armature.data.bones.find(child.name)
                 bone_bytes += struct.pack(endian_char + 'I', child_idx)
+            
+            # Bounds of weighted vertices (inverted if bone weights none)
+            if bone.name in self.bone_bounds:
+                bounds = self.bone_bounds[bone.name]
+            else:
+                bounds = [[1.0,1.0,1.0], [-1.0,-1.0,-1.0]]
+            for comp in bounds[0]:
+                bone_bytes += struct.pack(endian_char + 'f', comp)
+            for comp in bounds[1]:
+                bone_bytes += struct.pack(endian_char + 'f', comp)
                     
             bones.append(bone_bytes)
 
@@ -8,9 +8,132 @@ their indices into the octree as leaf nodes. The resulting reference
 structure is written into the file.
 '''
 
+import struct
+
+# Child-type indicators
+OCTREE_NULL = 0
+OCTREE_NODE = 1
+OCTREE_LEAF = 2
+
+# Test if two AABBs overlap (touching counts)
+def aabb_overlap(a_min, a_max, b_min, b_max):
+    for i in range(3):
+        if a_min[i] > b_max[i] or a_max[i] < b_min[i]:
+            return False
+    return True
+
+# Compute AABB of octant `idx` (X: bit 2, Y: bit 1, Z: bit 0)
+def octant_aabb(box_min, box_max, idx):
+    mid = [(box_min[i] + box_max[i]) / 2 for i in range(3)]
+    oct_min = list(box_min)
+    oct_max = list(mid)
+    for i in range(3):
+        if idx & (4 >> i):
+            oct_min[i] = mid[i]
+            oct_max[i] = box_max[i]
+    return oct_min, oct_max
+
+
 class pmdl_par2_octree:
-    
+
     # Set up with collection-populated PMDL object
-    def __init__(self, pmdl):
-        pass
-            
+    def __init__(self, pmdl, levels):
+        self.pmdl = pmdl
+        self.levels = levels
+
+
+    # Recursively subdivide node AABB; returns list of 8 children
+    # (None, ('NODE', children) or ('LEAF', mesh refs)) or None if empty
+    def _subdivide(self, box_min, box_max, mesh_refs, level):
+        children = []
+        populated = False
+        for i in range(8):
+            oct_min, oct_max = octant_aabb(box_min, box_max, i)
+            oct_refs = [ref for ref in mesh_refs if aabb_overlap(oct_min, oct_max, ref[2], ref[3])]
+            child = None
+            if len(oct_refs):
+                if level + 1 >= self.levels:
+                    child = ('LEAF', oct_refs)
+                else:
+                    sub_children = self._subdivide(oct_min, oct_max, oct_refs, level + 1)
+                    if sub_children:
+                        child = ('NODE', sub_children)
+            if child:
+                populated = True
+            children.append(child)
+
+        if not populated:
+            return None
+        return children
+
+
+    # Generate octree buffer from mesh references gathered by
+    # `generate_collection_buffer` [(collection idx, mesh idx, min, max)]
+    def generate_octree_buffer(self, endian_char):
+        box_min = self.pmdl.bound_box_min
+        box_max = self.pmdl.bound_box_max
+
+        # Clamp mesh AABBs to master AABB so every mesh lands in a leaf
+        mesh_refs = []
+        for ref in self.pmdl.mesh_refs:
+            ref_min = [min(max(ref[2][i], box_min[i]), box_max[i]) for i in range(3)]
+            ref_max = [min(max(ref[3][i], box_min[i]), box_max[i]) for i in range(3)]
+            mesh_refs.append((ref[0], ref[1], ref_min, ref_max))
+
+        root = self._subdivide(box_min, box_max, mesh_refs, 0)
+        if not root:
+            root = [None] * 8
+
+        # Breadth-first node order (most-significant hierarchy first)
+        nodes = [root]
+        leaves = []
+        cur = 0
+        while cur < len(nodes):
+            for child in nodes[cur]:
+                if child and child[0] == 'NODE':
+                    nodes.append(child[1])
+                elif child and child[0] == 'LEAF':
+                    leaves.append(child[1])
+            cur += 1
+
+        # Node and leaf offsets
+        node_offsets = []
+        offset = 0
+        for node in nodes:
+            node_offsets.append(offset)
+            offset += 4 + 4 * len([child for child in node if child])
+        leaf_offsets = []
+        for leaf in leaves:
+            leaf_offsets.append(offset)
+            offset += 4 + 8 * len(leaf)
+
+        # Write nodes
+        octree_buffer = bytearray()
+        node_idx = 1
+        leaf_idx = 0
+        for node in nodes:
+            child_types = 0
+            child_offsets = bytearray()
+            for i in range(8):
+                child = node[i]
+                if not child:
+                    continue
+                if child[0] == 'NODE':
+                    child_types |= OCTREE_NODE << (i * 2)
+                    child_offsets += struct.pack(endian_char + 'I', node_offsets[node_idx])
+                    node_idx += 1
+                else:
+                    child_types |= OCTREE_LEAF << (i * 2)
+                    child_offsets += struct.pack(endian_char + 'I', leaf_offsets[leaf_idx])
+                    leaf_idx += 1
+            octree_buffer += struct.pack(endian_char + 'HH', child_types, 0)
+            octree_buffer += child_offsets
+
+        # Write leaves
+        for leaf in leaves:
+            octree_buffer += struct.pack(endian_char + 'I', len(leaf))
+            for ref in leaf:
+                octree_buffer += struct.pack(endian_char + 'II', ref[0], ref[1])
+
+        return octree_buffer
+
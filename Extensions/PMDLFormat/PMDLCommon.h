@@ -9,6 +9,8 @@
 #ifndef PSPL_PMDLCommon_h
 #define PSPL_PMDLCommon_h
 
+#include <string.h>
+
 #ifndef PSPL_PMDLRuntime_h
 
 /* Pointer decl */
@@ -50,9 +52,134 @@ typedef struct __attribute__ ((__packed__)) {
     uint32_t shader_table_offset;
     uint32_t bone_table_offset;
     
-    uint32_t padding;
+    uint32_t reloc_table_offset;
     
 } pmdl_header;
 #pragma pack()
 
+/* The header is fixed at 64 bytes; sections added since are linked
+ * from after the relocation table (see `pmdl_section_offset`) */
+typedef char pmdl_header_size_check[(sizeof(pmdl_header) == 64) ? 1 : -1];
+
+/* PMDL Shader-Pointer Relocation; the table (at `reloc_table_offset`; 0 if
+ * absent) is a 32-bit count followed by these entries */
+typedef struct {
+    uint32_t offset;
+    int32_t shader_index;
+} pmdl_reloc_entry;
+
+/* PMDL Section Link; optional sections are linked by a run of these directly
+ * after the relocation table's entries. The run ends at end of file or at
+ * the first tag not opening with '_' (such as the `0xff` padding of files
+ * predating links) */
+typedef struct {
+    char tag[4];
+    uint32_t offset;
+} pmdl_section_link;
+
+/* Lookup section link by tag (NULL if absent) */
+static inline pmdl_section_link* pmdl_section_link_lookup(void* file_data, size_t file_len, const char* tag) {
+    pmdl_header* header = file_data;
+    if (!header->reloc_table_offset || header->reloc_table_offset + sizeof(uint32_t) > file_len)
+        return NULL;
+    size_t link_off = header->reloc_table_offset + sizeof(uint32_t) +
+                      sizeof(pmdl_reloc_entry) * (size_t)*(uint32_t*)(file_data + header->reloc_table_offset);
+    for (; link_off + sizeof(pmdl_section_link) <= file_len ; link_off += sizeof(pmdl_section_link)) {
+        pmdl_section_link* link = file_data + link_off;
+        if (link->tag[0] != '_')
+            break;
+        if (!memcmp(link->tag, tag, 4))
+            return link;
+    }
+    return NULL;
+}
+
+/* Absolute offset of section by tag (0 if absent) */
+static inline uint32_t pmdl_section_offset(const void* file_data, size_t file_len, const char* tag) {
+    const pmdl_section_link* link = pmdl_section_link_lookup((void*)file_data, file_len, tag);
+    return (link) ? link->offset : 0;
+}
+
+/* PMDL Level of Detail; the table (linked as section `_LOD`) is a 32-bit
+ * count followed by these entries in order of increasing error (the
+ * largest vertex displacement, relative to the master-AABB diagonal). Each
+ * level's run table holds `collection_count` absolute offsets of mesh
+ * primitive runs laid out as in the collection's drawing index; their
+ * elements index the full-detail vertex buffer */
+typedef struct {
+    float error;
+    uint32_t run_table_offset;
+} pmdl_lod_level;
+
+/* PMDL Collection Header */
+#pragma pack(1)
+typedef struct __attribute__ ((__packed__)) {
+    
+    uint16_t uv_count;
+    uint16_t bone_count;
+    uint32_t vert_buf_off;
+    uint32_t vert_buf_len;
+    uint32_t elem_buf_off;
+    uint32_t elem_buf_len;
+    uint32_t draw_idx_off;
+    
+} pmdl_col_header;
+#pragma pack()
+
+/* `_COL` bounding-volume hierarchy node; the collection's drawing index (if
+ * present) is a 32-bit node count and a padding word followed by these in
+ * depth-first order. Leaves (non-zero `count`, at most 4) hold triangles
+ * `first` onwards of the leaf-ordered element buffer; inner nodes have their
+ * two children at `first` and `first`+1 */
+typedef struct pmdl_bvh_node {
+    float aabb[2][3];
+    uint32_t first;
+    uint32_t count;
+} pmdl_bvh_node;
+
+/* General collections with this `uv_count` bit set hold quantised vertices:
+ * 16-bit positions within the collection bounds, octahedral 16-bit normals,
+ * half-float UVs and 8-bit weights; the vertex buffer opens with the
+ * dequantisation terms below */
+#define PMDL_COL_QUANTISED 0x8000
+#define PMDL_COL_UV_COUNT(col) ((col)->uv_count & ~PMDL_COL_QUANTISED)
+
+/* Quantised vertex buffer head; positions decode as `pos * scale + bias`.
+ * `scale[3]` is 1 to flag octahedral normals to the vertex shader */
+typedef struct {
+    float scale[4];
+    float bias[4];
+} pmdl_quant_head;
+
+/* General vertex stride and offset of first vertex within vertex buffer */
+static inline unsigned pmdl_general_vert_stride(const pmdl_col_header* col) {
+    if (col->uv_count & PMDL_COL_QUANTISED)
+        return ROUND_UP_4(12 + PMDL_COL_UV_COUNT(col)*4 + col->bone_count);
+    return 24 + col->uv_count*8 + col->bone_count*4;
+}
+static inline unsigned pmdl_general_vert_base(const pmdl_col_header* col) {
+    return (col->uv_count & PMDL_COL_QUANTISED) ? sizeof(pmdl_quant_head) : 0;
+}
+
+/* General draw-format primitive types */
+enum pmdl_prim_type {
+    PMDL_POINTS          = 0,
+    PMDL_TRIANGLES       = 1,
+    PMDL_TRIANGLE_FANS   = 2,
+    PMDL_TRIANGLE_STRIPS = 3,
+    PMDL_LINES           = 4,
+    PMDL_LINE_STRIPS     = 5
+};
+
+/* PMDL General Primitive */
+typedef struct {
+    uint32_t prim_type;
+    uint32_t prim_start_idx;
+    uint32_t prim_count;
+} pmdl_general_prim;
+typedef struct {
+    uint32_t skin_idx;
+    pmdl_general_prim prim;
+} pmdl_general_prim_par1;
+
 #endif
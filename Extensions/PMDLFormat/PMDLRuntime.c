@@ -24,6 +24,16 @@ struct file_array {
 /* My own extension */
 extern const pspl_extension_t PMDL_extension;
 
+/* Load-time fix-up job (one per PMDL) */
+struct fixup_job {
+    pspl_job_t job;
+    pmdl_t* pmdl;
+    int result;
+};
+static void fixup_job_func(struct fixup_job* job) {
+    job->result = pmdl_init_fixup(job->pmdl);
+}
+
 static uint8_t hash_cached = 0;
 static pspl_hash pmdl_ref_key_hash_cache;
 static void load_object_hook(pspl_runtime_psplc_t* object) {
@@ -39,14 +49,33 @@ static void load_object_hook(pspl_runtime_psplc_t* object) {
     // Array to populate
     struct file_array* files = pmdl_ref_data.object_data;
     
-    // Initialise PMDLs
+    // Fetch PMDLs
     int i;
-    for (i=0 ; i<files->count.native.integer ; ++i) {
-        char hash[PSPL_HASH_STRING_LEN];
-        pspl_hash_fmt(hash, &files->files[i].pmdl_file_hash);
+    unsigned count = files->count.native.integer;
+    for (i=0 ; i<count ; ++i)
         files->files[i].pmdl.file_ptr = (pspl_runtime_arc_file_t*)
         pspl_runtime_get_archived_file_from_hash(object->parent, &files->files[i].pmdl_file_hash, 1);
-        pmdl_init(&files->files[i].pmdl);
+    
+    // Fix-up PMDLs across animation workers, then load into GPU here
+    if (count) {
+        struct fixup_job* jobs = malloc(sizeof(struct fixup_job)*count);
+        pspl_fence_t fence = 0;
+        for (i=0 ; i<count ; ++i) {
+            struct fixup_job* job = &jobs[i];
+            job->job.func = (void(*)(void*))fixup_job_func;
+            job->job.usr_ptr = job;
+            job->job.priority = PSPL_JOB_PRIORITY_NORMAL;
+            job->job.fence = &fence;
+            job->pmdl = &files->files[i].pmdl;
+            job->result = -1;
+            pmdl_animation_pool_submit(&job->job);
+        }
+        pspl_fence_wait(&fence);
+        
+        for (i=0 ; i<count ; ++i)
+            if (!jobs[i].result)
+                pmdl_init_upload(jobs[i].pmdl);
+        free(jobs);
     }
     
     // Set user data pointer appropriately
@@ -97,11 +126,16 @@ const pmdl_t* pmdl_lookup(const pspl_runtime_psplc_t* pspl_object, const char* p
 
 static int init_hook(const pspl_extension_t* extension) {
     pmdl_master_init();
-    return 0;
+    return pmdl_animation_pool_init();
+}
+
+static void shutdown_hook() {
+    pmdl_animation_pool_shutdown();
 }
 
 pspl_runtime_extension_t PMDL_runext = {
     .init_hook = init_hook,
+    .shutdown_hook = shutdown_hook,
     .load_object_hook = load_object_hook,
     .unload_object_hook = unload_object_hook
 };
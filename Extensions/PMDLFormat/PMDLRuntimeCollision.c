@@ -0,0 +1,1086 @@
+//
+//  PMDLRuntimeCollision.c
+//  PSPL
+//
+//  Collision BVH queries (rays, swept spheres and AABBs)
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#if __SSE__
+#   include <xmmintrin.h>
+#endif
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLCommon.h"
+
+/* Triangles per leaf (one SIMD test group) */
+#define BVH_LEAF_TRIS 4
+
+/* SAH bins per axis */
+#define BVH_BINS 16
+
+/* Below this depth splits follow the SAH; deeper ones split at the object
+ * median, halving 32-bit triangle counts to leaves within 30 more levels, so
+ * built trees always fit the traversal stacks (mapped ones are validated) */
+#define BVH_SAH_DEPTH 64
+#define BVH_STACK_DEPTH 96
+
+/* Determinant below which rays are considered parallel to triangles */
+#define RAY_TRI_EPSILON 1e-12f
+
+
+#pragma mark Hierarchy Construction
+
+/* Construction state */
+typedef struct {
+    float (*tri_bounds)[2][3];
+    float (*centroids)[3];
+    uint32_t* order;
+    pmdl_bvh_node* nodes;
+    unsigned node_count;
+} bvh_builder;
+
+/* SAH bin */
+typedef struct {
+    float bounds[2][3];
+    unsigned count;
+} bvh_bin;
+
+static inline void bounds_empty(float bounds[2][3]) {
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        bounds[0][i] = FLT_MAX;
+        bounds[1][i] = -FLT_MAX;
+    }
+}
+
+static inline void bounds_merge(float bounds[2][3], const float other[2][3]) {
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        if (other[0][i] < bounds[0][i])
+            bounds[0][i] = other[0][i];
+        if (other[1][i] > bounds[1][i])
+            bounds[1][i] = other[1][i];
+    }
+}
+
+/* Half surface area (SAH weight) */
+static inline float bounds_area(const float bounds[2][3]) {
+    float dx = bounds[1][0] - bounds[0][0];
+    float dy = bounds[1][1] - bounds[0][1];
+    float dz = bounds[1][2] - bounds[0][2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+        return 0.0f;
+    return dx*dy + dy*dz + dz*dx;
+}
+
+/* Leaf groups needed for `count` triangles */
+static inline float leaf_groups(unsigned count) {
+    return (float)((count + BVH_LEAF_TRIS - 1) / BVH_LEAF_TRIS);
+}
+
+/* Reorder `order[first..first+count)` so the `nth` smallest centroid along `axis` is in place */
+static void bvh_select(bvh_builder* b, unsigned first, unsigned count, unsigned nth, int axis) {
+    unsigned lo = first, hi = first + count - 1;
+    while (lo < hi) {
+        float pivot = b->centroids[b->order[(lo + hi) / 2]][axis];
+        unsigned i = lo, j = hi;
+        while (i <= j) {
+            while (b->centroids[b->order[i]][axis] < pivot)
+                ++i;
+            while (b->centroids[b->order[j]][axis] > pivot)
+                --j;
+            if (i <= j) {
+                uint32_t tmp = b->order[i];
+                b->order[i] = b->order[j];
+                b->order[j] = tmp;
+                ++i;
+                if (!j--)
+                    break;
+            }
+        }
+        if (nth <= j)
+            hi = j;
+        else if (nth >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+/* Build subtree over `order[first..first+count)` at `node_idx`; children are
+ * allocated as adjacent pairs, so inner nodes need only the left index */
+static void bvh_build_node(bvh_builder* b, unsigned node_idx, unsigned first, unsigned count, unsigned depth) {
+    unsigned i;
+    int axis;
+
+    // Triangle and centroid bounds
+    float bounds[2][3], cbounds[2][3];
+    bounds_empty(bounds);
+    bounds_empty(cbounds);
+    for (i=first ; i<first+count ; ++i) {
+        bounds_merge(bounds, b->tri_bounds[b->order[i]]);
+        const float* c = b->centroids[b->order[i]];
+        float cb[2][3] = {{c[0], c[1], c[2]}, {c[0], c[1], c[2]}};
+        bounds_merge(cbounds, cb);
+    }
+    pmdl_bvh_node* node = &b->nodes[node_idx];
+    memcpy(node->aabb, bounds, sizeof(bounds));
+
+    if (count <= BVH_LEAF_TRIS) {
+        node->first = first;
+        node->count = count;
+        return;
+    }
+
+    // Binned SAH split
+    unsigned mid = first;
+    int best_axis = -1;
+    unsigned best_bin = 0;
+    float best_cost = FLT_MAX;
+    if (depth < BVH_SAH_DEPTH) {
+        for (axis=0 ; axis<3 ; ++axis) {
+            float extent = cbounds[1][axis] - cbounds[0][axis];
+            if (!(extent > 0.0f))
+                continue;
+            float bin_scale = BVH_BINS / extent;
+            bvh_bin bins[BVH_BINS];
+            for (i=0 ; i<BVH_BINS ; ++i) {
+                bounds_empty(bins[i].bounds);
+                bins[i].count = 0;
+            }
+            for (i=first ; i<first+count ; ++i) {
+                int bin = (int)((b->centroids[b->order[i]][axis] - cbounds[0][axis]) * bin_scale);
+                bin = (bin >= BVH_BINS) ? BVH_BINS-1 : bin;
+                bounds_merge(bins[bin].bounds, b->tri_bounds[b->order[i]]);
+                ++bins[bin].count;
+            }
+
+            // Sweep from the right, then evaluate left partitions
+            float right_area[BVH_BINS];
+            unsigned right_count[BVH_BINS];
+            float acc[2][3];
+            bounds_empty(acc);
+            unsigned acc_count = 0;
+            for (i=BVH_BINS-1 ; i>0 ; --i) {
+                bounds_merge(acc, bins[i].bounds);
+                acc_count += bins[i].count;
+                right_area[i] = bounds_area(acc);
+                right_count[i] = acc_count;
+            }
+            bounds_empty(acc);
+            acc_count = 0;
+            for (i=0 ; i<BVH_BINS-1 ; ++i) {
+                bounds_merge(acc, bins[i].bounds);
+                acc_count += bins[i].count;
+                if (!acc_count || !right_count[i+1])
+                    continue;
+                float cost = bounds_area(acc) * leaf_groups(acc_count) +
+                             right_area[i+1] * leaf_groups(right_count[i+1]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = i;
+                }
+            }
+        }
+    }
+
+    if (best_axis >= 0) {
+        float bin_scale = BVH_BINS / (cbounds[1][best_axis] - cbounds[0][best_axis]);
+        unsigned j = first + count;
+        mid = first;
+        while (mid < j) {
+            int bin = (int)((b->centroids[b->order[mid]][best_axis] - cbounds[0][best_axis]) * bin_scale);
+            bin = (bin >= BVH_BINS) ? BVH_BINS-1 : bin;
+            if (bin <= best_bin)
+                ++mid;
+            else {
+                uint32_t tmp = b->order[mid];
+                b->order[mid] = b->order[--j];
+                b->order[j] = tmp;
+            }
+        }
+    } else {
+        // Object median along widest centroid axis (coincident centroids split by count)
+        int wide_axis = 0;
+        for (axis=1 ; axis<3 ; ++axis)
+            if (cbounds[1][axis] - cbounds[0][axis] > cbounds[1][wide_axis] - cbounds[0][wide_axis])
+                wide_axis = axis;
+        mid = first + count / 2;
+        bvh_select(b, first, count, mid, wide_axis);
+    }
+    if (mid == first || mid == first + count)
+        mid = first + count / 2;
+
+    unsigned left = b->node_count;
+    b->node_count += 2;
+    node->first = left;
+    node->count = 0;
+    bvh_build_node(b, left, first, mid - first, depth + 1);
+    bvh_build_node(b, left + 1, mid, first + count - mid, depth + 1);
+}
+
+/* Precompute SoA triangle terms (first vertex and two edges) for SIMD tests;
+ * arrays are padded by a group so loads of partial leaves stay in bounds */
+static void collision_prepare_tris(pmdl_collision* col) {
+    unsigned i,j;
+    unsigned stride = col->tri_count + BVH_LEAF_TRIS;
+    col->tri_soa = pspl_allocate_media_block(sizeof(float)*9*stride);
+    memset(col->tri_soa, 0, sizeof(float)*9*stride);
+    for (i=0 ; i<col->tri_count ; ++i) {
+        const float* v0 = &col->position_arr[col->index_arr[i*3]*3];
+        const float* v1 = &col->position_arr[col->index_arr[i*3+1]*3];
+        const float* v2 = &col->position_arr[col->index_arr[i*3+2]*3];
+        for (j=0 ; j<3 ; ++j) {
+            col->tri_soa[stride*j + i] = v0[j];
+            col->tri_soa[stride*(3+j) + i] = v1[j] - v0[j];
+            col->tri_soa[stride*(6+j) + i] = v2[j] - v0[j];
+        }
+    }
+}
+
+/* Build hierarchy over `tri_count` triangles, reordering them into leaf order */
+static void collision_build(pmdl_collision* col, const float* positions, const uint32_t* indices) {
+    unsigned i,j,k;
+    unsigned tri_count = col->tri_count;
+
+    bvh_builder b;
+    b.tri_bounds = malloc(sizeof(float)*6*tri_count + 1);
+    b.centroids = malloc(sizeof(float)*3*tri_count + 1);
+    b.order = pspl_allocate_media_block(sizeof(uint32_t)*tri_count + 1);
+    b.nodes = pspl_allocate_media_block(sizeof(pmdl_bvh_node)*(tri_count*2 + 1));
+    b.node_count = 1;
+    for (i=0 ; i<tri_count ; ++i) {
+        bounds_empty(b.tri_bounds[i]);
+        for (j=0 ; j<3 ; ++j) {
+            const float* v = &positions[indices[i*3+j]*3];
+            for (k=0 ; k<3 ; ++k) {
+                if (v[k] < b.tri_bounds[i][0][k])
+                    b.tri_bounds[i][0][k] = v[k];
+                if (v[k] > b.tri_bounds[i][1][k])
+                    b.tri_bounds[i][1][k] = v[k];
+            }
+        }
+        for (k=0 ; k<3 ; ++k)
+            b.centroids[i][k] = (b.tri_bounds[i][0][k] + b.tri_bounds[i][1][k]) * 0.5f;
+        b.order[i] = i;
+    }
+    bvh_build_node(&b, 0, 0, tri_count, 0);
+
+    // Triangles in leaf order
+    uint32_t* leaf_indices = pspl_allocate_media_block(sizeof(uint32_t)*3*tri_count + 1);
+    for (i=0 ; i<tri_count ; ++i)
+        for (j=0 ; j<3 ; ++j)
+            leaf_indices[i*3+j] = indices[b.order[i]*3+j];
+
+    free(b.tri_bounds);
+    free(b.centroids);
+    col->node_arr = b.nodes;
+    col->node_count = b.node_count;
+    col->index_arr = leaf_indices;
+    col->tri_id_arr = b.order;
+    col->owned_nodes = b.nodes;
+    col->owned_indices = leaf_indices;
+}
+
+/* Check a mapped hierarchy before traversal trusts it: leaves must index
+ * triangles in range, inner nodes must place both children after themselves
+ * (ruling out cycles), and no path may outgrow the fixed traversal stacks.
+ * Inner nodes at depth `d` leave at most `d`+2 entries on a stack */
+static int bvh_validate(const pmdl_bvh_node* nodes, uint32_t node_count, unsigned tri_count) {
+    uint32_t i;
+    uint8_t* depth = calloc(node_count, 1);
+    for (i=0 ; i<node_count ; ++i) {
+        const pmdl_bvh_node* node = &nodes[i];
+        if (node->count) {
+            if (node->count > BVH_LEAF_TRIS || node->first + (size_t)node->count > tri_count)
+                break;
+            continue;
+        }
+        if (!tri_count)
+            continue;
+        if (node->first <= i || node->first + 1 >= node_count ||
+            depth[i] + 2 > BVH_STACK_DEPTH)
+            break;
+        uint8_t child_depth = depth[i] + 1;
+        if (depth[node->first] < child_depth)
+            depth[node->first] = child_depth;
+        if (depth[node->first+1] < child_depth)
+            depth[node->first+1] = child_depth;
+    }
+    free(depth);
+    if (i < node_count) {
+        pspl_warn("Unable to init collision", "`_COL` hierarchy node %u out of range or too deep; rebuilding", i);
+        return -1;
+    }
+    return 0;
+}
+
+
+#pragma mark Init / Destroy
+
+int pmdl_collision_init(pmdl_collision* col, const float* positions, unsigned vert_count,
+                        const uint32_t* indices, unsigned tri_count) {
+    unsigned i;
+    memset(col, 0, sizeof(pmdl_collision));
+    for (i=0 ; i<tri_count*3 ; ++i)
+        if (indices[i] >= vert_count) {
+            pspl_warn("Unable to init collision", "triangle %u indexes vertex %u of %u", i/3, indices[i], vert_count);
+            return -1;
+        }
+
+    float* position_copy = pspl_allocate_media_block(sizeof(float)*3*vert_count + 1);
+    memcpy(position_copy, positions, sizeof(float)*3*vert_count);
+    col->position_arr = position_copy;
+    col->owned_positions = position_copy;
+    col->tri_count = tri_count;
+    collision_build(col, position_copy, indices);
+    collision_prepare_tris(col);
+    return 0;
+}
+
+int pmdl_collision_init_file(pmdl_collision* col, const void* file_data, size_t file_len) {
+    memset(col, 0, sizeof(pmdl_collision));
+
+    // Validate header and single collection
+    const pmdl_header* header = file_data;
+#   if __LITTLE_ENDIAN__
+        const char* endian_str = "_LIT";
+#   elif __BIG_ENDIAN__
+        const char* endian_str = "_BIG";
+#   endif
+    if (file_len < sizeof(pmdl_header) || memcmp(header->magic, "PMDL", 4) ||
+        memcmp(header->endianness, endian_str, 4) || memcmp(header->draw_format, "_COL", 4) ||
+        header->collection_count != 1 ||
+        header->collection_offset + sizeof(pmdl_col_header) > file_len) {
+        pspl_warn("Unable to init collision", "buffer is not a native-endian `_COL` PMDL with one collection");
+        return -1;
+    }
+    const void* collection_buf = file_data + header->collection_offset;
+    const pmdl_col_header* col_header = collection_buf;
+    if (header->collection_offset + (size_t)col_header->vert_buf_off + col_header->vert_buf_len > file_len ||
+        header->collection_offset + (size_t)col_header->elem_buf_off + col_header->elem_buf_len > file_len) {
+        pspl_warn("Unable to init collision", "`_COL` buffers lie outside file");
+        return -1;
+    }
+
+    unsigned vert_count = col_header->vert_buf_len / (sizeof(float)*3);
+    unsigned tri_count = col_header->elem_buf_len / (sizeof(uint32_t)*3);
+    const uint32_t* indices = collection_buf + col_header->elem_buf_off;
+    unsigned i;
+    for (i=0 ; i<tri_count*3 ; ++i)
+        if (indices[i] >= vert_count) {
+            pspl_warn("Unable to init collision", "triangle %u indexes vertex %u of %u", i/3, indices[i], vert_count);
+            return -1;
+        }
+    col->position_arr = collection_buf + col_header->vert_buf_off;
+    col->tri_count = tri_count;
+
+    // Map prebuilt hierarchy (triangles already in leaf order), or build one
+    uint32_t node_count = 0;
+    const void* bvh = collection_buf + col_header->draw_idx_off;
+    if (col_header->draw_idx_off &&
+        header->collection_offset + (size_t)col_header->draw_idx_off + 8 <= file_len) {
+        node_count = *(uint32_t*)bvh;
+        if (header->collection_offset + (size_t)col_header->draw_idx_off + 8 +
+            sizeof(pmdl_bvh_node) * (size_t)node_count > file_len)
+            node_count = 0;
+    }
+    if (node_count && bvh_validate(bvh + 8, node_count, tri_count) < 0)
+        node_count = 0;
+    if (node_count) {
+        col->node_arr = bvh + 8;
+        col->node_count = node_count;
+        col->index_arr = indices;
+    } else
+        collision_build(col, col->position_arr, indices);
+
+    collision_prepare_tris(col);
+    return 0;
+}
+
+void pmdl_collision_destroy(pmdl_collision* col) {
+    if (col->owned_positions)
+        pspl_free_media_block(col->owned_positions);
+    if (col->owned_indices)
+        pspl_free_media_block(col->owned_indices);
+    if (col->owned_nodes)
+        pspl_free_media_block(col->owned_nodes);
+    if (col->tri_id_arr)
+        pspl_free_media_block(col->tri_id_arr);
+    if (col->tri_soa)
+        pspl_free_media_block(col->tri_soa);
+    memset(col, 0, sizeof(pmdl_collision));
+}
+
+
+#pragma mark Shared Query Routines
+
+/* Caller-facing index of leaf-ordered triangle */
+static inline uint32_t tri_id(const pmdl_collision* col, unsigned tri) {
+    return (col->tri_id_arr) ? col->tri_id_arr[tri] : tri;
+}
+
+/* Fill miss record */
+static inline void hit_clear(pmdl_collision_hit* hit) {
+    hit->t = FLT_MAX;
+    hit->triangle = PMDL_COLLISION_MISS;
+    hit->normal[0] = hit->normal[1] = hit->normal[2] = 0.0f;
+}
+
+/* Reciprocal direction for slab tests; axis-parallel components get a large
+ * finite value so rays lying in a slab plane yield 0 rather than NaN */
+static inline void ray_inv_dir(const float* dir, float* inv_out) {
+    int i;
+    for (i=0 ; i<3 ; ++i)
+        inv_out[i] = (fabsf(dir[i]) > 1e-30f) ? 1.0f / dir[i] : ((dir[i] < 0.0f) ? -1e30f : 1e30f);
+}
+
+/* Ray slab test against node AABB (grown by `pad`); returns entry distance
+ * or -1 if the ray misses within [0, t_max] */
+static inline float ray_node_entry(const pmdl_bvh_node* node, const float* origin,
+                                   const float* inv_dir, float pad, float t_max) {
+    float t_near = 0.0f, t_far = t_max;
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        float t0 = (node->aabb[0][i] - pad - origin[i]) * inv_dir[i];
+        float t1 = (node->aabb[1][i] + pad - origin[i]) * inv_dir[i];
+        t_near = fmaxf(t_near, fminf(t0, t1));
+        t_far = fminf(t_far, fmaxf(t0, t1));
+    }
+    return (t_near <= t_far) ? t_near : -1.0f;
+}
+
+/* Geometric normal of leaf-ordered triangle, facing against `dir` */
+static void tri_facing_normal(const pmdl_collision* col, unsigned tri, const float* dir, float* normal_out) {
+    unsigned stride = col->tri_count + BVH_LEAF_TRIS;
+    const float* soa = col->tri_soa;
+    float e1[3] = {soa[stride*3+tri], soa[stride*4+tri], soa[stride*5+tri]};
+    float e2[3] = {soa[stride*6+tri], soa[stride*7+tri], soa[stride*8+tri]};
+    float n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+    float len = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    float sign = (n[0]*dir[0] + n[1]*dir[1] + n[2]*dir[2] > 0.0f) ? -1.0f : 1.0f;
+    int i;
+    for (i=0 ; i<3 ; ++i)
+        normal_out[i] = (len > 0.0f) ? n[i] * sign / len : 0.0f;
+}
+
+/* Test ray against leaf's triangles (double-sided Moller-Trumbore); updates
+ * nearest `*t_best` / `*tri_best` */
+static void ray_test_leaf(const pmdl_collision* col, const pmdl_bvh_node* leaf,
+                          const float* origin, const float* dir, float* t_best, unsigned* tri_best) {
+    unsigned stride = col->tri_count + BVH_LEAF_TRIS;
+    const float* soa = col->tri_soa;
+    unsigned first = leaf->first;
+
+#   if __SSE__
+        // One ray against the leaf's (up to 4) triangles
+        __m128 v0x = _mm_loadu_ps(&soa[first]);
+        __m128 v0y = _mm_loadu_ps(&soa[stride+first]);
+        __m128 v0z = _mm_loadu_ps(&soa[stride*2+first]);
+        __m128 e1x = _mm_loadu_ps(&soa[stride*3+first]);
+        __m128 e1y = _mm_loadu_ps(&soa[stride*4+first]);
+        __m128 e1z = _mm_loadu_ps(&soa[stride*5+first]);
+        __m128 e2x = _mm_loadu_ps(&soa[stride*6+first]);
+        __m128 e2y = _mm_loadu_ps(&soa[stride*7+first]);
+        __m128 e2z = _mm_loadu_ps(&soa[stride*8+first]);
+        __m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        __m128 tx = _mm_sub_ps(_mm_set1_ps(origin[0]), v0x);
+        __m128 ty = _mm_sub_ps(_mm_set1_ps(origin[1]), v0y);
+        __m128 tz = _mm_sub_ps(_mm_set1_ps(origin[2]), v0z);
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 abs_det = _mm_max_ps(det, _mm_sub_ps(zero, det));
+        __m128 hit = _mm_and_ps(_mm_cmpgt_ps(abs_det, _mm_set1_ps(RAY_TRI_EPSILON)),
+                                _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(*t_best))));
+        int mask = _mm_movemask_ps(hit) & ((1 << leaf->count) - 1);
+        if (mask) {
+            float t_arr[4];
+            _mm_storeu_ps(t_arr, t);
+            unsigned i;
+            for (i=0 ; i<leaf->count ; ++i)
+                if ((mask & (1 << i)) && t_arr[i] < *t_best) {
+                    *t_best = t_arr[i];
+                    *tri_best = first + i;
+                }
+        }
+
+#   else
+        unsigned i;
+        for (i=first ; i<first+leaf->count ; ++i) {
+            float e1[3] = {soa[stride*3+i], soa[stride*4+i], soa[stride*5+i]};
+            float e2[3] = {soa[stride*6+i], soa[stride*7+i], soa[stride*8+i]};
+            float p[3] = {dir[1]*e2[2] - dir[2]*e2[1], dir[2]*e2[0] - dir[0]*e2[2], dir[0]*e2[1] - dir[1]*e2[0]};
+            float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+            if (fabsf(det) <= RAY_TRI_EPSILON)
+                continue;
+            float inv_det = 1.0f / det;
+            float tv[3] = {origin[0] - soa[i], origin[1] - soa[stride+i], origin[2] - soa[stride*2+i]};
+            float u = (tv[0]*p[0] + tv[1]*p[1] + tv[2]*p[2]) * inv_det;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            float q[3] = {tv[1]*e1[2] - tv[2]*e1[1], tv[2]*e1[0] - tv[0]*e1[2], tv[0]*e1[1] - tv[1]*e1[0]};
+            float v = (dir[0]*q[0] + dir[1]*q[1] + dir[2]*q[2]) * inv_det;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            float t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inv_det;
+            if (t >= 0.0f && t < *t_best) {
+                *t_best = t;
+                *tri_best = i;
+            }
+        }
+#   endif
+
+}
+
+
+#pragma mark Ray Casting
+
+/* Nearest hit of one ray (front-to-back traversal) */
+static int raycast_single(const pmdl_collision* col, const pmdl_ray* ray, pmdl_collision_hit* hit) {
+    hit_clear(hit);
+    if (!col->tri_count)
+        return 0;
+
+    float inv_dir[3];
+    ray_inv_dir(ray->dir, inv_dir);
+    float t_best = ray->t_max;
+    unsigned tri_best = PMDL_COLLISION_MISS;
+
+    unsigned stack[BVH_STACK_DEPTH];
+    unsigned sp = 0;
+    if (ray_node_entry(&col->node_arr[0], ray->origin, inv_dir, 0.0f, t_best) >= 0.0f)
+        stack[sp++] = 0;
+    while (sp) {
+        const pmdl_bvh_node* node = &col->node_arr[stack[--sp]];
+        if (node->count) {
+            ray_test_leaf(col, node, ray->origin, ray->dir, &t_best, &tri_best);
+            continue;
+        }
+        float t_left = ray_node_entry(&col->node_arr[node->first], ray->origin, inv_dir, 0.0f, t_best);
+        float t_right = ray_node_entry(&col->node_arr[node->first+1], ray->origin, inv_dir, 0.0f, t_best);
+        // Nearer child is popped first
+        if (t_left >= 0.0f && t_right >= 0.0f) {
+            stack[sp++] = (t_left <= t_right) ? node->first+1 : node->first;
+            stack[sp++] = (t_left <= t_right) ? node->first : node->first+1;
+        } else if (t_left >= 0.0f)
+            stack[sp++] = node->first;
+        else if (t_right >= 0.0f)
+            stack[sp++] = node->first+1;
+    }
+
+    if (tri_best == PMDL_COLLISION_MISS)
+        return 0;
+    hit->t = t_best;
+    hit->triangle = tri_id(col, tri_best);
+    tri_facing_normal(col, tri_best, ray->dir, hit->normal);
+    return 1;
+}
+
+unsigned pmdl_collision_raycast_batch(const pmdl_collision* col, const pmdl_ray* rays,
+                                      unsigned count, pmdl_collision_hit* hits) {
+    unsigned i, hit_count = 0;
+    for (i=0 ; i<count ; ++i)
+        hit_count += raycast_single(col, &rays[i], &hits[i]);
+    return hit_count;
+}
+
+#if __SSE__
+/* Traverse 4 rays as one packet; nodes are visited while any active ray
+ * reaches them, and leaf triangles are tested against all 4 rays at once */
+static unsigned raycast_packet(const pmdl_collision* col, const pmdl_ray* rays, unsigned count,
+                               pmdl_collision_hit* hits) {
+    unsigned i,j;
+    unsigned stride = col->tri_count + BVH_LEAF_TRIS;
+    const float* soa = col->tri_soa;
+
+    // SoA packet (unused lanes repeat the first ray and are masked off)
+    float o_arr[3][4], d_arr[3][4], inv_arr[3][4], tm[4];
+    for (i=0 ; i<4 ; ++i) {
+        const pmdl_ray* ray = &rays[(i < count) ? i : 0];
+        float inv_dir[3];
+        ray_inv_dir(ray->dir, inv_dir);
+        for (j=0 ; j<3 ; ++j) {
+            o_arr[j][i] = ray->origin[j];
+            d_arr[j][i] = ray->dir[j];
+            inv_arr[j][i] = inv_dir[j];
+        }
+        tm[i] = (i < count) ? ray->t_max : -1.0f;
+    }
+    __m128 o[3] = {_mm_loadu_ps(o_arr[0]), _mm_loadu_ps(o_arr[1]), _mm_loadu_ps(o_arr[2])};
+    __m128 d[3] = {_mm_loadu_ps(d_arr[0]), _mm_loadu_ps(d_arr[1]), _mm_loadu_ps(d_arr[2])};
+    __m128 inv[3] = {_mm_loadu_ps(inv_arr[0]), _mm_loadu_ps(inv_arr[1]), _mm_loadu_ps(inv_arr[2])};
+    __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    __m128 t_best = _mm_loadu_ps(tm);
+    unsigned tri_best[4] = {PMDL_COLLISION_MISS, PMDL_COLLISION_MISS, PMDL_COLLISION_MISS, PMDL_COLLISION_MISS};
+
+    unsigned stack[BVH_STACK_DEPTH];
+    unsigned sp = 0;
+    if (col->tri_count)
+        stack[sp++] = 0;
+    while (sp) {
+        const pmdl_bvh_node* node = &col->node_arr[stack[--sp]];
+
+        // Packet slab test
+        __m128 t_near = zero, t_far = t_best;
+        for (j=0 ; j<3 ; ++j) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->aabb[0][j]), o[j]), inv[j]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->aabb[1][j]), o[j]), inv[j]);
+            t_near = _mm_max_ps(t_near, _mm_min_ps(t0, t1));
+            t_far = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+        }
+        if (!_mm_movemask_ps(_mm_cmple_ps(t_near, t_far)))
+            continue;
+
+        if (!node->count) {
+            stack[sp++] = node->first+1;
+            stack[sp++] = node->first;
+            continue;
+        }
+
+        // Each leaf triangle against the packet
+        for (i=node->first ; i<node->first+node->count ; ++i) {
+            __m128 e1[3] = {_mm_set1_ps(soa[stride*3+i]), _mm_set1_ps(soa[stride*4+i]), _mm_set1_ps(soa[stride*5+i])};
+            __m128 e2[3] = {_mm_set1_ps(soa[stride*6+i]), _mm_set1_ps(soa[stride*7+i]), _mm_set1_ps(soa[stride*8+i])};
+            __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1]));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2]));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+            __m128 inv_det = _mm_div_ps(one, det);
+            __m128 tx = _mm_sub_ps(o[0], _mm_set1_ps(soa[i]));
+            __m128 ty = _mm_sub_ps(o[1], _mm_set1_ps(soa[stride+i]));
+            __m128 tz = _mm_sub_ps(o[2], _mm_set1_ps(soa[stride*2+i]));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1[2]), _mm_mul_ps(tz, e1[1]));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1[0]), _mm_mul_ps(tx, e1[2]));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1[1]), _mm_mul_ps(ty, e1[0]));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), inv_det);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz)), inv_det);
+
+            __m128 abs_det = _mm_max_ps(det, _mm_sub_ps(zero, det));
+            __m128 hit = _mm_and_ps(_mm_cmpgt_ps(abs_det, _mm_set1_ps(RAY_TRI_EPSILON)),
+                                    _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, t_best)));
+            int mask = _mm_movemask_ps(hit);
+            if (!mask)
+                continue;
+            t_best = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, t_best));
+            for (j=0 ; j<4 ; ++j)
+                if (mask & (1 << j))
+                    tri_best[j] = i;
+        }
+    }
+
+    float t_arr[4];
+    _mm_storeu_ps(t_arr, t_best);
+    unsigned hit_count = 0;
+    for (i=0 ; i<count ; ++i) {
+        hit_clear(&hits[i]);
+        if (tri_best[i] == PMDL_COLLISION_MISS)
+            continue;
+        hits[i].t = t_arr[i];
+        hits[i].triangle = tri_id(col, tri_best[i]);
+        tri_facing_normal(col, tri_best[i], rays[i].dir, hits[i].normal);
+        ++hit_count;
+    }
+    return hit_count;
+}
+#endif
+
+unsigned pmdl_collision_raycast_packets(const pmdl_collision* col, const pmdl_ray* rays,
+                                        unsigned count, pmdl_collision_hit* hits) {
+#   if __SSE__
+        unsigned i, hit_count = 0;
+        for (i=0 ; i<count ; i+=4)
+            hit_count += raycast_packet(col, &rays[i], (count - i < 4) ? count - i : 4, &hits[i]);
+        return hit_count;
+#   else
+        return pmdl_collision_raycast_batch(col, rays, count, hits);
+#   endif
+}
+
+
+#pragma mark Sphere Sweeps
+
+static inline float dot3(const float* a, const float* b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/* Closest point on triangle to `p` (Ericson, Real-Time Collision Detection 5.1.5) */
+static void closest_on_triangle(const float* p, const float* a, const float* b, const float* c, float* out) {
+    float ab[3], ac[3], ap[3], bp[3], cp[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        ab[i] = b[i] - a[i];
+        ac[i] = c[i] - a[i];
+        ap[i] = p[i] - a[i];
+        bp[i] = p[i] - b[i];
+        cp[i] = p[i] - c[i];
+    }
+    float d1 = dot3(ab, ap), d2 = dot3(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        memcpy(out, a, sizeof(float)*3);
+        return;
+    }
+    float d3 = dot3(ab, bp), d4 = dot3(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        memcpy(out, b, sizeof(float)*3);
+        return;
+    }
+    float vc = d1*d4 - d3*d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        float v = d1 / (d1 - d3);
+        for (i=0 ; i<3 ; ++i)
+            out[i] = a[i] + ab[i] * v;
+        return;
+    }
+    float d5 = dot3(ab, cp), d6 = dot3(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        memcpy(out, c, sizeof(float)*3);
+        return;
+    }
+    float vb = d5*d2 - d1*d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        float w = d2 / (d2 - d6);
+        for (i=0 ; i<3 ; ++i)
+            out[i] = a[i] + ac[i] * w;
+        return;
+    }
+    float va = d3*d6 - d5*d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        for (i=0 ; i<3 ; ++i)
+            out[i] = b[i] + (c[i] - b[i]) * w;
+        return;
+    }
+    float denom = 1.0f / (va + vb + vc);
+    float v = vb * denom, w = vc * denom;
+    for (i=0 ; i<3 ; ++i)
+        out[i] = a[i] + ab[i] * v + ac[i] * w;
+}
+
+/* Earliest `t` at which ray reaches within `radius` of point; 0 if never */
+static int ray_sphere(const float* origin, const float* dir, const float* centre, float radius, float* t_out) {
+    float m[3] = {origin[0] - centre[0], origin[1] - centre[1], origin[2] - centre[2]};
+    float a = dot3(dir, dir), b = dot3(m, dir), c = dot3(m, m) - radius*radius;
+    float disc = b*b - a*c;
+    if (!(a > 0.0f) || disc < 0.0f)
+        return 0;
+    *t_out = (-b - sqrtf(disc)) / a;
+    return 1;
+}
+
+/* Earliest `t` at which ray reaches within `radius` of segment interior; 0 if never */
+static int ray_capsule_side(const float* origin, const float* dir, const float* p, const float* q,
+                            float radius, float* t_out) {
+    float d[3] = {q[0] - p[0], q[1] - p[1], q[2] - p[2]};
+    float m[3] = {origin[0] - p[0], origin[1] - p[1], origin[2] - p[2]};
+    float md = dot3(m, d), nd = dot3(dir, d), dd = dot3(d, d);
+    float nn = dot3(dir, dir), mn = dot3(m, dir);
+    float a = dd*nn - nd*nd;
+    if (fabsf(a) <= RAY_TRI_EPSILON * dd * nn)
+        return 0;
+    float k = dot3(m, m) - radius*radius;
+    float c = dd*k - md*md;
+    float b = dd*mn - nd*md;
+    float disc = b*b - a*c;
+    if (disc < 0.0f)
+        return 0;
+    float t = (-b - sqrtf(disc)) / a;
+    float s = md + t*nd;
+    if (s < 0.0f || s > dd)
+        return 0;
+    *t_out = t;
+    return 1;
+}
+
+/* Earliest contact of swept sphere with leaf-ordered triangle within [0, t_best) */
+static int sweep_triangle(const pmdl_collision* col, unsigned tri, const pmdl_sphere_sweep* sweep,
+                          float* t_best) {
+    const float* a = &col->position_arr[col->index_arr[tri*3]*3];
+    const float* b = &col->position_arr[col->index_arr[tri*3+1]*3];
+    const float* c = &col->position_arr[col->index_arr[tri*3+2]*3];
+    const float* origin = sweep->origin;
+    const float* dir = sweep->dir;
+    float r = sweep->radius;
+
+    // Already touching
+    float closest[3];
+    closest_on_triangle(origin, a, b, c, closest);
+    float off[3] = {origin[0] - closest[0], origin[1] - closest[1], origin[2] - closest[2]};
+    if (dot3(off, off) <= r*r) {
+        *t_best = 0.0f;
+        return 1;
+    }
+
+    // Solve from the point of the path nearest the triangle; this keeps the
+    // terms below at triangle scale, where distant origins would lose grazing contacts
+    float dd = dot3(dir, dir);
+    if (!(dd > 0.0f))
+        return 0;
+    float ao[3] = {a[0] - origin[0], a[1] - origin[1], a[2] - origin[2]};
+    float t_base = dot3(ao, dir) / dd;
+    float base[3] = {origin[0] + dir[0]*t_base, origin[1] + dir[1]*t_base, origin[2] + dir[2]*t_base};
+    float t_hit = FLT_MAX;
+    int i;
+
+    // Face contact (sphere touches the plane inside the triangle)
+    float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    float n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+    float n_len = sqrtf(dot3(n, n));
+    if (n_len > 0.0f) {
+        for (i=0 ; i<3 ; ++i)
+            n[i] /= n_len;
+        // Side is that of the starting point
+        float ab[3] = {base[0] - a[0], base[1] - a[1], base[2] - a[2]};
+        float side = (dot3(n, ao) <= 0.0f) ? 1.0f : -1.0f;
+        float approach = -dot3(n, dir) * side;
+        if (approach > 0.0f) {
+            float t = (dot3(n, ab) * side - r) / approach;
+            float contact[3], proj[3];
+            for (i=0 ; i<3 ; ++i)
+                contact[i] = base[i] + dir[i]*t - n[i]*side*r;
+            closest_on_triangle(contact, a, b, c, proj);
+            float dev[3] = {contact[0] - proj[0], contact[1] - proj[1], contact[2] - proj[2]};
+            if (dot3(dev, dev) <= 1e-8f * (dot3(e1, e1) + dot3(e2, e2)) && t_base + t >= 0.0f)
+                t_hit = t_base + t;
+        }
+    }
+
+    // Edges and vertices
+    const float* verts[3] = {a, b, c};
+    for (i=0 ; i<3 ; ++i) {
+        float t;
+        if (ray_sphere(base, dir, verts[i], r, &t) && t_base + t >= 0.0f && t_base + t < t_hit)
+            t_hit = t_base + t;
+        if (ray_capsule_side(base, dir, verts[i], verts[(i+1)%3], r, &t) &&
+            t_base + t >= 0.0f && t_base + t < t_hit)
+            t_hit = t_base + t;
+    }
+
+    if (t_hit < *t_best) {
+        *t_best = t_hit;
+        return 1;
+    }
+    return 0;
+}
+
+/* Nearest contact of one swept sphere */
+static int sweep_single(const pmdl_collision* col, const pmdl_sphere_sweep* sweep, pmdl_collision_hit* hit) {
+    hit_clear(hit);
+    if (!col->tri_count)
+        return 0;
+
+    float inv_dir[3];
+    ray_inv_dir(sweep->dir, inv_dir);
+    float t_best = sweep->t_max;
+    unsigned tri_best = PMDL_COLLISION_MISS;
+
+    unsigned stack[BVH_STACK_DEPTH];
+    unsigned sp = 0;
+    if (ray_node_entry(&col->node_arr[0], sweep->origin, inv_dir, sweep->radius, t_best) >= 0.0f)
+        stack[sp++] = 0;
+    while (sp) {
+        const pmdl_bvh_node* node = &col->node_arr[stack[--sp]];
+        if (node->count) {
+            unsigned i;
+            for (i=node->first ; i<node->first+node->count ; ++i)
+                if (sweep_triangle(col, i, sweep, &t_best))
+                    tri_best = i;
+            // Nothing precedes contact at the start
+            if (tri_best != PMDL_COLLISION_MISS && t_best <= 0.0f)
+                break;
+            continue;
+        }
+        float t_left = ray_node_entry(&col->node_arr[node->first], sweep->origin, inv_dir, sweep->radius, t_best);
+        float t_right = ray_node_entry(&col->node_arr[node->first+1], sweep->origin, inv_dir, sweep->radius, t_best);
+        if (t_left >= 0.0f && t_right >= 0.0f) {
+            stack[sp++] = (t_left <= t_right) ? node->first+1 : node->first;
+            stack[sp++] = (t_left <= t_right) ? node->first : node->first+1;
+        } else if (t_left >= 0.0f)
+            stack[sp++] = node->first;
+        else if (t_right >= 0.0f)
+            stack[sp++] = node->first+1;
+    }
+
+    if (tri_best == PMDL_COLLISION_MISS)
+        return 0;
+
+    // Contact normal points from the touched feature to the sphere centre
+    const float* a = &col->position_arr[col->index_arr[tri_best*3]*3];
+    const float* b = &col->position_arr[col->index_arr[tri_best*3+1]*3];
+    const float* c = &col->position_arr[col->index_arr[tri_best*3+2]*3];
+    float centre[3], closest[3];
+    int i;
+    for (i=0 ; i<3 ; ++i)
+        centre[i] = sweep->origin[i] + sweep->dir[i] * t_best;
+    closest_on_triangle(centre, a, b, c, closest);
+    float n[3] = {centre[0] - closest[0], centre[1] - closest[1], centre[2] - closest[2]};
+    float len = sqrtf(dot3(n, n));
+    hit->t = t_best;
+    hit->triangle = tri_id(col, tri_best);
+    if (len > 0.0f)
+        for (i=0 ; i<3 ; ++i)
+            hit->normal[i] = n[i] / len;
+    else
+        tri_facing_normal(col, tri_best, sweep->dir, hit->normal);
+    return 1;
+}
+
+unsigned pmdl_collision_sweep_batch(const pmdl_collision* col, const pmdl_sphere_sweep* sweeps,
+                                    unsigned count, pmdl_collision_hit* hits) {
+    unsigned i, hit_count = 0;
+    for (i=0 ; i<count ; ++i)
+        hit_count += sweep_single(col, &sweeps[i], &hits[i]);
+    return hit_count;
+}
+
+
+#pragma mark AABB Overlap
+
+/* Separating-axis test of leaf-ordered triangle against box (Akenine-Moller) */
+static int triangle_box_overlap(const pmdl_collision* col, unsigned tri, const float* centre, const float* extent) {
+    float v[3][3];
+    int i,j;
+    for (i=0 ; i<3 ; ++i) {
+        const float* p = &col->position_arr[col->index_arr[tri*3+i]*3];
+        for (j=0 ; j<3 ; ++j)
+            v[i][j] = p[j] - centre[j];
+    }
+
+    // Box face normals
+    for (j=0 ; j<3 ; ++j) {
+        float lo = fminf(v[0][j], fminf(v[1][j], v[2][j]));
+        float hi = fmaxf(v[0][j], fmaxf(v[1][j], v[2][j]));
+        if (lo > extent[j] || hi < -extent[j])
+            return 0;
+    }
+
+    // Edge cross products
+    float e[3][3];
+    for (i=0 ; i<3 ; ++i)
+        for (j=0 ; j<3 ; ++j)
+            e[i][j] = v[(i+1)%3][j] - v[i][j];
+    for (i=0 ; i<3 ; ++i)
+        for (j=0 ; j<3 ; ++j) {
+            // Axis = box axis j x edge i
+            float axis[3] = {0.0f, 0.0f, 0.0f};
+            int j1 = (j+1)%3, j2 = (j+2)%3;
+            axis[j1] = -e[i][j2];
+            axis[j2] = e[i][j1];
+            float p0 = dot3(axis, v[0]), p1 = dot3(axis, v[1]), p2 = dot3(axis, v[2]);
+            float r = extent[0]*fabsf(axis[0]) + extent[1]*fabsf(axis[1]) + extent[2]*fabsf(axis[2]);
+            if (fminf(p0, fminf(p1, p2)) > r || fmaxf(p0, fmaxf(p1, p2)) < -r)
+                return 0;
+        }
+
+    // Triangle plane
+    float n[3] = {e[0][1]*e[1][2] - e[0][2]*e[1][1], e[0][2]*e[1][0] - e[0][0]*e[1][2], e[0][0]*e[1][1] - e[0][1]*e[1][0]};
+    float d = dot3(n, v[0]);
+    float r = extent[0]*fabsf(n[0]) + extent[1]*fabsf(n[1]) + extent[2]*fabsf(n[2]);
+    return fabsf(d) <= r;
+}
+
+/* Overlapping triangles of box; stops at the first if `tri_out` is NULL */
+static unsigned aabb_query(const pmdl_collision* col, const float* centre, const float* extent,
+                           uint32_t* tri_out, unsigned tri_cap) {
+    if (!col->tri_count)
+        return 0;
+    unsigned found = 0;
+    unsigned stack[BVH_STACK_DEPTH];
+    unsigned sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        const pmdl_bvh_node* node = &col->node_arr[stack[--sp]];
+
+#       if __SSE__
+            // Box against node bounds (3 axes at once; 4th lane always passes)
+            __m128 nmin = _mm_set_ps(0.0f, node->aabb[0][2], node->aabb[0][1], node->aabb[0][0]);
+            __m128 nmax = _mm_set_ps(0.0f, node->aabb[1][2], node->aabb[1][1], node->aabb[1][0]);
+            __m128 c = _mm_set_ps(0.0f, centre[2], centre[1], centre[0]);
+            __m128 ex = _mm_set_ps(0.0f, extent[2], extent[1], extent[0]);
+            __m128 sep = _mm_or_ps(_mm_cmpgt_ps(_mm_sub_ps(c, ex), nmax), _mm_cmplt_ps(_mm_add_ps(c, ex), nmin));
+            if (_mm_movemask_ps(sep))
+                continue;
+#       else
+            int j, separate = 0;
+            for (j=0 ; j<3 ; ++j)
+                if (centre[j] - extent[j] > node->aabb[1][j] || centre[j] + extent[j] < node->aabb[0][j])
+                    separate = 1;
+            if (separate)
+                continue;
+#       endif
+
+        if (!node->count) {
+            stack[sp++] = node->first+1;
+            stack[sp++] = node->first;
+            continue;
+        }
+        unsigned i;
+        for (i=node->first ; i<node->first+node->count ; ++i) {
+            if (!triangle_box_overlap(col, i, centre, extent))
+                continue;
+            if (!tri_out)
+                return 1;
+            if (found < tri_cap)
+                tri_out[found] = tri_id(col, i);
+            ++found;
+        }
+    }
+    return found;
+}
+
+unsigned pmdl_collision_aabb_query(const pmdl_collision* col, const float aabb[2][3],
+                                   uint32_t* tri_out, unsigned tri_cap) {
+    float centre[3], extent[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        centre[i] = (aabb[0][i] + aabb[1][i]) * 0.5f;
+        extent[i] = (aabb[1][i] - aabb[0][i]) * 0.5f;
+    }
+    return aabb_query(col, centre, extent, tri_out, tri_cap);
+}
+
+unsigned pmdl_collision_aabb_test_batch(const pmdl_collision* col, const pmdl_aabb_soa_t* aabbs,
+                                        uint32_t* hit_bits) {
+    unsigned i,j;
+    unsigned hit_count = 0;
+    memset(hit_bits, 0, sizeof(uint32_t)*((aabbs->count+31)/32));
+    for (i=0 ; i<aabbs->count ; ++i) {
+        float centre[3], extent[3];
+        for (j=0 ; j<3 ; ++j) {
+            centre[j] = aabbs->centre[j][i];
+            extent[j] = aabbs->extent[j][i];
+        }
+        if (aabb_query(col, centre, extent, NULL, 0)) {
+            hit_bits[i/32] |= 1u << (i%32);
+            ++hit_count;
+        }
+    }
+    return hit_count;
+}
+
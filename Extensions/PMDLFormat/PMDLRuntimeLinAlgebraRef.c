@@ -7,7 +7,8 @@
 //
 
 /* This is a pure C reference implementation of the 
- * PMDL runtime linear algebra routines */
+ * PMDL runtime linear algebra routines; those with SSE versions
+ * (PMDLRuntimeLinAlgebraSSE.c) are only built for other targets */
 
 #include <PMDLRuntime.h>
 
@@ -100,6 +101,7 @@ void pspl_matrix44_cpy(pspl_matrix44_t src, pspl_matrix44_t dst) {
 }
  */
 
+#if !__SSE__
 void pmdl_matrix34_mul(pspl_matrix34_t* a, pspl_matrix34_t* b, pspl_matrix34_t* ab) {
     pspl_matrix34_t tmp;
 	pspl_matrix34_t* m;
@@ -155,7 +157,7 @@ void pmdl_matrix44_mul(pspl_matrix44_t* a, pspl_matrix44_t* b, pspl_matrix44_t*
     m->m[3][0] = a->m[3][0]*b->m[0][0] + a->m[3][1]*b->m[1][0] + a->m[3][2]*b->m[2][0] + a->m[3][3]*b->m[3][0];
     m->m[3][1] = a->m[3][0]*b->m[0][1] + a->m[3][1]*b->m[1][1] + a->m[3][2]*b->m[2][1] + a->m[3][3]*b->m[3][1];
     m->m[3][2] = a->m[3][0]*b->m[0][2] + a->m[3][1]*b->m[1][2] + a->m[3][2]*b->m[2][2] + a->m[3][3]*b->m[3][2];
-    m->m[3][3] = a->m[3][0]*b->m[0][3] + a->m[3][1]*b->m[1][3] + a->m[3][2]*b->m[2][2] + a->m[3][3]*b->m[3][3];
+    m->m[3][3] = a->m[3][0]*b->m[0][3] + a->m[3][1]*b->m[1][3] + a->m[3][2]*b->m[2][3] + a->m[3][3]*b->m[3][3];
     
     
 	if(m==&tmp) {
@@ -246,6 +248,8 @@ void pmdl_matrix34_invxpose(pspl_matrix34_t* src, pspl_matrix34_t* xPose) {
     
 }
 
+#endif
+
 /* Reference C implementations from libogc */
 float pmdl_vector3_dot(pspl_vector3_t* a, pspl_vector3_t* b) {
     pspl_vector3_t tmp;
@@ -310,6 +314,7 @@ void pmdl_vector4_sub(pspl_vector4_t a, pspl_vector4_t b, pspl_vector4_t ab) {
 }
  */
 
+#if !__SSE__
 void pmdl_vector3_matrix_mul(const pspl_matrix34_t* mt, const pspl_vector3_t* src, pspl_vector3_t* dst) {
     pspl_vector3_t tmp;
 	
@@ -320,6 +325,7 @@ void pmdl_vector3_matrix_mul(const pspl_matrix34_t* mt, const pspl_vector3_t* sr
     dst->v = tmp.v;
 
 }
+#endif
 
 void _pmdl_matrix_lookat(pspl_matrix34_t* mt, pspl_vector3_t* pos, pspl_vector3_t* up, pspl_vector3_t* look) {
     pspl_vector3_t vLook,vRight,vUp;
@@ -369,6 +375,7 @@ float pmdl_vector4_dot(pspl_vector4_t* a, pspl_vector4_t* b) {
 	return tmp.v[0] + tmp.v[1] + tmp.v[2] + tmp.v[3];
 }
 
+#if !__SSE__
 void pmdl_matrix34_quat(pspl_matrix34_t* m, pspl_vector4_t* a) {
     
     // Normalise vector
@@ -444,3 +451,21 @@ void pmdl_quat_mul(pspl_vector4_t* a, pspl_vector4_t* b, pspl_vector4_t* ab) {
         ab->f[3] = ab_tmp.f[3];
     }
 }
+
+void pmdl_matrix34_mul_batch(const pspl_matrix34_t* a_arr, const pspl_matrix34_t* b,
+                             pspl_matrix34_t* ab_arr, unsigned count) {
+    unsigned i;
+    for (i=0 ; i<count ; ++i)
+        pmdl_matrix34_mul((pspl_matrix34_t*)&a_arr[i], (pspl_matrix34_t*)b, &ab_arr[i]);
+}
+
+void pmdl_vector3_matrix_mul_batch(const pspl_matrix34_t* mt, const float* src, float* dst, unsigned count) {
+    unsigned i;
+    for (i=0 ; i<count ; ++i) {
+        float x = src[i*3], y = src[i*3+1], z = src[i*3+2];
+        dst[i*3] = mt->m[0][0]*x + mt->m[0][1]*y + mt->m[0][2]*z + mt->m[0][3];
+        dst[i*3+1] = mt->m[1][0]*x + mt->m[1][1]*y + mt->m[1][2]*z + mt->m[1][3];
+        dst[i*3+2] = mt->m[2][0]*x + mt->m[2][1]*y + mt->m[2][2]*z + mt->m[2][3];
+    }
+}
+#endif
@@ -0,0 +1,265 @@
+//
+//  PMDLRuntimeLinAlgebraSSE.c
+//  PSPL
+//
+//  x86-SSE vector and matrix operations
+//
+//
+
+/* x86-SSE implementations of PMDL vector and matrix operations;
+ * each accumulates in the same order as the reference C, so results
+ * match it bit-for-bit */
+
+#include <PMDLRuntime.h>
+
+#if !HW_RVL && __SSE__
+#include <xmmintrin.h>
+
+/* Lane masks */
+typedef union {
+    uint32_t u[4];
+    __m128 v;
+} sse_mask_t;
+static const sse_mask_t XYZ_MASK = {{0xffffffff, 0xffffffff, 0xffffffff, 0}};
+static const sse_mask_t W_MASK = {{0, 0, 0, 0xffffffff}};
+
+/* -0.0 leaves any addend (including -0.0) unchanged */
+static const sse_mask_t XYZ_NEG_ZERO = {{0x80000000, 0x80000000, 0x80000000, 0}};
+
+/* Sign flips for quaternion terms */
+static const sse_mask_t SIGN_W = {{0, 0, 0, 0x80000000}};
+static const sse_mask_t SIGN_XZ = {{0x80000000, 0, 0x80000000, 0x80000000}};
+static const sse_mask_t SIGN_X = {{0x80000000, 0, 0, 0}};
+static const sse_mask_t SIGN_Y = {{0, 0x80000000, 0, 0}};
+static const sse_mask_t SIGN_XY = {{0x80000000, 0x80000000, 0, 0}};
+static const sse_mask_t SIGN_YZ = {{0, 0x80000000, 0x80000000, 0}};
+static const sse_mask_t SIGN_Z = {{0, 0, 0x80000000, 0}};
+
+#define SPLAT(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i,i,i,i))
+
+/* Row of `a` (3x4, implied homogenous bottom row) times `b` rows */
+static inline __m128 row34_mul(__m128 row, __m128 b0, __m128 b1, __m128 b2) {
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SPLAT(row, 0), b0),
+                                     _mm_mul_ps(SPLAT(row, 1), b1)),
+                          _mm_mul_ps(SPLAT(row, 2), b2));
+    return _mm_add_ps(r, _mm_or_ps(_mm_and_ps(SPLAT(row, 3), W_MASK.v), XYZ_NEG_ZERO.v));
+}
+
+/* Row of `a` (4 columns) times `b` rows */
+static inline __m128 row44_mul(__m128 row, __m128 b0, __m128 b1, __m128 b2, __m128 b3) {
+    return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(SPLAT(row, 0), b0),
+                                            _mm_mul_ps(SPLAT(row, 1), b1)),
+                                 _mm_mul_ps(SPLAT(row, 2), b2)),
+                      _mm_mul_ps(SPLAT(row, 3), b3));
+}
+
+void pmdl_matrix34_mul(pspl_matrix34_t* a, pspl_matrix34_t* b, pspl_matrix34_t* ab) {
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    __m128 r0 = row34_mul(_mm_loadu_ps(a->m[0]), b0, b1, b2);
+    __m128 r1 = row34_mul(_mm_loadu_ps(a->m[1]), b0, b1, b2);
+    __m128 r2 = row34_mul(_mm_loadu_ps(a->m[2]), b0, b1, b2);
+    _mm_storeu_ps(ab->m[0], r0);
+    _mm_storeu_ps(ab->m[1], r1);
+    _mm_storeu_ps(ab->m[2], r2);
+}
+
+void pmdl_matrix44_mul(pspl_matrix44_t* a, pspl_matrix44_t* b, pspl_matrix44_t* ab) {
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    __m128 b3 = _mm_loadu_ps(b->m[3]);
+    __m128 r0 = row44_mul(_mm_loadu_ps(a->m[0]), b0, b1, b2, b3);
+    __m128 r1 = row44_mul(_mm_loadu_ps(a->m[1]), b0, b1, b2, b3);
+    __m128 r2 = row44_mul(_mm_loadu_ps(a->m[2]), b0, b1, b2, b3);
+    __m128 r3 = row44_mul(_mm_loadu_ps(a->m[3]), b0, b1, b2, b3);
+    _mm_storeu_ps(ab->m[0], r0);
+    _mm_storeu_ps(ab->m[1], r1);
+    _mm_storeu_ps(ab->m[2], r2);
+    _mm_storeu_ps(ab->m[3], r3);
+}
+
+void pmdl_matrix3444_mul(pspl_matrix34_t* a, pspl_matrix44_t* b, pspl_matrix44_t* ab) {
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    __m128 b3 = _mm_loadu_ps(b->m[3]);
+    __m128 r0 = row44_mul(_mm_loadu_ps(a->m[0]), b0, b1, b2, b3);
+    __m128 r1 = row44_mul(_mm_loadu_ps(a->m[1]), b0, b1, b2, b3);
+    __m128 r2 = row44_mul(_mm_loadu_ps(a->m[2]), b0, b1, b2, b3);
+    _mm_storeu_ps(ab->m[0], r0);
+    _mm_storeu_ps(ab->m[1], r1);
+    _mm_storeu_ps(ab->m[2], r2);
+    _mm_storeu_ps(ab->m[3], b3);
+}
+
+/* a x b (lanes X, Y, Z) */
+static inline __m128 cross3(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+    __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+    __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+    return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+}
+
+void pmdl_matrix34_invxpose(pspl_matrix34_t* src, pspl_matrix34_t* xPose) {
+
+    // Determinant of the upper 3x3 submatrix (same term order as reference)
+    float det =   src->m[0][0]*src->m[1][1]*src->m[2][2] + src->m[0][1]*src->m[1][2]*src->m[2][0] + src->m[0][2]*src->m[1][0]*src->m[2][1]
+    - src->m[2][0]*src->m[1][1]*src->m[0][2] - src->m[1][0]*src->m[0][1]*src->m[2][2] - src->m[0][0]*src->m[2][1]*src->m[1][2];
+
+    // Check if matrix is singular
+    if (det == 0.0f) return;
+
+    // Rows of cofactors are cross products of the other two rows
+    __m128 s0 = _mm_loadu_ps(src->m[0]);
+    __m128 s1 = _mm_loadu_ps(src->m[1]);
+    __m128 s2 = _mm_loadu_ps(src->m[2]);
+    __m128 inv_det = _mm_set1_ps(1.0f / det);
+    __m128 r0 = _mm_and_ps(_mm_mul_ps(cross3(s1, s2), inv_det), XYZ_MASK.v);
+    __m128 r1 = _mm_and_ps(_mm_mul_ps(cross3(s2, s0), inv_det), XYZ_MASK.v);
+    __m128 r2 = _mm_and_ps(_mm_mul_ps(cross3(s0, s1), inv_det), XYZ_MASK.v);
+    _mm_storeu_ps(xPose->m[0], r0);
+    _mm_storeu_ps(xPose->m[1], r1);
+    _mm_storeu_ps(xPose->m[2], r2);
+
+}
+
+/* Columns of 3x4 matrix (bottom lane 0) */
+static inline void matrix34_columns(const pspl_matrix34_t* mt, __m128* c0, __m128* c1, __m128* c2, __m128* c3) {
+    __m128 r0 = _mm_loadu_ps(mt->m[0]);
+    __m128 r1 = _mm_loadu_ps(mt->m[1]);
+    __m128 r2 = _mm_loadu_ps(mt->m[2]);
+    __m128 r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    *c0 = r0;
+    *c1 = r1;
+    *c2 = r2;
+    *c3 = r3;
+}
+
+void pmdl_vector3_matrix_mul(const pspl_matrix34_t* mt, const pspl_vector3_t* src, pspl_vector3_t* dst) {
+    __m128 c0, c1, c2, c3;
+    matrix34_columns(mt, &c0, &c1, &c2, &c3);
+    __m128 v = _mm_loadu_ps(src->f);
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, SPLAT(v, 0)),
+                                                _mm_mul_ps(c1, SPLAT(v, 1))),
+                                     _mm_mul_ps(c2, SPLAT(v, 2))), c3);
+    _mm_storeu_ps(dst->f, r);
+}
+
+void pmdl_matrix34_quat(pspl_matrix34_t* m, pspl_vector4_t* a) {
+
+    // Normalise (dot product summed in lane order, as reference)
+    __m128 q = _mm_loadu_ps(a->f);
+    __m128 sq = _mm_mul_ps(q, q);
+    __m128 dot = _mm_add_ss(_mm_add_ss(_mm_add_ss(sq, SPLAT(sq, 1)), SPLAT(sq, 2)), SPLAT(sq, 3));
+    __m128 n = _mm_div_ss(_mm_set_ss(1.0f), _mm_sqrt_ss(dot));
+    q = _mm_mul_ps(q, SPLAT(n, 0));
+    __m128 q2 = _mm_add_ps(q, q);
+
+    // Each row is identity row plus two scaled, sign-flipped swizzles
+    __m128 q_yxww = _mm_shuffle_ps(q, q, _MM_SHUFFLE(3,3,0,1));
+    __m128 q_zwxx = _mm_shuffle_ps(q, q, _MM_SHUFFLE(0,0,3,2));
+    __m128 q_wzyx = _mm_shuffle_ps(q, q, _MM_SHUFFLE(0,1,2,3));
+    __m128 x2 = SPLAT(q2, 0), y2 = SPLAT(q2, 1), z2 = SPLAT(q2, 2);
+
+    __m128 r0 = _mm_add_ps(_mm_add_ps(_mm_set_ps(0.0f, -0.0f, -0.0f, 1.0f),
+                                      _mm_mul_ps(y2, _mm_xor_ps(q_yxww, SIGN_XZ.v))),
+                           _mm_mul_ps(z2, _mm_xor_ps(q_zwxx, SIGN_X.v)));
+    __m128 r1 = _mm_add_ps(_mm_add_ps(_mm_set_ps(0.0f, -0.0f, 1.0f, -0.0f),
+                                      _mm_mul_ps(x2, _mm_xor_ps(q_yxww, SIGN_Y.v))),
+                           _mm_mul_ps(z2, _mm_xor_ps(q_wzyx, SIGN_XY.v)));
+    __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_set_ps(0.0f, 1.0f, -0.0f, -0.0f),
+                                      _mm_mul_ps(x2, _mm_xor_ps(q_zwxx, SIGN_YZ.v))),
+                           _mm_mul_ps(y2, _mm_xor_ps(q_wzyx, SIGN_Z.v)));
+
+    // Location column is left intact
+    _mm_storeu_ps(m->m[0], _mm_or_ps(_mm_and_ps(r0, XYZ_MASK.v), _mm_and_ps(_mm_loadu_ps(m->m[0]), W_MASK.v)));
+    _mm_storeu_ps(m->m[1], _mm_or_ps(_mm_and_ps(r1, XYZ_MASK.v), _mm_and_ps(_mm_loadu_ps(m->m[1]), W_MASK.v)));
+    _mm_storeu_ps(m->m[2], _mm_or_ps(_mm_and_ps(r2, XYZ_MASK.v), _mm_and_ps(_mm_loadu_ps(m->m[2]), W_MASK.v)));
+
+}
+
+void pmdl_quat_mul(pspl_vector4_t* a, pspl_vector4_t* b, pspl_vector4_t* ab) {
+    __m128 av = _mm_loadu_ps(a->f);
+    __m128 bv = _mm_loadu_ps(b->f);
+
+    // Lanes X, Y, Z, W
+    __m128 t1 = _mm_mul_ps(SPLAT(av, 3), bv);
+    __m128 t2 = _mm_mul_ps(_mm_shuffle_ps(av, av, _MM_SHUFFLE(0,2,1,0)),
+                           _mm_shuffle_ps(bv, bv, _MM_SHUFFLE(0,3,3,3)));
+    __m128 t3 = _mm_mul_ps(_mm_shuffle_ps(av, av, _MM_SHUFFLE(1,0,2,1)),
+                           _mm_shuffle_ps(bv, bv, _MM_SHUFFLE(1,1,0,2)));
+    __m128 t4 = _mm_mul_ps(_mm_shuffle_ps(av, av, _MM_SHUFFLE(2,1,0,2)),
+                           _mm_shuffle_ps(bv, bv, _MM_SHUFFLE(2,0,2,1)));
+    __m128 r = _mm_sub_ps(_mm_add_ps(_mm_add_ps(t1, _mm_xor_ps(t2, SIGN_W.v)),
+                                     _mm_xor_ps(t3, SIGN_W.v)), t4);
+    _mm_storeu_ps(ab->f, r);
+}
+
+void pmdl_matrix34_mul_batch(const pspl_matrix34_t* a_arr, const pspl_matrix34_t* b,
+                             pspl_matrix34_t* ab_arr, unsigned count) {
+    __m128 b0 = _mm_loadu_ps(b->m[0]);
+    __m128 b1 = _mm_loadu_ps(b->m[1]);
+    __m128 b2 = _mm_loadu_ps(b->m[2]);
+    unsigned i;
+    for (i=0 ; i<count ; ++i) {
+        __m128 r0 = row34_mul(_mm_loadu_ps(a_arr[i].m[0]), b0, b1, b2);
+        __m128 r1 = row34_mul(_mm_loadu_ps(a_arr[i].m[1]), b0, b1, b2);
+        __m128 r2 = row34_mul(_mm_loadu_ps(a_arr[i].m[2]), b0, b1, b2);
+        _mm_storeu_ps(ab_arr[i].m[0], r0);
+        _mm_storeu_ps(ab_arr[i].m[1], r1);
+        _mm_storeu_ps(ab_arr[i].m[2], r2);
+    }
+}
+
+void pmdl_vector3_matrix_mul_batch(const pspl_matrix34_t* mt, const float* src, float* dst, unsigned count) {
+    unsigned i;
+
+    // Four vertices per iteration, de-interleaved to SoA
+    __m128 m[3][4];
+    for (i=0 ; i<3 ; ++i) {
+        m[i][0] = _mm_set1_ps(mt->m[i][0]);
+        m[i][1] = _mm_set1_ps(mt->m[i][1]);
+        m[i][2] = _mm_set1_ps(mt->m[i][2]);
+        m[i][3] = _mm_set1_ps(mt->m[i][3]);
+    }
+    for (i=0 ; i+4<=count ; i+=4) {
+        __m128 s0 = _mm_loadu_ps(&src[i*3]);
+        __m128 s1 = _mm_loadu_ps(&src[i*3+4]);
+        __m128 s2 = _mm_loadu_ps(&src[i*3+8]);
+        __m128 x = _mm_shuffle_ps(s0, _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(0,0,1,1)),
+                                  _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(1,1,2,2)), s2, _MM_SHUFFLE(3,0,2,0));
+
+        __m128 o[3];
+        int j;
+        for (j=0 ; j<3 ; ++j)
+            o[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[j][0], x), _mm_mul_ps(m[j][1], y)),
+                                         _mm_mul_ps(m[j][2], z)), m[j][3]);
+
+        // Re-interleave
+        __m128 d0 = _mm_shuffle_ps(_mm_shuffle_ps(o[0], o[1], _MM_SHUFFLE(0,0,0,0)),
+                                   _mm_shuffle_ps(o[2], o[0], _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+        __m128 d1 = _mm_shuffle_ps(_mm_shuffle_ps(o[1], o[2], _MM_SHUFFLE(1,1,1,1)),
+                                   _mm_shuffle_ps(o[0], o[1], _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+        __m128 d2 = _mm_shuffle_ps(_mm_shuffle_ps(o[2], o[0], _MM_SHUFFLE(3,3,2,2)),
+                                   _mm_shuffle_ps(o[1], o[2], _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+        _mm_storeu_ps(&dst[i*3], d0);
+        _mm_storeu_ps(&dst[i*3+4], d1);
+        _mm_storeu_ps(&dst[i*3+8], d2);
+    }
+
+    // Remainder
+    for (; i<count ; ++i) {
+        float x = src[i*3], y = src[i*3+1], z = src[i*3+2];
+        dst[i*3] = mt->m[0][0]*x + mt->m[0][1]*y + mt->m[0][2]*z + mt->m[0][3];
+        dst[i*3+1] = mt->m[1][0]*x + mt->m[1][1]*y + mt->m[1][2]*z + mt->m[1][3];
+        dst[i*3+2] = mt->m[2][0]*x + mt->m[2][1]*y + mt->m[2][2]*z + mt->m[2][3];
+    }
+}
+
+#endif
@@ -1,10 +0,0 @@
-//
-//  PMDLRuntimeLinAlgebraSSE.s
-//  PSPL
-//
-//  Created by Jack Andersen on 7/23/13.
-//
-//
-
-// x86-SSE implementations of PMDL vector and matrix operations
-
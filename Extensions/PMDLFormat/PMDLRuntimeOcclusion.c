@@ -0,0 +1,355 @@
+//
+//  PMDLRuntimeOcclusion.c
+//  PSPL
+//
+//  Software occlusion culling against a CPU-rasterised depth buffer
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#if __SSE__
+#   include <xmmintrin.h>
+#endif
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLRuntimeProcessing.h"
+
+/* Edge length (in pixels) of hierarchical depth tiles */
+#define OCC_TILE 8
+
+/* Depth of pixels no occluder covers
+ * (depths are screen-linear and increase towards the camera) */
+#define OCC_CLEAR (-FLT_MAX)
+
+/* Corners of solid AABB as 12 triangles (index bits select max X, Y, Z) */
+static const uint8_t AABB_TRIS[12][3] = {
+    {0,1,3}, {0,3,2}, {4,6,7}, {4,7,5},
+    {0,4,5}, {0,5,1}, {2,3,7}, {2,7,6},
+    {0,2,6}, {0,6,4}, {1,5,7}, {1,7,3}
+};
+
+
+#pragma mark Buffer Management
+
+int pmdl_occlusion_buffer_init(pmdl_occlusion_buffer* buf, unsigned width, unsigned height) {
+    width = (width + OCC_TILE-1) & ~(OCC_TILE-1);
+    height = (height + OCC_TILE-1) & ~(OCC_TILE-1);
+    if (!width || !height)
+        return -1;
+
+    buf->width = width;
+    buf->height = height;
+    buf->tiles_x = width / OCC_TILE;
+    buf->tiles_y = height / OCC_TILE;
+    buf->depth_arr = pspl_allocate_media_block(sizeof(float)*(width*height + buf->tiles_x*buf->tiles_y));
+    buf->tile_depth_arr = buf->depth_arr + width*height;
+
+    unsigned i;
+    for (i=0 ; i<width*height + buf->tiles_x*buf->tiles_y ; ++i)
+        buf->depth_arr[i] = OCC_CLEAR;
+    buf->perspective = 1;
+    buf->near = 0.0f;
+    buf->scale[0] = buf->scale[1] = 1.0f;
+    buf->offset[0] = buf->offset[1] = 0.0f;
+
+    return 0;
+}
+
+void pmdl_occlusion_buffer_destroy(pmdl_occlusion_buffer* buf) {
+    pspl_free_media_block(buf->depth_arr);
+    buf->depth_arr = NULL;
+    buf->tile_depth_arr = NULL;
+}
+
+/* Clear buffer and take projection of `ctx` for the coming frame */
+void pmdl_occlusion_begin(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx) {
+
+    unsigned i;
+    for (i=0 ; i<buf->width*buf->height + buf->tiles_x*buf->tiles_y ; ++i)
+        buf->depth_arr[i] = OCC_CLEAR;
+
+    // View space looks down -Z; buffer rows run top to bottom
+    if (ctx->projection_type == PMDL_PERSPECTIVE) {
+        buf->perspective = 1;
+        buf->near = ctx->projection.perspective.near;
+        buf->scale[0] = buf->width * 0.5f / ctx->f_tanh;
+        buf->scale[1] = -(buf->height * 0.5f) / ctx->f_tanv;
+        buf->offset[0] = buf->width * 0.5f;
+        buf->offset[1] = buf->height * 0.5f;
+    } else {
+        const pspl_orthographic_t* ortho = &ctx->projection.orthographic;
+        buf->perspective = 0;
+        buf->near = ortho->near;
+        buf->scale[0] = buf->width / (ortho->right - ortho->left);
+        buf->scale[1] = -(buf->height / (ortho->top - ortho->bottom));
+        buf->offset[0] = -ortho->left * buf->scale[0];
+        buf->offset[1] = -ortho->top * buf->scale[1];
+    }
+
+}
+
+/* Build hierarchical level (farthest occluder depth of each tile) */
+void pmdl_occlusion_end(pmdl_occlusion_buffer* buf) {
+    unsigned tx,ty,x,y;
+    for (ty=0 ; ty<buf->tiles_y ; ++ty) {
+        for (tx=0 ; tx<buf->tiles_x ; ++tx) {
+            float farthest = FLT_MAX;
+            for (y=ty*OCC_TILE ; y<(ty+1)*OCC_TILE ; ++y) {
+                const float* row = &buf->depth_arr[y*buf->width];
+                for (x=tx*OCC_TILE ; x<(tx+1)*OCC_TILE ; ++x)
+                    if (row[x] < farthest)
+                        farthest = row[x];
+            }
+            buf->tile_depth_arr[ty*buf->tiles_x+tx] = farthest;
+        }
+    }
+}
+
+
+#pragma mark Rasterisation
+
+/* Project view-space point into buffer space; `out` receives pixel X, Y,
+ * depth and a flag cleared for points in front of the near plane */
+static inline void occ_project(const pmdl_occlusion_buffer* buf, const float view[3], float out[4]) {
+    float w = -view[2];
+    if (w < buf->near) {
+        out[3] = 0.0f;
+        return;
+    }
+    if (buf->perspective) {
+        float inv_w = 1.0f / w;
+        out[0] = view[0] * inv_w * buf->scale[0] + buf->offset[0];
+        out[1] = view[1] * inv_w * buf->scale[1] + buf->offset[1];
+        out[2] = inv_w;
+    } else {
+        out[0] = view[0] * buf->scale[0] + buf->offset[0];
+        out[1] = view[1] * buf->scale[1] + buf->offset[1];
+        out[2] = view[2];
+    }
+    out[3] = 1.0f;
+}
+
+/* Transform model-space position by modelview and project into buffer space */
+void pmdl_occlusion_transform(const pmdl_occlusion_buffer* buf, const pspl_matrix44_t* modelview,
+                              const float pos[3], float out[4]) {
+    float view[3];
+    int i;
+    for (i=0 ; i<3 ; ++i)
+        view[i] = modelview->m[i][0]*pos[0] + modelview->m[i][1]*pos[1] +
+                  modelview->m[i][2]*pos[2] + modelview->m[i][3];
+    occ_project(buf, view, out);
+}
+
+/* Rasterise projected triangle (either winding) at pixel centres,
+ * keeping the nearest depth; triangles crossing the near plane
+ * are skipped, so occlusion is never overstated */
+void pmdl_occlusion_raster_triangle(pmdl_occlusion_buffer* buf,
+                                    const float v0[4], const float v1[4], const float v2[4]) {
+    if (!v0[3] || !v1[3] || !v2[3])
+        return;
+
+    // Orient counter-clockwise (positive area)
+    float area = (v1[0]-v0[0])*(v2[1]-v0[1]) - (v1[1]-v0[1])*(v2[0]-v0[0]);
+    if (area < 0.0f) {
+        const float* tmp = v1;
+        v1 = v2;
+        v2 = tmp;
+        area = -area;
+    }
+    if (!(area > 1e-6f))
+        return;
+
+    // Pixel bounds (centres within triangle bounds)
+    float fmin_x = fminf(v0[0], fminf(v1[0], v2[0]));
+    float fmax_x = fmaxf(v0[0], fmaxf(v1[0], v2[0]));
+    float fmin_y = fminf(v0[1], fminf(v1[1], v2[1]));
+    float fmax_y = fmaxf(v0[1], fmaxf(v1[1], v2[1]));
+    int min_x = (int)ceilf(fmaxf(fmin_x - 0.5f, 0.0f));
+    int max_x = (int)floorf(fminf(fmax_x - 0.5f, buf->width - 1.0f));
+    int min_y = (int)ceilf(fmaxf(fmin_y - 0.5f, 0.0f));
+    int max_y = (int)floorf(fminf(fmax_y - 0.5f, buf->height - 1.0f));
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    // Edge functions (e = a*x + b*y + c; non-negative inside),
+    // each opposite the vertex whose barycentric weight it yields
+    const float* verts[3] = {v0, v1, v2};
+    float ea[3], eb[3], ec[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        const float* va = verts[(i+1)%3];
+        const float* vb = verts[(i+2)%3];
+        ea[i] = va[1] - vb[1];
+        eb[i] = vb[0] - va[0];
+        ec[i] = -(ea[i]*va[0] + eb[i]*va[1]);
+    }
+
+    // Depth plane from barycentric weights
+    float inv_area = 1.0f / area;
+    float da = (ea[0]*v0[2] + ea[1]*v1[2] + ea[2]*v2[2]) * inv_area;
+    float db = (eb[0]*v0[2] + eb[1]*v1[2] + eb[2]*v2[2]) * inv_area;
+    float dc = (ec[0]*v0[2] + ec[1]*v1[2] + ec[2]*v2[2]) * inv_area;
+
+    int x,y;
+    for (y=min_y ; y<=max_y ; ++y) {
+        float py = y + 0.5f;
+        float* row = &buf->depth_arr[y*buf->width];
+        float row_e[3];
+        for (i=0 ; i<3 ; ++i)
+            row_e[i] = eb[i]*py + ec[i];
+        float row_d = db*py + dc;
+        x = min_x;
+
+#       if __SSE__
+            // 4 pixels per iteration (width is a multiple of 8, so aligned groups stay in-row)
+            {
+                x &= ~3;
+                __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+                __m128 v_ea0 = _mm_set1_ps(ea[0]), v_ea1 = _mm_set1_ps(ea[1]), v_ea2 = _mm_set1_ps(ea[2]);
+                __m128 v_re0 = _mm_set1_ps(row_e[0]), v_re1 = _mm_set1_ps(row_e[1]), v_re2 = _mm_set1_ps(row_e[2]);
+                __m128 v_da = _mm_set1_ps(da), v_rd = _mm_set1_ps(row_d);
+                __m128 zero = _mm_setzero_ps();
+                for (; x<=max_x ; x+=4) {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                    __m128 e0 = _mm_add_ps(_mm_mul_ps(v_ea0, px), v_re0);
+                    __m128 e1 = _mm_add_ps(_mm_mul_ps(v_ea1, px), v_re1);
+                    __m128 e2 = _mm_add_ps(_mm_mul_ps(v_ea2, px), v_re2);
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                               _mm_cmpge_ps(e2, zero));
+                    if (!_mm_movemask_ps(inside))
+                        continue;
+                    __m128 old = _mm_loadu_ps(&row[x]);
+                    __m128 depth = _mm_max_ps(old, _mm_add_ps(_mm_mul_ps(v_da, px), v_rd));
+                    _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, old)));
+                }
+            }
+#       endif
+
+        // Remaining pixels
+        for (; x<=max_x ; ++x) {
+            float px = x + 0.5f;
+            if (ea[0]*px + row_e[0] < 0.0f ||
+                ea[1]*px + row_e[1] < 0.0f ||
+                ea[2]*px + row_e[2] < 0.0f)
+                continue;
+            float depth = da*px + row_d;
+            if (depth > row[x])
+                row[x] = depth;
+        }
+    }
+
+}
+
+/* Add solid AABB (in `ctx` model space) as occluder */
+void pmdl_occlusion_add_aabb(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const float aabb[2][3]) {
+    float corners[8][4];
+    int i;
+    for (i=0 ; i<8 ; ++i) {
+        float pos[3] = {aabb[(i>>2)&1][0], aabb[(i>>1)&1][1], aabb[i&1][2]};
+        pmdl_occlusion_transform(buf, &ctx->cached_modelview_mtx, pos, corners[i]);
+    }
+    for (i=0 ; i<12 ; ++i)
+        pmdl_occlusion_raster_triangle(buf, corners[AABB_TRIS[i][0]],
+                                       corners[AABB_TRIS[i][1]], corners[AABB_TRIS[i][2]]);
+}
+
+/* Add indexed triangle list (in `ctx` model space) as occluder;
+ * positions are float triples `stride` bytes apart */
+void pmdl_occlusion_add_triangles(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx,
+                                  const float* positions, unsigned stride,
+                                  const uint16_t* indices, unsigned tri_count) {
+    unsigned i;
+    int j;
+    for (i=0 ; i<tri_count ; ++i) {
+        float verts[3][4];
+        for (j=0 ; j<3 ; ++j)
+            pmdl_occlusion_transform(buf, &ctx->cached_modelview_mtx,
+                                     (const void*)positions + stride*indices[i*3+j], verts[j]);
+        pmdl_occlusion_raster_triangle(buf, verts[0], verts[1], verts[2]);
+    }
+}
+
+
+#pragma mark Occlusion Testing
+
+/* Test view-space box corners against buffer; returns non-zero if any
+ * part may be visible (boxes reaching the near plane always are) */
+static int occ_test_corners(const pmdl_occlusion_buffer* buf, const float corners[8][3]) {
+
+    // Screen rectangle and nearest depth of box
+    float fmin_x = FLT_MAX, fmax_x = -FLT_MAX;
+    float fmin_y = FLT_MAX, fmax_y = -FLT_MAX;
+    float nearest = OCC_CLEAR;
+    int i;
+    for (i=0 ; i<8 ; ++i) {
+        float proj[4];
+        occ_project(buf, corners[i], proj);
+        if (!proj[3])
+            return 1;
+        fmin_x = fminf(fmin_x, proj[0]);
+        fmax_x = fmaxf(fmax_x, proj[0]);
+        fmin_y = fminf(fmin_y, proj[1]);
+        fmax_y = fmaxf(fmax_y, proj[1]);
+        nearest = fmaxf(nearest, proj[2]);
+    }
+
+    // Offscreen boxes are left to the frustum test
+    int min_x = (int)floorf(fmaxf(fmin_x, 0.0f));
+    int max_x = (int)floorf(fminf(fmax_x, buf->width - 1.0f));
+    int min_y = (int)floorf(fmaxf(fmin_y, 0.0f));
+    int max_y = (int)floorf(fminf(fmax_y, buf->height - 1.0f));
+    if (min_x > max_x || min_y > max_y)
+        return 1;
+
+    // Tiles entirely nearer than the box are skipped; others are resolved per-pixel
+    int tx,ty,x,y;
+    for (ty=min_y/OCC_TILE ; ty<=max_y/OCC_TILE ; ++ty) {
+        for (tx=min_x/OCC_TILE ; tx<=max_x/OCC_TILE ; ++tx) {
+            if (nearest < buf->tile_depth_arr[ty*buf->tiles_x+tx])
+                continue;
+            int y0 = (ty*OCC_TILE > min_y) ? ty*OCC_TILE : min_y;
+            int y1 = ((ty+1)*OCC_TILE-1 < max_y) ? (ty+1)*OCC_TILE-1 : max_y;
+            int x0 = (tx*OCC_TILE > min_x) ? tx*OCC_TILE : min_x;
+            int x1 = ((tx+1)*OCC_TILE-1 < max_x) ? (tx+1)*OCC_TILE-1 : max_x;
+            for (y=y0 ; y<=y1 ; ++y) {
+                const float* row = &buf->depth_arr[y*buf->width];
+                for (x=x0 ; x<=x1 ; ++x)
+                    if (nearest >= row[x])
+                        return 1;
+            }
+        }
+    }
+
+    return 0;
+
+}
+
+/* Test AABB in `ctx` model space */
+int pmdl_occlusion_test_aabb(const pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const float aabb[2][3]) {
+    const pspl_matrix44_t* mv = &ctx->cached_modelview_mtx;
+    float corners[8][3];
+    int i,j;
+    for (i=0 ; i<8 ; ++i) {
+        float pos[3] = {aabb[(i>>2)&1][0], aabb[(i>>1)&1][1], aabb[i&1][2]};
+        for (j=0 ; j<3 ; ++j)
+            corners[i][j] = mv->m[j][0]*pos[0] + mv->m[j][1]*pos[1] + mv->m[j][2]*pos[2] + mv->m[j][3];
+    }
+    return occ_test_corners(buf, corners);
+}
+
+/* Test view-space AABB given as centre and half-extent */
+int pmdl_occlusion_test_view_aabb(const pmdl_occlusion_buffer* buf, const float centre[3], const float extent[3]) {
+    float corners[8][3];
+    int i,j;
+    for (i=0 ; i<8 ; ++i)
+        for (j=0 ; j<3 ; ++j)
+            corners[i][j] = centre[j] + (((i>>(2-j))&1) ? extent[j] : -extent[j]);
+    return occ_test_corners(buf, corners);
+}
+
@@ -10,6 +10,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
+
+#if __AVX__
+#   include <immintrin.h>
+#elif __SSE__
+#   include <xmmintrin.h>
+#endif
 
 #include <PSPLExtension.h>
 #include <PSPLRuntime.h>
@@ -20,9 +28,6 @@
 /* Homogenous transformation matrix bottom row */
 static const pspl_vector4_t HOMOGENOUS_BOTTOM_VECTOR = {.f[0]=0, .f[1]=0, .f[2]=0, .f[3]=1};
 
-/* Logical XOR */
-#define LXOR(a,b) (((a) || (b)) && !((a) && (b)))
-
 
 /* Platform headers */
 #if PSPL_RUNTIME_PLATFORM_GL2
@@ -69,6 +74,11 @@ static const pspl_vector4_t HOMOGENOUS_BOTTOM_VECTOR = {.f[0]=0, .f[1]=0, .f[2]=
 #       endif
 #   endif
 
+/* Half-float vertex attributes (quantised collections) */
+#   ifndef GL_HALF_FLOAT
+#       define GL_HALF_FLOAT GL_HALF_FLOAT_OES
+#   endif
+
 
 #elif PSPL_RUNTIME_PLATFORM_D3D11
 #   include <d3d11.h>
@@ -119,22 +129,6 @@ enum pmdl_par {
     PMDL_PAR2 = 2
 };
 
-/* PMDL Collection Header */
-#pragma pack(1)
-typedef struct __attribute__ ((__packed__)) {
-    
-    uint16_t uv_count;
-    uint16_t bone_count;
-    uint32_t vert_buf_off;
-    uint32_t vert_buf_len;
-    uint32_t elem_buf_off;
-    uint32_t elem_buf_len;
-    uint32_t draw_idx_off;
-    
-} pmdl_col_header;
-#pragma pack()
-
-
 /* PMDL Mesh header */
 typedef struct {
     
@@ -144,27 +138,24 @@ typedef struct {
     
 } pmdl_mesh_header;
 
+/* PAR2 mesh shader-index bits; the MSB marks meshes already drawn
+ * within the current draw call (meshes may be referenced by many
+ * octree leaves), the remaining bits index the shader table */
+#define PMDL_MESH_DRAWN_BIT 0x80000000
+#define PMDL_MESH_NO_SHADER 0x7fffffff
+
+/* Default level-of-detail tolerance (about 2 pixels at 1080 lines) */
+#define PMDL_LOD_DEFAULT_TOLERANCE 0.002f
+
+/* Hysteresis margin; a level coarser than the last selected one is only
+ * taken once its projected error falls this fraction below tolerance */
+#define PMDL_LOD_HYSTERESIS 0.25f
+
+/* Slots of the level-of-detail hysteresis table (power of two) */
+#define PMDL_LOD_STATE_SLOTS 256
 
-#if PMDL_GENERAL
-    enum pmdl_prim_type {
-        PMDL_POINTS          = 0,
-        PMDL_TRIANGLES       = 1,
-        PMDL_TRIANGLE_FANS   = 2,
-        PMDL_TRIANGLE_STRIPS = 3,
-        PMDL_LINES           = 4,
-        PMDL_LINE_STRIPS     = 5
-    };
-    /* PMDL General Primitive */
-    typedef struct {
-        uint32_t prim_type;
-        uint32_t prim_start_idx;
-        uint32_t prim_count;
-    } pmdl_general_prim;
-    typedef struct {
-        uint32_t skin_idx;
-        pmdl_general_prim prim;
-    } pmdl_general_prim_par1;
 
+#if PMDL_GENERAL
     struct gl_bufs_t {
         GLuint vao, vert_buf, elem_buf;
     };
@@ -208,40 +199,75 @@ void pmdl_master_init() {
 
 #pragma mark PMDL Loading / Unloading
 
-/* This routine will load collection data */
-static int pmdl_init_collections(const pspl_runtime_arc_file_t* pmdl_file) {
+/* This routine will resolve mesh shader pointers; files carrying a
+ * relocation table are patched in a single flat pass, older files
+ * resolve them while walking each collection's mesh headers (the walk
+ * sanitises shader indices either way) */
+static void pmdl_relocate(const pspl_runtime_arc_file_t* pmdl_file) {
     void* file_data = pmdl_file->file_data;
     pmdl_header* header = file_data;
     
-    // Shader hash array
+    // Resolve each shader once (lookup only; retained on upload)
+    unsigned i;
+    uint32_t shader_count = *(uint32_t*)(file_data + header->shader_table_offset);
     pspl_hash* shader_hashes = file_data + header->shader_table_offset + sizeof(uint32_t);
+    const pspl_runtime_psplc_t* shaders[shader_count+1];
+    for (i=0 ; i<shader_count ; ++i)
+        shaders[i] = pspl_runtime_get_psplc_from_hash(pmdl_file->parent, &shader_hashes[i], 0);
+    
+    // Relocation table (an empty one may only be carrying section links)
+    uint32_t reloc_count = (header->reloc_table_offset) ?
+                           *(uint32_t*)(file_data + header->reloc_table_offset) : 0;
+    if (reloc_count) {
+        const pmdl_reloc_entry* relocs = file_data + header->reloc_table_offset + sizeof(uint32_t);
+        for (i=0 ; i<reloc_count ; ++i)
+            *(const pspl_runtime_psplc_t**)(file_data + relocs[i].offset) =
+            (relocs[i].shader_index >= 0 && relocs[i].shader_index < shader_count) ?
+            shaders[relocs[i].shader_index] : NULL;
+    }
     
-    // Init collections
+    // Mesh header walk
     void* collection_buf = file_data + header->collection_offset;
     pmdl_col_header* collection_header = collection_buf;
-    unsigned i;
     for (i=0 ; i<header->collection_count; ++i) {
-        void* index_buf = collection_buf + collection_header->draw_idx_off;
-        
-        // Mesh count
+        void* index_buf = collection_buf + collection_header[i].draw_idx_off;
         uint32_t mesh_count = *(uint32_t*)index_buf;
-        uint32_t index_buf_offset = *(uint32_t*)(index_buf+4);
-        
-        // Mesh head array; lookup shader objects and cache pointers
         pmdl_mesh_header* mesh_heads = index_buf+8;
         unsigned j;
         for (j=0 ; j<mesh_count ; ++j) {
             pmdl_mesh_header* mesh_head = &mesh_heads[j];
-            if (mesh_head->shader_index < 0)
+            if (mesh_head->shader_index < 0 || mesh_head->shader_index >= shader_count) {
                 mesh_head->shader_pointer = NULL;
-            else
-                mesh_head->shader_pointer =
-                pspl_runtime_get_psplc_from_hash(pmdl_file->parent, &shader_hashes[mesh_head->shader_index], 0);
+                
+                // PAR2 reserves the MSB as draw bit; shaderless meshes must leave it clear
+                if (header->sub_type_num == '2')
+                    mesh_head->shader_index = PMDL_MESH_NO_SHADER;
+            } else if (!reloc_count)
+                mesh_head->shader_pointer = shaders[mesh_head->shader_index];
         }
+    }
+    
+}
+
+/* This routine will load collection data */
+static int pmdl_init_collections(const pspl_runtime_arc_file_t* pmdl_file) {
+    void* file_data = pmdl_file->file_data;
+    pmdl_header* header = file_data;
+    
+    // Init collections
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* collection_header = collection_buf;
+    unsigned i;
+    for (i=0 ; i<header->collection_count; ++i) {
+        void* index_buf = collection_buf + collection_header->draw_idx_off;
+        
+        // Skip mesh headers (shader pointers already relocated)
+        uint32_t index_buf_offset = *(uint32_t*)(index_buf+4);
         index_buf += index_buf_offset;
         
 #       if PSPL_RUNTIME_PLATFORM_GL2
             struct gl_bufs_t* gl_bufs = index_buf;
+            unsigned j;
         
             // VAO
             GLVAO(glGenVertexArrays)(1, &gl_bufs->vao);
@@ -257,28 +283,59 @@ static int pmdl_init_collections(const pspl_runtime_arc_file_t* pmdl_file) {
                          collection_buf + collection_header->elem_buf_off, GL_STATIC_DRAW);
             
             // Attributes
-            GLsizei buf_stride = 24 + collection_header->uv_count*8 + collection_header->bone_count*4;
+            GLsizei buf_stride = pmdl_general_vert_stride(collection_header);
+            unsigned uv_count = PMDL_COL_UV_COUNT(collection_header);
             
-            glEnableVertexAttribArray(0); // Position
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, buf_stride, 0);
-        
-            glEnableVertexAttribArray(1); // Normal
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)12);
-        
-            GLuint idx = 2;
-            for (j=0 ; j<collection_header->uv_count ; ++j) { // UVs
-                glEnableVertexAttribArray(idx);
-                glVertexAttribPointer(idx, 2, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)(GLsizeiptr)(24+8*j));
-                ++idx;
-            }
-            
-            GLsizeiptr weight_offset = 24 + collection_header->uv_count*8;
-            if (collection_header->bone_count) {
+            if (collection_header->uv_count & PMDL_COL_QUANTISED) {
+                
+                // Quantised layout: int16 position (padded to 4), octahedral int16 normal,
+                // half-float UVs, uint8 weights (dequantised by shader)
+                GLsizeiptr base = sizeof(pmdl_quant_head);
+                
+                glEnableVertexAttribArray(0); // Position
+                glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, buf_stride, (GLvoid*)base);
+                
+                glEnableVertexAttribArray(1); // Normal
+                glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, buf_stride, (GLvoid*)(base+8));
+                
+                GLuint idx = 2;
+                for (j=0 ; j<uv_count ; ++j) { // UVs
+                    glEnableVertexAttribArray(idx);
+                    glVertexAttribPointer(idx, 2, GL_HALF_FLOAT, GL_FALSE, buf_stride, (GLvoid*)(base+12+4*j));
+                    ++idx;
+                }
+                
+                GLsizeiptr weight_offset = base + 12 + uv_count*4;
                 for (j=0 ; j<(collection_header->bone_count/4) ; ++j) { // Bone Weight Coefficients
                     glEnableVertexAttribArray(idx);
-                    glVertexAttribPointer(idx, 4, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)(weight_offset+16*j));
+                    glVertexAttribPointer(idx, 4, GL_UNSIGNED_BYTE, GL_TRUE, buf_stride, (GLvoid*)(weight_offset+4*j));
+                    ++idx;
+                }
+                
+            } else {
+            
+                glEnableVertexAttribArray(0); // Position
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, buf_stride, 0);
+            
+                glEnableVertexAttribArray(1); // Normal
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)12);
+            
+                GLuint idx = 2;
+                for (j=0 ; j<uv_count ; ++j) { // UVs
+                    glEnableVertexAttribArray(idx);
+                    glVertexAttribPointer(idx, 2, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)(GLsizeiptr)(24+8*j));
                     ++idx;
                 }
+                
+                GLsizeiptr weight_offset = 24 + uv_count*8;
+                if (collection_header->bone_count) {
+                    for (j=0 ; j<(collection_header->bone_count/4) ; ++j) { // Bone Weight Coefficients
+                        glEnableVertexAttribArray(idx);
+                        glVertexAttribPointer(idx, 4, GL_FLOAT, GL_FALSE, buf_stride, (GLvoid*)(weight_offset+16*j));
+                        ++idx;
+                    }
+                }
+                
             }
         
 #       elif PSPL_RUNTIME_PLATFORM_D3D11
@@ -350,8 +407,9 @@ static void pmdl_destroy_collections(void* file_data) {
         
 }
 
-/* This routine will validate and load PMDL data into GPU */
-int pmdl_init(pmdl_t* pmdl) {
+/* This routine will validate PMDL data and relocate its shader pointers
+ * (touches nothing but the file's own buffer; safe on worker threads) */
+int pmdl_init_fixup(pmdl_t* pmdl) {
     char hash[PSPL_HASH_STRING_LEN];
     
     // First, validate header members
@@ -412,6 +470,64 @@ int pmdl_init(pmdl_t* pmdl) {
         return -1;
     }
     
+    // Relocation table bounds
+    if (header->reloc_table_offset &&
+        (header->reloc_table_offset + sizeof(uint32_t) > pmdl->file_ptr->file_len ||
+         header->reloc_table_offset + sizeof(uint32_t) + sizeof(pmdl_reloc_entry) *
+         (size_t)*(uint32_t*)(pmdl->file_ptr->file_data + header->reloc_table_offset) > pmdl->file_ptr->file_len)) {
+        pspl_hash_fmt(hash, &pmdl->file_ptr->hash);
+        pspl_warn("Unable to init PMDL", "file `%s` has out-of-bounds relocation table; skipping", hash);
+        return -1;
+    }
+    if (header->reloc_table_offset) {
+        uint32_t reloc_count = *(uint32_t*)(pmdl->file_ptr->file_data + header->reloc_table_offset);
+        const pmdl_reloc_entry* relocs = pmdl->file_ptr->file_data + header->reloc_table_offset + sizeof(uint32_t);
+        unsigned i;
+        for (i=0 ; i<reloc_count ; ++i) {
+            if (relocs[i].offset + sizeof(void*) > pmdl->file_ptr->file_len) {
+                pspl_hash_fmt(hash, &pmdl->file_ptr->hash);
+                pspl_warn("Unable to init PMDL", "file `%s` relocates out-of-bounds pointer at 0x%x; skipping",
+                          hash, relocs[i].offset);
+                return -1;
+            }
+        }
+    }
+    
+    // Level-of-detail table bounds
+    size_t file_len = pmdl->file_ptr->file_len;
+    uint32_t lod_table_offset = pmdl_section_offset(pmdl->file_ptr->file_data, file_len, "_LOD");
+    if (lod_table_offset) {
+        int lod_valid = (lod_table_offset + sizeof(uint32_t) <= file_len);
+        uint32_t level_count = (lod_valid) ? *(uint32_t*)(pmdl->file_ptr->file_data + lod_table_offset) : 0;
+        lod_valid = lod_valid && (lod_table_offset + sizeof(uint32_t) +
+                                  sizeof(pmdl_lod_level) * (size_t)level_count <= file_len);
+        const pmdl_lod_level* levels = pmdl->file_ptr->file_data + lod_table_offset + sizeof(uint32_t);
+        unsigned l,c;
+        for (l=0 ; lod_valid && l<level_count ; ++l) {
+            lod_valid = (levels[l].run_table_offset + sizeof(uint32_t) * (size_t)header->collection_count <= file_len);
+            const uint32_t* run_offs = pmdl->file_ptr->file_data + levels[l].run_table_offset;
+            for (c=0 ; lod_valid && c<header->collection_count ; ++c)
+                lod_valid = (run_offs[c] < file_len);
+        }
+        if (!lod_valid) {
+            pspl_hash_fmt(hash, &pmdl->file_ptr->hash);
+            pspl_warn("Unable to init PMDL", "file `%s` has out-of-bounds level-of-detail table; skipping", hash);
+            return -1;
+        }
+    }
+    
+    // Resolve shader pointers
+    pmdl_relocate(pmdl->file_ptr);
+    
+    return 0;
+    
+}
+
+/* This routine will load validated, relocated PMDL data into GPU
+ * (main thread only; retains shaders and allocates from the media heap) */
+void pmdl_init_upload(pmdl_t* pmdl) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    
     // Load shaders into GPU
     int i;
     uint32_t shader_count = *(uint32_t*)(pmdl->file_ptr->file_data + header->shader_table_offset);
@@ -429,11 +545,17 @@ int pmdl_init(pmdl_t* pmdl) {
 #   if PMDL_GX
         DCStoreRange(pmdl->file_ptr->file_data, pmdl->file_ptr->file_len);
 #   endif
-    
-    return 0;
 
 }
 
+/* This routine will validate and load PMDL data into GPU */
+int pmdl_init(pmdl_t* pmdl) {
+    if (pmdl_init_fixup(pmdl))
+        return -1;
+    pmdl_init_upload(pmdl);
+    return 0;
+}
+
 /* This routine will unload data from GPU */
 void pmdl_destroy(pmdl_t* pmdl) {
     pmdl_header* header = pmdl->file_ptr->file_data;
@@ -458,14 +580,42 @@ void pmdl_destroy(pmdl_t* pmdl) {
 }
 
 
-#pragma mark PMDL Action lookup
+#pragma mark PMDL Action / Bone lookup
+
+/* Hash name for rigging name tables (32-bit FNV-1a) */
+uint32_t pmdl_name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name ; ++name) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Probe name table; yields array index of each slot bearing `name_hash` in turn
+ * (resume with `*slot_cur`), or -1 once the probe reaches an empty slot */
+static inline int name_table_probe(const pmdl_name_slot* table, unsigned mask,
+                                   uint32_t name_hash, unsigned* slot_cur) {
+    unsigned slot = *slot_cur;
+    for (; table[slot].index ; slot = (slot+1) & mask) {
+        if (table[slot].name_hash == name_hash) {
+            *slot_cur = (slot+1) & mask;
+            return table[slot].index - 1;
+        }
+    }
+    return -1;
+}
 
 /* Lookup PMDL rigging action */
 const pmdl_action* pmdl_action_lookup(const pmdl_t* pmdl, const char* action_name) {
-    int i;
-    
-    for (i=0 ; i<pmdl->rigging_ptr->action_count ; ++i) {
-        const pmdl_action* action = &pmdl->rigging_ptr->action_array[i];
+    const pmdl_rigging_ctx* rig_ctx = pmdl->rigging_ptr;
+    uint32_t name_hash = pmdl_name_hash(action_name);
+    unsigned slot = name_hash & rig_ctx->action_name_mask;
+    int idx;
+    
+    while ((idx = name_table_probe(rig_ctx->action_name_table, rig_ctx->action_name_mask,
+                                   name_hash, &slot)) >= 0) {
+        const pmdl_action* action = &rig_ctx->action_array[idx];
         if (!strcmp(action_name, action->action_name))
             return action;
     }
@@ -473,6 +623,36 @@ const pmdl_action* pmdl_action_lookup(const pmdl_t* pmdl, const char* action_nam
     return NULL;
     
 }
+const pmdl_action* pmdl_action_lookup_hash(const pmdl_t* pmdl, uint32_t name_hash) {
+    const pmdl_rigging_ctx* rig_ctx = pmdl->rigging_ptr;
+    unsigned slot = name_hash & rig_ctx->action_name_mask;
+    int idx = name_table_probe(rig_ctx->action_name_table, rig_ctx->action_name_mask, name_hash, &slot);
+    return (idx >= 0) ? &rig_ctx->action_array[idx] : NULL;
+}
+
+/* Lookup PMDL rigging bone */
+const pmdl_bone* pmdl_bone_lookup(const pmdl_t* pmdl, const char* bone_name) {
+    const pmdl_rigging_ctx* rig_ctx = pmdl->rigging_ptr;
+    uint32_t name_hash = pmdl_name_hash(bone_name);
+    unsigned slot = name_hash & rig_ctx->bone_name_mask;
+    int idx;
+    
+    while ((idx = name_table_probe(rig_ctx->bone_name_table, rig_ctx->bone_name_mask,
+                                   name_hash, &slot)) >= 0) {
+        const pmdl_bone* bone = &rig_ctx->bone_array[idx];
+        if (!strcmp(bone_name, bone->bone_name))
+            return bone;
+    }
+    
+    return NULL;
+    
+}
+const pmdl_bone* pmdl_bone_lookup_hash(const pmdl_t* pmdl, uint32_t name_hash) {
+    const pmdl_rigging_ctx* rig_ctx = pmdl->rigging_ptr;
+    unsigned slot = name_hash & rig_ctx->bone_name_mask;
+    int idx = name_table_probe(rig_ctx->bone_name_table, rig_ctx->bone_name_mask, name_hash, &slot);
+    return (idx >= 0) ? &rig_ctx->bone_array[idx] : NULL;
+}
 
 
 #pragma mark Context Init
@@ -512,6 +692,12 @@ static void _pmdl_set_default_context(pmdl_draw_ctx* ctx) {
     ctx->projection.perspective.aspect = 1.3333;
     ctx->projection.perspective.post_translate_x = 0;
     ctx->projection.perspective.post_translate_y = 0;
+    ctx->lod_tolerance = PMDL_LOD_DEFAULT_TOLERANCE;
+    ctx->camera = NULL;
+    ctx->pending_inv_bits = 0;
+    ctx->camera_view_generation = 0;
+    ctx->camera_projection_generation = 0;
+    ctx->cached_generation = 0;
     
 }
 
@@ -550,227 +736,865 @@ void pmdl_free_draw_context_array(pmdl_draw_ctx* array) {
 
 #pragma mark Context Representation and Frustum Testing
 
-/* Invalidate context transformation cache (if values updated) */
-void pmdl_update_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits) {
+/* Compute view-space frustum planes (camera looking down -Z);
+ * positive half-space is within frustum */
+static void pmdl_view_frustum_planes(const pmdl_draw_ctx* ctx, float view_planes[6][4]) {
+    
+    memset(view_planes, 0, sizeof(float)*6*4);
+    if (ctx->projection_type == PMDL_PERSPECTIVE) {
+        float near = ctx->projection.perspective.near;
+        float far = ctx->projection.perspective.far;
+        view_planes[PTOP][1] = -1; view_planes[PTOP][2] = -ctx->f_tanv;
+        view_planes[PBOTTOM][1] = 1; view_planes[PBOTTOM][2] = -ctx->f_tanv;
+        view_planes[PLEFT][0] = 1; view_planes[PLEFT][2] = -ctx->f_tanh;
+        view_planes[PRIGHT][0] = -1; view_planes[PRIGHT][2] = -ctx->f_tanh;
+        view_planes[PNEAR][2] = -1; view_planes[PNEAR][3] = -near;
+        view_planes[PFAR][2] = 1; view_planes[PFAR][3] = far;
+    } else if (ctx->projection_type == PMDL_ORTHOGRAPHIC) {
+        const pspl_orthographic_t* ortho = &ctx->projection.orthographic;
+        view_planes[PTOP][1] = -1; view_planes[PTOP][3] = ortho->top;
+        view_planes[PBOTTOM][1] = 1; view_planes[PBOTTOM][3] = -ortho->bottom;
+        view_planes[PLEFT][0] = 1; view_planes[PLEFT][3] = -ortho->left;
+        view_planes[PRIGHT][0] = -1; view_planes[PRIGHT][3] = ortho->right;
+        view_planes[PNEAR][2] = -1; view_planes[PNEAR][3] = -ortho->near;
+        view_planes[PFAR][2] = 1; view_planes[PFAR][3] = ortho->far;
+    }
     
-    if (!inv_bits)
-        return;
+}
+
+/* Extract model-space frustum planes; view-space planes are
+ * carried into model space by the transposed modelview */
+static void pmdl_update_frustum_planes(pmdl_draw_ctx* ctx) {
     
-    if (inv_bits & PMDL_INVALIDATE_VIEW) {
-        pmdl_matrix_lookat(&ctx->cached_view_mtx, ctx->camera_view);
-    }
+    float view_planes[6][4];
+    pmdl_view_frustum_planes(ctx, view_planes);
     
-    if (inv_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW)) {
+    int i,j;
+    for (i=0 ; i<6 ; ++i) {
+        float* plane = ctx->cached_frustum_planes[i].ABCD.f;
         
-        pmdl_matrix34_mul(&ctx->model_mtx, &ctx->cached_view_mtx, &ctx->cached_modelview_mtx.m34);
-        pmdl_matrix34_mul(&ctx->cached_modelview_mtx.m34, (pspl_matrix34_t*)&LH_SWIZZLE_MATRIX, &ctx->cached_modelview_mtx.m34);
-        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, ctx->cached_modelview_mtx.v[3]);
+        // Transform by transposed modelview
+        for (j=0 ; j<4 ; ++j)
+            plane[j] = view_planes[i][0] * ctx->cached_modelview_mtx.m[0][j] +
+                       view_planes[i][1] * ctx->cached_modelview_mtx.m[1][j] +
+                       view_planes[i][2] * ctx->cached_modelview_mtx.m[2][j];
+        plane[3] += view_planes[i][3];
         
-        pmdl_matrix34_invxpose(&ctx->cached_modelview_mtx.m34, &ctx->cached_modelview_invxpose_mtx.m34);
-        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, ctx->cached_modelview_invxpose_mtx.v[3]);
+        // Normalise (keeping distances comparable across planes)
+        float len = sqrtf(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+        if (len > 0) {
+            for (j=0 ; j<4 ; ++j)
+                plane[j] /= len;
+        }
+    }
+    
+}
+
+/* Source of process-unique context (and camera) generations */
+static volatile int32_t ctx_generation_counter = 0;
+
+/* Routine to allocate and return a new camera */
+pmdl_camera* pmdl_new_camera() {
+    
+    pmdl_camera* camera = pspl_allocate_indexing_block(sizeof(pmdl_camera));
+    camera->camera_view.pos.f[0] = 0;
+    camera->camera_view.pos.f[1] = 3;
+    camera->camera_view.pos.f[2] = 0;
+    camera->camera_view.look.f[0] = 0;
+    camera->camera_view.look.f[1] = 0;
+    camera->camera_view.look.f[2] = 0;
+    camera->camera_view.up.f[0] = 0;
+    camera->camera_view.up.f[1] = 0;
+    camera->camera_view.up.f[2] = 1;
+    camera->projection_type = PMDL_PERSPECTIVE;
+    camera->projection.perspective.fov = 55;
+    camera->projection.perspective.far = 5;
+    camera->projection.perspective.near = 1;
+    camera->projection.perspective.aspect = 1.3333;
+    camera->projection.perspective.post_translate_x = 0;
+    camera->projection.perspective.post_translate_y = 0;
+    pmdl_update_camera(camera, PMDL_INVALIDATE_ALL);
+    return camera;
+    
+}
+
+/* Routine to free camera */
+void pmdl_free_camera(pmdl_camera* camera) {
+    pspl_free_indexing_block(camera);
+}
 
+/* Invalidate camera transformation cache (if view or projection updated) */
+void pmdl_update_camera(pmdl_camera* camera, enum pmdl_invalidate_bits inv_bits) {
+    
+    if (inv_bits & PMDL_INVALIDATE_VIEW) {
+        pmdl_matrix_lookat(&camera->cached_view_mtx, camera->camera_view);
+        pmdl_matrix34_mul(&camera->cached_view_mtx, (pspl_matrix34_t*)&LH_SWIZZLE_MATRIX,
+                          &camera->cached_view_swizzle_mtx);
+        camera->view_generation = pspl_atomic_inc(&ctx_generation_counter);
     }
     
     if (inv_bits & PMDL_INVALIDATE_PROJECTION) {
-        if (ctx->projection_type == PMDL_PERSPECTIVE) {
-            pmdl_matrix_perspective(&ctx->cached_projection_mtx, ctx->projection.perspective);
-            ctx->f_tanv = tanf(DegToRad(ctx->projection.perspective.fov));
-            ctx->f_tanh = ctx->f_tanv * ctx->projection.perspective.aspect;
-        } else if (ctx->projection_type == PMDL_ORTHOGRAPHIC) {
-            pmdl_matrix_orthographic(&ctx->cached_projection_mtx, ctx->projection.orthographic);
+        if (camera->projection_type == PMDL_PERSPECTIVE) {
+            pmdl_matrix_perspective(&camera->cached_projection_mtx, camera->projection.perspective);
+            camera->f_tanv = tanf(DegToRad(camera->projection.perspective.fov * 0.5f));
+            camera->f_tanh = camera->f_tanv * camera->projection.perspective.aspect;
+        } else if (camera->projection_type == PMDL_ORTHOGRAPHIC) {
+            pmdl_matrix_orthographic(&camera->cached_projection_mtx, camera->projection.orthographic);
         }
+        camera->projection_generation = pspl_atomic_inc(&ctx_generation_counter);
+    }
+    
+}
+
+/* Gather deferred bits and pull view/projection state from the context's
+ * camera where it has changed since the context was last updated */
+static enum pmdl_invalidate_bits pmdl_sync_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits) {
+    
+    inv_bits |= ctx->pending_inv_bits;
+    ctx->pending_inv_bits = 0;
+    
+    const pmdl_camera* camera = ctx->camera;
+    if (!camera)
+        return inv_bits;
+    
+    if (ctx->camera_view_generation != camera->view_generation) {
+        ctx->camera_view = camera->camera_view;
+        ctx->cached_view_mtx = camera->cached_view_mtx;
+        ctx->camera_view_generation = camera->view_generation;
+        inv_bits |= PMDL_INVALIDATE_VIEW;
+    }
+    
+    if (ctx->camera_projection_generation != camera->projection_generation) {
+        ctx->projection_type = camera->projection_type;
+        memcpy(&ctx->projection, &camera->projection, sizeof(ctx->projection));
+        ctx->cached_projection_mtx = camera->cached_projection_mtx;
+        ctx->f_tanv = camera->f_tanv;
+        ctx->f_tanh = camera->f_tanh;
+        ctx->camera_projection_generation = camera->projection_generation;
+        inv_bits |= PMDL_INVALIDATE_PROJECTION;
+    }
+    
+    return inv_bits;
+    
+}
+
+/* Derive everything downstream of the modelview and stamp a new generation */
+static void pmdl_finish_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits) {
+    
+    if (inv_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW)) {
+        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, ctx->cached_modelview_mtx.v[3]);
+        pmdl_matrix34_invxpose(&ctx->cached_modelview_mtx.m34, &ctx->cached_modelview_invxpose_mtx.m34);
+        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, ctx->cached_modelview_invxpose_mtx.v[3]);
     }
     
+    if (inv_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW | PMDL_INVALIDATE_PROJECTION))
+        pmdl_update_frustum_planes(ctx);
+    
+    ctx->cached_generation = pspl_atomic_inc(&ctx_generation_counter);
+    
 #   if PMDL_GX
         DCStoreRange((void*)((((uintptr_t)ctx)>>5)<<5), ROUND_UP_32(sizeof(pmdl_draw_ctx)));
 #   endif
     
 }
 
-/* Perform AABB frustum test */
-static int pmdl_aabb_frustum_test(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
-    
-    // Setup straddle-test state
-    enum {
-        TOO_FAR = 1,
-        TOO_NEAR = 1<<1,
-        TOO_LEFT = 1<<2,
-        TOO_RIGHT = 1<<3,
-        TOO_UP = 1<<4,
-        TOO_DOWN = 1<<5
-    } straddle = 0;
-    
-    // Compute using 8 points of AABB
-    int i;
-    for (i=0 ; i<8 ; ++i) {
+/* Invalidate context transformation cache (if values updated) */
+void pmdl_update_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits) {
+    
+    inv_bits = pmdl_sync_context(ctx, inv_bits);
+    if (!inv_bits)
+        return;
+    
+    if (ctx->camera) {
         
-        // Select point
-        pspl_vector3_t point = {.f[0]=aabb[i/4][0], .f[1]=aabb[(i/2)&1][1], .f[2]=aabb[i&1][2]};
+        // View and projection already resolved by camera
+        if (inv_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW))
+            pmdl_matrix34_mul(&ctx->model_mtx, (pspl_matrix34_t*)&ctx->camera->cached_view_swizzle_mtx,
+                              &ctx->cached_modelview_mtx.m34);
         
-        // Transform point into view->point vector
-        pmdl_vector3_matrix_mul(&ctx->cached_modelview_mtx.m34, &point, &point);
+    } else {
         
-        // If orthographic, perform some simple tests
-        if (ctx->projection_type == PMDL_ORTHOGRAPHIC) {
-            
-            if (-point.f[2] > ctx->projection.orthographic.far) {
-                straddle |= TOO_FAR;
-                continue;
-            }
-            if (-point.f[2] < ctx->projection.orthographic.near) {
-                straddle |= TOO_NEAR;
-                continue;
-            }
-            
-            if (point.f[0] > ctx->projection.orthographic.right) {
-                straddle |= TOO_RIGHT;
-                continue;
-            }
-            if (point.f[0] < ctx->projection.orthographic.left) {
-                straddle |= TOO_LEFT;
-                continue;
-            }
-            
-            if (point.f[1] > ctx->projection.orthographic.top) {
-                straddle |= TOO_UP;
-                continue;
-            }
-            if (point.f[1] < ctx->projection.orthographic.bottom) {
-                straddle |= TOO_DOWN;
-                continue;
-            }
-            
-            // Point is in frustum
-            return 1;
-            
+        if (inv_bits & PMDL_INVALIDATE_VIEW) {
+            pmdl_matrix_lookat(&ctx->cached_view_mtx, ctx->camera_view);
         }
         
-        // Perspective testing otherwise
-        else if (ctx->projection_type == PMDL_PERSPECTIVE) {
-            
-            // See if vector exceeds far plane or comes too near
-            if (-point.f[2] > ctx->projection.perspective.far) {
-                straddle |= TOO_FAR;
-                continue;
-            }
-            if (-point.f[2] < ctx->projection.perspective.near) {
-                straddle |= TOO_NEAR;
-                continue;
-            }
-            
-            // Use radar-test to see if point's Y coordinate is within frustum
-            float y_threshold = ctx->f_tanv * (-point.f[2]);
-            if (point.f[1] > y_threshold) {
-                straddle |= TOO_UP;
-                continue;
-            }
-            if (point.f[1] < -y_threshold) {
-                straddle |= TOO_DOWN;
-                continue;
-            }
-            
-            // Same for X coordinate
-            float x_threshold = ctx->f_tanh * (-point.f[2]);
-            if (point.f[0] > x_threshold) {
-                straddle |= TOO_RIGHT;
-                continue;
-            }
-            if (point.f[0] < -x_threshold) {
-                straddle |= TOO_LEFT;
-                continue;
+        if (inv_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW)) {
+            pmdl_matrix34_mul(&ctx->model_mtx, &ctx->cached_view_mtx, &ctx->cached_modelview_mtx.m34);
+            pmdl_matrix34_mul(&ctx->cached_modelview_mtx.m34, (pspl_matrix34_t*)&LH_SWIZZLE_MATRIX, &ctx->cached_modelview_mtx.m34);
+        }
+        
+        if (inv_bits & PMDL_INVALIDATE_PROJECTION) {
+            if (ctx->projection_type == PMDL_PERSPECTIVE) {
+                pmdl_matrix_perspective(&ctx->cached_projection_mtx, ctx->projection.perspective);
+                ctx->f_tanv = tanf(DegToRad(ctx->projection.perspective.fov * 0.5f));
+                ctx->f_tanh = ctx->f_tanv * ctx->projection.perspective.aspect;
+            } else if (ctx->projection_type == PMDL_ORTHOGRAPHIC) {
+                pmdl_matrix_orthographic(&ctx->cached_projection_mtx, ctx->projection.orthographic);
             }
-            
-            // Point is in frustum
-            return 1;
-            
         }
         
     }
     
-    // Perform evaluation of straddle results as last resort
-    int p = 0;
-    if (straddle & TOO_FAR && straddle & TOO_NEAR)
-        ++p;
-    if (straddle & TOO_LEFT && straddle & TOO_RIGHT)
-        ++p;
-    if (straddle & TOO_UP && straddle & TOO_DOWN)
-        ++p;
-    
-    int d = 0;
-    if (LXOR(straddle & TOO_FAR, straddle & TOO_NEAR))
-        ++d;
-    if (LXOR(straddle & TOO_LEFT, straddle & TOO_RIGHT))
-        ++d;
-    if (LXOR(straddle & TOO_UP, straddle & TOO_DOWN))
-        ++d;
-    
-    return ((p-d) >= 1);
+    pmdl_finish_context(ctx, inv_bits);
     
 }
 
+/* Scratch for batched context modelviews (grown on demand) */
+static pspl_matrix34_t* ctx_model_scratch = NULL;
+static pspl_matrix34_t* ctx_mv_scratch = NULL;
+static unsigned* ctx_idx_scratch = NULL;
+static uint8_t* ctx_bits_scratch = NULL;
+static unsigned ctx_scratch_cap = 0;
 
-#pragma mark PMDL Drawing
-
-/* Resolve primitive enumeration */
-#if PSPL_RUNTIME_PLATFORM_GL2
-static inline GLenum resolve_prim(uint32_t prim) {
-    if (prim == PMDL_TRIANGLE_STRIPS)
-        return GL_TRIANGLE_STRIP;
-    else if (prim == PMDL_TRIANGLE_FANS)
-        return GL_TRIANGLE_FAN;
-    else if (prim == PMDL_TRIANGLES)
-        return GL_TRIANGLES;
-    else if (prim == PMDL_LINE_STRIPS)
-        return GL_LINE_STRIP;
-    else if (prim == PMDL_LINES)
-        return GL_LINES;
-    return GL_POINTS;
-}
-#elif PSPL_RUNTIME_PLATFORM_D3D11
-static inline int resolve_prim(uint32_t prim) {
+/* Compute batched modelviews against one camera and finish their contexts */
+static void pmdl_flush_context_batch(pmdl_draw_ctx* array, const pmdl_camera* camera, unsigned count) {
     
-}
-#endif
-
-
-/* Set NULL shader (some sort of fixed-function preset) */
-#if PSPL_RUNTIME_PLATFORM_GL2
-static inline void null_shader(const pmdl_draw_ctx* ctx) {
-    glUseProgram(0);
-}
-#elif PSPL_RUNTIME_PLATFORM_GX
-static inline void null_shader(pmdl_draw_ctx* ctx) {
+    pmdl_matrix34_mul_batch(ctx_model_scratch, &camera->cached_view_swizzle_mtx, ctx_mv_scratch, count);
     
-}
-#elif PSPL_RUNTIME_PLATFORM_D3D11
-static inline void null_shader() {
+    unsigned i;
+    for (i=0 ; i<count ; ++i) {
+        pmdl_draw_ctx* ctx = &array[ctx_idx_scratch[i]];
+        ctx->cached_modelview_mtx.m34 = ctx_mv_scratch[i];
+        pmdl_finish_context(ctx, ctx_bits_scratch[i]);
+    }
     
 }
-#endif
 
-/* This routine will draw PAR0 PMDLs */
-static void pmdl_draw_par0(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
-    pmdl_header* header = pmdl->file_ptr->file_data;
+/* Grow batch scratch to `count` contexts; returns -1 without memory
+ * (blocks already grown are kept) */
+static int pmdl_ctx_scratch_reserve(unsigned count) {
+    if (count <= ctx_scratch_cap)
+        return 0;
+    pspl_matrix34_t* model_scratch = realloc(ctx_model_scratch, sizeof(pspl_matrix34_t)*count);
+    if (model_scratch)
+        ctx_model_scratch = model_scratch;
+    pspl_matrix34_t* mv_scratch = realloc(ctx_mv_scratch, sizeof(pspl_matrix34_t)*count);
+    if (mv_scratch)
+        ctx_mv_scratch = mv_scratch;
+    unsigned* idx_scratch = realloc(ctx_idx_scratch, sizeof(unsigned)*count);
+    if (idx_scratch)
+        ctx_idx_scratch = idx_scratch;
+    uint8_t* bits_scratch = realloc(ctx_bits_scratch, count);
+    if (bits_scratch)
+        ctx_bits_scratch = bits_scratch;
+    if (!model_scratch || !mv_scratch || !idx_scratch || !bits_scratch)
+        return -1;
+    ctx_scratch_cap = count;
+    return 0;
+}
 
-    int i,j,k;
+/* Update array of draw contexts */
+void pmdl_update_context_array(pmdl_draw_ctx* array, unsigned count, enum pmdl_invalidate_bits inv_bits) {
+    unsigned i;
     
-#   if PMDL_GX
-        // Load in GX transformation context here
-        GX_LoadPosMtxImm(ctx->cached_modelview_mtx.m, GX_PNMTX0);
-        GX_LoadNrmMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_PNMTX0);
+    // Without batch scratch, each context is updated alone
+    if (pmdl_ctx_scratch_reserve(count)) {
+        for (i=0 ; i<count ; ++i)
+            pmdl_update_context(&array[i], inv_bits);
+        return;
+    }
     
-        unsigned gx_loaded_texcoord_mats = 0;
+    // Contexts needing a modelview are gathered per camera (runs of
+    // contexts sharing one camera are the common case)
+    const pmdl_camera* batch_camera = NULL;
+    unsigned batch_count = 0;
+    
+    for (i=0 ; i<count ; ++i) {
+        pmdl_draw_ctx* ctx = &array[i];
         
-        GX_LoadProjectionMtx(ctx->cached_projection_mtx.m,
-                             (ctx->projection_type == PMDL_PERSPECTIVE)?
-                             GX_PERSPECTIVE:GX_ORTHOGRAPHIC);
+        if (!ctx->camera) {
+            pmdl_update_context(ctx, inv_bits);
+            continue;
+        }
+        
+        enum pmdl_invalidate_bits ctx_bits = pmdl_sync_context(ctx, inv_bits);
+        if (!ctx_bits)
+            continue;
+        
+        if (!(ctx_bits & (PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_VIEW))) {
+            pmdl_finish_context(ctx, ctx_bits);
+            continue;
+        }
+        
+        if (ctx->camera != batch_camera) {
+            if (batch_count)
+                pmdl_flush_context_batch(array, batch_camera, batch_count);
+            batch_camera = ctx->camera;
+            batch_count = 0;
+        }
+        
+        ctx_model_scratch[batch_count] = ctx->model_mtx;
+        ctx_idx_scratch[batch_count] = i;
+        ctx_bits_scratch[batch_count] = ctx_bits;
+        ++batch_count;
+    }
+    
+    if (batch_count)
+        pmdl_flush_context_batch(array, batch_camera, batch_count);
+    
+}
+
+/* AABB frustum classification results */
+enum pmdl_frustum_class {
+    PMDL_FRUSTUM_OUTSIDE   = 0,
+    PMDL_FRUSTUM_INTERSECT = 1,
+    PMDL_FRUSTUM_INSIDE    = 2
+};
+
+/* Perform AABB frustum classification (centre-extent against each plane) */
+static enum pmdl_frustum_class pmdl_aabb_frustum_classify(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
+    
+    float centre[3] = {
+        (aabb[0][0] + aabb[1][0]) * 0.5f,
+        (aabb[0][1] + aabb[1][1]) * 0.5f,
+        (aabb[0][2] + aabb[1][2]) * 0.5f
+    };
+    float extent[3] = {
+        (aabb[1][0] - aabb[0][0]) * 0.5f,
+        (aabb[1][1] - aabb[0][1]) * 0.5f,
+        (aabb[1][2] - aabb[0][2]) * 0.5f
+    };
+    
+    enum pmdl_frustum_class result = PMDL_FRUSTUM_INSIDE;
+    int i;
+    for (i=0 ; i<6 ; ++i) {
+        const float* plane = ctx->cached_frustum_planes[i].ABCD.f;
+        
+        // Signed centre distance and projected radius
+        float dist = plane[0]*centre[0] + plane[1]*centre[1] + plane[2]*centre[2] + plane[3];
+        float radius = fabsf(plane[0])*extent[0] + fabsf(plane[1])*extent[1] + fabsf(plane[2])*extent[2];
+        
+        if (dist < -radius)
+            return PMDL_FRUSTUM_OUTSIDE;
+        if (dist < radius)
+            result = PMDL_FRUSTUM_INTERSECT;
+    }
+    
+    return result;
+    
+}
+
+/* Perform AABB frustum test */
+static inline int pmdl_aabb_frustum_test(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
+    return pmdl_aabb_frustum_classify(ctx, aabb) != PMDL_FRUSTUM_OUTSIDE;
+}
+
+/* Active occlusion buffer (occlusion culling when set) */
+static const pmdl_occlusion_buffer* occlusion_buffer = NULL;
+
+/* Set (or clear with NULL) active occlusion buffer */
+void pmdl_set_occlusion_buffer(const pmdl_occlusion_buffer* buf) {
+    occlusion_buffer = buf;
+}
+
+/* Perform AABB frustum test, then occlusion test if a buffer is set */
+static inline int pmdl_aabb_visible(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
+    if (!pmdl_aabb_frustum_test(ctx, aabb))
+        return 0;
+    return !occlusion_buffer || pmdl_occlusion_test_aabb(occlusion_buffer, ctx, aabb);
+}
+
+/* Merge skinned bounds of bone into `aabb_out`; vertices weighted to the bone
+ * (clipped to the mesh's bind-pose AABB) are carried through the evaluated
+ * bone matrix exactly as skinning does (`M * (v - base)`) */
+static void pmdl_bone_aabb_merge(const pmdl_animation_ctx* anim_ctx, const pmdl_bone* bone,
+                                 float mesh_aabb[2][3], float aabb_out[2][3]) {
+    
+    // Bind-pose source bounds
+    float src[2][3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        src[0][i] = mesh_aabb[0][i];
+        src[1][i] = mesh_aabb[1][i];
+        if (bone->vert_aabb) {
+            if (bone->vert_aabb[0][i] > src[0][i])
+                src[0][i] = bone->vert_aabb[0][i];
+            if (bone->vert_aabb[1][i] < src[1][i])
+                src[1][i] = bone->vert_aabb[1][i];
+        }
+        
+        // Bone weights no vertices of this mesh
+        if (src[0][i] > src[1][i])
+            return;
+    }
+    
+    // Centre-extent transform
+    const pspl_matrix34_t* mtx = anim_ctx->fk_instance_array[bone->bone_index].bone_matrix;
+    float centre[3], extent[3];
+    for (i=0 ; i<3 ; ++i) {
+        centre[i] = (src[0][i] + src[1][i]) * 0.5f - bone->base_vector->f[i];
+        extent[i] = (src[1][i] - src[0][i]) * 0.5f;
+    }
+    for (i=0 ; i<3 ; ++i) {
+        float c = mtx->m[i][0]*centre[0] + mtx->m[i][1]*centre[1] + mtx->m[i][2]*centre[2] + mtx->m[i][3];
+        float e = fabsf(mtx->m[i][0])*extent[0] + fabsf(mtx->m[i][1])*extent[1] + fabsf(mtx->m[i][2])*extent[2];
+        if (c - e < aabb_out[0][i])
+            aabb_out[0][i] = c - e;
+        if (c + e > aabb_out[1][i])
+            aabb_out[1][i] = c + e;
+    }
+    
+}
+
+/* Perform six-plane test on SoA AABB array; sets bit (i%32) of
+ * `vis_bits_out[i/32]` for each visible AABB and returns visible count.
+ * Vector lanes sum terms in scalar order, so every AABB gets the result
+ * `pmdl_aabb_frustum_classify` would give it */
+static unsigned pmdl_aabb_planes_test_batch(const pmdl_plane_t* planes, const pmdl_aabb_soa_t* aabbs,
+                                            uint32_t* vis_bits_out) {
+    
+    unsigned i,j;
+    unsigned count = aabbs->count;
+    memset(vis_bits_out, 0, ((count+31)/32) * sizeof(uint32_t));
+    
+    const float* cx = aabbs->centre[0];
+    const float* cy = aabbs->centre[1];
+    const float* cz = aabbs->centre[2];
+    const float* ex = aabbs->extent[0];
+    const float* ey = aabbs->extent[1];
+    const float* ez = aabbs->extent[2];
+    
+    i = 0;
+    
+#   if __AVX__
+        // 8 AABBs per iteration
+        {
+            __m256 p_x[6], p_y[6], p_z[6], p_w[6], a_x[6], a_y[6], a_z[6];
+            for (j=0 ; j<6 ; ++j) {
+                const float* plane = planes[j].ABCD.f;
+                p_x[j] = _mm256_set1_ps(plane[0]); a_x[j] = _mm256_set1_ps(fabsf(plane[0]));
+                p_y[j] = _mm256_set1_ps(plane[1]); a_y[j] = _mm256_set1_ps(fabsf(plane[1]));
+                p_z[j] = _mm256_set1_ps(plane[2]); a_z[j] = _mm256_set1_ps(fabsf(plane[2]));
+                p_w[j] = _mm256_set1_ps(plane[3]);
+            }
+            __m256 zero = _mm256_setzero_ps();
+            for (; i+8<=count ; i+=8) {
+                __m256 vcx = _mm256_loadu_ps(&cx[i]), vcy = _mm256_loadu_ps(&cy[i]), vcz = _mm256_loadu_ps(&cz[i]);
+                __m256 vex = _mm256_loadu_ps(&ex[i]), vey = _mm256_loadu_ps(&ey[i]), vez = _mm256_loadu_ps(&ez[i]);
+                __m256 out = zero;
+                for (j=0 ; j<6 ; ++j) {
+                    __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p_x[j], vcx), _mm256_mul_ps(p_y[j], vcy)),
+                                                              _mm256_mul_ps(p_z[j], vcz)), p_w[j]);
+                    __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a_x[j], vex), _mm256_mul_ps(a_y[j], vey)),
+                                                  _mm256_mul_ps(a_z[j], vez));
+                    out = _mm256_or_ps(out, _mm256_cmp_ps(dist, _mm256_sub_ps(zero, radius), _CMP_LT_OQ));
+                }
+                vis_bits_out[i/32] |= (uint32_t)(~_mm256_movemask_ps(out) & 0xff) << (i%32);
+            }
+        }
+#   endif
+    
+#   if __SSE__
+        // 4 AABBs per iteration
+        {
+            __m128 p_x[6], p_y[6], p_z[6], p_w[6], a_x[6], a_y[6], a_z[6];
+            for (j=0 ; j<6 ; ++j) {
+                const float* plane = planes[j].ABCD.f;
+                p_x[j] = _mm_set1_ps(plane[0]); a_x[j] = _mm_set1_ps(fabsf(plane[0]));
+                p_y[j] = _mm_set1_ps(plane[1]); a_y[j] = _mm_set1_ps(fabsf(plane[1]));
+                p_z[j] = _mm_set1_ps(plane[2]); a_z[j] = _mm_set1_ps(fabsf(plane[2]));
+                p_w[j] = _mm_set1_ps(plane[3]);
+            }
+            __m128 zero = _mm_setzero_ps();
+            for (; i+4<=count ; i+=4) {
+                __m128 vcx = _mm_loadu_ps(&cx[i]), vcy = _mm_loadu_ps(&cy[i]), vcz = _mm_loadu_ps(&cz[i]);
+                __m128 vex = _mm_loadu_ps(&ex[i]), vey = _mm_loadu_ps(&ey[i]), vez = _mm_loadu_ps(&ez[i]);
+                __m128 out = zero;
+                for (j=0 ; j<6 ; ++j) {
+                    __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p_x[j], vcx), _mm_mul_ps(p_y[j], vcy)),
+                                                        _mm_mul_ps(p_z[j], vcz)), p_w[j]);
+                    __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a_x[j], vex), _mm_mul_ps(a_y[j], vey)),
+                                               _mm_mul_ps(a_z[j], vez));
+                    out = _mm_or_ps(out, _mm_cmplt_ps(dist, _mm_sub_ps(zero, radius)));
+                }
+                vis_bits_out[i/32] |= (uint32_t)(~_mm_movemask_ps(out) & 0xf) << (i%32);
+            }
+        }
+#   endif
+    
+    // Remaining AABBs
+    for (; i<count ; ++i) {
+        int visible = 1;
+        for (j=0 ; j<6 ; ++j) {
+            const float* plane = planes[j].ABCD.f;
+            float dist = plane[0]*cx[i] + plane[1]*cy[i] + plane[2]*cz[i] + plane[3];
+            float radius = fabsf(plane[0])*ex[i] + fabsf(plane[1])*ey[i] + fabsf(plane[2])*ez[i];
+            if (dist < -radius) {
+                visible = 0;
+                break;
+            }
+        }
+        if (visible)
+            vis_bits_out[i/32] |= 1u << (i%32);
+    }
+    
+    // Visible count
+    unsigned vis_count = 0;
+    for (i=0 ; i<(count+31)/32 ; ++i)
+        vis_count += __builtin_popcount(vis_bits_out[i]);
+    return vis_count;
+    
+}
+
+/* Perform frustum test on SoA AABB array (planes cached by `pmdl_update_context`) */
+unsigned pmdl_aabb_frustum_test_batch(const pmdl_draw_ctx* ctx, const pmdl_aabb_soa_t* aabbs,
+                                      uint32_t* vis_bits_out) {
+    return pmdl_aabb_planes_test_batch(ctx->cached_frustum_planes, aabbs, vis_bits_out);
+}
+
+
+#pragma mark Level of Detail
+
+/* Level-of-detail table offset (0 if absent) */
+static inline uint32_t pmdl_lod_table(const pspl_runtime_arc_file_t* file) {
+    return pmdl_section_offset(file->file_data, file->file_len, "_LOD");
+}
+
+/* Mesh primitive runs of collection at reduced level (1-based) */
+static inline void* pmdl_lod_runs(const pspl_runtime_arc_file_t* file, unsigned lod_level, unsigned collection_idx) {
+    void* file_data = file->file_data;
+    const pmdl_lod_level* levels = file_data + pmdl_lod_table(file) + sizeof(uint32_t);
+    const uint32_t* run_offs = file_data + levels[lod_level-1].run_table_offset;
+    return file_data + run_offs[collection_idx];
+}
+
+/* Projected size of AABB (bounding-sphere diameter) as a fraction of viewport height */
+static float pmdl_projected_size(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
+    const pspl_matrix44_t* mv = &ctx->cached_modelview_mtx;
+    float centre[3], extent[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        centre[i] = (aabb[0][i] + aabb[1][i]) * 0.5f;
+        extent[i] = (aabb[1][i] - aabb[0][i]) * 0.5f;
+    }
+    float radius_sq = 0.0f, depth = 0.0f;
+    for (i=0 ; i<3 ; ++i) {
+        float axis = fabsf(mv->m[i][0])*extent[0] + fabsf(mv->m[i][1])*extent[1] + fabsf(mv->m[i][2])*extent[2];
+        radius_sq += axis * axis;
+    }
+    float radius = sqrtf(radius_sq);
+    
+    if (ctx->projection_type == PMDL_PERSPECTIVE) {
+        depth = -(mv->m[2][0]*centre[0] + mv->m[2][1]*centre[1] + mv->m[2][2]*centre[2] + mv->m[2][3]);
+        if (depth <= radius)
+            return FLT_MAX;
+        return radius / (depth * ctx->f_tanv);
+    }
+    
+    return radius * 2.0f / (ctx->projection.orthographic.top - ctx->projection.orthographic.bottom);
+}
+
+/* Level last selected for each context and model pair (hysteresis state);
+ * direct-mapped, so a pair evicted by another restarts from full detail */
+typedef struct {
+    const pmdl_draw_ctx* ctx;
+    const pmdl_t* pmdl;
+    unsigned level;
+} pmdl_lod_state;
+static pmdl_lod_state lod_states[PMDL_LOD_STATE_SLOTS];
+
+static inline pmdl_lod_state* pmdl_lod_state_slot(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+    uint64_t key = ((uint64_t)(uintptr_t)ctx * 0x9E3779B97F4A7C15ull) ^ (uint64_t)(uintptr_t)pmdl;
+    return &lod_states[((key * 0x9E3779B97F4A7C15ull) >> 32) & (PMDL_LOD_STATE_SLOTS-1)];
+}
+
+/* Select level of detail to draw (0 for full detail); the coarsest level
+ * within tolerance is taken, with hysteresis against the level last
+ * selected for this context and model */
+static unsigned pmdl_select_lod(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+    void* file_data = pmdl->file_ptr->file_data;
+    pmdl_header* header = file_data;
+    uint32_t lod_table_offset = (ctx->lod_tolerance > 0.0f) ? pmdl_lod_table(pmdl->file_ptr) : 0;
+    if (!lod_table_offset)
+        return 0;
+    
+    pmdl_lod_state* state = pmdl_lod_state_slot(ctx, pmdl);
+    unsigned last_level = (state->ctx == ctx && state->pmdl == pmdl) ? state->level : 0;
+    
+    uint32_t level_count = *(uint32_t*)(file_data + lod_table_offset);
+    const pmdl_lod_level* levels = file_data + lod_table_offset + sizeof(uint32_t);
+    float size = pmdl_projected_size(ctx, header->master_aabb);
+    
+    unsigned level;
+    for (level=level_count ; level>0 ; --level) {
+        float limit = ctx->lod_tolerance;
+        if (level > last_level)
+            limit *= 1.0f - PMDL_LOD_HYSTERESIS;
+        if (levels[level-1].error * size <= limit)
+            break;
+    }
+    
+    state->ctx = ctx;
+    state->pmdl = pmdl;
+    state->level = level;
+    return level;
+}
+
+
+#pragma mark Headless Draw Recording
+
+/* Active draw recorder (headless mode when set) */
+static pmdl_draw_recorder* draw_recorder = NULL;
+
+/* Set (or clear with NULL) active draw recorder */
+void pmdl_set_draw_recorder(pmdl_draw_recorder* recorder) {
+    draw_recorder = recorder;
+}
+
+/* Append mesh to active draw recorder */
+static inline void pmdl_record_mesh(const pmdl_t* pmdl, unsigned collection_idx, unsigned mesh_idx,
+                                    unsigned lod_level) {
+    if (draw_recorder->record_count < draw_recorder->record_cap) {
+        pmdl_draw_record* record = &draw_recorder->record_arr[draw_recorder->record_count];
+        record->pmdl = pmdl;
+        record->collection_idx = collection_idx;
+        record->mesh_idx = mesh_idx;
+        record->lod_level = lod_level;
+    }
+    ++draw_recorder->record_count;
+}
+
+/* Get mesh header array (and count) of collection */
+static inline pmdl_mesh_header* pmdl_collection_meshes(void* file_data, unsigned collection_idx,
+                                                       uint32_t* mesh_count_out) {
+    pmdl_header* header = file_data;
+    pmdl_col_header* collection_headers = file_data + header->collection_offset;
+    void* index_buf = file_data + header->collection_offset + collection_headers[collection_idx].draw_idx_off;
+    *mesh_count_out = *(uint32_t*)index_buf;
+    return index_buf+8;
+}
+
+/* Record PAR0 meshes surviving frustum and occlusion tests */
+static void pmdl_record_par0(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl, unsigned lod_level) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    
+    unsigned i,j;
+    for (i=0 ; i<header->collection_count ; ++i) {
+        uint32_t mesh_count;
+        pmdl_mesh_header* mesh_heads = pmdl_collection_meshes(pmdl->file_ptr->file_data, i, &mesh_count);
+        for (j=0 ; j<mesh_count ; ++j)
+            if (pmdl_aabb_visible(ctx, mesh_heads[j].mesh_aabb))
+                pmdl_record_mesh(pmdl, i, j, lod_level);
+    }
+}
+
+
+#pragma mark PMDL Drawing
+
+/* Resolve primitive enumeration */
+#if PSPL_RUNTIME_PLATFORM_GL2
+static inline GLenum resolve_prim(uint32_t prim) {
+    if (prim == PMDL_TRIANGLE_STRIPS)
+        return GL_TRIANGLE_STRIP;
+    else if (prim == PMDL_TRIANGLE_FANS)
+        return GL_TRIANGLE_FAN;
+    else if (prim == PMDL_TRIANGLES)
+        return GL_TRIANGLES;
+    else if (prim == PMDL_LINE_STRIPS)
+        return GL_LINE_STRIP;
+    else if (prim == PMDL_LINES)
+        return GL_LINES;
+    return GL_POINTS;
+}
+#elif PSPL_RUNTIME_PLATFORM_D3D11
+static inline int resolve_prim(uint32_t prim) {
+    
+}
+#endif
+
+
+/* Set NULL shader (some sort of fixed-function preset) */
+#if PSPL_RUNTIME_PLATFORM_GL2
+static inline void null_shader(const pmdl_draw_ctx* ctx) {
+    pspl_gl2_use_program(0);
+}
+#elif PSPL_RUNTIME_PLATFORM_GX
+static inline void null_shader(const pmdl_draw_ctx* ctx) {
+    
+}
+#elif PSPL_RUNTIME_PLATFORM_D3D11
+static inline void null_shader() {
+    
+}
+#endif
+
+#if PSPL_RUNTIME_PLATFORM_GL2
+/* Load draw context's transform uniforms into bound shader
+ * (skipped while the program still holds this context's generation) */
+static inline void gl_load_native_ctx_uniforms(const pmdl_draw_ctx* ctx, GL2_shader_object_t* native_shader) {
+    if (!pspl_gl2_stamp_uniforms(native_shader, ctx, ctx->cached_generation))
+        return;
+    glUniformMatrix4fv(native_shader->mv_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_mtx.m);
+    glUniformMatrix4fv(native_shader->mv_invxpose_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_invxpose_mtx.m);
+    glUniformMatrix4fv(native_shader->proj_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_projection_mtx.m);
+    glUniformMatrix4fv(native_shader->tc_genmtx_arr, native_shader->config->texgen_count,
+                       GL_FALSE, (GLfloat*)ctx->texcoord_mtx);
+}
+static inline void gl_load_ctx_uniforms(const pmdl_draw_ctx* ctx, const pspl_runtime_psplc_t* shader_obj) {
+    gl_load_native_ctx_uniforms(ctx, (GL2_shader_object_t*)&shader_obj->native_shader);
+}
+
+/* Dequantisation terms of float (unquantised) vertex buffers */
+static const pmdl_quant_head IDENTITY_QUANT = {
+    .scale = {1.0, 1.0, 1.0, 0.0},
+    .bias = {0.0, 0.0, 0.0, 0.0}
+};
+
+/* Load collection's vertex dequantisation terms into bound shader
+ * (skipped while the program still holds this collection's terms) */
+static inline void gl_load_native_vert_format(GL2_shader_object_t* native_shader, const void* collection_buf,
+                                              const pmdl_col_header* collection_header) {
+    const pmdl_quant_head* quant = NULL;
+    if (collection_header->uv_count & PMDL_COL_QUANTISED)
+        quant = collection_buf + collection_header->vert_buf_off;
+    if (native_shader->loaded_dequant == quant)
+        return;
+    native_shader->loaded_dequant = quant;
+    glUniform4fv(native_shader->pos_dequant_uni, 2, (quant)?quant->scale:IDENTITY_QUANT.scale);
+}
+static inline void gl_load_vert_format(const pspl_runtime_psplc_t* shader_obj, const void* collection_buf,
+                                       const pmdl_col_header* collection_header) {
+    gl_load_native_vert_format((GL2_shader_object_t*)&shader_obj->native_shader, collection_buf, collection_header);
+}
+#endif
+
+#if PMDL_GX
+/* Load context's modelview and projection transforms */
+static inline void gx_load_ctx_transforms(const pmdl_draw_ctx* ctx) {
+    GX_LoadPosMtxImm(ctx->cached_modelview_mtx.m, GX_PNMTX0);
+    GX_LoadNrmMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_PNMTX0);
+    GX_LoadProjectionMtx(ctx->cached_projection_mtx.m,
+                         (ctx->projection_type == PMDL_PERSPECTIVE)?
+                         GX_PERSPECTIVE:GX_ORTHOGRAPHIC);
+}
+
+/* Load context's texture coordinate matrices read by shader, past the
+ * `*loaded_mats` already loaded (and the normal matrix of normal texgens) */
+static inline void gx_load_texcoord_mats(const pmdl_draw_ctx* ctx, const pspl_runtime_psplc_t* shader_obj,
+                                         unsigned* loaded_mats) {
+    unsigned k;
+    if (shader_obj->native_shader.texgen_count > *loaded_mats) {
+        for (k=*loaded_mats ; k<shader_obj->native_shader.texgen_count ; ++k) {
+            GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_TEXMTX0 + (k*3), GX_MTX2x4);
+            if (shader_obj->native_shader.using_texcoord_normal)
+                GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_DTTMTX0 + (k*3), GX_MTX3x4);
+        }
+        *loaded_mats = shader_obj->native_shader.texgen_count;
+    }
+    if (shader_obj->native_shader.using_texcoord_normal)
+        GX_LoadTexMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_TEXMTX9, GX_MTX3x4);
+}
+#endif
+
+/* Bind collection's vertex data for drawing; `index_buf` is the drawing
+ * index past its mesh headers (where GL buffer names are kept) */
+static void pmdl_bind_collection(const void* collection_buf, const pmdl_col_header* collection_header,
+                                 const void* index_buf) {
+#   if PSPL_RUNTIME_PLATFORM_GL2
+        const struct gl_bufs_t* gl_bufs = index_buf;
+        GLVAO(glBindVertexArray)(gl_bufs->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, gl_bufs->vert_buf);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_bufs->elem_buf);
+#   elif PSPL_RUNTIME_PLATFORM_D3D11
+    
+#   elif PMDL_GX
+        int j;
+    
+        // Set GX Attribute Table
+        GX_ClearVtxDesc();
+        
+        GX_SetVtxDesc(GX_VA_POS, GX_INDEX16);
+        GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
+    
+        GX_SetVtxDesc(GX_VA_NRM, GX_INDEX16);
+        GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, GX_F32, 0);
+
+        for (j=0 ; j<collection_header->uv_count ; ++j) {
+            GX_SetVtxDesc(GX_VA_TEX0+j, GX_INDEX16);
+            GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0+j, GX_TEX_ST, GX_F32, 0);
+        }
+        
+        
+        // Load in GX buffer context here
+        const void* vert_buf = collection_buf + collection_header->vert_buf_off;
+        uint32_t vert_count = *(uint32_t*)vert_buf;
+        uint32_t loop_vert_count = *(uint32_t*)(vert_buf+4);
+        vert_buf += 32;
+        GX_SetArray(GX_VA_POS, (void*)vert_buf, 12);
+        vert_buf += vert_count * 12;
+        GX_SetArray(GX_VA_NRM, (void*)vert_buf, 12);
+        vert_buf += vert_count * 12;
+    
+        for (j=0 ; j<collection_header->uv_count ; ++j) {
+            GX_SetArray(GX_VA_TEX0+j, (void*)vert_buf, 8);
+            vert_buf += loop_vert_count * 8;
+        }
+    
+        GX_InvVtxCache();
+#   endif
+}
+
+/* Bind shader of mesh in bound collection, along with the context and
+ * vertex-format state it reads; shaderless meshes (`mesh_shader` NULL)
+ * take the context's default shader, or the null shader without one.
+ * Returns shader bound (NULL for the null shader) */
+static const pspl_runtime_psplc_t* pmdl_bind_mesh_shader(const pmdl_draw_ctx* ctx, const pspl_runtime_psplc_t* mesh_shader,
+                                                         const void* collection_buf, const pmdl_col_header* collection_header,
+                                                         unsigned* gx_loaded_texcoord_mats) {
+    const pspl_runtime_psplc_t* shader_obj = (mesh_shader) ? mesh_shader : ctx->default_shader;
+    if (!shader_obj) {
+        null_shader(ctx);
+        return NULL;
+    }
+    
+#   if PMDL_GX
+        gx_load_texcoord_mats(ctx, shader_obj, gx_loaded_texcoord_mats);
+#   endif
+    
+    pspl_runtime_bind_psplc(shader_obj);
+    
+#   if PSPL_RUNTIME_PLATFORM_GL2
+        gl_load_ctx_uniforms(ctx, shader_obj);
+        gl_load_vert_format(shader_obj, collection_buf, collection_header);
+#   elif PSPL_RUNTIME_PLATFORM_D3D11
+    
+#   endif
+    
+    return shader_obj;
+}
+
+#if PMDL_GENERAL
+/* Draw mesh primitives (from bound collection) */
+static inline void pmdl_draw_prims(const pmdl_general_prim* prims, uint32_t prim_count) {
+    uint32_t k;
+    for (k=0 ; k<prim_count ; ++k) {
+#       if PSPL_RUNTIME_PLATFORM_GL2
+            glDrawElements(resolve_prim(prims[k].prim_type), prims[k].prim_count, GL_UNSIGNED_SHORT,
+                           (GLvoid*)(GLsizeiptr)(prims[k].prim_start_idx*2));
+#       elif PSPL_RUNTIME_PLATFORM_D3D11
+        
+#       endif
+    }
+}
+#endif
+
+/* This routine will draw PAR0 PMDLs (at the given level of detail) */
+static void pmdl_draw_par0(pmdl_draw_ctx* ctx, const pmdl_t* pmdl, unsigned lod_level) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+
+    int i,j;
     
+#   if PMDL_GX
+        // Load in GX transformation context here
+        gx_load_ctx_transforms(ctx);
+        unsigned gx_loaded_texcoord_mats = 0;
 #   endif
     
     
     void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
-    pmdl_col_header* collection_header = collection_buf;
+    pmdl_col_header* collection_headers = collection_buf;
     for (i=0 ; i<header->collection_count; ++i) {
+        pmdl_col_header* collection_header = &collection_headers[i];
         
         void* index_buf = collection_buf + collection_header->draw_idx_off;
         
@@ -782,71 +1606,33 @@ static void pmdl_draw_par0(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
         pmdl_mesh_header* mesh_heads = index_buf+8;
         index_buf += index_buf_offset;
         
+        pmdl_bind_collection(collection_buf, collection_header, index_buf);
+        
 #       if PMDL_GENERAL
         
-            // Platform specific index buffer array
-#           if PSPL_RUNTIME_PLATFORM_GL2
-                struct gl_bufs_t* gl_bufs = index_buf;
-                GLVAO(glBindVertexArray)(gl_bufs->vao);
-                glBindBuffer(GL_ARRAY_BUFFER, gl_bufs->vert_buf);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_bufs->elem_buf);
-#           elif PSPL_RUNTIME_PLATFORM_D3D11
-            
-#           endif
             index_buf += header->pointer_size*3;
+            
+            // Reduced level's primitive runs stand in for the collection's own
+            if (lod_level)
+                index_buf = pmdl_lod_runs(pmdl->file_ptr, lod_level, i);
 
             
             for (j=0 ; j<mesh_count ; ++j) {
                 pmdl_mesh_header* mesh_head = &mesh_heads[j];
                 
-                // Primitive count
+                // Primitive run
                 uint32_t prim_count = *(uint32_t*)index_buf;
-                index_buf += sizeof(uint32_t);
+                pmdl_general_prim* prims = index_buf + sizeof(uint32_t);
+                index_buf += sizeof(uint32_t) + sizeof(pmdl_general_prim) * prim_count;
                 
-                // Frustum test
-                if (!pmdl_aabb_frustum_test(ctx, mesh_head->mesh_aabb)) {
-                    index_buf += sizeof(pmdl_general_prim) * prim_count;
+                // Frustum and occlusion test
+                if (!pmdl_aabb_visible(ctx, mesh_head->mesh_aabb))
                     continue;
-                }
-                
-                // Apply mesh context
-                const pspl_runtime_psplc_t* shader_obj = NULL;
-                if (mesh_head->shader_index < 0) {
-                    if (ctx->default_shader)
-                        shader_obj = ctx->default_shader;
-                    else
-                        null_shader(ctx);
-                } else
-                    shader_obj = mesh_head->shader_pointer;
-                
-                if (shader_obj) {
-                    pspl_runtime_bind_psplc(shader_obj);
-                    
-#                   if PSPL_RUNTIME_PLATFORM_GL2
-                        glUniformMatrix4fv(shader_obj->native_shader.mv_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.mv_invxpose_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_invxpose_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.proj_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_projection_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.tc_genmtx_arr,
-                                           shader_obj->native_shader.config->texgen_count,
-                                           GL_FALSE, (GLfloat*)ctx->texcoord_mtx);
-                    
-#                   elif PSPL_RUNTIME_PLATFORM_D3D11
-                    
-#                   endif
-                }
                 
-                // Iterate primitives
-                for (k=0 ; k<prim_count ; ++k) {
-                    pmdl_general_prim* prim = index_buf;
-                    index_buf += sizeof(pmdl_general_prim);
-#                   if PSPL_RUNTIME_PLATFORM_GL2
-                        glDrawElements(resolve_prim(prim->prim_type), prim->prim_count, GL_UNSIGNED_SHORT,
-                                       (GLvoid*)(GLsizeiptr)(prim->prim_start_idx*2));
-#                   elif PSPL_RUNTIME_PLATFORM_D3D11
-                    
-#                   endif
-                    
-                }
+                // Apply mesh context and draw
+                pmdl_bind_mesh_shader(ctx, (mesh_head->shader_index < 0) ? NULL : mesh_head->shader_pointer,
+                                      collection_buf, collection_header, NULL);
+                pmdl_draw_prims(prims, prim_count);
                 
             }
             
@@ -854,115 +1640,27 @@ static void pmdl_draw_par0(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
         
 #       elif PMDL_GX
         
-            // Set GX Attribute Table
-            GX_ClearVtxDesc();
-            
-            GX_SetVtxDesc(GX_VA_POS, GX_INDEX16);
-            GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
-        
-            GX_SetVtxDesc(GX_VA_NRM, GX_INDEX16);
-            GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_NRM, GX_NRM_XYZ, GX_F32, 0);
-
-            for (j=0 ; j<collection_header->uv_count ; ++j) {
-                GX_SetVtxDesc(GX_VA_TEX0+j, GX_INDEX16);
-                GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_TEX0+j, GX_TEX_ST, GX_F32, 0);
-            }
-            
-            
-            // Load in GX buffer context here
-            void* vert_buf = collection_buf + collection_header->vert_buf_off;
-            uint32_t vert_count = *(uint32_t*)vert_buf;
-            uint32_t loop_vert_count = *(uint32_t*)(vert_buf+4);
-            vert_buf += 32;
-            GX_SetArray(GX_VA_POS, vert_buf, 12);
-            vert_buf += vert_count * 12;
-            GX_SetArray(GX_VA_NRM, vert_buf, 12);
-            vert_buf += vert_count * 12;
-        
-            for (j=0 ; j<collection_header->uv_count ; ++j) {
-                GX_SetArray(GX_VA_TEX0+j, vert_buf, 8);
-                vert_buf += loop_vert_count * 8;
-            }
-        
-            GX_InvVtxCache();
-        
-            // Offset anchor for display list buffers
-            void* buf_anchor = index_buf;
+            // Offset anchor for display list buffers
+            void* buf_anchor = index_buf;
+            pmdl_gx_mesh* gx_meshes = index_buf;
         
             // Iterate each mesh
             for (j=0 ; j<mesh_count ; ++j) {
                 pmdl_mesh_header* mesh_head = &mesh_heads[j];
-                pmdl_gx_mesh* gx_mesh = index_buf;
                 
-                // Frustum test
-                if (!pmdl_aabb_frustum_test(ctx, mesh_head->mesh_aabb)) {
-                    index_buf += sizeof(pmdl_gx_mesh);
+                // Frustum and occlusion test
+                if (!pmdl_aabb_visible(ctx, mesh_head->mesh_aabb))
                     continue;
-                }
-                
-                // Apply mesh context
-                const pspl_runtime_psplc_t* shader_obj = NULL;
-                if (mesh_head->shader_index < 0) {
-                    if (ctx->default_shader)
-                        shader_obj = ctx->default_shader;
-                    else
-                        null_shader(ctx);
-                } else
-                    shader_obj = mesh_head->shader_pointer;
-                
-                if (shader_obj) {
-                    
-                    // Load remaining texture coordinate matrices here
-                    if (shader_obj->native_shader.texgen_count > gx_loaded_texcoord_mats) {
-                        for (k=gx_loaded_texcoord_mats ; k<shader_obj->native_shader.texgen_count ; ++k) {
-                            GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_TEXMTX0 + (k*3), GX_MTX2x4);
-                            if (shader_obj->native_shader.using_texcoord_normal)
-                                GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_DTTMTX0 + (k*3), GX_MTX3x4);
-                        }
-                        gx_loaded_texcoord_mats = shader_obj->native_shader.texgen_count;
-                    }
-                    
-                    if (shader_obj->native_shader.using_texcoord_normal)
-                        GX_LoadTexMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_TEXMTX9, GX_MTX3x4);
-
-                    
-                    // Execute shader Display List
-                    pspl_runtime_bind_psplc(shader_obj);
-
-                }
-                
-                //GX_SetTexCoordGen2(GX_TEXCOORD0, GX_TG_MTX3x4, GX_TG_NRM, GX_TEXMTX9, GX_TRUE, GX_DTTMTX0);
-                //GX_SetNumTexGens(1);
-                
-                /*
-                GX_SetTevOrder(GX_TEVSTAGE0, GX_TEXCOORD0, GX_TEXMAP0, GX_COLORNULL);
-                GX_SetTevColorOp(GX_TEVSTAGE0, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1, GX_TRUE, GX_TEVPREV);
-                GX_SetTevColorIn(GX_TEVSTAGE0, GX_CC_TEXC, GX_CC_ZERO, GX_CC_ZERO, GX_CC_ZERO);
-                //GX_SetTevAlphaOp(GX_TEVSTAGE0, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1, GX_TRUE, GX_TEVPREV);
-                //GX_SetTevAlphaIn(GX_TEVSTAGE0, GX_CA_TEXA, GX_CA_ZERO, GX_CA_ZERO, GX_CA_ZERO);
-                
-                GX_SetTevOrder(GX_TEVSTAGE1, GX_TEXCOORD0, GX_TEXMAP1, GX_COLORNULL);
-                GX_SetTevColorOp(GX_TEVSTAGE1, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1, GX_TRUE, GX_TEVPREV);
-                GX_SetTevColorIn(GX_TEVSTAGE1, GX_CC_TEXC, GX_CC_ZERO, GX_CC_ZERO, GX_CC_CPREV);
-                //GX_SetTevAlphaOp(GX_TEVSTAGE1, GX_TEV_ADD, GX_TB_ZERO, GX_CS_SCALE_1, GX_TRUE, GX_TEVPREV);
-                //GX_SetTevAlphaIn(GX_TEVSTAGE1, GX_CA_TEXA, GX_CA_ZERO, GX_CA_ZERO, GX_CA_APREV);
-                */
-                 
-                //GX_SetNumTevStages(2);
-                
-                
-                // Draw Mesh
-                GX_CallDispList(buf_anchor + gx_mesh->dl_offset, gx_mesh->dl_length);
                 
-                index_buf += sizeof(pmdl_gx_mesh);
+                // Apply mesh context and draw
+                pmdl_bind_mesh_shader(ctx, (mesh_head->shader_index < 0) ? NULL : mesh_head->shader_pointer,
+                                      collection_buf, collection_header, &gx_loaded_texcoord_mats);
+                GX_CallDispList(buf_anchor + gx_meshes[j].dl_offset, gx_meshes[j].dl_length);
                 
             }
         
 #       endif
         
-        // ADVANCE!!
-        collection_header += sizeof(pmdl_col_header);
-        
     }
 }
 
@@ -972,6 +1670,7 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
     pmdl_header* header = pmdl->file_ptr->file_data;
     if (header->sub_type_num != '1')
         return;
+    unsigned lod_level = pmdl_select_lod(ctx, pmdl);
 
     int i,j,k,l;
     
@@ -979,12 +1678,7 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
 #   if PMDL_GX
         // Load in GX transformation context here
 
-        GX_LoadPosMtxImm(ctx->cached_modelview_mtx.m, GX_PNMTX0);
-        GX_LoadNrmMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_PNMTX0);
-    
-        GX_LoadProjectionMtx(ctx->cached_projection_mtx.m,
-                             (ctx->projection_type == PMDL_PERSPECTIVE)?
-                             GX_PERSPECTIVE:GX_ORTHOGRAPHIC);
+        gx_load_ctx_transforms(ctx);
     
         unsigned gx_loaded_texcoord_mats = 0;
         GX_SetArray(GX_TEXMTXARRAY, &ctx->texcoord_mtx, 64);
@@ -1020,6 +1714,10 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
             
 #           endif
             index_buf += header->pointer_size*3;
+            
+            // Reduced level's primitive runs stand in for the collection's own
+            if (lod_level)
+                index_buf = pmdl_lod_runs(pmdl->file_ptr, lod_level, i);
 
             
             for (j=0 ; j<mesh_count ; ++j) {
@@ -1029,13 +1727,28 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
                 uint32_t prim_count = *(uint32_t*)index_buf;
                 index_buf += sizeof(uint32_t);
                 
-                // Frustum test
-                /*
-                if (!pmdl_aabb_frustum_test(ctx, mesh_head->mesh_aabb)) {
+                // Frustum and occlusion test against skinned bounds; identity blend keeps bind-pose
+                // AABB in the union, with the bones of each referenced skin entry merged in
+                float skinned_aabb[2][3];
+                memcpy(skinned_aabb, mesh_head->mesh_aabb, sizeof(skinned_aabb));
+                if (anim_ctx) {
+                    int32_t last_skin_index = -1;
+                    for (k=0 ; k<prim_count ; ++k) {
+                        pmdl_general_prim_par1* prim = index_buf + sizeof(pmdl_general_prim_par1) * k;
+                        if (last_skin_index == prim->skin_idx)
+                            continue;
+                        last_skin_index = prim->skin_idx;
+                        const pmdl_skin_entry* skin_entry =
+                        &anim_ctx->parent_ctx->skin_entry_array[last_skin_index];
+                        for (l=0 ; l<skin_entry->bone_count ; ++l)
+                            pmdl_bone_aabb_merge(anim_ctx, skin_entry->bone_array[l],
+                                                 mesh_head->mesh_aabb, skinned_aabb);
+                    }
+                }
+                if (!pmdl_aabb_visible(ctx, skinned_aabb)) {
                     index_buf += sizeof(pmdl_general_prim_par1) * prim_count;
                     continue;
                 }
-                 */
                 
                 // Apply mesh context
                 const pspl_runtime_psplc_t* shader_obj = NULL;
@@ -1051,12 +1764,8 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
                     pspl_runtime_bind_psplc(shader_obj);
                     
 #                   if PSPL_RUNTIME_PLATFORM_GL2
-                        glUniformMatrix4fv(shader_obj->native_shader.mv_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.mv_invxpose_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_modelview_invxpose_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.proj_mtx_uni, 1, GL_FALSE, (GLfloat*)ctx->cached_projection_mtx.m);
-                        glUniformMatrix4fv(shader_obj->native_shader.tc_genmtx_arr,
-                                           shader_obj->native_shader.config->texgen_count,
-                                           GL_FALSE, (GLfloat*)ctx->texcoord_mtx);
+                        gl_load_ctx_uniforms(ctx, shader_obj);
+                        gl_load_vert_format(shader_obj, collection_buf, collection_header);
                     
 #                   elif PSPL_RUNTIME_PLATFORM_D3D11
                     
@@ -1064,44 +1773,40 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
                 }
                 
                 // Iterate primitives
-                int32_t last_skin_index = -1;
                 for (k=0 ; k<prim_count ; ++k) {
                     pmdl_general_prim_par1* prim = index_buf;
                     index_buf += sizeof(pmdl_general_prim_par1);
                     
-                    // Load evaluated bones from skinning entry into GPU
-                    pspl_matrix44_t bone_mats[PMDL_MAX_BONES];
-                    pspl_vector4_t bone_bases[PMDL_MAX_BONES];
-                    if (last_skin_index != prim->skin_idx) {
-                        last_skin_index = prim->skin_idx;
+                    // Reference skin entry's palette (built at animation evaluation);
+                    // uploaded only if the bound shader holds a different palette
+                    if (shader_obj) {
+                        const pspl_matrix44_t* palette = IDENTITY_MATS;
+                        const pspl_vector4_t* palette_bases = NULL;
+                        unsigned palette_count = PMDL_MAX_BONES;
+                        unsigned palette_gen = 0;
                         if (anim_ctx) {
                             const pmdl_skin_entry* skin_entry =
-                            &anim_ctx->parent_ctx->skin_entry_array[last_skin_index];
-                            for (l=0 ; l<skin_entry->bone_count ; ++l) {
-                                const pmdl_bone* bone = skin_entry->bone_array[l];
-                                const pmdl_fk_playback* bone_fk = &anim_ctx->fk_instance_array[bone->bone_index];
-                                pmdl_matrix34_cpy(bone_fk->bone_matrix->v, bone_mats[l].v);
-                                pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, bone_mats[l].v[3]);
-                                pmdl_vector4_cpy(bone->base_vector->v, bone_bases[l].v);
-                            }
-#                           if PSPL_RUNTIME_PLATFORM_GL2
-                                glUniformMatrix4fv(shader_obj->native_shader.bone_mat_uni,
-                                                   skin_entry->bone_count, GL_FALSE, (GLfloat*)bone_mats);
-                                glUniform4fv(shader_obj->native_shader.bone_base_uni, skin_entry->bone_count,
-                                             (GLfloat*)bone_bases);
-#                           elif PSPL_RUNTIME_PLATFORM_D3D11
-                            
-#                           endif
-                            
-                        } else {
-#                           if PSPL_RUNTIME_PLATFORM_GL2
-                                glUniformMatrix4fv(shader_obj->native_shader.bone_mat_uni, PMDL_MAX_BONES,
-                                                   GL_FALSE, (GLfloat*)IDENTITY_MATS);
-#                           elif PSPL_RUNTIME_PLATFORM_D3D11
-                            
-#                           endif
+                            &anim_ctx->parent_ctx->skin_entry_array[prim->skin_idx];
+                            palette = &anim_ctx->skin_palette_array[skin_entry->palette_offset];
+                            palette_bases = &anim_ctx->parent_ctx->skin_base_array[skin_entry->palette_offset];
+                            palette_count = skin_entry->bone_count;
+                            palette_gen = anim_ctx->palette_generation;
                         }
-
+#                       if PSPL_RUNTIME_PLATFORM_GL2
+                            GL2_shader_object_t* native_shader = (GL2_shader_object_t*)&shader_obj->native_shader;
+                            if (native_shader->loaded_bone_palette != palette ||
+                                native_shader->loaded_bone_palette_gen != palette_gen) {
+                                glUniformMatrix4fv(native_shader->bone_mat_uni, palette_count,
+                                                   GL_FALSE, (GLfloat*)palette);
+                                if (palette_bases)
+                                    glUniform4fv(native_shader->bone_base_uni, palette_count,
+                                                 (GLfloat*)palette_bases);
+                                native_shader->loaded_bone_palette = palette;
+                                native_shader->loaded_bone_palette_gen = palette_gen;
+                            }
+#                       elif PSPL_RUNTIME_PLATFORM_D3D11
+                        
+#                       endif
                     }
                     
 #                   if PSPL_RUNTIME_PLATFORM_GL2
@@ -1272,13 +1977,19 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
                 pmdl_mesh_header* mesh_head = &mesh_heads[j];
                 pmdl_gx_mesh* gx_mesh = index_buf;
                 
-                // Frustum test
-                /*
-                if (!pmdl_aabb_frustum_test(ctx, mesh_head->mesh_aabb)) {
+                // Frustum and occlusion test against skinned bounds; GX stores no skin entries,
+                // so every bone is merged (each clipped to its weighted vertices)
+                float skinned_aabb[2][3];
+                memcpy(skinned_aabb, mesh_head->mesh_aabb, sizeof(skinned_aabb));
+                if (anim_ctx) {
+                    for (k=0 ; k<pmdl->rigging_ptr->bone_count ; ++k)
+                        pmdl_bone_aabb_merge(anim_ctx, &pmdl->rigging_ptr->bone_array[k],
+                                             mesh_head->mesh_aabb, skinned_aabb);
+                }
+                if (!pmdl_aabb_visible(ctx, skinned_aabb)) {
                     index_buf += sizeof(pmdl_gx_mesh);
                     continue;
                 }
-                 */
                 
                 // Apply mesh context
                 const pspl_runtime_psplc_t* shader_obj = NULL;
@@ -1361,29 +2072,1356 @@ void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
     }
 }
 
-/* This routine will draw PAR2 PMDLs */
-static void pmdl_draw_par2(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+#pragma mark CPU Skinning
+
+/* Vertices skinned per worker job */
+#define SKIN_CHUNK_VERTS 1024
+
+/* Marks general-format vertices not referenced by any primitive */
+#define SKIN_NO_ENTRY 0xffff
+
+/* Bone palette entry; matrix stored as columns for multiply-add
+ * accumulation with the bone's base subtracted from each position */
+typedef struct {
+    pspl_vector4_t col[4];
+    pspl_vector4_t base;
+} pmdl_skin_bone;
+
+/* Worker job skinning a contiguous vertex range */
+struct skin_job {
+    pspl_job_t job;
+    const pmdl_skin_bone* palette;
+    unsigned vert_start, vert_count;
+    float* position_out;
+    float* normal_out;
+#   if PMDL_GENERAL
+        const void* vert_buf;
+        const pmdl_quant_head* quant;
+        unsigned vert_stride;
+        unsigned weight_off;
+        unsigned weight_count;
+        const uint16_t* vert_skin;
+        const pmdl_skin_entry* skin_entry_array;
+#   elif PMDL_GX
+        const f32* position_arr;
+        const f32* normal_arr;
+        const void* first_vert_head;
+#   endif
+};
+
+/* Accumulate one weighted bone transform of position and normal */
+static inline void skin_accumulate(const pmdl_skin_bone* bone, float weight,
+                                   const pspl_vector4_t* pos, const pspl_vector4_t* norm,
+                                   pspl_vector4_t* pos_acc, pspl_vector4_t* norm_acc) {
+    pspl_vector4_t d = {.v = pos->v - bone->base.v};
+    pos_acc->v += (bone->col[0].v*d.f[0] + bone->col[1].v*d.f[1] +
+                   bone->col[2].v*d.f[2] + bone->col[3].v) * weight;
+    norm_acc->v += (bone->col[0].v*norm->f[0] + bone->col[1].v*norm->f[1] +
+                    bone->col[2].v*norm->f[2]) * weight;
+}
+
+/* Store skinned vertex (normal re-normalised) */
+static inline void skin_store(struct skin_job* job, unsigned idx,
+                              const pspl_vector4_t* pos_acc, pspl_vector4_t* norm_acc) {
+    float len = sqrtf(norm_acc->f[0]*norm_acc->f[0] + norm_acc->f[1]*norm_acc->f[1] +
+                      norm_acc->f[2]*norm_acc->f[2]);
+    if (len > 0.0f)
+        norm_acc->v *= 1.0f / len;
+    float* pos_out = &job->position_out[3*idx];
+    float* norm_out = &job->normal_out[3*idx];
+    pos_out[0] = pos_acc->f[0]; pos_out[1] = pos_acc->f[1]; pos_out[2] = pos_acc->f[2];
+    norm_out[0] = norm_acc->f[0]; norm_out[1] = norm_acc->f[1]; norm_out[2] = norm_acc->f[2];
+}
+
+#if PMDL_GENERAL
+/* Decode quantised vertex position and octahedral normal (as the vertex shader does) */
+static inline void skin_dequantise(const pmdl_quant_head* quant, const int16_t* vert,
+                                   pspl_vector4_t* pos, pspl_vector4_t* norm) {
+    int i;
+    for (i=0 ; i<3 ; ++i)
+        pos->f[i] = fmaxf(vert[i] / 32767.0f, -1.0f) * quant->scale[i] + quant->bias[i];
+    pos->f[3] = 0;
+    
+    float x = fmaxf(vert[4] / 32767.0f, -1.0f);
+    float y = fmaxf(vert[5] / 32767.0f, -1.0f);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    if (z < 0.0f) {
+        x += (x >= 0.0f) ? z : -z;
+        y += (y >= 0.0f) ? z : -z;
+    }
+    float len = sqrtf(x*x + y*y + z*z);
+    norm->f[0] = x / len; norm->f[1] = y / len; norm->f[2] = z / len; norm->f[3] = 0;
+}
+
+/* Vertex's bone weight coefficient */
+static inline float skin_weight(const struct skin_job* job, const void* vert, unsigned idx) {
+    if (job->quant)
+        return ((const uint8_t*)(vert + job->weight_off))[idx] / 255.0f;
+    return ((const float*)(vert + job->weight_off))[idx];
+}
+#endif
+
+static void skin_job_func(struct skin_job* job) {
+    unsigned i,j;
+    
+#   if PMDL_GENERAL
+        for (i=job->vert_start ; i<job->vert_start+job->vert_count ; ++i) {
+            const void* vert_ptr = job->vert_buf + job->vert_stride*i;
+            pspl_vector4_t pos, norm;
+            if (job->quant)
+                skin_dequantise(job->quant, vert_ptr, &pos, &norm);
+            else {
+                const float* vert = vert_ptr;
+                pos = (pspl_vector4_t){.f[0]=vert[0], .f[1]=vert[1], .f[2]=vert[2], .f[3]=0};
+                norm = (pspl_vector4_t){.f[0]=vert[3], .f[1]=vert[4], .f[2]=vert[5], .f[3]=0};
+            }
+            pspl_vector4_t pos_acc, norm_acc;
+            
+            if (job->vert_skin[i] == SKIN_NO_ENTRY || !job->weight_count) {
+                pos_acc = pos;
+                norm_acc = norm;
+            } else {
+                // First weight is the identity blend; remaining weights follow skin entry bones
+                float identity_blend = skin_weight(job, vert_ptr, 0);
+                pos_acc.v = pos.v * identity_blend;
+                norm_acc.v = norm.v * identity_blend;
+                const pmdl_skin_entry* skin_entry = &job->skin_entry_array[job->vert_skin[i]];
+                unsigned weight_count = job->weight_count - 1;
+                if (skin_entry->bone_count < weight_count)
+                    weight_count = skin_entry->bone_count;
+                for (j=0 ; j<weight_count ; ++j) {
+                    float weight = skin_weight(job, vert_ptr, j+1);
+                    if (weight == 0.0f)
+                        continue;
+                    skin_accumulate(&job->palette[skin_entry->bone_array[j]->bone_index], weight,
+                                    &pos, &norm, &pos_acc, &norm_acc);
+                }
+            }
+            
+            skin_store(job, i, &pos_acc, &norm_acc);
+        }
     
+#   elif PMDL_GX
+        const void* vert_head_cur = job->first_vert_head;
+        for (i=job->vert_start ; i<job->vert_start+job->vert_count ; ++i) {
+            const pmdl_gx_par1_vert_head* vert_head = vert_head_cur;
+            const f32* vert = &job->position_arr[3*i];
+            const f32* nrm = &job->normal_arr[3*i];
+            pspl_vector4_t pos = {.f[0]=vert[0], .f[1]=vert[1], .f[2]=vert[2], .f[3]=0};
+            pspl_vector4_t norm = {.f[0]=nrm[0], .f[1]=nrm[1], .f[2]=nrm[2], .f[3]=0};
+            pspl_vector4_t pos_acc = {.v = pos.v * vert_head->identity_blend};
+            pspl_vector4_t norm_acc = {.v = norm.v * vert_head->identity_blend};
+            for (j=0 ; j<vert_head->bone_count ; ++j)
+                skin_accumulate(&job->palette[vert_head->bone_arr[j].bone_idx],
+                                vert_head->bone_arr[j].bone_weight,
+                                &pos, &norm, &pos_acc, &norm_acc);
+            skin_store(job, i, &pos_acc, &norm_acc);
+            vert_head_cur += 8*vert_head->bone_count + 8;
+        }
+    
+#   endif
 }
 
-/* This is the main draw dispatch routine */
-void pmdl_draw(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+/* Vertex count of collection (entries in CPU skinning output arrays) */
+unsigned pmdl_collection_vertex_count(const pmdl_t* pmdl, unsigned collection_idx) {
     pmdl_header* header = pmdl->file_ptr->file_data;
+    if (collection_idx >= header->collection_count)
+        return 0;
+    void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
+    pmdl_col_header* collection_header = &((pmdl_col_header*)collection_buf)[collection_idx];
+#   if PMDL_GENERAL
+        return (collection_header->vert_buf_len - pmdl_general_vert_base(collection_header)) /
+               pmdl_general_vert_stride(collection_header);
+#   elif PMDL_GX
+        return *(uint32_t*)(collection_buf + collection_header->vert_buf_off + 4);
+#   else
+        return 0;
+#   endif
+}
 
-    // Master Frustum test
-    if (!pmdl_aabb_frustum_test(ctx, header->master_aabb))
-        return;
+#if PMDL_GENERAL
+/* Map each vertex of collection to the skin entry of the primitives
+ * referencing it (`SKIN_NO_ENTRY` where none do). NULL if out of memory, or
+ * if primitives of different skin entries share a vertex; the GPU skins
+ * such a vertex once per entry, so it has no single CPU-skinned result */
+static uint16_t* pmdl_skin_vertex_entries(void* collection_buf, const pmdl_col_header* collection_header,
+                                          unsigned pointer_size, unsigned vert_count) {
+    uint16_t* vert_skin = malloc(sizeof(uint16_t)*vert_count);
+    if (!vert_skin)
+        return NULL;
+    memset(vert_skin, 0xff, sizeof(uint16_t)*vert_count);
+    
+    const uint16_t* elem_arr = collection_buf + collection_header->elem_buf_off;
+    void* index_buf = collection_buf + collection_header->draw_idx_off;
+    uint32_t mesh_count = *(uint32_t*)index_buf;
+    index_buf += *(uint32_t*)(index_buf+4);
+    index_buf += pointer_size*3;
+    unsigned i,j,k;
+    for (i=0 ; i<mesh_count ; ++i) {
+        uint32_t prim_count = *(uint32_t*)index_buf;
+        index_buf += sizeof(uint32_t);
+        for (j=0 ; j<prim_count ; ++j) {
+            pmdl_general_prim_par1* prim = index_buf;
+            index_buf += sizeof(pmdl_general_prim_par1);
+            for (k=0 ; k<prim->prim.prim_count ; ++k) {
+                uint16_t elem = elem_arr[prim->prim.prim_start_idx+k];
+                if (elem >= vert_count)
+                    continue;
+                if (vert_skin[elem] != SKIN_NO_ENTRY && vert_skin[elem] != prim->skin_idx) {
+                    free(vert_skin);
+                    return NULL;
+                }
+                vert_skin[elem] = prim->skin_idx;
+            }
+        }
+    }
+    
+    return vert_skin;
+}
+#endif
 
+/* Skin PAR1 collection on CPU into caller-provided position/normal arrays */
+int pmdl_skin_collection(const pmdl_t* pmdl, unsigned collection_idx,
+                         const pmdl_animation_ctx* anim_ctx,
+                         float* position_out, float* normal_out) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    if (header->sub_type_num != '1' || !anim_ctx || anim_ctx->parent_ctx != pmdl->rigging_ptr)
+        return -1;
+    unsigned vert_count = pmdl_collection_vertex_count(pmdl, collection_idx);
+    if (!vert_count)
+        return -1;
     
-    // Select draw routine based on sub-type
-    if (header->sub_type_num == '0')
-        pmdl_draw_par0(ctx, pmdl);
+    int i,j;
+    void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
+    pmdl_col_header* collection_header = &((pmdl_col_header*)collection_buf)[collection_idx];
+    
+#   if PMDL_GENERAL
+        // Primitives select skin entries; map each vertex to the entry that references it
+        uint16_t* vert_skin = pmdl_skin_vertex_entries(collection_buf, collection_header,
+                                                       header->pointer_size, vert_count);
+        if (!vert_skin)
+            return -1;
+#   endif
+    
+    // Bone palette (columns of evaluated bone matrices)
+    const pmdl_rigging_ctx* rig_ctx = anim_ctx->parent_ctx;
+    pmdl_skin_bone* palette = pspl_allocate_media_block(sizeof(pmdl_skin_bone)*rig_ctx->bone_count);
+    if (!palette) {
+#       if PMDL_GENERAL
+            free(vert_skin);
+#       endif
+        return -1;
+    }
+    for (i=0 ; i<rig_ctx->bone_count ; ++i) {
+        const pspl_matrix34_t* mtx = anim_ctx->fk_instance_array[i].bone_matrix;
+        for (j=0 ; j<4 ; ++j) {
+            palette[i].col[j].f[0] = mtx->m[0][j];
+            palette[i].col[j].f[1] = mtx->m[1][j];
+            palette[i].col[j].f[2] = mtx->m[2][j];
+            palette[i].col[j].f[3] = 0.0f;
+        }
+        pmdl_vector4_cpy(rig_ctx->bone_array[i].base_vector->v, palette[i].base.v);
+        palette[i].base.f[3] = 0.0f;
+    }
+    
+    // Common job state
+    struct skin_job job_base;
+    job_base.palette = palette;
+    job_base.position_out = position_out;
+    job_base.normal_out = normal_out;
+    
+#   if PMDL_GENERAL
+        job_base.vert_buf = collection_buf + collection_header->vert_buf_off +
+                            pmdl_general_vert_base(collection_header);
+        job_base.quant = NULL;
+        job_base.vert_stride = pmdl_general_vert_stride(collection_header);
+        job_base.weight_off = 24 + collection_header->uv_count*8;
+        if (collection_header->uv_count & PMDL_COL_QUANTISED) {
+            job_base.quant = collection_buf + collection_header->vert_buf_off;
+            job_base.weight_off = 12 + PMDL_COL_UV_COUNT(collection_header)*4;
+        }
+        job_base.weight_count = collection_header->bone_count;
+        job_base.vert_skin = vert_skin;
+        job_base.skin_entry_array = rig_ctx->skin_entry_array;
+    
+#   elif PMDL_GX
+        void* vert_buf = collection_buf + collection_header->vert_buf_off;
+        const void* vert_head_cur = vert_buf + *(uint32_t*)vert_buf + sizeof(pmdl_gx_par1_vertbuf_head);
+        job_base.position_arr = vert_buf + 32;
+        job_base.normal_arr = vert_buf + 32 + vert_count*12;
+    
+#   endif
+    
+    // Split vertices into chunks across animation workers
+    // (skinned here in one pass without memory for the jobs)
+    unsigned job_count = (vert_count + SKIN_CHUNK_VERTS - 1) / SKIN_CHUNK_VERTS;
+    struct skin_job* jobs = malloc(sizeof(struct skin_job)*job_count);
+    if (!jobs) {
+        job_base.vert_start = 0;
+        job_base.vert_count = vert_count;
+#       if PMDL_GX
+            job_base.first_vert_head = vert_head_cur;
+#       endif
+        skin_job_func(&job_base);
+    }
+    pspl_fence_t fence = 0;
+    for (i=0 ; jobs && i<job_count ; ++i) {
+        struct skin_job* job = &jobs[i];
+        *job = job_base;
+        job->job.func = (void(*)(void*))skin_job_func;
+        job->job.usr_ptr = job;
+        job->job.priority = PSPL_JOB_PRIORITY_HIGH;
+        job->job.fence = &fence;
+        job->vert_start = i*SKIN_CHUNK_VERTS;
+        job->vert_count = (vert_count - job->vert_start > SKIN_CHUNK_VERTS)?
+                          SKIN_CHUNK_VERTS:(vert_count - job->vert_start);
+        
+#       if PMDL_GX
+            // Per-vertex bone heads are variable-length; walk to each chunk's start
+            job->first_vert_head = vert_head_cur;
+            for (j=0 ; j<job->vert_count ; ++j)
+                vert_head_cur += 8*((const pmdl_gx_par1_vert_head*)vert_head_cur)->bone_count + 8;
+#       endif
+        
+        pmdl_animation_pool_submit(&job->job);
+    }
+    pspl_fence_wait(&fence);
+    
+    free(jobs);
+#   if PMDL_GENERAL
+        free(vert_skin);
+#   endif
+    pspl_free_media_block(palette);
+    
+    return 0;
+    
+}
+
+/* Double-buffered skinning output */
+int pmdl_skin_buffer_init(pmdl_skin_buffer* buf, const pmdl_t* pmdl, unsigned collection_idx) {
+    buf->vert_count = pmdl_collection_vertex_count(pmdl, collection_idx);
+    if (!buf->vert_count)
+        return -1;
+    buf->collection_idx = collection_idx;
+    buf->front = 0;
+    float* block = pspl_allocate_media_block(sizeof(float)*3*4*buf->vert_count);
+    if (!block)
+        return -1;
+    buf->position_arr[0] = block;
+    buf->normal_arr[0] = block + 3*buf->vert_count;
+    buf->position_arr[1] = block + 6*buf->vert_count;
+    buf->normal_arr[1] = block + 9*buf->vert_count;
+    return 0;
+}
+void pmdl_skin_buffer_destroy(pmdl_skin_buffer* buf) {
+    pspl_free_media_block(buf->position_arr[0]);
+    buf->position_arr[0] = buf->position_arr[1] = NULL;
+    buf->normal_arr[0] = buf->normal_arr[1] = NULL;
+}
+int pmdl_skin_buffer_swap(pmdl_skin_buffer* buf, const pmdl_t* pmdl,
+                          const pmdl_animation_ctx* anim_ctx) {
+    unsigned back = buf->front ^ 1;
+    if (pmdl_skin_collection(pmdl, buf->collection_idx, anim_ctx,
+                             buf->position_arr[back], buf->normal_arr[back]))
+        return -1;
+    buf->front = back;
+    return 0;
+}
+
+#pragma mark Occluder Rasterisation
+
+/* Projected-vertex scratch of occluder models (grown as needed) */
+static float (*occluder_vert_scratch)[4] = NULL;
+static unsigned occluder_vert_cap = 0;
+
+/* Rasterise occluder triangle from collection-local indices */
+static inline void pmdl_occluder_tri(pmdl_occlusion_buffer* buf, unsigned vert_count,
+                                     uint16_t a, uint16_t b, uint16_t c) {
+    if (a >= vert_count || b >= vert_count || c >= vert_count)
+        return;
+    pmdl_occlusion_raster_triangle(buf, occluder_vert_scratch[a], occluder_vert_scratch[b],
+                                   occluder_vert_scratch[c]);
+}
+
+/* Rasterise all triangles of General PAR0/PAR2 model as occluders */
+int pmdl_occlusion_add_pmdl(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+#   if PMDL_GENERAL
+    pmdl_header* header = pmdl->file_ptr->file_data;
     if (header->sub_type_num == '1')
-        pmdl_draw_rigged(ctx, pmdl, NULL);
-    else if (header->sub_type_num == '2')
-        pmdl_draw_par2(ctx, pmdl);
+        return -1;
+    
+    void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
+    unsigned i,j,k,l;
+    for (i=0 ; i<header->collection_count ; ++i) {
+        pmdl_col_header* collection_header = &((pmdl_col_header*)collection_buf)[i];
+        unsigned vert_count = pmdl_collection_vertex_count(pmdl, i);
+        if (!vert_count)
+            continue;
+        
+        // Project each vertex once
+        if (vert_count > occluder_vert_cap) {
+            float (*vert_scratch)[4] = realloc(occluder_vert_scratch, sizeof(float)*4*vert_count);
+            if (!vert_scratch)
+                return -1;
+            occluder_vert_scratch = vert_scratch;
+            occluder_vert_cap = vert_count;
+        }
+        const void* vert_buf = collection_buf + collection_header->vert_buf_off;
+        const pmdl_quant_head* quant = (collection_header->uv_count & PMDL_COL_QUANTISED) ? vert_buf : NULL;
+        const void* vert = vert_buf + pmdl_general_vert_base(collection_header);
+        unsigned stride = pmdl_general_vert_stride(collection_header);
+        for (j=0 ; j<vert_count ; ++j, vert+=stride) {
+            float pos[3];
+            if (quant)
+                for (k=0 ; k<3 ; ++k)
+                    pos[k] = fmaxf(((int16_t*)vert)[k] / 32767.0f, -1.0f) * quant->scale[k] + quant->bias[k];
+            else
+                memcpy(pos, vert, sizeof(pos));
+            pmdl_occlusion_transform(buf, &ctx->cached_modelview_mtx, pos, occluder_vert_scratch[j]);
+        }
+        
+        // Walk primitives of every mesh
+        const uint16_t* elems = collection_buf + collection_header->elem_buf_off;
+        void* index_buf = collection_buf + collection_header->draw_idx_off;
+        uint32_t mesh_count = *(uint32_t*)index_buf;
+        index_buf += *(uint32_t*)(index_buf+4) + header->pointer_size*3;
+        for (j=0 ; j<mesh_count ; ++j) {
+            uint32_t prim_count = *(uint32_t*)index_buf;
+            index_buf += sizeof(uint32_t);
+            for (k=0 ; k<prim_count ; ++k) {
+                pmdl_general_prim* prim = index_buf;
+                index_buf += sizeof(pmdl_general_prim);
+                const uint16_t* idx = elems + prim->prim_start_idx;
+                switch (prim->prim_type) {
+                    case PMDL_TRIANGLES:
+                        for (l=0 ; l+2<prim->prim_count ; l+=3)
+                            pmdl_occluder_tri(buf, vert_count, idx[l], idx[l+1], idx[l+2]);
+                        break;
+                    case PMDL_TRIANGLE_STRIPS:
+                        for (l=2 ; l<prim->prim_count ; ++l)
+                            pmdl_occluder_tri(buf, vert_count, idx[l-2], idx[l-1], idx[l]);
+                        break;
+                    case PMDL_TRIANGLE_FANS:
+                        for (l=2 ; l<prim->prim_count ; ++l)
+                            pmdl_occluder_tri(buf, vert_count, idx[0], idx[l-1], idx[l]);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    
+    return 0;
+#   else
+    return -1;
+#   endif
+}
+
+#pragma mark PAR2 Octree Traversal
+
+/* Octree child-type indicators */
+enum pmdl_octree_child {
+    PMDL_OCTREE_NULL = 0,
+    PMDL_OCTREE_NODE = 1,
+    PMDL_OCTREE_LEAF = 2
+};
+
+/* Octree node */
+typedef struct {
+    uint16_t child_types;
+    uint16_t padding;
+    uint32_t child_offs[];
+} pmdl_octree_node;
+
+/* Set draw bits of meshes referenced by leaf */
+static void pmdl_octree_mark_leaf(void* file_data, const void* leaf, unsigned* col_marks) {
+    pmdl_header* header = file_data;
+    
+    uint32_t ref_count = *(uint32_t*)leaf;
+    const uint32_t* ref_arr = leaf + sizeof(uint32_t);
+    
+    unsigned i;
+    for (i=0 ; i<ref_count ; ++i) {
+        uint32_t collection_idx = ref_arr[i*2];
+        uint32_t mesh_idx = ref_arr[i*2+1];
+        if (collection_idx >= header->collection_count)
+            continue;
+        
+        uint32_t mesh_count;
+        pmdl_mesh_header* mesh_heads = pmdl_collection_meshes(file_data, collection_idx, &mesh_count);
+        if (mesh_idx >= mesh_count)
+            continue;
+        
+        // Meshes spanning multiple leaves are only marked (and counted) once
+        uint32_t* shader_word = (uint32_t*)&mesh_heads[mesh_idx].shader_index;
+        if (!(*shader_word & PMDL_MESH_DRAWN_BIT)) {
+            *shader_word |= PMDL_MESH_DRAWN_BIT;
+            ++col_marks[collection_idx];
+        }
+    }
+}
+
+/* Recursively traverse octree node, culling child subtrees outside frustum
+ * or occluded. Subtrees fully inside frustum skip further frustum testing */
+static void pmdl_octree_mark_node(const pmdl_draw_ctx* ctx, void* file_data, const void* octree,
+                                  const pmdl_octree_node* node, float aabb[2][3],
+                                  int inside, unsigned* col_marks) {
+    
+    // Node center (shared corner of child octants)
+    float mid[3] = {
+        (aabb[0][0] + aabb[1][0]) * 0.5f,
+        (aabb[0][1] + aabb[1][1]) * 0.5f,
+        (aabb[0][2] + aabb[1][2]) * 0.5f
+    };
     
+    int i;
+    unsigned off_idx = 0;
+    for (i=0 ; i<8 ; ++i) {
+        enum pmdl_octree_child child_type = (node->child_types >> (i*2)) & 0x3;
+        if (child_type == PMDL_OCTREE_NULL)
+            continue;
+        const void* child = octree + node->child_offs[off_idx++];
+        
+        // Child octant; index bits select upper halves (X: bit 2, Y: bit 1, Z: bit 0)
+        float child_aabb[2][3] = {
+            {(i&4)?mid[0]:aabb[0][0], (i&2)?mid[1]:aabb[0][1], (i&1)?mid[2]:aabb[0][2]},
+            {(i&4)?aabb[1][0]:mid[0], (i&2)?aabb[1][1]:mid[1], (i&1)?aabb[1][2]:mid[2]}
+        };
+        
+        // Frustum classification (unless parent already inside)
+        int child_inside = inside;
+        if (!child_inside) {
+            enum pmdl_frustum_class cls = pmdl_aabb_frustum_classify(ctx, child_aabb);
+            if (cls == PMDL_FRUSTUM_OUTSIDE)
+                continue;
+            child_inside = (cls == PMDL_FRUSTUM_INSIDE);
+        }
         
+        // Subtrees hidden behind occluders are pruned
+        if (occlusion_buffer && !pmdl_occlusion_test_aabb(occlusion_buffer, ctx, child_aabb))
+            continue;
+        
+        if (child_type == PMDL_OCTREE_LEAF)
+            pmdl_octree_mark_leaf(file_data, child, col_marks);
+        else if (child_type == PMDL_OCTREE_NODE)
+            pmdl_octree_mark_node(ctx, file_data, octree, child, child_aabb, child_inside, col_marks);
+    }
+    
 }
 
+/* Record PAR2 meshes marked by octree traversal (resetting draw bits) */
+static void pmdl_record_par2(const pmdl_t* pmdl, const unsigned* col_marks) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    
+    unsigned i,j;
+    for (i=0 ; i<header->collection_count ; ++i) {
+        if (!col_marks[i])
+            continue;
+        uint32_t mesh_count;
+        pmdl_mesh_header* mesh_heads = pmdl_collection_meshes(pmdl->file_ptr->file_data, i, &mesh_count);
+        for (j=0 ; j<mesh_count ; ++j) {
+            uint32_t* shader_word = (uint32_t*)&mesh_heads[j].shader_index;
+            if (*shader_word & PMDL_MESH_DRAWN_BIT) {
+                *shader_word &= ~PMDL_MESH_DRAWN_BIT;
+                pmdl_record_mesh(pmdl, i, j, 0);
+            }
+        }
+    }
+}
 
+/* This routine will draw PAR2 PMDLs */
+static void pmdl_draw_par2(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    
+    int i,j;
+    
+    // Octree immediately follows header; its root subdivides the master AABB
+    void* octree = pmdl->file_ptr->file_data + sizeof(pmdl_header);
+    
+    // Mark visible meshes (counting per-collection to skip unmarked collections)
+    unsigned col_marks[header->collection_count];
+    memset(col_marks, 0, sizeof(col_marks));
+    pmdl_octree_mark_node(ctx, pmdl->file_ptr->file_data, octree, octree, header->master_aabb, 0, col_marks);
+    
+    // Headless recording
+    if (draw_recorder) {
+        pmdl_record_par2(pmdl, col_marks);
+        return;
+    }
+    
+#   if PMDL_GX
+        // Load in GX transformation context here
+        gx_load_ctx_transforms(ctx);
+        unsigned gx_loaded_texcoord_mats = 0;
+#   endif
+    
+    
+    // Draw marked meshes in collection order, resetting draw bits along the way
+    void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
+    pmdl_col_header* collection_headers = collection_buf;
+    for (i=0 ; i<header->collection_count; ++i) {
+        if (!col_marks[i])
+            continue;
+        pmdl_col_header* collection_header = &collection_headers[i];
+        
+        void* index_buf = collection_buf + collection_header->draw_idx_off;
+        
+        // Mesh count and index buf offset
+        uint32_t mesh_count = *(uint32_t*)index_buf;
+        uint32_t index_buf_offset = *(uint32_t*)(index_buf+4);
+        
+        // Mesh head array
+        pmdl_mesh_header* mesh_heads = index_buf+8;
+        index_buf += index_buf_offset;
+        
+        pmdl_bind_collection(collection_buf, collection_header, index_buf);
+        
+#       if PMDL_GENERAL
+        
+            index_buf += header->pointer_size*3;
+        
+            
+            for (j=0 ; j<mesh_count ; ++j) {
+                pmdl_mesh_header* mesh_head = &mesh_heads[j];
+                
+                // Primitive run
+                uint32_t prim_count = *(uint32_t*)index_buf;
+                pmdl_general_prim* prims = index_buf + sizeof(uint32_t);
+                index_buf += sizeof(uint32_t) + sizeof(pmdl_general_prim) * prim_count;
+                
+                // Draw bit test (and reset)
+                uint32_t* shader_word = (uint32_t*)&mesh_head->shader_index;
+                if (!(*shader_word & PMDL_MESH_DRAWN_BIT))
+                    continue;
+                *shader_word &= ~PMDL_MESH_DRAWN_BIT;
+                
+                // Apply mesh context and draw
+                pmdl_bind_mesh_shader(ctx, (*shader_word == PMDL_MESH_NO_SHADER) ? NULL : mesh_head->shader_pointer,
+                                      collection_buf, collection_header, NULL);
+                pmdl_draw_prims(prims, prim_count);
+                
+            }
+        
+#       elif PMDL_GX
+        
+            // Offset anchor for display list buffers
+            void* buf_anchor = index_buf;
+            pmdl_gx_mesh* gx_meshes = index_buf;
+        
+            // Iterate each mesh
+            for (j=0 ; j<mesh_count ; ++j) {
+                pmdl_mesh_header* mesh_head = &mesh_heads[j];
+                
+                // Draw bit test (and reset)
+                uint32_t* shader_word = (uint32_t*)&mesh_head->shader_index;
+                if (!(*shader_word & PMDL_MESH_DRAWN_BIT))
+                    continue;
+                *shader_word &= ~PMDL_MESH_DRAWN_BIT;
+                
+                // Apply mesh context and draw
+                pmdl_bind_mesh_shader(ctx, (*shader_word == PMDL_MESH_NO_SHADER) ? NULL : mesh_head->shader_pointer,
+                                      collection_buf, collection_header, &gx_loaded_texcoord_mats);
+                GX_CallDispList(buf_anchor + gx_meshes[j].dl_offset, gx_meshes[j].dl_length);
+                
+            }
+        
+#       endif
+        
+    }
+    
+}
+
+/* This is the main draw dispatch routine */
+void pmdl_draw(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+
+    // Master frustum and occlusion test
+    if (!pmdl_aabb_visible(ctx, header->master_aabb))
+        return;
+
+    
+    // Headless recording of PAR0 (PAR2 records after octree traversal)
+    if (draw_recorder && header->sub_type_num == '0') {
+        pmdl_record_par0(ctx, pmdl, pmdl_select_lod(ctx, pmdl));
+        return;
+    }
+    
+    // Select draw routine based on sub-type (PAR2 is always drawn at full detail)
+    if (header->sub_type_num == '0')
+        pmdl_draw_par0(ctx, pmdl, pmdl_select_lod(ctx, pmdl));
+    if (header->sub_type_num == '1')
+        pmdl_draw_rigged(ctx, pmdl, NULL);
+    else if (header->sub_type_num == '2')
+        pmdl_draw_par2(ctx, pmdl);
+    
+        
+}
+
+
+
+
+#pragma mark Render Queue
+
+/* Queued mesh draw */
+typedef struct {
+    uint64_t sort_key;
+    pmdl_draw_ctx* ctx;
+    const pmdl_t* pmdl;
+    unsigned collection_idx;
+    unsigned mesh_idx;
+    const pspl_runtime_psplc_t* shader_obj;
+    
+    // Collection's platform buffer block (GL buffer objects; GX display list anchor)
+    void* index_buf;
+    
+    // Mesh draw data (general primitive count and array; GX display list record)
+    void* mesh_draw;
+} pmdl_draw_packet;
+
+/* Sort key layout (most significant first): hashed shader, hashed collection
+ * buffer, then depth beyond near plane (front-to-back). Hash collisions only
+ * interleave groups; binds are decided by comparing the actual objects */
+#define QUEUE_SHADER_BITS 20
+#define QUEUE_BUFFER_BITS 12
+
+/* Pending packets (appended by `pmdl_submit`, consumed by `pmdl_flush_queue`) */
+static pmdl_draw_packet* queue_arr = NULL;
+static unsigned queue_count = 0;
+static unsigned queue_cap = 0;
+
+static inline uint64_t queue_hash_ptr(const void* ptr, unsigned bits) {
+    return ((uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+}
+
+/* Sortable depth of AABB centre (non-negative float bits order as integers) */
+static inline uint32_t queue_depth_bits(const pmdl_draw_ctx* ctx, float aabb[2][3]) {
+    const float* plane = ctx->cached_frustum_planes[PNEAR].ABCD.f;
+    float depth = plane[0]*(aabb[0][0] + aabb[1][0])*0.5f +
+                  plane[1]*(aabb[0][1] + aabb[1][1])*0.5f +
+                  plane[2]*(aabb[0][2] + aabb[1][2])*0.5f + plane[3];
+    if (!(depth > 0.0f))
+        return 0;
+    union {float f; uint32_t u;} bits = {.f = depth};
+    return bits.u;
+}
+
+/* Queue visible meshes of one collection (PAR2 meshes by draw bit, otherwise by frustum test) */
+static void pmdl_queue_collection(pmdl_draw_ctx* ctx, const pmdl_t* pmdl, unsigned collection_idx) {
+    void* file_data = pmdl->file_ptr->file_data;
+    pmdl_header* header = file_data;
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* collection_header = &((pmdl_col_header*)collection_buf)[collection_idx];
+    
+    void* index_buf = collection_buf + collection_header->draw_idx_off;
+    uint32_t mesh_count = *(uint32_t*)index_buf;
+    uint32_t index_buf_offset = *(uint32_t*)(index_buf+4);
+    pmdl_mesh_header* mesh_heads = index_buf+8;
+    index_buf += index_buf_offset;
+    
+    void* mesh_draw = index_buf;
+#   if PMDL_GENERAL
+        mesh_draw += header->pointer_size*3;
+#   endif
+    
+    unsigned j;
+    for (j=0 ; j<mesh_count ; ++j) {
+        pmdl_mesh_header* mesh_head = &mesh_heads[j];
+        void* this_mesh_draw = mesh_draw;
+#       if PMDL_GENERAL
+            mesh_draw += sizeof(uint32_t) + sizeof(pmdl_general_prim) * *(uint32_t*)mesh_draw;
+#       elif PMDL_GX
+            mesh_draw += sizeof(pmdl_gx_mesh);
+#       endif
+        
+        if (header->sub_type_num == '2') {
+            uint32_t* shader_word = (uint32_t*)&mesh_head->shader_index;
+            if (!(*shader_word & PMDL_MESH_DRAWN_BIT))
+                continue;
+            *shader_word &= ~PMDL_MESH_DRAWN_BIT;
+        } else if (!pmdl_aabb_visible(ctx, mesh_head->mesh_aabb))
+            continue;
+        
+        if (queue_count == queue_cap) {
+            unsigned new_cap = queue_cap ? queue_cap*2 : 256;
+            pmdl_draw_packet* packets = realloc(queue_arr, sizeof(pmdl_draw_packet)*new_cap);
+            if (packets) {
+                queue_arr = packets;
+                queue_cap = new_cap;
+            } else {
+                // Out of memory; draw what is queued to make room
+                pmdl_flush_queue(NULL);
+                if (!queue_cap)
+                    continue;
+            }
+        }
+        pmdl_draw_packet* packet = &queue_arr[queue_count++];
+        packet->ctx = ctx;
+        packet->pmdl = pmdl;
+        packet->collection_idx = collection_idx;
+        packet->mesh_idx = j;
+        packet->shader_obj = (mesh_head->shader_pointer) ? mesh_head->shader_pointer : ctx->default_shader;
+        packet->index_buf = index_buf;
+        packet->mesh_draw = this_mesh_draw;
+        packet->sort_key = (queue_hash_ptr(packet->shader_obj, QUEUE_SHADER_BITS) << (64 - QUEUE_SHADER_BITS)) |
+                           (queue_hash_ptr(collection_header, QUEUE_BUFFER_BITS) << 32) |
+                           queue_depth_bits(ctx, mesh_head->mesh_aabb);
+    }
+}
+
+/* Queue visible meshes of model for sorted drawing at `pmdl_flush_queue` */
+void pmdl_submit(pmdl_draw_ctx* ctx, const pmdl_t* pmdl) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    
+    // Master frustum and occlusion test
+    if (!pmdl_aabb_visible(ctx, header->master_aabb))
+        return;
+    
+    unsigned i;
+    if (header->sub_type_num == '0') {
+        for (i=0 ; i<header->collection_count ; ++i)
+            pmdl_queue_collection(ctx, pmdl, i);
+    } else if (header->sub_type_num == '2') {
+        void* octree = pmdl->file_ptr->file_data + sizeof(pmdl_header);
+        unsigned col_marks[header->collection_count];
+        memset(col_marks, 0, sizeof(col_marks));
+        pmdl_octree_mark_node(ctx, pmdl->file_ptr->file_data, octree, octree, header->master_aabb, 0, col_marks);
+        for (i=0 ; i<header->collection_count ; ++i)
+            if (col_marks[i])
+                pmdl_queue_collection(ctx, pmdl, i);
+    } else
+        pmdl_draw(ctx, pmdl);
+}
+
+/* Queue entry being sorted */
+typedef struct {
+    uint64_t sort_key;
+    unsigned packet_idx;
+} pmdl_queue_entry;
+
+/* LSD radix sort on 8-bit digits (digits shared by every key are skipped);
+ * returns whichever of the two arrays holds the sorted result */
+static pmdl_queue_entry* pmdl_queue_radix_sort(pmdl_queue_entry* entries, pmdl_queue_entry* scratch,
+                                               unsigned count) {
+    unsigned shift, i;
+    for (shift=0 ; shift<64 ; shift+=8) {
+        unsigned offsets[256] = {0};
+        for (i=0 ; i<count ; ++i)
+            ++offsets[(entries[i].sort_key >> shift) & 0xff];
+        if (offsets[(entries[0].sort_key >> shift) & 0xff] == count)
+            continue;
+        
+        unsigned total = 0;
+        for (i=0 ; i<256 ; ++i) {
+            unsigned digit_count = offsets[i];
+            offsets[i] = total;
+            total += digit_count;
+        }
+        for (i=0 ; i<count ; ++i)
+            scratch[offsets[(entries[i].sort_key >> shift) & 0xff]++] = entries[i];
+        
+        pmdl_queue_entry* swap = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+    return entries;
+}
+
+/* Sort and draw all queued packets, binding only changed state */
+void pmdl_flush_queue(pmdl_queue_stats* stats_out) {
+    pmdl_queue_stats stats = {0};
+    if (!queue_count) {
+        if (stats_out)
+            *stats_out = stats;
+        return;
+    }
+    
+    unsigned i;
+    // Without memory to sort, packets are drawn in submission order
+    pmdl_queue_entry* entries = malloc(sizeof(pmdl_queue_entry)*queue_count*2);
+    pmdl_queue_entry* sorted = NULL;
+    if (entries) {
+        for (i=0 ; i<queue_count ; ++i) {
+            entries[i].sort_key = queue_arr[i].sort_key;
+            entries[i].packet_idx = i;
+        }
+        sorted = pmdl_queue_radix_sort(entries, entries+queue_count, queue_count);
+    }
+    
+    // Currently bound state
+    const pspl_runtime_psplc_t* bound_shader = NULL;
+    const void* bound_buffer = NULL;
+    const pmdl_draw_ctx* bound_ctx = NULL;
+    int have_shader = 0;
+#   if PMDL_GX
+        unsigned gx_loaded_texcoord_mats = 0;
+#   endif
+    
+    for (i=0 ; i<queue_count ; ++i) {
+        pmdl_draw_packet* packet = &queue_arr[(sorted) ? sorted[i].packet_idx : i];
+        pmdl_draw_ctx* ctx = packet->ctx;
+        const pspl_runtime_psplc_t* shader_obj = packet->shader_obj;
+        ++stats.packet_count;
+        
+        int shader_changed = !have_shader || shader_obj != bound_shader;
+        int ctx_changed = ctx != bound_ctx;
+        int buffer_changed = packet->index_buf != bound_buffer;
+        
+        if (shader_changed) {
+            ++stats.shader_binds;
+            have_shader = 1;
+            bound_shader = shader_obj;
+        }
+        if (buffer_changed) {
+            ++stats.buffer_binds;
+            bound_buffer = packet->index_buf;
+        }
+        if (ctx_changed || shader_changed) {
+            ++stats.context_loads;
+            bound_ctx = ctx;
+        }
+        
+        // Headless; record meshes in sorted order
+        if (draw_recorder) {
+            pmdl_record_mesh(packet->pmdl, packet->collection_idx, packet->mesh_idx, 0);
+            continue;
+        }
+        
+#       if PMDL_GX
+            // Transformation context
+            if (ctx_changed) {
+                gx_load_ctx_transforms(ctx);
+                gx_loaded_texcoord_mats = 0;
+            }
+        
+            // Texture coordinate matrices (context state; a new context within
+            // a shader group needs its own loaded as well)
+            if (shader_obj && (ctx_changed || shader_changed))
+                gx_load_texcoord_mats(ctx, shader_obj, &gx_loaded_texcoord_mats);
+#       endif
+        
+        // Shader
+        if (shader_changed) {
+            if (!shader_obj)
+                null_shader(ctx);
+            else
+                pspl_runtime_bind_psplc(shader_obj);
+        }
+        
+#       if PSPL_RUNTIME_PLATFORM_GL2
+            // Context uniforms (per-program state; stamped by context generation)
+            if (shader_obj && (ctx_changed || shader_changed))
+                gl_load_ctx_uniforms(ctx, shader_obj);
+        
+            // Vertex dequantisation terms (per-program state; shadowed by collection)
+            if (shader_obj && (buffer_changed || shader_changed)) {
+                pmdl_header* header = packet->pmdl->file_ptr->file_data;
+                void* collection_buf = packet->pmdl->file_ptr->file_data + header->collection_offset;
+                gl_load_vert_format(shader_obj, collection_buf,
+                                    &((pmdl_col_header*)collection_buf)[packet->collection_idx]);
+            }
+#       endif
+        
+        // Collection buffers
+        if (buffer_changed) {
+            pmdl_header* header = packet->pmdl->file_ptr->file_data;
+            void* collection_buf = packet->pmdl->file_ptr->file_data + header->collection_offset;
+            pmdl_bind_collection(collection_buf, &((pmdl_col_header*)collection_buf)[packet->collection_idx],
+                                 packet->index_buf);
+        }
+        
+        // Draw mesh
+#       if PMDL_GENERAL
+            pmdl_draw_prims(packet->mesh_draw + sizeof(uint32_t), *(uint32_t*)packet->mesh_draw);
+#       elif PMDL_GX
+            pmdl_gx_mesh* gx_mesh = packet->mesh_draw;
+            GX_CallDispList(packet->index_buf + gx_mesh->dl_offset, gx_mesh->dl_length);
+#       endif
+        
+    }
+    
+    free(entries);
+    queue_count = 0;
+    if (stats_out)
+        *stats_out = stats;
+    
+}
+
+
+#pragma mark Instanced Drawing
+
+/* Packed per-instance transforms (survivors of instance culling) */
+typedef struct {
+    pspl_matrix44_t modelview;
+    pspl_matrix44_t modelview_invxpose;
+} pmdl_instance_xf;
+
+/* Instance buffer (reused across calls) */
+static pmdl_instance_xf* instance_buf = NULL;
+
+/* Instance-culling scratch (modelviews of all instances, view-space AABBs
+ * and visibility bits, reused for each mesh's survivors); grown along with
+ * the instance buffer by `pmdl_instance_scratch_reserve` */
+static pspl_matrix34_t* instance_mv_scratch = NULL;
+static float* instance_aabb_scratch = NULL;
+static uint32_t* instance_vis_scratch = NULL;
+static unsigned instance_scratch_cap = 0;
+
+#if PSPL_RUNTIME_PLATFORM_GL2 && PSPL_GL2_INSTANCING
+/* Per-instance attribute stream (visible instances of one mesh) */
+static GLuint instance_vbo = 0;
+static pmdl_instance_xf* instance_pack_buf = NULL;
+static unsigned instance_pack_cap = 0;
+#endif
+
+/* View-space AABB of model-space `aabb` under each modelview (SoA out) */
+static inline void pmdl_instance_aabbs(float aabb[2][3], const pspl_matrix34_t* mvs, size_t mv_stride,
+                                       unsigned count, pmdl_aabb_soa_t* aabbs) {
+    unsigned i,j;
+    float centre[3], extent[3];
+    for (j=0 ; j<3 ; ++j) {
+        centre[j] = (aabb[0][j] + aabb[1][j]) * 0.5f;
+        extent[j] = (aabb[1][j] - aabb[0][j]) * 0.5f;
+    }
+    for (i=0 ; i<count ; ++i) {
+        const pspl_matrix34_t* mv = (const void*)mvs + mv_stride*i;
+        for (j=0 ; j<3 ; ++j) {
+            aabbs->centre[j][i] = mv->m[j][0]*centre[0] + mv->m[j][1]*centre[1] + mv->m[j][2]*centre[2] + mv->m[j][3];
+            aabbs->extent[j][i] = fabsf(mv->m[j][0])*extent[0] + fabsf(mv->m[j][1])*extent[1] +
+                                  fabsf(mv->m[j][2])*extent[2];
+        }
+    }
+}
+
+/* Batched frustum test of view-space AABBs into `instance_vis_scratch`, then
+ * occlusion test of survivors (clearing bits); returns visible count */
+static unsigned pmdl_instance_vis(const pmdl_plane_t* planes, const pmdl_aabb_soa_t* aabbs) {
+    unsigned i;
+    unsigned vis_count = pmdl_aabb_planes_test_batch(planes, aabbs, instance_vis_scratch);
+    if (!vis_count || !occlusion_buffer)
+        return vis_count;
+    for (i=0 ; i<aabbs->count ; ++i) {
+        if (!(instance_vis_scratch[i/32] & (1u << (i%32))))
+            continue;
+        float centre[3] = {aabbs->centre[0][i], aabbs->centre[1][i], aabbs->centre[2][i]};
+        float extent[3] = {aabbs->extent[0][i], aabbs->extent[1][i], aabbs->extent[2][i]};
+        if (!pmdl_occlusion_test_view_aabb(occlusion_buffer, centre, extent)) {
+            instance_vis_scratch[i/32] &= ~(1u << (i%32));
+            --vis_count;
+        }
+    }
+    return vis_count;
+}
+
+/* Grow instance buffer and scratch to `count` instances; returns -1
+ * without memory (blocks already grown are kept) */
+static int pmdl_instance_scratch_reserve(unsigned count) {
+    if (count <= instance_scratch_cap)
+        return 0;
+    float* aabb_scratch = realloc(instance_aabb_scratch, sizeof(float)*6*count);
+    if (aabb_scratch)
+        instance_aabb_scratch = aabb_scratch;
+    uint32_t* vis_scratch = realloc(instance_vis_scratch, sizeof(uint32_t)*((count+31)/32));
+    if (vis_scratch)
+        instance_vis_scratch = vis_scratch;
+    pspl_matrix34_t* mv_scratch = pspl_allocate_media_block(sizeof(pspl_matrix34_t)*count);
+    pmdl_instance_xf* xf_buf = pspl_allocate_media_block(sizeof(pmdl_instance_xf)*count);
+    if (!aabb_scratch || !vis_scratch || !mv_scratch || !xf_buf) {
+        if (mv_scratch)
+            pspl_free_media_block(mv_scratch);
+        if (xf_buf)
+            pspl_free_media_block(xf_buf);
+        return -1;
+    }
+    if (instance_mv_scratch)
+        pspl_free_media_block(instance_mv_scratch);
+    if (instance_buf)
+        pspl_free_media_block(instance_buf);
+    instance_mv_scratch = mv_scratch;
+    instance_buf = xf_buf;
+    instance_scratch_cap = count;
+    return 0;
+}
+
+/* Cull instances by master AABB in view space (frustum, then occlusion) and
+ * pack surviving transforms into `instance_buf`; returns surviving count */
+static unsigned pmdl_cull_instances(const pmdl_draw_ctx* ctx, const pmdl_plane_t* planes,
+                                    float master_aabb[2][3], const pspl_matrix34_t* instance_mtxs,
+                                    unsigned count) {
+    unsigned i,k;
+    
+    // Per-instance modelview (composed as `pmdl_update_context` does for the
+    // model matrix) and view-space AABB of the transformed master AABB
+    pmdl_aabb_soa_t aabbs = {.count = count};
+    for (k=0 ; k<3 ; ++k) {
+        aabbs.centre[k] = instance_aabb_scratch + count*k;
+        aabbs.extent[k] = instance_aabb_scratch + count*(3+k);
+    }
+    pspl_matrix34_t view_swizzle;
+    pmdl_matrix34_mul((pspl_matrix34_t*)&ctx->cached_view_mtx, (pspl_matrix34_t*)&LH_SWIZZLE_MATRIX, &view_swizzle);
+    pmdl_matrix34_mul_batch(instance_mtxs, &view_swizzle, instance_mv_scratch, count);
+    pmdl_instance_aabbs(master_aabb, instance_mv_scratch, sizeof(pspl_matrix34_t), count, &aabbs);
+    
+    unsigned vis_count = pmdl_instance_vis(planes, &aabbs);
+    if (!vis_count)
+        return 0;
+    
+    // Pack survivors
+    pmdl_instance_xf* xf = instance_buf;
+    for (i=0 ; i<count ; ++i) {
+        if (!(instance_vis_scratch[i/32] & (1u << (i%32))))
+            continue;
+        pmdl_matrix34_cpy(instance_mv_scratch[i].v, xf->modelview.v);
+        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, xf->modelview.v[3]);
+        pmdl_matrix34_invxpose(&xf->modelview.m34, &xf->modelview_invxpose.m34);
+        pmdl_vector4_cpy(HOMOGENOUS_BOTTOM_VECTOR, xf->modelview_invxpose.v[3]);
+        ++xf;
+    }
+    
+    return vis_count;
+}
+
+/* Cull packed instances by one mesh's AABB, setting a bit of
+ * `instance_vis_scratch` per visible instance; returns visible count */
+static unsigned pmdl_cull_instance_mesh(const pmdl_plane_t* planes, float mesh_aabb[2][3], unsigned vis_count) {
+    unsigned k;
+    pmdl_aabb_soa_t aabbs = {.count = vis_count};
+    for (k=0 ; k<3 ; ++k) {
+        aabbs.centre[k] = instance_aabb_scratch + vis_count*k;
+        aabbs.extent[k] = instance_aabb_scratch + vis_count*(3+k);
+    }
+    pmdl_instance_aabbs(mesh_aabb, &instance_buf[0].modelview.m34, sizeof(pmdl_instance_xf), vis_count, &aabbs);
+    return pmdl_instance_vis(planes, &aabbs);
+}
+
+#define INSTANCE_VISIBLE(l) (instance_vis_scratch[(l)/32] & (1u << ((l)%32)))
+
+#if PSPL_RUNTIME_PLATFORM_GL2 && PSPL_GL2_INSTANCING
+/* Draw mesh primitives once for each visible instance with the bound
+ * instanced program, streaming transforms as per-instance attributes */
+static void gl_draw_mesh_instanced(const pmdl_general_prim* prims, uint32_t prim_count,
+                                   unsigned vis_count, unsigned mesh_vis, GLuint vert_buf) {
+    unsigned k,l;
+    
+    // Visible transforms (all packed instances if none were culled)
+    const pmdl_instance_xf* xfs = instance_buf;
+    if (mesh_vis < vis_count) {
+        if (mesh_vis > instance_pack_cap) {
+            pmdl_instance_xf* pack_buf = realloc(instance_pack_buf, sizeof(pmdl_instance_xf)*mesh_vis);
+            if (pack_buf) {
+                instance_pack_buf = pack_buf;
+                instance_pack_cap = mesh_vis;
+            }
+        }
+        
+        // Without memory to pack, culled instances are streamed as well
+        // (they fall outside the view or behind occluders)
+        if (mesh_vis <= instance_pack_cap) {
+            pmdl_instance_xf* xf = instance_pack_buf;
+            for (l=0 ; l<vis_count ; ++l)
+                if (INSTANCE_VISIBLE(l))
+                    *xf++ = instance_buf[l];
+            xfs = instance_pack_buf;
+        } else
+            mesh_vis = vis_count;
+    }
+    
+    if (!instance_vbo)
+        glGenBuffers(1, &instance_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(pmdl_instance_xf)*mesh_vis, xfs, GL_STREAM_DRAW);
+    for (k=0 ; k<8 ; ++k) {
+        GLuint loc = PSPL_GL2_INSTANCE_ATTRIB + k;
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(pmdl_instance_xf),
+                              (GLvoid*)(GLsizeiptr)(sizeof(GLfloat)*4*k));
+        GLINST(glVertexAttribDivisor)(loc, 1);
+    }
+    
+    for (k=0 ; k<prim_count ; ++k)
+        GLINST(glDrawElementsInstanced)(resolve_prim(prims[k].prim_type), prims[k].prim_count, GL_UNSIGNED_SHORT,
+                                        (GLvoid*)(GLsizeiptr)(prims[k].prim_start_idx*2), mesh_vis);
+    
+    // Leave the collection's vertex array as non-instanced draws expect it
+    for (k=0 ; k<8 ; ++k)
+        glDisableVertexAttribArray(PSPL_GL2_INSTANCE_ATTRIB + k);
+    glBindBuffer(GL_ARRAY_BUFFER, vert_buf);
+}
+#endif
+
+/* Draw PAR0 model once per instance transform */
+void pmdl_draw_instanced(pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
+                         const pspl_matrix34_t* instance_mtxs, unsigned count) {
+    pmdl_header* header = pmdl->file_ptr->file_data;
+    unsigned i,j,k,l;
+    
+    if (!count)
+        return;
+    
+    // Other sub-types (and PAR0 without memory for instance culling) draw
+    // each instance through the context's model matrix
+    if (header->sub_type_num != '0' || pmdl_instance_scratch_reserve(count)) {
+        pspl_matrix34_t saved_model_mtx;
+        pmdl_matrix34_cpy(ctx->model_mtx.v, saved_model_mtx.v);
+        for (i=0 ; i<count ; ++i) {
+            pmdl_matrix34_cpy(((pspl_matrix34_t*)&instance_mtxs[i])->v, ctx->model_mtx.v);
+            pmdl_update_context(ctx, PMDL_INVALIDATE_MODEL);
+            pmdl_draw(ctx, pmdl);
+        }
+        pmdl_matrix34_cpy(saved_model_mtx.v, ctx->model_mtx.v);
+        pmdl_update_context(ctx, PMDL_INVALIDATE_MODEL);
+        return;
+    }
+    
+    // View-space planes shared by instance and mesh culling
+    float view_planes[6][4];
+    pmdl_view_frustum_planes(ctx, view_planes);
+    pmdl_plane_t planes[6];
+    for (j=0 ; j<6 ; ++j)
+        for (k=0 ; k<4 ; ++k)
+            planes[j].ABCD.f[k] = view_planes[j][k];
+    
+    unsigned vis_count = pmdl_cull_instances(ctx, planes, header->master_aabb, instance_mtxs, count);
+    if (!vis_count)
+        return;
+    
+    // Headless; record each mesh once per instance it is visible in
+    if (draw_recorder) {
+        for (i=0 ; i<header->collection_count ; ++i) {
+            uint32_t mesh_count;
+            pmdl_mesh_header* mesh_heads = pmdl_collection_meshes(pmdl->file_ptr->file_data, i, &mesh_count);
+            for (j=0 ; j<mesh_count ; ++j) {
+                if (!pmdl_cull_instance_mesh(planes, mesh_heads[j].mesh_aabb, vis_count))
+                    continue;
+                for (l=0 ; l<vis_count ; ++l)
+                    if (INSTANCE_VISIBLE(l))
+                        pmdl_record_mesh(pmdl, i, j, 0);
+            }
+        }
+        return;
+    }
+    
+#   if PMDL_GX
+        GX_LoadProjectionMtx(ctx->cached_projection_mtx.m,
+                             (ctx->projection_type == PMDL_PERSPECTIVE)?
+                             GX_PERSPECTIVE:GX_ORTHOGRAPHIC);
+        unsigned gx_loaded_texcoord_mats = 0;
+#   endif
+    
+    void* collection_buf = pmdl->file_ptr->file_data + header->collection_offset;
+    for (i=0 ; i<header->collection_count ; ++i) {
+        pmdl_col_header* collection_header = &((pmdl_col_header*)collection_buf)[i];
+        
+        void* index_buf = collection_buf + collection_header->draw_idx_off;
+        uint32_t mesh_count = *(uint32_t*)index_buf;
+        uint32_t index_buf_offset = *(uint32_t*)(index_buf+4);
+        pmdl_mesh_header* mesh_heads = index_buf+8;
+        index_buf += index_buf_offset;
+        
+        // Collection buffers are bound once for all instances
+        pmdl_bind_collection(collection_buf, collection_header, index_buf);
+#       if PMDL_GENERAL
+#           if PSPL_RUNTIME_PLATFORM_GL2 && PSPL_GL2_INSTANCING
+                struct gl_bufs_t* gl_bufs = index_buf;
+#           endif
+            void* mesh_draw = index_buf + header->pointer_size*3;
+        
+#       elif PMDL_GX
+            pmdl_gx_mesh* gx_meshes = index_buf;
+#       endif
+        
+        for (j=0 ; j<mesh_count ; ++j) {
+            pmdl_mesh_header* mesh_head = &mesh_heads[j];
+            
+#           if PMDL_GENERAL
+                uint32_t prim_count = *(uint32_t*)mesh_draw;
+                pmdl_general_prim* prims = mesh_draw + sizeof(uint32_t);
+                mesh_draw += sizeof(uint32_t) + sizeof(pmdl_general_prim) * prim_count;
+#           endif
+            
+            // Instances this mesh is visible in
+            unsigned mesh_vis = pmdl_cull_instance_mesh(planes, mesh_head->mesh_aabb, vis_count);
+            if (!mesh_vis)
+                continue;
+            
+            // Shader is bound once for all instances
+            const pspl_runtime_psplc_t* shader_obj = mesh_head->shader_pointer;
+            if (mesh_head->shader_index < 0)
+                shader_obj = ctx->default_shader;
+#           if PSPL_RUNTIME_PLATFORM_GL2 && PSPL_GL2_INSTANCING
+                GL2_shader_object_t* instanced_shader = NULL;
+#           endif
+            if (!shader_obj)
+                null_shader(ctx);
+            else {
+#               if PMDL_GX
+                    if (shader_obj->native_shader.texgen_count > gx_loaded_texcoord_mats) {
+                        for (k=gx_loaded_texcoord_mats ; k<shader_obj->native_shader.texgen_count ; ++k) {
+                            GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_TEXMTX0 + (k*3), GX_MTX2x4);
+                            if (shader_obj->native_shader.using_texcoord_normal)
+                                GX_LoadTexMtxImm(ctx->texcoord_mtx[k].m, GX_DTTMTX0 + (k*3), GX_MTX3x4);
+                        }
+                        gx_loaded_texcoord_mats = shader_obj->native_shader.texgen_count;
+                    }
+#               endif
+                pspl_runtime_bind_psplc(shader_obj);
+#               if PSPL_RUNTIME_PLATFORM_GL2
+#                   if PSPL_GL2_INSTANCING
+                        // Instanced variant reads transforms from per-instance attributes
+                        instanced_shader = pspl_gl2_instanced_shader((GL2_shader_object_t*)&shader_obj->native_shader);
+                        if (instanced_shader) {
+                            pspl_gl2_use_program(instanced_shader->program);
+                            gl_load_native_ctx_uniforms(ctx, instanced_shader);
+                            gl_load_native_vert_format(instanced_shader, collection_buf, collection_header);
+                        } else
+#                   endif
+                    {
+                        gl_load_ctx_uniforms(ctx, shader_obj);
+                        gl_load_vert_format(shader_obj, collection_buf, collection_header);
+                    }
+#               endif
+            }
+            
+#           if PSPL_RUNTIME_PLATFORM_GL2 && PSPL_GL2_INSTANCING
+                if (instanced_shader) {
+                    gl_draw_mesh_instanced(prims, prim_count, vis_count, mesh_vis, gl_bufs->vert_buf);
+                    continue;
+                }
+#           endif
+            
+            // Otherwise draw mesh for each visible instance
+            for (l=0 ; l<vis_count ; ++l) {
+                if (!INSTANCE_VISIBLE(l))
+                    continue;
+                pmdl_instance_xf* xf = &instance_buf[l];
+                
+#               if PSPL_RUNTIME_PLATFORM_GL2
+                    if (shader_obj) {
+                        GL2_shader_object_t* native_shader = (GL2_shader_object_t*)&shader_obj->native_shader;
+                        glUniformMatrix4fv(native_shader->mv_mtx_uni, 1, GL_FALSE, (GLfloat*)xf->modelview.m);
+                        glUniformMatrix4fv(native_shader->mv_invxpose_uni, 1, GL_FALSE, (GLfloat*)xf->modelview_invxpose.m);
+                        pspl_gl2_stamp_uniforms(native_shader, xf, 0);
+                    }
+                    pmdl_draw_prims(prims, prim_count);
+                
+#               elif PSPL_RUNTIME_PLATFORM_D3D11
+                
+#               elif PMDL_GX
+                    GX_LoadPosMtxImm(xf->modelview.m, GX_PNMTX0);
+                    GX_LoadNrmMtxImm(xf->modelview_invxpose.m, GX_PNMTX0);
+                    if (shader_obj && shader_obj->native_shader.using_texcoord_normal)
+                        GX_LoadTexMtxImm(xf->modelview_invxpose.m, GX_TEXMTX9, GX_MTX3x4);
+                    GX_CallDispList(index_buf + gx_meshes[j].dl_offset, gx_meshes[j].dl_length);
+#               endif
+            }
+            
+        }
+    }
+    
+#   if PMDL_GX
+        // Restore context transforms for subsequent draws
+        GX_LoadPosMtxImm(ctx->cached_modelview_mtx.m, GX_PNMTX0);
+        GX_LoadNrmMtxImm(ctx->cached_modelview_invxpose_mtx.m, GX_PNMTX0);
+#   endif
+    
+}
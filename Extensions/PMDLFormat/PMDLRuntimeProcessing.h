@@ -19,8 +19,26 @@ void pmdl_master_init();
 int pmdl_init(pmdl_t* pmdl);
 void pmdl_destroy(pmdl_t* pmdl);
 
+/* The two halves of `pmdl_init`; fix-up (validation and shader-pointer
+ * relocation) may run on worker threads, upload must follow on the main thread */
+int pmdl_init_fixup(pmdl_t* pmdl);
+void pmdl_init_upload(pmdl_t* pmdl);
+
 /* Rigging context */
 void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const char* bone_string_table);
 void pmdl_rigging_destroy(pmdl_rigging_ctx* rig_ctx);
 
+/* Animation worker pool (batched FK evaluation, CPU skinning and load fix-up) */
+int pmdl_animation_pool_init();
+void pmdl_animation_pool_shutdown();
+void pmdl_animation_pool_submit(pspl_job_t* job);
+
+/* Occlusion buffer internals; vertices project to buffer-space
+ * {x, y, depth, in-front-of-near-plane} */
+void pmdl_occlusion_transform(const pmdl_occlusion_buffer* buf, const pspl_matrix44_t* modelview,
+                              const float pos[3], float out[4]);
+void pmdl_occlusion_raster_triangle(pmdl_occlusion_buffer* buf,
+                                    const float v0[4], const float v1[4], const float v2[4]);
+int pmdl_occlusion_test_view_aabb(const pmdl_occlusion_buffer* buf, const float centre[3], const float extent[3]);
+
 #endif
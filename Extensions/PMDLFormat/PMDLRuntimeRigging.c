@@ -7,7 +7,9 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <alloca.h>
 #include <math.h>
 #include <PMDLRuntime.h>
@@ -51,6 +53,120 @@ struct file_action {
 #define ACTION_LOCATION(val) ((val)&0x80000000)
 
 
+#pragma mark Context Pools
+
+/* Round up to nearest 16 multiple (SIMD vector alignment) */
+#define ROUND_UP_16(val) (((val)+15) & ~(size_t)15)
+
+/* Context slots carved from each pool chunk */
+#define CTX_POOL_CHUNK_SLOTS 16
+
+/* Animation contexts composing up to this many actions are pooled
+ * (larger compositions are allocated individually) */
+#define ANIMATION_POOL_ACTIONS 4
+
+/* Fixed-size context pool; each rigging context keeps one for action
+ * contexts and one for animation contexts. Slots are 16-byte aligned,
+ * free slots are linked through their first word and chunks through
+ * their (16-byte) head, so allocation and release are O(1) */
+typedef struct pmdl_ctx_pool {
+    size_t slot_size;
+    void* free_list;
+    void* chunk_list;
+} pmdl_ctx_pool;
+
+static void* ctx_pool_alloc(pmdl_ctx_pool* pool) {
+    int i;
+    if (!pool->free_list) {
+        void* chunk = pspl_allocate_media_block(16 + pool->slot_size*CTX_POOL_CHUNK_SLOTS);
+        *(void**)chunk = pool->chunk_list;
+        pool->chunk_list = chunk;
+        void* slot = chunk + 16 + pool->slot_size*CTX_POOL_CHUNK_SLOTS;
+        for (i=0 ; i<CTX_POOL_CHUNK_SLOTS ; ++i) {
+            slot -= pool->slot_size;
+            *(void**)slot = pool->free_list;
+            pool->free_list = slot;
+        }
+    }
+    void* slot = pool->free_list;
+    pool->free_list = *(void**)slot;
+    return slot;
+}
+
+static void ctx_pool_free(pmdl_ctx_pool* pool, void* slot) {
+    *(void**)slot = pool->free_list;
+    pool->free_list = slot;
+}
+
+static void ctx_pool_destroy(pmdl_ctx_pool* pool) {
+    while (pool->chunk_list) {
+        void* next = *(void**)pool->chunk_list;
+        pspl_free_media_block(pool->chunk_list);
+        pool->chunk_list = next;
+    }
+    pool->free_list = NULL;
+}
+
+/* Size of action context block for `action` */
+static size_t action_ctx_size(const pmdl_action* action, unsigned* curve_instance_count_out) {
+    int i,j;
+    unsigned curve_instance_count = 0;
+    unsigned segment_count = 0;
+    for (i=0 ; i<action->bone_track_count; ++i) {
+        const pmdl_action_bone_track* bone_track = &action->bone_track_array[i];
+        curve_instance_count += bone_track->property_count;
+        const pmdl_curve* const* curves = &bone_track->scale_x; // Ten contiguous property curves
+        for (j=0 ; j<10 ; ++j)
+            if (curves[j] && curves[j]->keyframe_count > 1)
+                segment_count += curves[j]->keyframe_count - 1;
+    }
+    if (curve_instance_count_out)
+        *curve_instance_count_out = curve_instance_count;
+    
+    return sizeof(pmdl_action_ctx) +
+           sizeof(pmdl_curve_playback)*curve_instance_count +
+           sizeof(pmdl_curve_segment)*segment_count;
+}
+
+/* Layout of animation context block composing `action_count` actions:
+ * context, FK instances, per-action FK playbacks and action context array,
+ * then (16-byte aligned) bone matrices followed by skin palette */
+static size_t animation_ctx_size(const pmdl_rigging_ctx* rig_ctx, unsigned action_count,
+                                 size_t* matrix_off_out) {
+    size_t block_size = ROUND_UP_16(sizeof(pmdl_animation_ctx));
+    block_size += sizeof(pmdl_fk_playback)*rig_ctx->bone_count;
+    block_size += sizeof(pmdl_fk_action_playback)*action_count*rig_ctx->bone_count;
+    block_size += sizeof(pmdl_action_ctx*)*action_count;
+    block_size = ROUND_UP_16(block_size);
+    if (matrix_off_out)
+        *matrix_off_out = block_size;
+    block_size += sizeof(pspl_matrix34_t)*rig_ctx->bone_count;
+    block_size += sizeof(pspl_matrix44_t)*rig_ctx->skin_palette_count;
+    return block_size;
+}
+
+
+#pragma mark Rigging Context
+
+/* Slot count for a name table of `count` names (power-of-two; at most half full) */
+static unsigned name_table_slots(unsigned count) {
+    unsigned slots = 2;
+    while (slots < count*2)
+        slots <<= 1;
+    return slots;
+}
+
+/* Insert name into name table; inserting in index order keeps the
+ * first of any duplicate names ahead of the rest within its probe */
+static void name_table_insert(pmdl_name_slot* table, unsigned mask, const char* name, unsigned index) {
+    uint32_t name_hash = pmdl_name_hash(name);
+    unsigned slot = name_hash & mask;
+    while (table[slot].index)
+        slot = (slot+1) & mask;
+    table[slot].name_hash = name_hash;
+    table[slot].index = index + 1;
+}
+
 /* Routine to init rigging context */
 void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const char* bone_string_table) {
     const void* file_cur = file_data;
@@ -128,6 +244,10 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
         bone_track_count += action->bone_count;
     }
     
+    // Name table sizes
+    unsigned bone_slot_count = name_table_slots(bone_count);
+    unsigned action_slot_count = name_table_slots(action_count);
+    
     
     // Allocate context block
     size_t block_size = sizeof(pmdl_rigging_ctx);
@@ -138,6 +258,10 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
     block_size += sizeof(pmdl_bone*)*skin_bone_array_count;
     block_size += sizeof(pmdl_action)*action_count;
     block_size += sizeof(pmdl_action_bone_track)*bone_track_count;
+    block_size += sizeof(pmdl_action_bone_track*)*bone_count*action_count;
+    block_size += sizeof(pmdl_name_slot)*(bone_slot_count+action_slot_count);
+    block_size += sizeof(pmdl_ctx_pool)*2;
+    block_size += sizeof(unsigned)*bone_count;
     
     void* context_block = pspl_allocate_media_block(block_size);
     void* context_cur = context_block;
@@ -151,10 +275,10 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
     rigging_ctx->bone_array = context_cur;
     context_cur += sizeof(pmdl_bone)*bone_count;
     
-    // Allocate bone base vector block
+    // Allocate bone base vector block (followed by skin palette bases)
     // (Separated for SIMD vector alignment reasons)
     pspl_vector4_t* base_vector_block =
-    pspl_allocate_media_block(bone_count*sizeof(pspl_vector4_t));
+    pspl_allocate_media_block((bone_count+skin_bone_array_count)*sizeof(pspl_vector4_t));
     
     for (i=0 ; i<bone_count ; ++i) {
         
@@ -182,6 +306,16 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
         base_vector->f[2] = -bone->bone_head[1];
         target_bone->base_vector = base_vector;
         
+        // Optional vertex AABB follows child array (if bone structure long enough)
+        uint32_t bone_end = (i+1 < bone_count) ? bone_offsets[i+1] :
+                            (uint32_t)((file_data + skel_section_length) - bone_arr);
+        size_t bone_len = sizeof(struct file_bone) + sizeof(uint32_t)*bone->child_count;
+        if (bone_end - bone_offsets[i] >= bone_len + sizeof(float)*6)
+            target_bone->vert_aabb = (const float (*)[3])((const void*)bone->child_array +
+                                                          sizeof(uint32_t)*bone->child_count);
+        else
+            target_bone->vert_aabb = NULL;
+        
     }
     
     rigging_ctx->root_bone_count = root_bone_count;
@@ -200,8 +334,11 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
     rigging_ctx->skin_entry_count = skin_count;
     rigging_ctx->skin_entry_array = context_cur;
     context_cur += sizeof(pmdl_skin_entry)*skin_count;
+    rigging_ctx->skin_palette_count = skin_bone_array_count;
+    rigging_ctx->skin_base_array = &base_vector_block[bone_count];
     
 #if PMDL_GENERAL
+    unsigned palette_offset = 0;
     for (i=0 ; i<skin_count ; ++i) {
         
         struct file_skin* skin = (struct file_skin*)(skin_arr + skin_offsets[i]);
@@ -209,10 +346,14 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
         
         target_skin->bone_count = skin->bone_count;
         target_skin->bone_array = context_cur;
+        target_skin->palette_offset = palette_offset;
         pmdl_bone** bone_arr_writer = context_cur;
-        for (j=0 ; j<skin->bone_count ; ++j)
+        for (j=0 ; j<skin->bone_count ; ++j) {
             bone_arr_writer[j] = (pmdl_bone*)&rigging_ctx->bone_array[skin->bone_indices[j]];
+            base_vector_block[bone_count+palette_offset+j] = *bone_arr_writer[j]->base_vector;
+        }
         context_cur += sizeof(pmdl_bone*)*skin->bone_count;
+        palette_offset += skin->bone_count;
         
     }
 #endif
@@ -239,6 +380,7 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
         target_action->bone_track_count = action_head->bone_count;
         target_action->bone_track_array = context_cur;
         pmdl_action_bone_track* bone_arr_writer = context_cur;
+        unsigned curve_index = 0;
         for (j=0 ; j<action_head->bone_count ; ++j) {
             
             pmdl_action_bone_track* track = &bone_arr_writer[j];
@@ -248,6 +390,7 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
             
             track->bone_index = ACTION_BONE_IDX(track_head);
             track->property_count = 0;
+            track->first_curve_index = curve_index;
             
             if (ACTION_SCALE(track_head)) {
                 track->property_count += 3;
@@ -294,18 +437,89 @@ void pmdl_rigging_init(pmdl_rigging_ctx** rig_ctx, const void* file_data, const
                 track->location_z = NULL;
             }
             
+            curve_index += track->property_count;
+            
         }
         context_cur += sizeof(pmdl_action_bone_track)*action_head->bone_count;
         
     }
+    
+    // Bone-to-track tables (the first track of a bone wins)
+    for (i=0 ; i<action_count ; ++i) {
+        pmdl_action* target_action = (pmdl_action*)&rigging_ctx->action_array[i];
+        const pmdl_action_bone_track** lut_writer = context_cur;
+        memset(lut_writer, 0, sizeof(pmdl_action_bone_track*)*bone_count);
+        for (j=0 ; j<target_action->bone_track_count ; ++j) {
+            const pmdl_action_bone_track* track = &target_action->bone_track_array[j];
+            if (track->bone_index < bone_count && !lut_writer[track->bone_index])
+                lut_writer[track->bone_index] = track;
+        }
+        target_action->bone_track_lut = lut_writer;
+        context_cur += sizeof(pmdl_action_bone_track*)*bone_count;
+    }
+    
+    
+    // Hashed name tables
+    pmdl_name_slot* bone_name_writer = context_cur;
+    memset(bone_name_writer, 0, sizeof(pmdl_name_slot)*bone_slot_count);
+    rigging_ctx->bone_name_mask = bone_slot_count - 1;
+    rigging_ctx->bone_name_table = bone_name_writer;
+    for (i=0 ; i<bone_count ; ++i)
+        name_table_insert(bone_name_writer, rigging_ctx->bone_name_mask, rigging_ctx->bone_array[i].bone_name, i);
+    context_cur += sizeof(pmdl_name_slot)*bone_slot_count;
+    
+    pmdl_name_slot* action_name_writer = context_cur;
+    memset(action_name_writer, 0, sizeof(pmdl_name_slot)*action_slot_count);
+    rigging_ctx->action_name_mask = action_slot_count - 1;
+    rigging_ctx->action_name_table = action_name_writer;
+    for (i=0 ; i<action_count ; ++i)
+        name_table_insert(action_name_writer, rigging_ctx->action_name_mask, rigging_ctx->action_array[i].action_name, i);
+    context_cur += sizeof(pmdl_name_slot)*action_slot_count;
+    
+    
+    // Context pools (slots fit the largest action context, and
+    // animation contexts composing up to `ANIMATION_POOL_ACTIONS`)
+    pmdl_ctx_pool* pool_writer = context_cur;
+    size_t action_slot_size = 0;
+    for (i=0 ; i<action_count ; ++i) {
+        size_t size = action_ctx_size(&rigging_ctx->action_array[i], NULL);
+        if (size > action_slot_size)
+            action_slot_size = size;
+    }
+    pool_writer[0].slot_size = ROUND_UP_16(action_slot_size);
+    pool_writer[0].free_list = NULL;
+    pool_writer[0].chunk_list = NULL;
+    pool_writer[1].slot_size = ROUND_UP_16(animation_ctx_size(rigging_ctx, ANIMATION_POOL_ACTIONS, NULL));
+    pool_writer[1].free_list = NULL;
+    pool_writer[1].chunk_list = NULL;
+    rigging_ctx->action_ctx_pool = &pool_writer[0];
+    rigging_ctx->animation_ctx_pool = &pool_writer[1];
+    context_cur += sizeof(pmdl_ctx_pool)*2;
+    
+    
+    // FK evaluation order (breadth-first from root bones; parents always precede children)
+    rigging_ctx->fk_order_array = context_cur;
+    unsigned* fk_order_writer = context_cur;
+    j=0;
+    for (i=0 ; i<root_bone_count ; ++i)
+        fk_order_writer[j++] = rigging_ctx->root_bone_array[i]->bone_index;
+    for (i=0 ; i<j ; ++i) {
+        const pmdl_bone* bone = &rigging_ctx->bone_array[fk_order_writer[i]];
+        unsigned k;
+        for (k=0 ; k<bone->child_count && j<bone_count ; ++k)
+            fk_order_writer[j++] = bone->child_arr[k]->bone_index;
+    }
+    context_cur += sizeof(unsigned)*bone_count;
 
     
     *rig_ctx = rigging_ctx;
     
 }
 
-/* Routine to destroy rigging context */
+/* Routine to destroy rigging context (along with pooled contexts) */
 void pmdl_rigging_destroy(pmdl_rigging_ctx* rig_ctx) {
+    ctx_pool_destroy(rig_ctx->action_ctx_pool);
+    ctx_pool_destroy(rig_ctx->animation_ctx_pool);
     pspl_free_media_block((void*)rig_ctx->bone_array[0].base_vector);
     pspl_free_media_block(rig_ctx);
 }
@@ -318,19 +532,10 @@ pmdl_action_ctx* pmdl_action_init(const pmdl_action* action) {
     if (!action)
         return NULL;
     
-    // Determine size of context block
-    size_t block_size = sizeof(pmdl_action_ctx);
-    
-    unsigned curve_instance_count = 0;
-    for (i=0 ; i<action->bone_track_count; ++i) {
-        const pmdl_action_bone_track* bone_track = &action->bone_track_array[i];
-        curve_instance_count += bone_track->property_count;
-    }
-    
-    block_size += sizeof(pmdl_curve_playback)*curve_instance_count;
-    
-    // Allocate context block
-    void* context_block = pspl_allocate_media_block(block_size);
+    // Allocate context block from rigging context's pool
+    unsigned curve_instance_count;
+    action_ctx_size(action, &curve_instance_count);
+    void* context_block = ctx_pool_alloc(action->parent_ctx->action_ctx_pool);
     pmdl_action_ctx* new_ctx = context_block;
     new_ctx->action = action;
     new_ctx->current_time = 0.0;
@@ -402,6 +607,34 @@ pmdl_action_ctx* pmdl_action_init(const pmdl_action* action) {
         
     }
     
+    // Convert keyframe handles to power-basis cubic segments
+    pmdl_curve_segment* segment_cur = context_block + sizeof(pmdl_action_ctx) +
+    sizeof(pmdl_curve_playback)*curve_instance_count;
+    for (i=0 ; i<curve_instance_count ; ++i) {
+        pmdl_curve_playback* curve_inst = &new_ctx->curve_instance_array[i];
+        curve_inst->keyframe_cursor = 0;
+        curve_inst->cached_value = curve_inst->curve->keyframe_array[0].main_handle[1];
+        curve_inst->segment_array = segment_cur;
+        
+        for (j=0 ; j+1<curve_inst->curve->keyframe_count ; ++j) {
+            const pmdl_curve_keyframe* left_kf = &curve_inst->curve->keyframe_array[j];
+            const pmdl_curve_keyframe* right_kf = &curve_inst->curve->keyframe_array[j+1];
+            int k;
+            for (k=0 ; k<2 ; ++k) {
+                float p0 = left_kf->main_handle[k];
+                float p1 = left_kf->right_handle[k];
+                float p2 = right_kf->left_handle[k];
+                float p3 = right_kf->main_handle[k];
+                float* c = (k)?segment_cur->y:segment_cur->x;
+                c[0] = p3 - p0 + 3.0f*(p1 - p2);
+                c[1] = 3.0f*(p0 - 2.0f*p1 + p2);
+                c[2] = 3.0f*(p1 - p0);
+                c[3] = p0;
+            }
+            ++segment_cur;
+        }
+    }
+    
     
     return new_ctx;
     
@@ -409,221 +642,203 @@ pmdl_action_ctx* pmdl_action_init(const pmdl_action* action) {
 
 /* Routine to destroy action context */
 void pmdl_action_destroy(pmdl_action_ctx* ctx_ptr) {
-    pspl_free_media_block(ctx_ptr);
+    ctx_pool_free(ctx_ptr->action->parent_ctx->action_ctx_pool, ctx_ptr);
 }
 
-/* Recursively solve bézier Y (value) for X (time) by approaching
- * acceptable limit error. 
+/* Fixed Newton-Raphson iteration count for solving segment parameter from time */
+#define BEZIER_NEWTON_STEPS 5
+
+/* Solve bézier Y (value) for X (time) within one segment.
+ * Starts from the linear estimate and refines with Newton-Raphson;
  * CURVE MUST BE A FUNCTION! NON-FCURVES YIELD UNDEFINED RESULTS!! */
-static inline double solve_bezier(double time,
-                                  double limit_error,
-                                  const pmdl_curve_keyframe* left_kf,
-                                  const pmdl_curve_keyframe* right_kf) {
-    
-    double err;
-    double epsilon = 0.5;
-    double t = 0.5;
-    double result[2];
-    for (;;) {
-        
-        double t1m = 1.0-t;
-        double t1msq = t1m*t1m;
-        double tsq = t*t;
-        
-        double a = (t1msq*t1m);
-        double b = (3*t1msq*t);
-        double c = (3*t1m*tsq);
-        double d = (tsq*t);
-        
-        result[0] = (a*left_kf->main_handle[0]) + (b*left_kf->right_handle[0]) +
-                    (c*right_kf->left_handle[0]) + (d*right_kf->main_handle[0]);
-        
-        err = fabs(result[0] - time);
-        if (err < limit_error) {
-            result[1] = (a*left_kf->main_handle[1]) + (b*left_kf->right_handle[1]) +
-                        (c*right_kf->left_handle[1]) + (d*right_kf->main_handle[1]);
-            break;
-        }
-        epsilon /= 2;
-        if (result[0] > time)
-            t -= epsilon;
-        else
-            t += epsilon;
-        
+static inline float solve_bezier(float time, const pmdl_curve_segment* seg) {
+    
+    const float* x = seg->x;
+    const float* y = seg->y;
+    float span = x[0] + x[1] + x[2];
+    float t = (span > 0.0f) ? (time - x[3]) / span : 0.0f;
+    
+    int i;
+    for (i=0 ; i<BEZIER_NEWTON_STEPS ; ++i) {
+        float err = ((x[0]*t + x[1])*t + x[2])*t + x[3] - time;
+        float slope = (3.0f*x[0]*t + 2.0f*x[1])*t + x[2];
+        if (slope > 1e-6f)
+            t -= err / slope;
+        if (t < 0.0f)
+            t = 0.0f;
+        else if (t > 1.0f)
+            t = 1.0f;
     }
     
-    return result[1];
+    return ((y[0]*t + y[1])*t + y[2])*t + y[3];
     
 }
 
-/* Routine to recursively evaluate FK sub-chain */
-static void recursive_fk_evaluate(pmdl_fk_playback* fk, unsigned action_count, char flip_bit) {
+/* Routine to blend cached curve values of all composed actions for one FK instance */
+static void fk_blend(pmdl_fk_playback* fk, unsigned action_count) {
     int i = 0;
     int j;
     
-    if (fk->eval_flip_bit != flip_bit) {
-        fk->eval_flip_bit = flip_bit;
-        if (fk->parent_fk)
-            recursive_fk_evaluate(fk->parent_fk, action_count, flip_bit);
-        
-        
-        // Clear blended values
-        fk->is_animated = 0;
-        
-        fk->scale_blend.f[0] = 1.0;
-        fk->scale_blend.f[1] = 1.0;
-        fk->scale_blend.f[2] = 1.0;
+    // Clear blended values
+    fk->is_animated = 0;
     
-        fk->rotation_blend.f[3] = 1.0;
-        fk->rotation_blend.f[0] = 0.0;
-        fk->rotation_blend.f[1] = 0.0;
-        fk->rotation_blend.f[2] = 0.0;
+    fk->scale_blend.f[0] = 1.0;
+    fk->scale_blend.f[1] = 1.0;
+    fk->scale_blend.f[2] = 1.0;
+
+    fk->rotation_blend.f[3] = 1.0;
+    fk->rotation_blend.f[0] = 0.0;
+    fk->rotation_blend.f[1] = 0.0;
+    fk->rotation_blend.f[2] = 0.0;
+
+    fk->location_blend.f[0] = 0.0;
+    fk->location_blend.f[1] = 0.0;
+    fk->location_blend.f[2] = 0.0;
     
-        fk->location_blend.f[0] = 0.0;
-        fk->location_blend.f[1] = 0.0;
-        fk->location_blend.f[2] = 0.0;
-        
-        
-        // Blend values together for animation composition
-        for (j=0 ; j<action_count ; ++j) {
-            const pmdl_fk_action_playback* action_playback = &fk->action_playback_array[j];
-            
-            if (action_playback->bone_anim_track) {
-                
-                // Scale blend
-                if (action_playback->bone_anim_track->scale_x)
-                    fk->scale_blend.f[0] *= action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->scale_y)
-                    fk->scale_blend.f[1] *= action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->scale_z)
-                    fk->scale_blend.f[2] *= action_playback->first_curve_instance[i++].cached_value;
-                
-                // Rotation blend
-                pspl_vector4_t rotation_quat = {.f[0]=0, .f[1]=0, .f[2]=0, .f[3]=1};
-                if (action_playback->bone_anim_track->rotation_w)
-                    rotation_quat.f[3] = action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->rotation_x)
-                    rotation_quat.f[0] = action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->rotation_y)
-                    rotation_quat.f[2] = action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->rotation_z)
-                    rotation_quat.f[1] = action_playback->first_curve_instance[i++].cached_value;
-                if (!fk->is_animated)
-                    pmdl_quat_mul(&fk->rotation_blend, &rotation_quat, &fk->rotation_blend);
-                
-                // Location blend
-                if (action_playback->bone_anim_track->location_x)
-                    fk->location_blend.f[0] += action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->location_y)
-                    fk->location_blend.f[1] += action_playback->first_curve_instance[i++].cached_value;
-                if (action_playback->bone_anim_track->location_z)
-                    fk->location_blend.f[2] += action_playback->first_curve_instance[i++].cached_value;
-
-                fk->is_animated = 1;
-                
-            }
-            
-        }
+    
+    // Blend values together for animation composition
+    for (j=0 ; j<action_count ; ++j) {
+        const pmdl_fk_action_playback* action_playback = &fk->action_playback_array[j];
         
-        // Convert blended values to transformation matrices
-        if (fk->is_animated && fk->parent_fk) {
-            // Animated child bone
-            
-            // Scale transform
-            pspl_matrix34_t scale_matrix;
-            pmdl_matrix34_cpy(fk->parent_fk->bone_matrix->v, scale_matrix.v);
-            scale_matrix.m[0][0] *= fk->scale_blend.f[0];
-            scale_matrix.m[1][1] *= fk->scale_blend.f[1];
-            scale_matrix.m[2][2] *= fk->scale_blend.f[2];
-            //scale_matrix.m[0][3] = 0.0f;
-            //scale_matrix.m[1][3] = 0.0f;
-            //scale_matrix.m[2][3] = 0.0f;
-            
-            // Rotation transform
-            pspl_matrix34_t rotation_location_matrix;
-            pspl_vector4_t rotation_quat;
-            rotation_quat.f[3] = fk->rotation_blend.f[3];
-            rotation_quat.f[0] = fk->rotation_blend.f[0];
-            rotation_quat.f[1] = fk->rotation_blend.f[1];
-            rotation_quat.f[2] = fk->rotation_blend.f[2];
-            pmdl_matrix34_quat(&rotation_location_matrix, &rotation_quat);
-            
-            // Location transform
-            pspl_vector4_t parent_base_vector;
-            pmdl_vector4_sub(fk->bone->base_vector->v, fk->parent_fk->bone->base_vector->v, parent_base_vector.v);
-            rotation_location_matrix.m[0][3] = parent_base_vector.f[0];
-            rotation_location_matrix.m[1][3] = parent_base_vector.f[1];
-            rotation_location_matrix.m[2][3] = parent_base_vector.f[2];
-            /*
-            pmdl_vector3_matrix_mul(fk->parent_fk->bone_matrix,
-                                    (pspl_vector3_t*)&parent_base_vector, (pspl_vector3_t*)&parent_base_vector);
-            rotation_location_matrix.m[0][3] = parent_base_vector.f[0];
-            rotation_location_matrix.m[1][3] = parent_base_vector.f[1];
-            rotation_location_matrix.m[2][3] = parent_base_vector.f[2];
-            rotation_location_matrix.m[0][3] += fk->location_blend.f[0];
-            rotation_location_matrix.m[1][3] += fk->location_blend.f[1];
-            rotation_location_matrix.m[2][3] += fk->location_blend.f[2];
-             */
-            
-            // Concatenate transforms
-            pmdl_matrix34_mul(&scale_matrix, &rotation_location_matrix, fk->bone_matrix);
-            
-            
-        } else if (fk->is_animated) {
-            // Animated root bone
-            
-            // Scale transform
-            pspl_matrix34_t scale_matrix;
-            pmdl_matrix34_identity(&scale_matrix);
-            scale_matrix.m[0][0] = fk->scale_blend.f[0];
-            scale_matrix.m[1][1] = fk->scale_blend.f[1];
-            scale_matrix.m[2][2] = fk->scale_blend.f[2];
-            
-            // Rotation transform
-            pspl_matrix34_t rotation_location_matrix;
-            pspl_vector4_t rotation_quat;
-            rotation_quat.f[3] = fk->rotation_blend.f[3];
-            rotation_quat.f[0] = fk->rotation_blend.f[0];
-            rotation_quat.f[1] = fk->rotation_blend.f[1];
-            rotation_quat.f[2] = fk->rotation_blend.f[2];
-            pmdl_matrix34_quat(&rotation_location_matrix, &rotation_quat);
-            
-            // Location transform
-            rotation_location_matrix.m[0][3] = (fk->bone->base_vector)->f[0];
-            rotation_location_matrix.m[1][3] = (fk->bone->base_vector)->f[1];
-            rotation_location_matrix.m[2][3] = (fk->bone->base_vector)->f[2];
-            rotation_location_matrix.m[0][3] += fk->location_blend.f[0];
-            rotation_location_matrix.m[1][3] += fk->location_blend.f[1];
-            rotation_location_matrix.m[2][3] += fk->location_blend.f[2];
-            
-            // Concatenate transforms
-            pmdl_matrix34_mul(&scale_matrix, &rotation_location_matrix, fk->bone_matrix);
-            
-            
-        } else if (fk->parent_fk) {
-            // Non-animated child bone
-            
-            pmdl_matrix34_cpy(fk->parent_fk->bone_matrix->v, fk->bone_matrix->v);
-            pspl_vector4_t parent_base_vector;
-            pmdl_vector4_sub(fk->bone->base_vector->v, fk->parent_fk->bone->base_vector->v, parent_base_vector.v);
-            pmdl_vector3_matrix_mul(fk->parent_fk->bone_matrix,
-                                    (pspl_vector3_t*)&parent_base_vector, (pspl_vector3_t*)&parent_base_vector);
-            fk->bone_matrix->m[0][3] = parent_base_vector.f[0];
-            fk->bone_matrix->m[1][3] = parent_base_vector.f[1];
-            fk->bone_matrix->m[2][3] = parent_base_vector.f[2];
-            
+        if (action_playback->bone_anim_track) {
             
-        } else {
-            // Non-animated root bone
+            // Scale blend
+            if (action_playback->bone_anim_track->scale_x)
+                fk->scale_blend.f[0] *= action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->scale_y)
+                fk->scale_blend.f[1] *= action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->scale_z)
+                fk->scale_blend.f[2] *= action_playback->first_curve_instance[i++].cached_value;
             
-            pmdl_matrix34_identity(fk->bone_matrix);
-            fk->bone_matrix->m[0][3] = (fk->bone->base_vector)->f[0];
-            fk->bone_matrix->m[1][3] = (fk->bone->base_vector)->f[1];
-            fk->bone_matrix->m[2][3] = (fk->bone->base_vector)->f[2];
+            // Rotation blend
+            pspl_vector4_t rotation_quat = {.f[0]=0, .f[1]=0, .f[2]=0, .f[3]=1};
+            if (action_playback->bone_anim_track->rotation_w)
+                rotation_quat.f[3] = action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->rotation_x)
+                rotation_quat.f[0] = action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->rotation_y)
+                rotation_quat.f[2] = action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->rotation_z)
+                rotation_quat.f[1] = action_playback->first_curve_instance[i++].cached_value;
+            if (!fk->is_animated)
+                pmdl_quat_mul(&fk->rotation_blend, &rotation_quat, &fk->rotation_blend);
             
+            // Location blend
+            if (action_playback->bone_anim_track->location_x)
+                fk->location_blend.f[0] += action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->location_y)
+                fk->location_blend.f[1] += action_playback->first_curve_instance[i++].cached_value;
+            if (action_playback->bone_anim_track->location_z)
+                fk->location_blend.f[2] += action_playback->first_curve_instance[i++].cached_value;
+
+            fk->is_animated = 1;
             
         }
         
+    }
+    
+}
+
+/* Routine to convert blended values to the FK instance's transformation matrix
+ * (parent FK instance must already be composed) */
+static void fk_compose(pmdl_fk_playback* fk) {
+    
+    if (fk->is_animated && fk->parent_fk) {
+        // Animated child bone
+        
+        // Scale transform
+        pspl_matrix34_t scale_matrix;
+        pmdl_matrix34_cpy(fk->parent_fk->bone_matrix->v, scale_matrix.v);
+        scale_matrix.m[0][0] *= fk->scale_blend.f[0];
+        scale_matrix.m[1][1] *= fk->scale_blend.f[1];
+        scale_matrix.m[2][2] *= fk->scale_blend.f[2];
+        //scale_matrix.m[0][3] = 0.0f;
+        //scale_matrix.m[1][3] = 0.0f;
+        //scale_matrix.m[2][3] = 0.0f;
+        
+        // Rotation transform
+        pspl_matrix34_t rotation_location_matrix;
+        pspl_vector4_t rotation_quat;
+        rotation_quat.f[3] = fk->rotation_blend.f[3];
+        rotation_quat.f[0] = fk->rotation_blend.f[0];
+        rotation_quat.f[1] = fk->rotation_blend.f[1];
+        rotation_quat.f[2] = fk->rotation_blend.f[2];
+        pmdl_matrix34_quat(&rotation_location_matrix, &rotation_quat);
+        
+        // Location transform
+        pspl_vector4_t parent_base_vector;
+        pmdl_vector4_sub(fk->bone->base_vector->v, fk->parent_fk->bone->base_vector->v, parent_base_vector.v);
+        rotation_location_matrix.m[0][3] = parent_base_vector.f[0];
+        rotation_location_matrix.m[1][3] = parent_base_vector.f[1];
+        rotation_location_matrix.m[2][3] = parent_base_vector.f[2];
+        /*
+        pmdl_vector3_matrix_mul(fk->parent_fk->bone_matrix,
+                                (pspl_vector3_t*)&parent_base_vector, (pspl_vector3_t*)&parent_base_vector);
+        rotation_location_matrix.m[0][3] = parent_base_vector.f[0];
+        rotation_location_matrix.m[1][3] = parent_base_vector.f[1];
+        rotation_location_matrix.m[2][3] = parent_base_vector.f[2];
+        rotation_location_matrix.m[0][3] += fk->location_blend.f[0];
+        rotation_location_matrix.m[1][3] += fk->location_blend.f[1];
+        rotation_location_matrix.m[2][3] += fk->location_blend.f[2];
+         */
+        
+        // Concatenate transforms
+        pmdl_matrix34_mul(&scale_matrix, &rotation_location_matrix, fk->bone_matrix);
+        
+        
+    } else if (fk->is_animated) {
+        // Animated root bone
+        
+        // Scale transform
+        pspl_matrix34_t scale_matrix;
+        pmdl_matrix34_identity(&scale_matrix);
+        scale_matrix.m[0][0] = fk->scale_blend.f[0];
+        scale_matrix.m[1][1] = fk->scale_blend.f[1];
+        scale_matrix.m[2][2] = fk->scale_blend.f[2];
+        
+        // Rotation transform
+        pspl_matrix34_t rotation_location_matrix;
+        pspl_vector4_t rotation_quat;
+        rotation_quat.f[3] = fk->rotation_blend.f[3];
+        rotation_quat.f[0] = fk->rotation_blend.f[0];
+        rotation_quat.f[1] = fk->rotation_blend.f[1];
+        rotation_quat.f[2] = fk->rotation_blend.f[2];
+        pmdl_matrix34_quat(&rotation_location_matrix, &rotation_quat);
+        
+        // Location transform
+        rotation_location_matrix.m[0][3] = (fk->bone->base_vector)->f[0];
+        rotation_location_matrix.m[1][3] = (fk->bone->base_vector)->f[1];
+        rotation_location_matrix.m[2][3] = (fk->bone->base_vector)->f[2];
+        rotation_location_matrix.m[0][3] += fk->location_blend.f[0];
+        rotation_location_matrix.m[1][3] += fk->location_blend.f[1];
+        rotation_location_matrix.m[2][3] += fk->location_blend.f[2];
+        
+        // Concatenate transforms
+        pmdl_matrix34_mul(&scale_matrix, &rotation_location_matrix, fk->bone_matrix);
+        
+        
+    } else if (fk->parent_fk) {
+        // Non-animated child bone
+        
+        pmdl_matrix34_cpy(fk->parent_fk->bone_matrix->v, fk->bone_matrix->v);
+        pspl_vector4_t parent_base_vector;
+        pmdl_vector4_sub(fk->bone->base_vector->v, fk->parent_fk->bone->base_vector->v, parent_base_vector.v);
+        pmdl_vector3_matrix_mul(fk->parent_fk->bone_matrix,
+                                (pspl_vector3_t*)&parent_base_vector, (pspl_vector3_t*)&parent_base_vector);
+        fk->bone_matrix->m[0][3] = parent_base_vector.f[0];
+        fk->bone_matrix->m[1][3] = parent_base_vector.f[1];
+        fk->bone_matrix->m[2][3] = parent_base_vector.f[2];
+        
+        
+    } else {
+        // Non-animated root bone
+        
+        pmdl_matrix34_identity(fk->bone_matrix);
+        fk->bone_matrix->m[0][3] = (fk->bone->base_vector)->f[0];
+        fk->bone_matrix->m[1][3] = (fk->bone->base_vector)->f[1];
+        fk->bone_matrix->m[2][3] = (fk->bone->base_vector)->f[2];
+        
+        
     }
 }
 
@@ -634,9 +849,6 @@ void pmdl_action_advance(pmdl_action_ctx* ctx_ptr, double time_delta) {
     
     int i,j;
     
-    // Target epsilon value for solving cubic bézier values (adaptive to playback rate)
-    double limit_error = time_delta / 8.0;
-    
     // Calculate current time in animation
     double current_time = ctx_ptr->current_time + time_delta;
     
@@ -657,51 +869,65 @@ void pmdl_action_advance(pmdl_action_ctx* ctx_ptr, double time_delta) {
     // Iterate curve instances and cache current animation values
     for (i=0 ; i<ctx_ptr->curve_instance_count ; ++i) {
         pmdl_curve_playback* curve_inst = &ctx_ptr->curve_instance_array[i];
+        const pmdl_curve_keyframe* kf_arr = curve_inst->curve->keyframe_array;
+        unsigned kf_count = curve_inst->curve->keyframe_count;
         
-        // If one keyframe, static pose
-        if (curve_inst->curve->keyframe_count == 1) {
-            curve_inst->cached_value = curve_inst->curve->keyframe_array[0].main_handle[1];
+        // If outside keyframe bounds (or one keyframe), simply cache extrema value
+        if (kf_count == 1 || current_time <= kf_arr[0].main_handle[0]) {
+            curve_inst->cached_value = kf_arr[0].main_handle[1];
             continue;
         }
-        
-        // Find surrounding keyframes
-        const pmdl_curve_keyframe* left_kf = NULL;
-        const pmdl_curve_keyframe* right_kf = NULL;
-
-        for (j=0 ; j<curve_inst->curve->keyframe_count ; ++j) {
-            const pmdl_curve_keyframe* kf = &curve_inst->curve->keyframe_array[j];
-            
-            if (current_time > kf->main_handle[0])
-                left_kf = kf;
-            else {
-                right_kf = kf;
-                break;
-            }
-            
-        }
-        if (!right_kf)
-            right_kf = &curve_inst->curve->keyframe_array[curve_inst->curve->keyframe_count - 1];
-        if (!left_kf)
-            left_kf = right_kf;
-        
-        // If outside keyframe bounds, simply cache extrema value
-        if (left_kf == right_kf) {
-            curve_inst->cached_value = left_kf->main_handle[1];
+        if (current_time > kf_arr[kf_count-1].main_handle[0]) {
+            curve_inst->cached_value = kf_arr[kf_count-1].main_handle[1];
             continue;
         }
         
-        // Otherwise, solve cubic polynomial
-        curve_inst->cached_value = solve_bezier(current_time, limit_error, left_kf, right_kf);
+        // Find surrounding keyframes, starting from the last segment evaluated
+        // (forward playback rarely moves more than one segment per advance)
+        j = curve_inst->keyframe_cursor;
+        if (j > kf_count-2)
+            j = kf_count-2;
+        while (j > 0 && current_time <= kf_arr[j].main_handle[0])
+            --j;
+        while (current_time > kf_arr[j+1].main_handle[0])
+            ++j;
+        curve_inst->keyframe_cursor = j;
+        
+        // Solve cubic polynomial
+        curve_inst->cached_value = solve_bezier(current_time, &curve_inst->segment_array[j]);
         
     }
     
 }
 
 
+/* Source of process-unique palette generation numbers */
+static volatile int32_t palette_generation_counter = 0;
+
+/* Routine to copy evaluated bone matrices into the skin palette */
+static void fk_update_palette(pmdl_animation_ctx* ctx) {
+    int i,j;
+    const pmdl_rigging_ctx* rig_ctx = ctx->parent_ctx;
+    pspl_matrix44_t* palette = ctx->skin_palette_array;
+    for (i=0 ; i<rig_ctx->skin_entry_count ; ++i) {
+        const pmdl_skin_entry* skin_entry = &rig_ctx->skin_entry_array[i];
+        for (j=0 ; j<skin_entry->bone_count ; ++j) {
+            const pmdl_bone* bone = skin_entry->bone_array[j];
+            pmdl_matrix34_cpy(ctx->fk_instance_array[bone->bone_index].bone_matrix->v, palette->v);
+            palette->m[3][0] = 0.0f;
+            palette->m[3][1] = 0.0f;
+            palette->m[3][2] = 0.0f;
+            palette->m[3][3] = 1.0f;
+            ++palette;
+        }
+    }
+    ctx->palette_generation = pspl_atomic_inc(&palette_generation_counter);
+}
+
 /* Routine to init animation context */
 pmdl_animation_ctx* pmdl_animation_init(unsigned action_ctx_count,
                                         const pmdl_action_ctx** action_ctx_array) {
-    int i,j,k,l;
+    int i,l;
     if (!action_ctx_count)
         return NULL;
     
@@ -714,33 +940,32 @@ pmdl_animation_ctx* pmdl_animation_init(unsigned action_ctx_count,
     // Common rigging context
     const pmdl_rigging_ctx* parent_ctx = action_ctx_array[0]->action->parent_ctx;
     
-    // Allocate context block
-    size_t block_size = sizeof(pmdl_animation_ctx);
-    block_size += sizeof(pmdl_action_ctx*)*action_ctx_count;
-    block_size += sizeof(pmdl_fk_playback)*parent_ctx->bone_count;
-    block_size += sizeof(pmdl_fk_action_playback)*action_ctx_count*parent_ctx->bone_count;
-    void* context_block = pspl_allocate_media_block(block_size);
+    // Allocate context block (from rigging context's pool unless composing many actions)
+    size_t matrix_off;
+    size_t block_size = animation_ctx_size(parent_ctx, action_ctx_count, &matrix_off);
+    void* context_block = (action_ctx_count <= ANIMATION_POOL_ACTIONS) ?
+                          ctx_pool_alloc(parent_ctx->animation_ctx_pool) :
+                          pspl_allocate_media_block(block_size);
     pmdl_animation_ctx* new_ctx = context_block;
+    void* fk_block = context_block + ROUND_UP_16(sizeof(pmdl_animation_ctx));
     
     // Populate main members
     new_ctx->parent_ctx = parent_ctx;
+    new_ctx->fk_instance_count = parent_ctx->bone_count;
+    new_ctx->fk_instance_array = fk_block;
     new_ctx->action_ctx_count = action_ctx_count;
-    new_ctx->action_ctx_array = context_block + sizeof(pmdl_animation_ctx);
+    new_ctx->action_ctx_array = fk_block + sizeof(pmdl_fk_playback)*parent_ctx->bone_count +
+    sizeof(pmdl_fk_action_playback)*action_ctx_count*parent_ctx->bone_count;
     for (i=0 ; i<action_ctx_count ; ++i)
         new_ctx->action_ctx_array[i] = action_ctx_array[i];
-    new_ctx->fk_instance_count = parent_ctx->bone_count;
-    new_ctx->fk_instance_array = context_block + sizeof(pmdl_animation_ctx) +
-    sizeof(pmdl_action_ctx*)*action_ctx_count;
-    new_ctx->master_fk_flip_bit = 0;
     
-    // Allocate bone matrix array
-    // (separate block on heap due to SIMD vector alignment requirements)
-    pspl_matrix34_t* matrix_array_block =
-    pspl_allocate_media_block(parent_ctx->bone_count*sizeof(pspl_matrix34_t));
+    // Bone matrix array (followed by skin palette)
+    pspl_matrix34_t* matrix_array_block = context_block + matrix_off;
+    new_ctx->skin_palette_array = (pspl_matrix44_t*)&matrix_array_block[parent_ctx->bone_count];
+    new_ctx->palette_generation = 0;
     
     // Populate FK instance array
-    void* cur_action_playback = context_block + sizeof(pmdl_animation_ctx) +
-    sizeof(pmdl_action_ctx*)*action_ctx_count + sizeof(pmdl_fk_playback)*parent_ctx->bone_count;
+    void* cur_action_playback = fk_block + sizeof(pmdl_fk_playback)*parent_ctx->bone_count;
     for (i=0 ; i<parent_ctx->bone_count ; ++i) {
         
         const pmdl_bone* bone = &parent_ctx->bone_array[i];
@@ -753,22 +978,10 @@ pmdl_animation_ctx* pmdl_animation_init(unsigned action_ctx_count,
             const pmdl_action_ctx* action_ctx = action_ctx_array[l];
             pmdl_fk_action_playback* target_fk_action = (pmdl_fk_action_playback*)&target_fk->action_playback_array[l];
             
-            target_fk_action->bone_anim_track = NULL;
-            target_fk_action->first_curve_instance = NULL;
-            for (j=0 ; j<action_ctx->action->bone_track_count ; ++j) {
-                const pmdl_action_bone_track* bone_track = &action_ctx->action->bone_track_array[j];
-                if (bone_track->bone_index == i) {
-                    target_fk_action->bone_anim_track = bone_track;
-                    for (k=0 ; k<action_ctx->curve_instance_count ; ++k) {
-                        pmdl_curve_playback* curve_pb = &action_ctx->curve_instance_array[k];
-                        if (curve_pb->bone_index == i) {
-                            target_fk_action->first_curve_instance = curve_pb;
-                            break;
-                        }
-                    }
-                    break;
-                }
-            }
+            const pmdl_action_bone_track* bone_track = action_ctx->action->bone_track_lut[i];
+            target_fk_action->bone_anim_track = bone_track;
+            target_fk_action->first_curve_instance = (bone_track && bone_track->property_count) ?
+            &action_ctx->curve_instance_array[bone_track->first_curve_index] : NULL;
             
         }
         cur_action_playback += sizeof(pmdl_fk_action_playback)*action_ctx_count;
@@ -785,9 +998,8 @@ pmdl_animation_ctx* pmdl_animation_init(unsigned action_ctx_count,
         target_fk->bone_matrix->m[1][3] = (bone->base_vector)->f[1];
         target_fk->bone_matrix->m[2][3] = (bone->base_vector)->f[2];
         
-        target_fk->eval_flip_bit = 0;
-        
     }
+    fk_update_palette(new_ctx);
     
     return new_ctx;
     
@@ -823,20 +1035,266 @@ pmdl_animation_ctx* pmdl_animation_initv(const pmdl_action_ctx* first_action_ctx
 void pmdl_animation_evaluate(pmdl_animation_ctx* ctx_ptr) {
     int i;
     
-    // Iterate bone structure and perform FK transformations
-    ctx_ptr->master_fk_flip_bit ^= 1;
+    // Iterate bone structure in parent-first order and perform FK transformations
+    const unsigned* fk_order = ctx_ptr->parent_ctx->fk_order_array;
     for (i=0 ; i<ctx_ptr->fk_instance_count ; ++i) {
-        pmdl_fk_playback* fk = &ctx_ptr->fk_instance_array[i];
-        if (fk->bone)
-            recursive_fk_evaluate(fk, ctx_ptr->action_ctx_count, ctx_ptr->master_fk_flip_bit);
+        pmdl_fk_playback* fk = &ctx_ptr->fk_instance_array[fk_order[i]];
+        fk_blend(fk, ctx_ptr->action_ctx_count);
+        fk_compose(fk);
+    }
+    fk_update_palette(ctx_ptr);
+    
+}
+
+
+#pragma mark Batched Animation Evaluation
+
+/* Instances sharing a rigging context are composed together; one SIMD lane each */
+#define FK_LANE_COUNT 4
+
+/* Instances handed to each worker job */
+#define FK_JOB_INSTANCES (FK_LANE_COUNT*4)
+
+/* Workers evaluating batched animation contexts */
+#ifdef HW_RVL
+#define PMDL_ANIMATION_THREADS 0
+#else
+#define PMDL_ANIMATION_THREADS 4
+#endif
+static pspl_thread_pool_t* animation_pool = NULL;
+
+/* Structure-of-arrays transformation matrix (each element spans all lanes) */
+typedef struct {
+    pspl_vector4_vec_t m[3][4];
+} fk_lane_matrix;
+
+/* SoA matrix scratch of one batch (sliced per job) */
+typedef struct {
+    size_t count;
+    fk_lane_matrix matrices[];
+} fk_scratch_block;
+
+/* Free scratch block kept between batches; a batch takes it if large enough
+ * and returns it when done, while overlapping batches allocate their own */
+static fk_scratch_block* volatile soa_scratch = NULL;
+
+static fk_scratch_block* fk_scratch_take(size_t count) {
+    fk_scratch_block* block = soa_scratch;
+    if (block && pspl_atomic_cas(&soa_scratch, block, NULL)) {
+        if (block->count >= count)
+            return block;
+        pspl_free_media_block(block);
+    }
+    block = pspl_allocate_media_block(sizeof(fk_scratch_block) + sizeof(fk_lane_matrix)*count);
+    if (block)
+        block->count = count;
+    return block;
+}
+
+static void fk_scratch_release(fk_scratch_block* block) {
+    if (!pspl_atomic_cas(&soa_scratch, NULL, block))
+        pspl_free_media_block(block);
+}
+
+/* Routine to compose one bone across `lane_count` animation contexts;
+ * lanes beyond `lane_count` are evaluated with the rest pose and discarded */
+static void fk_compose_lanes(pmdl_animation_ctx** ctx_arr, unsigned lane_count,
+                             const pmdl_bone* bone, fk_lane_matrix* soa_matrices) {
+    int i,j,l;
+    
+    // Gather blended values into lanes
+    pspl_vector4_t scale[3], rot[4], loc[3];
+    for (l=0 ; l<FK_LANE_COUNT ; ++l) {
+        if (l < lane_count) {
+            pmdl_fk_playback* fk = &ctx_arr[l]->fk_instance_array[bone->bone_index];
+            fk_blend(fk, ctx_arr[l]->action_ctx_count);
+            for (i=0 ; i<3 ; ++i) {
+                scale[i].f[l] = fk->scale_blend.f[i];
+                loc[i].f[l] = fk->location_blend.f[i];
+            }
+            for (i=0 ; i<4 ; ++i)
+                rot[i].f[l] = fk->rotation_blend.f[i];
+        } else {
+            for (i=0 ; i<3 ; ++i) {
+                scale[i].f[l] = 1.0f;
+                loc[i].f[l] = 0.0f;
+            }
+            for (i=0 ; i<3 ; ++i)
+                rot[i].f[l] = 0.0f;
+            rot[3].f[l] = 1.0f;
+        }
+    }
+    
+    // Un-animated lanes blend to identity values; composing those through the animated
+    // path yields the same matrices as `fk_compose`, so every lane runs one path
+    
+    // Normalise quaternions
+    pspl_vector4_t norm = {.v = rot[0].v*rot[0].v + rot[1].v*rot[1].v +
+                                rot[2].v*rot[2].v + rot[3].v*rot[3].v};
+    for (l=0 ; l<FK_LANE_COUNT ; ++l)
+        norm.f[l] = 1.0f / sqrtf(norm.f[l]);
+    pspl_vector4_vec_t x = rot[0].v * norm.v;
+    pspl_vector4_vec_t y = rot[1].v * norm.v;
+    pspl_vector4_vec_t z = rot[2].v * norm.v;
+    pspl_vector4_vec_t w = rot[3].v * norm.v;
+    
+    // Rotation/location matrix (as in `pmdl_matrix34_quat`)
+    fk_lane_matrix rl;
+    rl.m[0][0] = 1.0f - (2.0f*y*y) - (2.0f*z*z);
+    rl.m[1][0] = (2.0f*x*y) - (2.0f*z*w);
+    rl.m[2][0] = (2.0f*x*z) + (2.0f*y*w);
+    
+    rl.m[0][1] = (2.0f*x*y) + (2.0f*z*w);
+    rl.m[1][1] = 1.0f - (2.0f*x*x) - (2.0f*z*z);
+    rl.m[2][1] = (2.0f*z*y) - (2.0f*x*w);
+    
+    rl.m[0][2] = (2.0f*x*z) - (2.0f*y*w);
+    rl.m[1][2] = (2.0f*z*y) + (2.0f*x*w);
+    rl.m[2][2] = 1.0f - (2.0f*x*x) - (2.0f*y*y);
+    
+    fk_lane_matrix* out = &soa_matrices[bone->bone_index];
+    if (bone->parent) {
+        // Child bone; parent matrix with scaled diagonal, then rotation/location
+        const fk_lane_matrix* parent = &soa_matrices[bone->parent->bone_index];
+        for (i=0 ; i<3 ; ++i)
+            rl.m[i][3] = (pspl_vector4_vec_t){0,0,0,0} +
+                         (bone->base_vector->f[i] - bone->parent->base_vector->f[i]);
+        
+        fk_lane_matrix sc = *parent;
+        sc.m[0][0] *= scale[0].v;
+        sc.m[1][1] *= scale[1].v;
+        sc.m[2][2] *= scale[2].v;
+        
+        for (i=0 ; i<3 ; ++i) {
+            for (j=0 ; j<4 ; ++j)
+                out->m[i][j] = sc.m[i][0]*rl.m[0][j] + sc.m[i][1]*rl.m[1][j] + sc.m[i][2]*rl.m[2][j];
+            out->m[i][3] += sc.m[i][3];
+        }
+    } else {
+        // Root bone; scale applied to rotation/location rows
+        for (i=0 ; i<3 ; ++i) {
+            rl.m[i][3] = loc[i].v + bone->base_vector->f[i];
+            for (j=0 ; j<4 ; ++j)
+                out->m[i][j] = scale[i].v * rl.m[i][j];
+        }
+    }
+    
+    // Scatter lanes back to each context's bone matrix
+    for (l=0 ; l<lane_count ; ++l) {
+        pspl_matrix34_t* bone_matrix = ctx_arr[l]->fk_instance_array[bone->bone_index].bone_matrix;
+        for (i=0 ; i<3 ; ++i)
+            for (j=0 ; j<4 ; ++j)
+                bone_matrix->m[i][j] = out->m[i][j][l];
+    }
+    
+}
+
+/* Worker job evaluating a contiguous run of animation contexts */
+struct fk_batch_job {
+    pspl_job_t job;
+    pmdl_animation_ctx** ctx_arr;
+    unsigned ctx_count;
+    fk_lane_matrix* soa_matrices;
+};
+static void fk_batch_job_func(struct fk_batch_job* job) {
+    unsigned i = 0;
+    int k;
+    while (i < job->ctx_count) {
+        
+        // Gather lanes from consecutive contexts sharing a rigging context
+        pmdl_animation_ctx** lanes = &job->ctx_arr[i];
+        const pmdl_rigging_ctx* rig_ctx = lanes[0]->parent_ctx;
+        unsigned lane_count = 1;
+        while (lane_count < FK_LANE_COUNT && i+lane_count < job->ctx_count &&
+               lanes[lane_count]->parent_ctx == rig_ctx)
+            ++lane_count;
+        
+        // Compose bones in parent-first order
+        for (k=0 ; k<rig_ctx->bone_count ; ++k)
+            fk_compose_lanes(lanes, lane_count,
+                             &rig_ctx->bone_array[rig_ctx->fk_order_array[k]], job->soa_matrices);
+        for (k=0 ; k<lane_count ; ++k)
+            fk_update_palette(lanes[k]);
+        
+        i += lane_count;
+    }
+}
+
+/* Evaluates many animation contexts at once; contexts sharing a rigging context
+ * are evaluated four at a time and the array is split across worker threads */
+void pmdl_animation_evaluate_batch(pmdl_animation_ctx** ctx_arr, unsigned ctx_count) {
+    int i;
+    if (!ctx_count)
+        return;
+    
+    // Per-job SoA matrix scratch is sized for the largest skeleton
+    unsigned max_bones = 0;
+    for (i=0 ; i<ctx_count ; ++i)
+        if (ctx_arr[i]->parent_ctx->bone_count > max_bones)
+            max_bones = ctx_arr[i]->parent_ctx->bone_count;
+    
+    unsigned job_count = (ctx_count + FK_JOB_INSTANCES - 1) / FK_JOB_INSTANCES;
+    struct fk_batch_job* jobs = malloc(sizeof(struct fk_batch_job)*job_count);
+    fk_scratch_block* scratch = (jobs) ? fk_scratch_take(max_bones*job_count) : NULL;
+    
+    // Without scratch, contexts are evaluated one at a time
+    if (!scratch) {
+        free(jobs);
+        for (i=0 ; i<ctx_count ; ++i)
+            pmdl_animation_evaluate(ctx_arr[i]);
+        return;
+    }
+    fk_lane_matrix* soa_block = scratch->matrices;
+    
+    pspl_fence_t fence = 0;
+    for (i=0 ; i<job_count ; ++i) {
+        struct fk_batch_job* job = &jobs[i];
+        job->job.func = (void(*)(void*))fk_batch_job_func;
+        job->job.usr_ptr = job;
+        job->job.priority = PSPL_JOB_PRIORITY_HIGH;
+        job->job.fence = &fence;
+        job->ctx_arr = &ctx_arr[i*FK_JOB_INSTANCES];
+        job->ctx_count = (ctx_count - i*FK_JOB_INSTANCES > FK_JOB_INSTANCES)?
+                         FK_JOB_INSTANCES:(ctx_count - i*FK_JOB_INSTANCES);
+        job->soa_matrices = &soa_block[max_bones*i];
+        pmdl_animation_pool_submit(&job->job);
     }
+    pspl_fence_wait(&fence);
     
+    fk_scratch_release(scratch);
+    free(jobs);
+    
+}
+
+/* Start and stop animation workers (extension init/shutdown) */
+int pmdl_animation_pool_init() {
+    animation_pool = pspl_thread_pool_create(PMDL_ANIMATION_THREADS, NULL, NULL);
+    if (!animation_pool)
+        return -1;
+    return 0;
+}
+void pmdl_animation_pool_shutdown() {
+    pspl_thread_pool_destroy(animation_pool);
+    animation_pool = NULL;
+    if (soa_scratch)
+        pspl_free_media_block(soa_scratch);
+    soa_scratch = NULL;
+}
+
+/* Queue job on animation workers (runs inline if workers aren't started) */
+void pmdl_animation_pool_submit(pspl_job_t* job) {
+    if (animation_pool)
+        pspl_thread_pool_submit(animation_pool, job);
+    else
+        job->func(job->usr_ptr);
 }
 
 
 /* Routine to destroy animation context */
 void pmdl_animation_destroy(pmdl_animation_ctx* ctx_ptr) {
-    pspl_free_media_block(ctx_ptr->fk_instance_array[0].bone_matrix);
-    pspl_free_media_block(ctx_ptr);
+    if (ctx_ptr->action_ctx_count <= ANIMATION_POOL_ACTIONS)
+        ctx_pool_free(ctx_ptr->parent_ctx->animation_ctx_pool, ctx_ptr);
+    else
+        pspl_free_media_block(ctx_ptr);
 }
 
@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <PSPLExtension.h>
 #include "PMDLCommon.h"
+#include "PMDLToolchainOptimiser.h"
 #include <PSPL/PSPLHash.h>
 #include <sys/param.h>
 
@@ -119,6 +120,12 @@ static void finish_hook(const pspl_toolchain_context_t* driver_context) {
 }
 
 
+/* Set while converting an `ADD_BLENDER_OBJECT` requesting quantised vertices */
+static uint8_t quantise_general = 0;
+
+/* Set while converting an `ADD_BLENDER_OBJECT` requesting a level-of-detail chain */
+static uint8_t lod_general = 0;
+
 /* Conversion hook to run Blender instance for auto-export of PMDL */
 static int blender_convert(char* path_out, const char* path_in, const char* path_ext_in,
                            const char* suggested_path, void* user_ptr) {
@@ -196,6 +203,16 @@ static int blender_convert(char* path_out, const char* path_in, const char* path
     
 #   endif
     
+    // Reorder General geometry for vertex-cache and fetch locality, then
+    // (as requested) add reduced levels and quantise vertices
+    if (user_ptr == general_plats) {
+        pmdl_optimise_general(path_out);
+        if (lod_general)
+            pmdl_generate_lods(path_out);
+        if (quantise_general)
+            pmdl_quantise_general(path_out);
+    }
+    
     return 0;
     
 }
@@ -280,7 +297,20 @@ static void command_call_hook(const pspl_toolchain_context_t* driver_context,
         
         if (command_argc < 3)
             pspl_error(-1, "Invalid ADD_BLENDER_OBJECT usage",
-                       "There must be *three* arguments: (<PMDL_NAME> <BLEND_PATH> <BLEND_OBJ_NAME>)");
+                       "There must be *three* arguments: (<PMDL_NAME> <BLEND_PATH> <BLEND_OBJ_NAME> [QUANTISED] [LOD])");
+        
+        // Optional quantised General vertex format and level-of-detail chain
+        quantise_general = 0;
+        lod_general = 0;
+        for (i=3 ; i<command_argc ; ++i) {
+            if (!strcasecmp(command_argv[i], "QUANTISED"))
+                quantise_general = 1;
+            else if (!strcasecmp(command_argv[i], "LOD"))
+                lod_general = 1;
+            else
+                pspl_error(-1, "Invalid ADD_BLENDER_OBJECT usage",
+                           "unrecognised option '%s'; only `QUANTISED` and `LOD` are accepted", command_argv[i]);
+        }
         
                 
         // Name hash
@@ -0,0 +1,1087 @@
+//
+//  PMDLToolchainOptimiser.c
+//  PSPL
+//
+//  Vertex-cache and vertex-fetch optimisation of General PMDLs
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <PSPLExtension.h>
+#include "PMDLCommon.h"
+#include "PMDLToolchainOptimiser.h"
+
+/* Modelled post-transform cache size (Forsyth scoring) */
+#define VCACHE_SIZE 32
+
+
+#pragma mark Vertex-Cache Triangle Ordering
+
+/* Per-vertex ordering state */
+typedef struct {
+    unsigned tri_offset;
+    unsigned tri_count;
+    unsigned remaining;
+    int cache_pos;
+    float score;
+} vcache_vert;
+
+/* Score vertex by cache position and remaining valence (Tom Forsyth,
+ * "Linear-Speed Vertex Cache Optimisation") */
+static float vcache_score(const vcache_vert* vert) {
+    if (!vert->remaining)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (vert->cache_pos >= 0) {
+        if (vert->cache_pos < 3)
+            score = 0.75f;
+        else {
+            float scaler = 1.0f - (vert->cache_pos - 3) / (float)(VCACHE_SIZE - 3);
+            score = powf(scaler, 1.5f);
+        }
+    }
+    return score + 2.0f / sqrtf((float)vert->remaining);
+}
+
+/* Reorder triangle list (in place) for post-transform cache hits */
+static void vcache_order_triangles(uint16_t* tris, unsigned tri_count, unsigned vert_count) {
+    unsigned i,j,k;
+    if (tri_count < 2)
+        return;
+
+    vcache_vert* verts = calloc(vert_count, sizeof(vcache_vert));
+    unsigned* vert_tris = malloc(sizeof(unsigned)*tri_count*3);
+    float* tri_scores = malloc(sizeof(float)*tri_count);
+    uint8_t* tri_emitted = calloc(tri_count, 1);
+    uint16_t* out_tris = malloc(sizeof(uint16_t)*tri_count*3);
+
+    // Vertex-triangle adjacency
+    for (i=0 ; i<tri_count*3 ; ++i)
+        ++verts[tris[i]].tri_count;
+    unsigned offset = 0;
+    for (i=0 ; i<vert_count ; ++i) {
+        verts[i].tri_offset = offset;
+        offset += verts[i].tri_count;
+        verts[i].remaining = 0;
+        verts[i].cache_pos = -1;
+    }
+    for (i=0 ; i<tri_count ; ++i)
+        for (j=0 ; j<3 ; ++j) {
+            vcache_vert* vert = &verts[tris[i*3+j]];
+            vert_tris[vert->tri_offset + vert->remaining++] = i;
+        }
+    for (i=0 ; i<vert_count ; ++i)
+        verts[i].score = vcache_score(&verts[i]);
+
+    // Initial best triangle
+    int best_tri = 0;
+    float best_score = -1.0f;
+    for (i=0 ; i<tri_count ; ++i) {
+        tri_scores[i] = verts[tris[i*3]].score + verts[tris[i*3+1]].score + verts[tris[i*3+2]].score;
+        if (tri_scores[i] > best_score) {
+            best_score = tri_scores[i];
+            best_tri = i;
+        }
+    }
+
+    // Modelled LRU cache (3 extra slots take the newest triangle before trimming)
+    int cache[VCACHE_SIZE+3];
+    unsigned cache_count = 0;
+    unsigned scan_cursor = 0;
+
+    unsigned out_idx;
+    for (out_idx=0 ; out_idx<tri_count ; ++out_idx) {
+
+        // No candidate from cache neighbourhood; take next unemitted triangle
+        if (best_tri < 0) {
+            while (tri_emitted[scan_cursor])
+                ++scan_cursor;
+            best_tri = scan_cursor;
+        }
+
+        // Emit triangle
+        tri_emitted[best_tri] = 1;
+        const uint16_t* tri = &tris[best_tri*3];
+        memcpy(&out_tris[out_idx*3], tri, sizeof(uint16_t)*3);
+
+        // Retire triangle from its vertices' remaining lists
+        for (j=0 ; j<3 ; ++j) {
+            vcache_vert* vert = &verts[tri[j]];
+            unsigned* list = &vert_tris[vert->tri_offset];
+            for (k=0 ; k<vert->remaining ; ++k)
+                if (list[k] == (unsigned)best_tri) {
+                    list[k] = list[--vert->remaining];
+                    break;
+                }
+        }
+
+        // Move triangle's vertices to cache front
+        int new_cache[VCACHE_SIZE+3];
+        unsigned new_count = 0;
+        for (j=0 ; j<3 ; ++j)
+            new_cache[new_count++] = tri[j];
+        for (j=0 ; j<cache_count ; ++j)
+            if (cache[j] != tri[0] && cache[j] != tri[1] && cache[j] != tri[2])
+                new_cache[new_count++] = cache[j];
+
+        // Update positions (evicted vertices lose their position)
+        for (j=0 ; j<new_count ; ++j) {
+            vcache_vert* vert = &verts[new_cache[j]];
+            vert->cache_pos = (j < VCACHE_SIZE) ? j : -1;
+            vert->score = vcache_score(vert);
+        }
+        cache_count = (new_count < VCACHE_SIZE) ? new_count : VCACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(int)*cache_count);
+
+        // Rescore triangles touching the cache and select the best one
+        best_tri = -1;
+        best_score = -1.0f;
+        for (j=0 ; j<new_count ; ++j) {
+            const vcache_vert* vert = &verts[new_cache[j]];
+            const unsigned* list = &vert_tris[vert->tri_offset];
+            for (k=0 ; k<vert->remaining ; ++k) {
+                unsigned t = list[k];
+                const uint16_t* cand = &tris[t*3];
+                tri_scores[t] = verts[cand[0]].score + verts[cand[1]].score + verts[cand[2]].score;
+                if (tri_scores[t] > best_score) {
+                    best_score = tri_scores[t];
+                    best_tri = t;
+                }
+            }
+        }
+
+    }
+
+    memcpy(tris, out_tris, sizeof(uint16_t)*tri_count*3);
+
+    free(verts);
+    free(vert_tris);
+    free(tri_scores);
+    free(tri_emitted);
+    free(out_tris);
+}
+
+#pragma mark Collection Rewriting
+
+/* Working view of one primitive */
+typedef struct {
+    pmdl_general_prim* prim;
+    int is_triangles;
+
+    // Triangle primitives: span of collection triangle array;
+    // others: elements carried over unchanged
+    unsigned first;
+    unsigned count;
+} opt_prim;
+
+/* Decode primitive's triangles (degenerate strip joins and triangles
+ * addressing past the vertex buffer are dropped; winding kept) */
+static unsigned decode_triangles(const pmdl_general_prim* prim, const uint16_t* elems,
+                                 unsigned vert_count, uint16_t* tris_out) {
+    unsigned i;
+    unsigned tri_count = 0;
+    const uint16_t* src = &elems[prim->prim_start_idx];
+
+    for (i=2 ; i<prim->prim_count ; ++i) {
+        uint16_t a, b, c = src[i];
+        if (prim->prim_type == PMDL_TRIANGLES) {
+            if (i % 3 != 2)
+                continue;
+            a = src[i-2];
+            b = src[i-1];
+        } else if (prim->prim_type == PMDL_TRIANGLE_STRIPS) {
+            a = (i & 1) ? src[i-1] : src[i-2];
+            b = (i & 1) ? src[i-2] : src[i-1];
+        } else {
+            a = src[0];
+            b = src[i-1];
+        }
+        if (a == b || b == c || a == c ||
+            a >= vert_count || b >= vert_count || c >= vert_count)
+            continue;
+        tris_out[tri_count*3] = a;
+        tris_out[tri_count*3+1] = b;
+        tris_out[tri_count*3+2] = c;
+        ++tri_count;
+    }
+    return tri_count;
+}
+
+/* Optimise one collection; fills new element buffer and permutes vertex
+ * buffer in place (primitives are rewritten to address the new elements) */
+static void optimise_collection(void* collection_buf, pmdl_col_header* col_header,
+                                pmdl_general_prim* prim_arr, unsigned prim_count,
+                                uint16_t** elems_out, unsigned* elem_count_out) {
+    unsigned i,j;
+
+    unsigned vert_stride = pmdl_general_vert_stride(col_header);
+    unsigned vert_base = pmdl_general_vert_base(col_header);
+    unsigned vert_count = (col_header->vert_buf_len - vert_base) / vert_stride;
+    const uint16_t* elems = collection_buf + col_header->elem_buf_off;
+    unsigned elem_count = col_header->elem_buf_len / sizeof(uint16_t);
+
+    // Gather primitives (strips hold at most one triangle per element)
+    opt_prim* prims = malloc(sizeof(opt_prim)*prim_count);
+    uint16_t* tris = malloc(sizeof(uint16_t)*(elem_count*3 + 3));
+    unsigned tri_count = 0;
+    for (i=0 ; i<prim_count ; ++i) {
+        opt_prim* op = &prims[i];
+        op->prim = &prim_arr[i];
+        op->is_triangles = (op->prim->prim_type == PMDL_TRIANGLES ||
+                            op->prim->prim_type == PMDL_TRIANGLE_STRIPS ||
+                            op->prim->prim_type == PMDL_TRIANGLE_FANS);
+        if (op->is_triangles) {
+            op->first = tri_count;
+            op->count = decode_triangles(op->prim, elems, vert_count, &tris[tri_count*3]);
+            tri_count += op->count;
+        } else {
+            op->first = op->prim->prim_start_idx;
+            op->count = op->prim->prim_count;
+        }
+    }
+
+    // Order each primitive's triangles separately (primitives carry
+    // mesh, shader and skin boundaries)
+    for (i=0 ; i<prim_count ; ++i)
+        if (prims[i].is_triangles)
+            vcache_order_triangles(&tris[prims[i].first*3], prims[i].count, vert_count);
+
+    // Number vertices in order of first use (unreferenced ones trail)
+    int* remap = malloc(sizeof(int)*vert_count);
+    for (i=0 ; i<vert_count ; ++i)
+        remap[i] = -1;
+    unsigned next_vert = 0;
+    unsigned new_elem_count = 0;
+    for (i=0 ; i<prim_count ; ++i) {
+        const uint16_t* src = (prims[i].is_triangles) ? &tris[prims[i].first*3] : &elems[prims[i].first];
+        unsigned src_count = (prims[i].is_triangles) ? prims[i].count*3 : prims[i].count;
+        for (j=0 ; j<src_count ; ++j)
+            if (src[j] < vert_count && remap[src[j]] < 0)
+                remap[src[j]] = next_vert++;
+        new_elem_count += src_count;
+    }
+    for (i=0 ; i<vert_count ; ++i)
+        if (remap[i] < 0)
+            remap[i] = next_vert++;
+
+    // Emit elements and rewrite primitives
+    uint16_t* new_elems = malloc(sizeof(uint16_t)*(new_elem_count + 1));
+    unsigned cursor = 0;
+    for (i=0 ; i<prim_count ; ++i) {
+        const uint16_t* src = (prims[i].is_triangles) ? &tris[prims[i].first*3] : &elems[prims[i].first];
+        unsigned src_count = (prims[i].is_triangles) ? prims[i].count*3 : prims[i].count;
+        for (j=0 ; j<src_count ; ++j)
+            new_elems[cursor+j] = (src[j] < vert_count) ? remap[src[j]] : src[j];
+        if (prims[i].is_triangles)
+            prims[i].prim->prim_type = PMDL_TRIANGLES;
+        prims[i].prim->prim_start_idx = cursor;
+        prims[i].prim->prim_count = src_count;
+        cursor += src_count;
+    }
+
+    // Permute vertex buffer
+    void* vert_buf = collection_buf + col_header->vert_buf_off + vert_base;
+    void* new_verts = malloc(vert_stride*vert_count);
+    for (i=0 ; i<vert_count ; ++i)
+        memcpy(new_verts + vert_stride*remap[i], vert_buf + vert_stride*i, vert_stride);
+    memcpy(vert_buf, new_verts, vert_stride*vert_count);
+
+    free(new_verts);
+    free(remap);
+    free(tris);
+    free(prims);
+
+    *elems_out = new_elems;
+    *elem_count_out = new_elem_count;
+}
+
+
+#pragma mark Level-of-Detail Simplification
+
+/* Vertex-clustering cell size of the first reduced level (fraction of
+ * master-AABB diagonal); each further attempt doubles it */
+#define LOD_FIRST_CELL (1.0f / 64.0f)
+
+/* Reduced levels generated at most (and cell sizes attempted) */
+#define LOD_MAX_LEVELS 4
+#define LOD_MAX_ATTEMPTS 8
+
+/* A level is kept only with at most this fraction of the previous level's triangles */
+#define LOD_MIN_REDUCTION 0.75f
+
+/* Position of collection vertex (float or quantised layout) */
+static void vertex_position(const void* collection_buf, const pmdl_col_header* col_header,
+                            unsigned idx, float* pos_out) {
+    const void* vert_buf = collection_buf + col_header->vert_buf_off;
+    const void* vert = vert_buf + pmdl_general_vert_base(col_header) + pmdl_general_vert_stride(col_header)*idx;
+    unsigned i;
+    if (col_header->uv_count & PMDL_COL_QUANTISED) {
+        const pmdl_quant_head* quant = vert_buf;
+        for (i=0 ; i<3 ; ++i)
+            pos_out[i] = fmaxf(((int16_t*)vert)[i] / 32767.0f, -1.0f) * quant->scale[i] + quant->bias[i];
+    } else
+        memcpy(pos_out, vert, sizeof(float)*3);
+}
+
+/* Clustering cell (open-addressed by grid coordinate) */
+typedef struct {
+    int32_t coord[3];
+    int used;
+    float sum[3];
+    unsigned count;
+    int rep;
+    float rep_dist;
+} lod_cell;
+
+/* Simplify one primitive's triangles by vertex clustering; each vertex
+ * collapses onto the vertex nearest its cell's centroid, chosen among the
+ * primitive's own vertices (so materials and skins stay intact). Writes
+ * surviving triangles to `tris_out` and returns their count; `*error` is
+ * raised to the largest vertex displacement */
+static unsigned cluster_triangles(const uint16_t* tris, unsigned tri_count,
+                                  const float (*positions)[3], const float* origin, float cell_size,
+                                  int* vert_cells, uint16_t* tris_out, float* error) {
+    unsigned i,j;
+
+    unsigned cell_cap = 1;
+    while (cell_cap < tri_count*6)
+        cell_cap <<= 1;
+    lod_cell* cells = calloc(cell_cap, sizeof(lod_cell));
+
+    // Bin each referenced vertex once (`vert_cells` is -1 for unvisited)
+    for (i=0 ; i<tri_count*3 ; ++i) {
+        uint16_t v = tris[i];
+        if (vert_cells[v] >= 0)
+            continue;
+        int32_t coord[3];
+        for (j=0 ; j<3 ; ++j)
+            coord[j] = (int32_t)floorf((positions[v][j] - origin[j]) / cell_size);
+        uint32_t slot = ((uint32_t)coord[0]*73856093u ^ (uint32_t)coord[1]*19349663u ^
+                         (uint32_t)coord[2]*83492791u) & (cell_cap-1);
+        while (cells[slot].used && memcmp(cells[slot].coord, coord, sizeof(coord)))
+            slot = (slot + 1) & (cell_cap-1);
+        lod_cell* cell = &cells[slot];
+        if (!cell->used) {
+            cell->used = 1;
+            memcpy(cell->coord, coord, sizeof(coord));
+            cell->rep = -1;
+        }
+        for (j=0 ; j<3 ; ++j)
+            cell->sum[j] += positions[v][j];
+        ++cell->count;
+        vert_cells[v] = slot;
+    }
+
+    // Representative nearest each centroid
+    for (i=0 ; i<tri_count*3 ; ++i) {
+        uint16_t v = tris[i];
+        lod_cell* cell = &cells[vert_cells[v]];
+        float dist = 0.0f;
+        for (j=0 ; j<3 ; ++j) {
+            float d = positions[v][j] - cell->sum[j] / cell->count;
+            dist += d * d;
+        }
+        if (cell->rep < 0 || dist < cell->rep_dist) {
+            cell->rep = v;
+            cell->rep_dist = dist;
+        }
+    }
+
+    // Collapse triangles (those losing an edge are dropped)
+    unsigned out_count = 0;
+    for (i=0 ; i<tri_count ; ++i) {
+        uint16_t mapped[3];
+        for (j=0 ; j<3 ; ++j) {
+            uint16_t v = tris[i*3+j];
+            mapped[j] = cells[vert_cells[v]].rep;
+            float d[3] = {positions[v][0] - positions[mapped[j]][0],
+                          positions[v][1] - positions[mapped[j]][1],
+                          positions[v][2] - positions[mapped[j]][2]};
+            float dist = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            if (dist > *error)
+                *error = dist;
+        }
+        if (mapped[0] == mapped[1] || mapped[1] == mapped[2] || mapped[0] == mapped[2])
+            continue;
+        memcpy(&tris_out[out_count*3], mapped, sizeof(mapped));
+        ++out_count;
+    }
+
+    // Reset visited vertices for the next primitive
+    for (i=0 ; i<tri_count*3 ; ++i)
+        vert_cells[tris[i]] = -1;
+    free(cells);
+
+    return out_count;
+}
+
+
+#pragma mark Vertex Quantisation
+
+/* IEEE 754 half-float encode (round to nearest even) */
+static uint16_t half_from_float(float value) {
+    union {float f; uint32_t u;} bits = {.f = value};
+    uint16_t sign = (bits.u >> 16) & 0x8000;
+    int32_t exp = (int32_t)((bits.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = bits.u & 0x7fffff;
+
+    if (((bits.u >> 23) & 0xff) == 0xff) // Inf and NaN
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    if (exp >= 31) // Overflow
+        return sign | 0x7c00;
+
+    uint32_t half, rem, halfway;
+    if (exp <= 0) { // Subnormal
+        if (exp < -10)
+            return sign;
+        unsigned shift = 14 - exp;
+        mant |= 0x800000;
+        half = mant >> shift;
+        rem = mant & ((1 << shift) - 1);
+        halfway = 1 << (shift - 1);
+    } else {
+        half = (exp << 10) | (mant >> 13);
+        rem = mant & 0x1fff;
+        halfway = 0x1000;
+    }
+    if (rem > halfway || (rem == halfway && (half & 1)))
+        ++half; // Carry may round into exponent
+    return sign | half;
+}
+
+/* Signed normalised 16-bit encode */
+static int16_t snorm16_from_float(float value) {
+    if (value > 1.0f)
+        value = 1.0f;
+    else if (value < -1.0f)
+        value = -1.0f;
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+/* Octahedral normal encode (projected onto the octahedron, lower
+ * hemisphere folded over the diagonals) */
+static void octahedral_from_normal(const float* normal, int16_t* oct_out) {
+    float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float x = 0.0f, y = 0.0f;
+    if (l1 > 0.0f) {
+        x = normal[0] / l1;
+        y = normal[1] / l1;
+        if (normal[2] < 0.0f) {
+            float fx = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+            float fy = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+    }
+    oct_out[0] = snorm16_from_float(x);
+    oct_out[1] = snorm16_from_float(y);
+}
+
+/* Encode collection's float vertices in quantised layout (see `PMDL_COL_QUANTISED`);
+ * positions are stored relative to the collection's bounds */
+static void* quantise_collection(const void* collection_buf, const pmdl_col_header* col_header,
+                                 unsigned* len_out) {
+    unsigned i,j;
+
+    unsigned uv_count = col_header->uv_count;
+    unsigned bone_count = col_header->bone_count;
+    unsigned src_stride = pmdl_general_vert_stride(col_header);
+    unsigned vert_count = col_header->vert_buf_len / src_stride;
+    const void* src_buf = collection_buf + col_header->vert_buf_off;
+
+    // Bounds of positions
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (i=0 ; i<vert_count ; ++i) {
+        const float* pos = src_buf + src_stride*i;
+        for (j=0 ; j<3 ; ++j) {
+            if (pos[j] < min[j]) min[j] = pos[j];
+            if (pos[j] > max[j]) max[j] = pos[j];
+        }
+    }
+
+    // Dequantisation head
+    pmdl_col_header quant_header = *col_header;
+    quant_header.uv_count |= PMDL_COL_QUANTISED;
+    unsigned stride = pmdl_general_vert_stride(&quant_header);
+    unsigned len = sizeof(pmdl_quant_head) + stride*vert_count;
+    void* buf = calloc(1, len);
+    pmdl_quant_head* head = buf;
+    for (j=0 ; j<3 ; ++j) {
+        head->scale[j] = (vert_count) ? (max[j] - min[j]) * 0.5f : 0.0f;
+        head->bias[j] = (vert_count) ? (max[j] + min[j]) * 0.5f : 0.0f;
+    }
+    head->scale[3] = 1.0f;
+    head->bias[3] = 0.0f;
+
+    // Vertices
+    for (i=0 ; i<vert_count ; ++i) {
+        const float* src = src_buf + src_stride*i;
+        void* dst = buf + sizeof(pmdl_quant_head) + stride*i;
+
+        int16_t* pos = dst;
+        for (j=0 ; j<3 ; ++j)
+            pos[j] = (head->scale[j] > 0.0f) ?
+                     snorm16_from_float((src[j] - head->bias[j]) / head->scale[j]) : 0;
+
+        octahedral_from_normal(&src[3], dst + 8);
+
+        uint16_t* uvs = dst + 12;
+        for (j=0 ; j<uv_count*2 ; ++j)
+            uvs[j] = half_from_float(src[6+j]);
+
+        // Weights; rounding residue is carried by the largest so blends keep their sum
+        if (bone_count) {
+            const float* weights = &src[6+uv_count*2];
+            uint8_t* qweights = dst + 12 + uv_count*4;
+            float sum = 0.0f;
+            int qsum = 0;
+            unsigned largest = 0;
+            for (j=0 ; j<bone_count ; ++j) {
+                float w = weights[j];
+                w = (w < 0.0f) ? 0.0f : ((w > 1.0f) ? 1.0f : w);
+                qweights[j] = (uint8_t)lrintf(w * 255.0f);
+                sum += w;
+                qsum += qweights[j];
+                if (weights[j] > weights[largest])
+                    largest = j;
+            }
+            int residue = (int)lrintf(sum * 255.0f) - qsum;
+            int adjusted = qweights[largest] + residue;
+            qweights[largest] = (adjusted < 0) ? 0 : ((adjusted > 255) ? 255 : adjusted);
+        }
+    }
+
+    *len_out = len;
+    return buf;
+}
+
+
+#pragma mark File Rewriting
+
+/* Read in native-endian General PMDL (NULL if file is another format or
+ * doesn't follow the exporter's collection layout: headers, contiguous vertex
+ * buffers, contiguous element buffers, then 32-aligned drawing-index buffers) */
+static void* read_general_pmdl(const char* path, size_t* len_out) {
+    unsigned i;
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        pspl_warn("Unable to open PMDL for optimisation", "`%s`: errno %d - %s", path, errno, strerror(errno));
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size_t file_len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* file_data = malloc(file_len);
+    if (fread(file_data, 1, file_len, file) != file_len) {
+        fclose(file);
+        free(file_data);
+        pspl_warn("Unable to read PMDL for optimisation", "`%s` ended early", path);
+        return NULL;
+    }
+    fclose(file);
+
+    // Only native-endian General files are rewritten
+    pmdl_header* header = file_data;
+    const union {uint32_t word; char bytes[4];} host_order = {.word = 1};
+    if (file_len < sizeof(pmdl_header) ||
+        memcmp(header->magic, "PMDL", 4) ||
+        memcmp(header->draw_format, "_GEN", 4) ||
+        memcmp(header->endianness, host_order.bytes[0] ? "_LIT" : "_BIG", 4) ||
+        !header->collection_count) {
+        free(file_data);
+        return NULL;
+    }
+
+    // Validate layout
+    pmdl_col_header* col_headers = file_data + header->collection_offset;
+    unsigned col_count = header->collection_count;
+    uint32_t vert_end = col_headers[0].vert_buf_off;
+    for (i=0 ; i<col_count ; ++i) {
+        if (col_headers[i].vert_buf_off != vert_end)
+            break;
+        vert_end += col_headers[i].vert_buf_len;
+    }
+    uint32_t elem_end = vert_end;
+    if (i == col_count)
+        for (i=0 ; i<col_count ; ++i) {
+            if (col_headers[i].elem_buf_off != elem_end)
+                break;
+            elem_end += col_headers[i].elem_buf_len;
+        }
+    uint32_t idx_start = UINT32_MAX;
+    if (i == col_count)
+        for (i=0 ; i<col_count ; ++i)
+            if (col_headers[i].draw_idx_off < idx_start)
+                idx_start = col_headers[i].draw_idx_off;
+    int lod_valid = 1;
+    uint32_t lod_table_offset = pmdl_section_offset(file_data, file_len, "_LOD");
+    if (lod_table_offset) {
+        lod_valid = (lod_table_offset + sizeof(uint32_t) <= file_len);
+        uint32_t level_count = (lod_valid) ? *(uint32_t*)(file_data + lod_table_offset) : 0;
+        lod_valid = lod_valid && (lod_table_offset + sizeof(uint32_t) +
+                                  sizeof(pmdl_lod_level) * (size_t)level_count <= file_len);
+        const pmdl_lod_level* levels = file_data + lod_table_offset + sizeof(uint32_t);
+        unsigned l;
+        for (l=0 ; lod_valid && l<level_count ; ++l)
+            lod_valid = (levels[l].run_table_offset + sizeof(uint32_t) * (size_t)col_count <= file_len);
+    }
+    if (i != col_count || idx_start < ROUND_UP_32(elem_end) ||
+        header->collection_offset + idx_start > file_len || !lod_valid ||
+        (header->reloc_table_offset &&
+         (header->reloc_table_offset + sizeof(uint32_t) > file_len ||
+          header->reloc_table_offset + sizeof(uint32_t) + sizeof(pmdl_reloc_entry) *
+          (size_t)*(uint32_t*)(file_data + header->reloc_table_offset) > file_len))) {
+        free(file_data);
+        pspl_warn("Unexpected PMDL collection layout", "`%s` left unoptimised", path);
+        return NULL;
+    }
+
+    *len_out = file_len;
+    return file_data;
+}
+
+/* Write General PMDL back out with replaced vertex and/or element buffers
+ * (NULL buffer arrays keep the originals); buffers are re-laid as the exporter
+ * does, with the drawing-index buffers and trailing tables relocated */
+static int write_general_pmdl(const char* path, void* file_data, size_t file_len,
+                              void** vert_bufs, const unsigned* vert_lens,
+                              void** elem_bufs, const unsigned* elem_lens) {
+    unsigned i,j;
+    pmdl_header* header = file_data;
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* col_headers = collection_buf;
+    unsigned col_count = header->collection_count;
+
+    // Source buffers
+    const void* vert_srcs[col_count];
+    const void* elem_srcs[col_count];
+    unsigned vert_src_lens[col_count];
+    unsigned elem_src_lens[col_count];
+    for (i=0 ; i<col_count ; ++i) {
+        vert_srcs[i] = (vert_bufs) ? vert_bufs[i] : collection_buf + col_headers[i].vert_buf_off;
+        vert_src_lens[i] = (vert_bufs) ? vert_lens[i] : col_headers[i].vert_buf_len;
+        elem_srcs[i] = (elem_bufs) ? elem_bufs[i] : collection_buf + col_headers[i].elem_buf_off;
+        elem_src_lens[i] = (elem_bufs) ? elem_lens[i] : col_headers[i].elem_buf_len;
+    }
+    uint32_t vert_start = col_headers[0].vert_buf_off;
+    uint32_t idx_start = ROUND_UP_32(col_headers[col_count-1].elem_buf_off + col_headers[col_count-1].elem_buf_len);
+
+    // Relocate collection headers and trailing sections
+    uint32_t cursor = vert_start;
+    for (i=0 ; i<col_count ; ++i) {
+        col_headers[i].vert_buf_off = cursor;
+        col_headers[i].vert_buf_len = vert_src_lens[i];
+        cursor += vert_src_lens[i];
+    }
+    for (i=0 ; i<col_count ; ++i) {
+        col_headers[i].elem_buf_off = cursor;
+        col_headers[i].elem_buf_len = elem_src_lens[i];
+        cursor += elem_src_lens[i];
+    }
+    int32_t delta = (int32_t)ROUND_UP_32(cursor) - (int32_t)idx_start;
+    for (i=0 ; i<col_count ; ++i)
+        col_headers[i].draw_idx_off += delta;
+    uint32_t idx_start_abs = header->collection_offset + idx_start;
+    if (header->shader_table_offset >= idx_start_abs)
+        header->shader_table_offset += delta;
+    if (header->bone_table_offset >= idx_start_abs)
+        header->bone_table_offset += delta;
+    pmdl_section_link* lod_link = pmdl_section_link_lookup(file_data, file_len, "_LOD");
+    if (lod_link && lod_link->offset >= idx_start_abs) {
+        uint32_t level_count = *(uint32_t*)(file_data + lod_link->offset);
+        pmdl_lod_level* levels = file_data + lod_link->offset + sizeof(uint32_t);
+        for (i=0 ; i<level_count ; ++i) {
+            uint32_t* run_offs = file_data + levels[i].run_table_offset;
+            for (j=0 ; j<col_count ; ++j)
+                run_offs[j] += delta;
+            levels[i].run_table_offset += delta;
+        }
+        lod_link->offset += delta;
+    }
+    if (header->reloc_table_offset >= idx_start_abs) {
+        uint32_t reloc_count = *(uint32_t*)(file_data + header->reloc_table_offset);
+        pmdl_reloc_entry* relocs = file_data + header->reloc_table_offset + sizeof(uint32_t);
+        for (i=0 ; i<reloc_count ; ++i)
+            if (relocs[i].offset >= idx_start_abs)
+                relocs[i].offset += delta;
+        header->reloc_table_offset += delta;
+    }
+
+    // Write out
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        pspl_warn("Unable to write optimised PMDL", "`%s`: errno %d - %s", path, errno, strerror(errno));
+        return -1;
+    }
+    static const uint8_t zero_pad[32] = {0};
+    fwrite(file_data, 1, header->collection_offset + vert_start, file);
+    for (i=0 ; i<col_count ; ++i)
+        fwrite(vert_srcs[i], 1, vert_src_lens[i], file);
+    for (i=0 ; i<col_count ; ++i)
+        fwrite(elem_srcs[i], 1, elem_src_lens[i], file);
+    fwrite(zero_pad, 1, ROUND_UP_32(cursor) - cursor, file);
+    fwrite(file_data + idx_start_abs, 1, file_len - idx_start_abs, file);
+    fclose(file);
+
+    return 0;
+}
+
+
+#pragma mark Passes
+
+int pmdl_optimise_general(const char* path) {
+    unsigned i;
+
+    size_t file_len;
+    void* file_data = read_general_pmdl(path, &file_len);
+    if (!file_data)
+        return -1;
+    pmdl_header* header = file_data;
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* col_headers = collection_buf;
+    unsigned col_count = header->collection_count;
+
+    // Level-of-detail elements index the vertex order they were built against
+    if (pmdl_section_offset(file_data, file_len, "_LOD")) {
+        free(file_data);
+        pspl_warn("PMDL already has LOD levels", "`%s` left unoptimised", path);
+        return -1;
+    }
+
+    // Optimise collections
+    void* new_elems[col_count];
+    unsigned new_elem_lens[col_count];
+    unsigned prim_stride = (header->sub_type_num == '1') ? sizeof(pmdl_general_prim_par1) : sizeof(pmdl_general_prim);
+    unsigned prim_offset = (header->sub_type_num == '1') ? sizeof(uint32_t) : 0;
+    for (i=0 ; i<col_count ; ++i) {
+        void* index_buf = collection_buf + col_headers[i].draw_idx_off;
+        uint32_t mesh_count = *(uint32_t*)index_buf;
+        index_buf += *(uint32_t*)(index_buf+4) + header->pointer_size*3;
+
+        // Flatten meshes' primitive arrays (each preceded by its count)
+        unsigned prim_total = 0, m;
+        void* mesh_cur = index_buf;
+        for (m=0 ; m<mesh_count ; ++m) {
+            prim_total += *(uint32_t*)mesh_cur;
+            mesh_cur += sizeof(uint32_t) + prim_stride * *(uint32_t*)mesh_cur;
+        }
+
+        // Work on a packed copy of all meshes' primitives (in order)
+        new_elems[i] = NULL;
+        new_elem_lens[i] = 0;
+        if (!prim_total)
+            continue;
+        pmdl_general_prim* prim_copy = malloc(sizeof(pmdl_general_prim)*prim_total);
+        pmdl_general_prim** prim_ptrs = malloc(sizeof(pmdl_general_prim*)*prim_total);
+        unsigned p = 0;
+        mesh_cur = index_buf;
+        for (m=0 ; m<mesh_count ; ++m) {
+            uint32_t mesh_prims = *(uint32_t*)mesh_cur;
+            mesh_cur += sizeof(uint32_t);
+            unsigned q;
+            for (q=0 ; q<mesh_prims ; ++q) {
+                prim_ptrs[p] = mesh_cur + prim_offset;
+                prim_copy[p] = *prim_ptrs[p];
+                mesh_cur += prim_stride;
+                ++p;
+            }
+        }
+
+        uint16_t* elems;
+        unsigned elem_count;
+        optimise_collection(collection_buf, &col_headers[i], prim_copy, prim_total,
+                            &elems, &elem_count);
+        new_elems[i] = elems;
+        new_elem_lens[i] = elem_count * sizeof(uint16_t);
+
+        for (p=0 ; p<prim_total ; ++p)
+            *prim_ptrs[p] = prim_copy[p];
+        free(prim_ptrs);
+        free(prim_copy);
+    }
+
+    int result = write_general_pmdl(path, file_data, file_len, NULL, NULL, new_elems, new_elem_lens);
+
+    for (i=0 ; i<col_count ; ++i)
+        free(new_elems[i]);
+    free(file_data);
+    return result;
+}
+
+int pmdl_quantise_general(const char* path) {
+    unsigned i;
+
+    size_t file_len;
+    void* file_data = read_general_pmdl(path, &file_len);
+    if (!file_data)
+        return -1;
+    pmdl_header* header = file_data;
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* col_headers = collection_buf;
+    unsigned col_count = header->collection_count;
+
+    // Encode collections (those already quantised are carried over)
+    void* new_verts[col_count];
+    unsigned new_vert_lens[col_count];
+    for (i=0 ; i<col_count ; ++i) {
+        if (col_headers[i].uv_count & PMDL_COL_QUANTISED) {
+            new_vert_lens[i] = col_headers[i].vert_buf_len;
+            new_verts[i] = malloc(new_vert_lens[i]);
+            memcpy(new_verts[i], collection_buf + col_headers[i].vert_buf_off, new_vert_lens[i]);
+            continue;
+        }
+        new_verts[i] = quantise_collection(collection_buf, &col_headers[i], &new_vert_lens[i]);
+        col_headers[i].uv_count |= PMDL_COL_QUANTISED;
+    }
+
+    int result = write_general_pmdl(path, file_data, file_len, new_verts, new_vert_lens, NULL, NULL);
+
+    for (i=0 ; i<col_count ; ++i)
+        free(new_verts[i]);
+    free(file_data);
+    return result;
+}
+
+/* Working state of one collection during level generation */
+typedef struct {
+    unsigned vert_count;
+    float (*positions)[3];
+    int* vert_cells;
+
+    // Full-detail triangles of each primitive (`prim_first` is -1 for other primitives)
+    uint16_t* tris;
+    int* prim_first;
+    unsigned* prim_tri_count;
+    unsigned prim_total;
+
+    // Element buffer (full detail, then each kept level's elements)
+    uint16_t* elems;
+    unsigned elem_count;
+    unsigned elem_cap;
+} lod_collection;
+
+int pmdl_generate_lods(const char* path) {
+    unsigned i,j,k,l;
+
+    size_t file_len;
+    void* file_data = read_general_pmdl(path, &file_len);
+    if (!file_data)
+        return -1;
+    pmdl_header* header = file_data;
+    void* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* col_headers = collection_buf;
+    unsigned col_count = header->collection_count;
+
+    // Partitioned models enclose the camera; they always draw at full detail
+    float origin[3], diag_sq = 0.0f;
+    for (i=0 ; i<3 ; ++i) {
+        origin[i] = header->master_aabb[0][i];
+        diag_sq += (header->master_aabb[1][i] - origin[i]) * (header->master_aabb[1][i] - origin[i]);
+    }
+    float diag = sqrtf(diag_sq);
+    if (header->sub_type_num == '2' || pmdl_section_offset(file_data, file_len, "_LOD") || !(diag > 0.0f)) {
+        free(file_data);
+        return -1;
+    }
+    unsigned prim_stride = (header->sub_type_num == '1') ? sizeof(pmdl_general_prim_par1) : sizeof(pmdl_general_prim);
+    unsigned prim_offset = (header->sub_type_num == '1') ? sizeof(uint32_t) : 0;
+
+    // Decode collections
+    lod_collection cols[col_count];
+    void* col_runs[col_count];
+    uint32_t col_mesh_counts[col_count];
+    unsigned full_tris = 0;
+    for (i=0 ; i<col_count ; ++i) {
+        lod_collection* col = &cols[i];
+        unsigned vert_base = pmdl_general_vert_base(&col_headers[i]);
+        col->vert_count = (col_headers[i].vert_buf_len - vert_base) / pmdl_general_vert_stride(&col_headers[i]);
+        col->positions = malloc(sizeof(float)*3*col->vert_count + 1);
+        col->vert_cells = malloc(sizeof(int)*col->vert_count + 1);
+        for (j=0 ; j<col->vert_count ; ++j) {
+            vertex_position(collection_buf, &col_headers[i], j, col->positions[j]);
+            col->vert_cells[j] = -1;
+        }
+
+        col->elem_count = col_headers[i].elem_buf_len / sizeof(uint16_t);
+        col->elem_cap = col->elem_count * 2 + 3;
+        col->elems = malloc(sizeof(uint16_t)*col->elem_cap);
+        memcpy(col->elems, collection_buf + col_headers[i].elem_buf_off, sizeof(uint16_t)*col->elem_count);
+
+        void* index_buf = collection_buf + col_headers[i].draw_idx_off;
+        col_mesh_counts[i] = *(uint32_t*)index_buf;
+        col_runs[i] = index_buf + *(uint32_t*)(index_buf+4) + header->pointer_size*3;
+
+        // Primitive triangles (strips hold at most one triangle per element)
+        col->prim_total = 0;
+        void* mesh_cur = col_runs[i];
+        for (j=0 ; j<col_mesh_counts[i] ; ++j) {
+            col->prim_total += *(uint32_t*)mesh_cur;
+            mesh_cur += sizeof(uint32_t) + prim_stride * *(uint32_t*)mesh_cur;
+        }
+        col->tris = malloc(sizeof(uint16_t)*(col->elem_count*3 + 3));
+        col->prim_first = malloc(sizeof(int)*col->prim_total + 1);
+        col->prim_tri_count = malloc(sizeof(unsigned)*col->prim_total + 1);
+        unsigned p = 0, tri_count = 0;
+        mesh_cur = col_runs[i];
+        for (j=0 ; j<col_mesh_counts[i] ; ++j) {
+            uint32_t mesh_prims = *(uint32_t*)mesh_cur;
+            mesh_cur += sizeof(uint32_t);
+            for (k=0 ; k<mesh_prims ; ++k, ++p, mesh_cur+=prim_stride) {
+                const pmdl_general_prim* prim = mesh_cur + prim_offset;
+                col->prim_first[p] = -1;
+                col->prim_tri_count[p] = 0;
+                if (prim->prim_type != PMDL_TRIANGLES && prim->prim_type != PMDL_TRIANGLE_STRIPS &&
+                    prim->prim_type != PMDL_TRIANGLE_FANS)
+                    continue;
+                col->prim_first[p] = tri_count;
+                col->prim_tri_count[p] = decode_triangles(prim, col->elems, col->vert_count, &col->tris[tri_count*3]);
+                tri_count += col->prim_tri_count[p];
+            }
+        }
+        full_tris += tri_count;
+    }
+
+    // Cluster at doubling cell sizes, keeping levels that reduce enough
+    void* level_runs[LOD_MAX_LEVELS][col_count];
+    unsigned level_run_lens[LOD_MAX_LEVELS][col_count];
+    float level_errors[LOD_MAX_LEVELS];
+    unsigned level_count = 0;
+    unsigned prev_tris = full_tris;
+    float prev_error = 0.0f;
+    float cell_size = diag * LOD_FIRST_CELL;
+    unsigned attempt;
+    for (attempt=0 ; attempt<LOD_MAX_ATTEMPTS && level_count<LOD_MAX_LEVELS ; ++attempt, cell_size*=2.0f) {
+        float error = prev_error;
+        unsigned tri_total = 0;
+        unsigned elem_marks[col_count];
+        for (i=0 ; i<col_count ; ++i) {
+            lod_collection* col = &cols[i];
+            elem_marks[i] = col->elem_count;
+            level_run_lens[level_count][i] = sizeof(uint32_t)*col_mesh_counts[i] + prim_stride*col->prim_total;
+            void* runs = malloc(level_run_lens[level_count][i] + 1);
+            level_runs[level_count][i] = runs;
+
+            // Same meshes and primitives as full detail; triangle primitives
+            // become lists of the clustered triangles
+            const void* src = col_runs[i];
+            unsigned p = 0;
+            for (j=0 ; j<col_mesh_counts[i] ; ++j) {
+                uint32_t mesh_prims = *(uint32_t*)src;
+                memcpy(runs, src, sizeof(uint32_t));
+                src += sizeof(uint32_t);
+                runs += sizeof(uint32_t);
+                for (k=0 ; k<mesh_prims ; ++k, ++p, src+=prim_stride, runs+=prim_stride) {
+                    memcpy(runs, src, prim_stride);
+                    if (col->prim_first[p] < 0)
+                        continue;
+                    unsigned count = col->prim_tri_count[p];
+                    if (col->elem_count + count*3 > col->elem_cap) {
+                        col->elem_cap = (col->elem_count + count*3) * 2;
+                        col->elems = realloc(col->elems, sizeof(uint16_t)*col->elem_cap);
+                    }
+                    uint16_t* out = &col->elems[col->elem_count];
+                    unsigned out_count = (count) ?
+                    cluster_triangles(&col->tris[col->prim_first[p]*3], count, (const float(*)[3])col->positions,
+                                      origin, cell_size, col->vert_cells, out, &error) : 0;
+                    if (out_count)
+                        vcache_order_triangles(out, out_count, col->vert_count);
+                    pmdl_general_prim* prim = runs + prim_offset;
+                    prim->prim_type = PMDL_TRIANGLES;
+                    prim->prim_start_idx = col->elem_count;
+                    prim->prim_count = out_count*3;
+                    col->elem_count += out_count*3;
+                    tri_total += out_count;
+                }
+            }
+        }
+
+        // Discard levels that vanish or barely reduce (a coarser cell may still)
+        if (!tri_total || tri_total > prev_tris * LOD_MIN_REDUCTION) {
+            for (i=0 ; i<col_count ; ++i) {
+                free(level_runs[level_count][i]);
+                cols[i].elem_count = elem_marks[i];
+            }
+            if (!tri_total)
+                break;
+            continue;
+        }
+        level_errors[level_count] = error / diag;
+        prev_tris = tri_total;
+        prev_error = error;
+        ++level_count;
+    }
+
+    // Append a copy of the relocation table (so the section link can follow
+    // it), the `_LOD` link, then the LOD section (level table, run tables,
+    // then runs)
+    int result = -1;
+    if (level_count) {
+        uint32_t reloc_count = (header->reloc_table_offset) ?
+                               *(uint32_t*)(file_data + header->reloc_table_offset) : 0;
+        size_t reloc_len = sizeof(uint32_t) + sizeof(pmdl_reloc_entry) * reloc_count;
+        uint32_t reloc_off = ROUND_UP_32(file_len);
+        uint32_t link_off = reloc_off + reloc_len;
+        uint32_t lod_off = ROUND_UP_32(link_off + sizeof(pmdl_section_link));
+        size_t section_len = sizeof(uint32_t) + (sizeof(pmdl_lod_level) + sizeof(uint32_t)*col_count) * level_count;
+        for (l=0 ; l<level_count ; ++l)
+            for (i=0 ; i<col_count ; ++i)
+                section_len += level_run_lens[l][i];
+        file_data = realloc(file_data, lod_off + section_len);
+        memset(file_data + file_len, 0xff, lod_off - file_len);
+        header = file_data;
+        if (reloc_count)
+            memcpy(file_data + reloc_off, file_data + header->reloc_table_offset, reloc_len);
+        else
+            *(uint32_t*)(file_data + reloc_off) = 0;
+        header->reloc_table_offset = reloc_off;
+        pmdl_section_link* lod_link = file_data + link_off;
+        memcpy(lod_link->tag, "_LOD", 4);
+        lod_link->offset = lod_off;
+
+        *(uint32_t*)(file_data + lod_off) = level_count;
+        pmdl_lod_level* levels = file_data + lod_off + sizeof(uint32_t);
+        uint32_t cursor = lod_off + sizeof(uint32_t) + sizeof(pmdl_lod_level)*level_count;
+        for (l=0 ; l<level_count ; ++l) {
+            levels[l].error = level_errors[l];
+            levels[l].run_table_offset = cursor;
+            cursor += sizeof(uint32_t)*col_count;
+        }
+        for (l=0 ; l<level_count ; ++l) {
+            uint32_t* run_offs = file_data + levels[l].run_table_offset;
+            for (i=0 ; i<col_count ; ++i) {
+                run_offs[i] = cursor;
+                memcpy(file_data + cursor, level_runs[l][i], level_run_lens[l][i]);
+                cursor += level_run_lens[l][i];
+            }
+        }
+
+        void* new_elems[col_count];
+        unsigned new_elem_lens[col_count];
+        for (i=0 ; i<col_count ; ++i) {
+            new_elems[i] = cols[i].elems;
+            new_elem_lens[i] = cols[i].elem_count * sizeof(uint16_t);
+        }
+        result = write_general_pmdl(path, file_data, lod_off + section_len, NULL, NULL, new_elems, new_elem_lens);
+    }
+
+    for (l=0 ; l<level_count ; ++l)
+        for (i=0 ; i<col_count ; ++i)
+            free(level_runs[l][i]);
+    for (i=0 ; i<col_count ; ++i) {
+        free(cols[i].positions);
+        free(cols[i].vert_cells);
+        free(cols[i].tris);
+        free(cols[i].prim_first);
+        free(cols[i].prim_tri_count);
+        free(cols[i].elems);
+    }
+    free(file_data);
+    return result;
+}
@@ -0,0 +1,29 @@
+//
+//  PMDLToolchainOptimiser.h
+//  PSPL
+//
+//  Vertex-cache and vertex-fetch optimisation of General PMDLs
+//
+//
+
+#ifndef PSPL_PMDLToolchainOptimiser_h
+#define PSPL_PMDLToolchainOptimiser_h
+
+/* Post-conversion geometry pass for General (`_GEN`) PMDLs; reorders each
+ * collection's triangles for post-transform vertex-cache efficiency and its
+ * vertices for fetch locality, rewriting the file at `path`.
+ * Returns 0 if optimised, -1 if the file was left as-is */
+int pmdl_optimise_general(const char* path);
+
+/* Post-conversion pass re-encoding General (`_GEN`) vertex buffers in the
+ * quantised layout (see `PMDL_COL_QUANTISED`), rewriting the file at `path`.
+ * Returns 0 if quantised, -1 if the file was left as-is */
+int pmdl_quantise_general(const char* path);
+
+/* Post-optimisation pass generating a discrete level-of-detail chain for
+ * General (`_GEN`) PAR0 and PAR1 PMDLs by vertex clustering; reduced levels
+ * reuse the vertex buffers (see `pmdl_lod_level`), rewriting the file at `path`.
+ * Returns 0 if levels were added, -1 if the file was left as-is */
+int pmdl_generate_lods(const char* path);
+
+#endif
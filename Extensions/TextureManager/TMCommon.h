@@ -10,7 +10,7 @@
 #define PSPL_TMCommon_h
 
 #include <stdint.h>
-#include <PSPL/PSPLValue.h>
+#include <PSPL/PSPLCommon.h>
 
 struct pspl_tm_size {
     uint16_t width, height;
@@ -21,4 +21,15 @@ typedef struct {
     DEF_BI_OBJ_TYPE(struct pspl_tm_size) size;
 } pspl_tm_texture_head_t;
 
+/* Samples packed into a shared atlas embed this in place of a plain texture
+ * hash; the transform maps sample UVs into the atlas sub-rectangle */
+struct pspl_tm_uv_transform {
+    float scale[2], offset[2];
+};
+
+typedef struct {
+    pspl_hash atlas_hash;
+    DEF_BI_OBJ_TYPE(struct pspl_tm_uv_transform) uv;
+} pspl_tm_atlas_ref_t;
+
 #endif
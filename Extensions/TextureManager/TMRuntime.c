@@ -8,6 +8,7 @@
 
 #include <stdlib.h>
 #include <PSPLExtension.h>
+#include <TMRuntime.h>
 #include "TMCommon.h"
 
 /* Platform-specific definitions */
@@ -27,7 +28,7 @@
 typedef struct {
     int mip_count;
     GLuint tex_obj;
-    uint8_t tex_ready;
+    volatile uint8_t tex_ready;
 } pspl_tm_gl_stream_tex_t;
 #  define TEX_T pspl_tm_gl_stream_tex_t
 #  define SUB_TEX_FORMAT_T GLenum
@@ -57,9 +58,6 @@ typedef struct {
 #endif
 
 
-/* Malloc context to keep map of PSPLC->texobj */
-static pspl_malloc_context_t map_ctx;
-
 /* Texture format */
 enum TEX_FORMAT {
     TEXTURE_RGB = 1,
@@ -67,23 +65,80 @@ enum TEX_FORMAT {
     TEXTURE_PVRTC = 3
 };
 
-/* Map-entry type */
-typedef struct {
+/* Map-entry type; attached to its PSPLC as the extension's user-data
+ * pointer and allocated as one block with its texture, job and UV arrays
+ * (texture handles stay contiguous for array binding) */
+struct pspl_tm_load_job;
+typedef struct _pspl_tm_map_entry {
+    struct _pspl_tm_map_entry* prev;
+    struct _pspl_tm_map_entry* next;
     const pspl_runtime_psplc_t* owner;
     unsigned texture_count;
+    unsigned alias_count;
     TEX_T* texture_arr;
+    struct pspl_tm_load_job* job_arr;
+    struct pspl_tm_uv_transform* uv_arr;
+    pspl_fence_t load_fence;
 } pspl_tm_map_entry;
 
-static pspl_mutex_t load_tex_st_lock;
+/* List of live map-entries (walked at shutdown only) */
+static pspl_tm_map_entry* map_head = NULL;
+extern const pspl_extension_t TextureManager_extension;
+
+/* Queued load of one texture within a map-entry; slots sampling an
+ * atlas already loaded by another slot alias that slot's texture
+ * (`src_key`) instead of loading their own */
+typedef struct pspl_tm_load_job {
+    pspl_job_t job;
+    pspl_tm_map_entry* ent;
+    unsigned key;
+    unsigned src_key;
+    const pspl_hash* tex_file_hash;
+} pspl_tm_load_job;
+
+/* Loader threads; textures stream in the background, each one becoming
+ * bindable once its completion fence (`tex_ready` on GL) is raised */
+#if PSPL_RUNTIME_PLATFORM_GL2
+/* All uploads share the platform's single load context */
+#  define LOAD_THREAD_COUNT 1
+#elif PSPL_RUNTIME_PLATFORM_GX
+/* Loads run synchronously in the PSPLC load hook */
+#  define LOAD_THREAD_COUNT 0
+#else
+#  define LOAD_THREAD_COUNT 4
+#endif
+static pspl_thread_pool_t* load_pool = NULL;
+static enum pspl_job_priority load_priority = PSPL_JOB_PRIORITY_NORMAL;
+
+/* Multi-threading context switch */
+#if PSPL_RUNTIME_PLATFORM_GL2
+    extern void gl_set_load_context();
+    static void load_thread_init(void* null) {
+        gl_set_load_context();
+    }
+#else
+#   define load_thread_init NULL
+#endif
+
 static int init_hook(const pspl_extension_t* extension) {
-    pspl_mutex_init(&load_tex_st_lock);
-    pspl_malloc_context_init(&map_ctx);
+    load_pool = pspl_thread_pool_create(LOAD_THREAD_COUNT, load_thread_init, NULL);
+    if (!load_pool)
+        return -1;
     return 0;
 }
 
 static void shutdown_hook() {
-    pspl_mutex_destroy(&load_tex_st_lock);
-    pspl_malloc_context_destroy(&map_ctx);
+    pspl_thread_pool_destroy(load_pool);
+    load_pool = NULL;
+    while (map_head) {
+        pspl_tm_map_entry* next = map_head->next;
+        free(map_head);
+        map_head = next;
+    }
+}
+
+void pspl_tm_set_load_priority(enum pspl_job_priority priority) {
+    load_priority = priority;
 }
 
 
@@ -149,10 +204,12 @@ static void recursive_mip_load(pspl_tm_recurse_t* info,
 
 #endif
 
-static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_entry* fill_struct) {
+static void load_texture(pspl_tm_load_job* load_job) {
+    pspl_tm_map_entry* fill_struct = load_job->ent;
+    unsigned key = load_job->key;
     
     // Ready texture file
-    const pspl_hash* tex_file_hash = (pspl_hash*)obj->object_data;
+    const pspl_hash* tex_file_hash = load_job->tex_file_hash;
     const pspl_runtime_arc_file_t* file = pspl_runtime_get_archived_file_from_hash(fill_struct->owner->parent, tex_file_hash, 0);
     if (!file) {
         char hash[PSPL_HASH_STRING_LEN];
@@ -181,14 +238,16 @@ static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_ent
 #       if PSPL_RUNTIME_PLATFORM_GL2 && !GL_EXT_texture_compression_s3tc
             pspl_warn("Unsupported texture format",
                       "S3TC textures not supported by this OpenGL platform");
-            return 0;
+            pspl_runtime_unaccess_archived_file(provider_hooks, &provider_handle);
+            return;
 #       endif
     } else if (!strcmp(tex_type, "PVRTC")) {
         format = TEXTURE_PVRTC;
 #       if PSPL_RUNTIME_PLATFORM_GL2 && !GL_IMG_texture_compression_pvrtc
             pspl_warn("Unsupported texture format",
                       "PVRTC textures not supported by this OpenGL platform");
-            return 0;
+            pspl_runtime_unaccess_archived_file(provider_hooks, &provider_handle);
+            return;
 #       endif
     } else
         pspl_error(-1, "Unsupported texture format",
@@ -365,7 +424,6 @@ static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_ent
             recursive_mip_load(&recurse_info,
                                tex_head->num_mips-1, 0, tex_head->size.native.width,
                                tex_head->size.native.height, 0);
-            fill_struct->texture_arr[key].tex_ready = 1;
             glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
             glDeleteBuffersARB(1, &load_data.pbo);
 #       else
@@ -375,10 +433,19 @@ static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_ent
             recursive_mip_load(&recurse_info,
                                tex_head->num_mips-1, 0, tex_head->size.native.width,
                                tex_head->size.native.height, load_data.tex);
-            fill_struct->texture_arr[key].tex_ready = 1;
             free(load_data.tex);
 #       endif
     
+        // Filter state lives with the texture object; set once here
+        // rather than on every bind
+        if (tex_head->num_mips > 1)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    
+        // Uploads must reach the GPU before the draw context may bind
+        glFlush();
+        pspl_atomic_barrier();
+        fill_struct->texture_arr[key].tex_ready = 1;
+    
 #   elif PSPL_RUNTIME_PLATFORM_GX
         void* tex_data = pspl_allocate_media_block(image_size);
         provider_hooks->read_direct(provider_handle, image_size, tex_data);
@@ -406,112 +473,184 @@ static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_ent
             .CPUAccessFlags = 0,
             .MiscFlags = 0
         };
-        fill_struct->texture_arr[key] = pspl_d3d11_create_texture(&desc, tex_buf);
+        TEX_T tex = pspl_d3d11_create_texture(&desc, tex_buf);
         free(tex_buf);
+        pspl_atomic_barrier();
+        fill_struct->texture_arr[key] = tex;
     
 #   endif
     
     pspl_runtime_unaccess_archived_file(provider_hooks, &provider_handle);
     
-    return 0;
 }
 
-/* Multi-threading context switch */
-#if PSPL_RUNTIME_PLATFORM_GL2
-    extern void gl_set_load_context();
-#endif
-
-static struct load_tex_st {
-    pspl_runtime_psplc_t* object;
-    pspl_tm_map_entry* ent;
-} load_tex_st;
-static void load_texture_thread(void* null) {
-    struct load_tex_st load_tex_st_local = {
-        .object = load_tex_st.object,
-        .ent = load_tex_st.ent
-    };
-#   if PSPL_RUNTIME_PLATFORM_GL2
-        gl_set_load_context();
-#   endif
-    pspl_runtime_enumerate_integer_embedded_data_objects(load_tex_st_local.object,
-                                                         (pspl_integer_enumerate_hook)load_enumerate,
-                                                         load_tex_st_local.ent);
-    pspl_mutex_unlock(&load_tex_st_lock);
+/* Queue each integer-keyed texture object (runs in load hook; the embedded
+ * data APIs aren't available from loader threads) */
+static int load_enumerate(pspl_data_object_t* obj, uint32_t key, pspl_tm_map_entry* ent) {
+    int j;
+    if (key >= ent->texture_count)
+        return 0;
+    pspl_tm_load_job* load_job = &ent->job_arr[key];
+    load_job->ent = ent;
+    load_job->key = key;
+    load_job->src_key = key;
+    load_job->tex_file_hash = (pspl_hash*)obj->object_data;
+    
+    // Atlas-packed sample; share the atlas with any slot already loading it
+    if (obj->object_len == sizeof(pspl_tm_atlas_ref_t)) {
+        pspl_tm_atlas_ref_t* ref = obj->object_data;
+        ent->uv_arr[key] = ref->uv.native;
+        for (j=0 ; j<ent->texture_count ; ++j) {
+            pspl_tm_load_job* other = &ent->job_arr[j];
+            if (j != key && other->ent && other->src_key == j &&
+                !pspl_hash_cmp(other->tex_file_hash, load_job->tex_file_hash)) {
+                load_job->src_key = j;
+                ++ent->alias_count;
+                return 0;
+            }
+        }
+    }
+    
+    load_job->job.func = (void(*)(void*))load_texture;
+    load_job->job.usr_ptr = load_job;
+    load_job->job.priority = load_priority;
+    load_job->job.fence = &ent->load_fence;
+    pspl_thread_pool_submit(load_pool, &load_job->job);
+    return 0;
 }
 
 static void load_object(pspl_runtime_psplc_t* object) {
     int tex_c = pspl_runtime_count_integer_embedded_data_objects(object);
-    pspl_tm_map_entry* ent = pspl_malloc(&map_ctx, sizeof(pspl_tm_map_entry));
+    if (tex_c < 0)
+        tex_c = 0;
+    
+    // Single allocation: entry, texture array, job array, UV array
+    size_t tex_arr_off = ROUND_UP_32(sizeof(pspl_tm_map_entry));
+    size_t job_arr_off = ROUND_UP_32(tex_arr_off + sizeof(TEX_T) * tex_c);
+    size_t uv_arr_off = ROUND_UP_32(job_arr_off + sizeof(pspl_tm_load_job) * tex_c);
+    uint8_t* block = calloc(1, uv_arr_off + sizeof(struct pspl_tm_uv_transform) * tex_c);
+    pspl_tm_map_entry* ent = (pspl_tm_map_entry*)block;
     ent->owner = object;
     ent->texture_count = tex_c;
-    ent->texture_arr = calloc(tex_c, sizeof(TEX_T));
-    memset(ent->texture_arr, 0, sizeof(TEX_T) * tex_c);
-    pspl_mutex_lock(&load_tex_st_lock);
-    load_tex_st.object = object;
-    load_tex_st.ent = ent;
-#   if PSPL_RUNTIME_PLATFORM_GX
-        load_texture_thread(NULL);
-#   else
-        pspl_thread_fork(load_texture_thread, NULL);
-#   endif
+    ent->texture_arr = (TEX_T*)(block + tex_arr_off);
+    ent->job_arr = (pspl_tm_load_job*)(block + job_arr_off);
+    ent->uv_arr = (struct pspl_tm_uv_transform*)(block + uv_arr_off);
+    ent->load_fence = 0;
+    
+    // Unpacked samples map UVs through unchanged
+    int j;
+    for (j=0 ; j<tex_c ; ++j) {
+        ent->uv_arr[j].scale[0] = 1.0;
+        ent->uv_arr[j].scale[1] = 1.0;
+    }
+    
+    ent->next = map_head;
+    if (map_head)
+        map_head->prev = ent;
+    map_head = ent;
+    pspl_runtime_set_extension_user_data_pointer(&TextureManager_extension, object, ent);
+    
+    pspl_runtime_enumerate_integer_embedded_data_objects(object,
+                                                         (pspl_integer_enumerate_hook)load_enumerate,
+                                                         ent);
+}
+
+static inline pspl_tm_map_entry* find_entry(const pspl_runtime_psplc_t* object) {
+    return pspl_runtime_get_extension_user_data_pointer(&TextureManager_extension, object);
 }
 
 static void unload_object(pspl_runtime_psplc_t* object) {
-    int i,j;
-    for (i=0 ; i<map_ctx.object_num ; ++i) {
-        pspl_tm_map_entry* ent = map_ctx.object_arr[i];
-        if (ent->owner == object) {
-            // Destroy platform objects
-            for (j=0 ; j<ent->texture_count ; ++j) {
-#               if PSPL_RUNTIME_PLATFORM_GL2
-                    glDeleteTextures(1, &ent->texture_arr[j].tex_obj);
-                
-#               elif PSPL_RUNTIME_PLATFORM_GX
-                    void* tex_data = GX_GetTexObjUserData(&ent->texture_arr[j]);
-                    pspl_free_media_block(tex_data);
-                
-#               elif PSPL_RUNTIME_PLATFORM_D3D11
-                    pspl_d3d11_destroy_texture(ent->texture_arr[j]);
-                
-#               endif
-            }
-            free(ent->texture_arr);
-            pspl_malloc_free(&map_ctx, ent);
-            break;
-        }
+    int j;
+    pspl_tm_map_entry* ent = find_entry(object);
+    if (!ent)
+        return;
+    
+    // Drop loads still queued and wait out any in flight
+    pspl_thread_pool_cancel(load_pool, &ent->load_fence);
+    pspl_fence_wait(&ent->load_fence);
+    
+    // Destroy platform objects (aliased slots don't own theirs)
+    for (j=0 ; j<ent->texture_count ; ++j) {
+        if (ent->job_arr[j].ent && ent->job_arr[j].src_key != j)
+            continue;
+#       if PSPL_RUNTIME_PLATFORM_GL2
+            if (ent->texture_arr[j].tex_ready)
+                glDeleteTextures(1, &ent->texture_arr[j].tex_obj);
+        
+#       elif PSPL_RUNTIME_PLATFORM_GX
+            void* tex_data = GX_GetTexObjUserData(&ent->texture_arr[j]);
+            pspl_free_media_block(tex_data);
+        
+#       elif PSPL_RUNTIME_PLATFORM_D3D11
+            if (ent->texture_arr[j])
+                pspl_d3d11_destroy_texture(ent->texture_arr[j]);
+        
+#       endif
     }
+    
+    if (ent->prev)
+        ent->prev->next = ent->next;
+    else
+        map_head = ent->next;
+    if (ent->next)
+        ent->next->prev = ent->prev;
+    pspl_runtime_set_extension_user_data_pointer(&TextureManager_extension, object, NULL);
+    free(ent);
 }
 
-static void bind_object(pspl_runtime_psplc_t* object) {
-    int i,j;
-    for (i=0 ; i<map_ctx.object_num ; ++i) {
-        pspl_tm_map_entry* ent = map_ctx.object_arr[i];
-        if (ent->owner == object) {
-            // Bind platform objects
-#           if PSPL_RUNTIME_PLATFORM_D3D11
-                pspl_d3d11_bind_texture_array(ent->texture_arr, ent->texture_count);
-#           else
-                for (j=0 ; j<ent->texture_count ; ++j) {
-#                   if PSPL_RUNTIME_PLATFORM_GL2
-                        glActiveTexture(GL_TEXTURE0+j);
-                        glBindTexture(GL_TEXTURE_2D, ent->texture_arr[j].tex_ready?ent->texture_arr[j].tex_obj:0);
-                        if (ent->texture_arr[j].mip_count > 1)
-                            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-                    
-#                   elif PSPL_RUNTIME_PLATFORM_GX
-                        GX_LoadTexObj(&ent->texture_arr[j], GX_TEXMAP0+j);
+/* Block until all textures of PSPLC have finished loading */
+void pspl_tm_wait_psplc(const pspl_runtime_psplc_t* psplc) {
+    pspl_tm_map_entry* ent = find_entry(psplc);
+    if (ent)
+        pspl_fence_wait(&ent->load_fence);
+}
 
-#                   endif
-                }
-#           endif
+/* Get UV transform of PSPLC's texture map (identity unless atlas-packed) */
+int pspl_tm_get_sample_uv_transform(const pspl_runtime_psplc_t* psplc, unsigned map_idx,
+                                    float xf_out[4]) {
+    pspl_tm_map_entry* ent = find_entry(psplc);
+    if (!ent || map_idx >= ent->texture_count)
+        return -1;
+    xf_out[0] = ent->uv_arr[map_idx].scale[0];
+    xf_out[1] = ent->uv_arr[map_idx].scale[1];
+    xf_out[2] = ent->uv_arr[map_idx].offset[0];
+    xf_out[3] = ent->uv_arr[map_idx].offset[1];
+    return 0;
+}
+
+static void bind_object(pspl_runtime_psplc_t* object) {
+    int j;
+    pspl_tm_map_entry* ent = find_entry(object);
+    if (!ent)
+        return;
+    
+    // Bind platform objects
+    // (textures still loading bind as empty until their fence is raised)
+#   if PSPL_RUNTIME_PLATFORM_D3D11
+        if (ent->alias_count) {
+            TEX_T bind_arr[ent->texture_count];
+            for (j=0 ; j<ent->texture_count ; ++j)
+                bind_arr[j] = ent->texture_arr[ent->job_arr[j].src_key];
+            pspl_d3d11_bind_texture_array(bind_arr, ent->texture_count);
+        } else
+            pspl_d3d11_bind_texture_array(ent->texture_arr, ent->texture_count);
+#   else
+        for (j=0 ; j<ent->texture_count ; ++j) {
+            unsigned src = ent->job_arr[j].src_key;
+#           if PSPL_RUNTIME_PLATFORM_GL2
+                pspl_gl2_bind_texture(j, ent->texture_arr[src].tex_ready?ent->texture_arr[src].tex_obj:0);
             
-#           if PSPL_RUNTIME_PLATFORM_GX
-                GX_InvalidateTexAll();
+#           elif PSPL_RUNTIME_PLATFORM_GX
+                GX_LoadTexObj(&ent->texture_arr[src], GX_TEXMAP0+j);
+
 #           endif
-            
-            break;
         }
-    }
+#   endif
+    
+#   if PSPL_RUNTIME_PLATFORM_GX
+        GX_InvalidateTexAll();
+#   endif
+    
 }
 
 pspl_runtime_extension_t TextureManager_runext = {
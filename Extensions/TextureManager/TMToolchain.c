@@ -8,7 +8,15 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/param.h>
 #include <PSPLExtension.h>
+#include <PSPL/PSPLHash.h>
 #include "TMToolchain.h"
 #include "TMCommon.h"
 
@@ -81,9 +89,8 @@ static void box_filter(const uint8_t* input, unsigned chan_count,
     }
 }
 
-/* Converter hook */
-static int sample_converter(void** buf_out, size_t* len_out, const char* path_in, pspl_tm_convert_t* conv) {
-    int i;
+/* Decode source image (GX targets get 3-component images expanded to RGBA) */
+static void decode_image(const char* path_in, const pspl_tm_convert_t* conv, pspl_tm_image_t* image) {
     
     // Determine decoder
     pspl_tm_decoder_t** dec_arr = pspl_tm_available_decoders;
@@ -112,45 +119,70 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     if (!dec->decoder_hook)
         pspl_error(-1, "Unimplemented decoder hook", "decoder '%s' doesn't implement decoder hook",
                    dec->name);
-    pspl_tm_image_t image;
     int err;
-    pspl_converter_progress_update(0.05);
-    if ((err = dec->decoder_hook(path_in, conv->name_ext, &image)))
+    if ((err = dec->decoder_hook(path_in, conv->name_ext, image)))
         pspl_error(-1, "Decoder returned error", "decoder '%s' returned error %d while processing `%s`",
                    dec->name, err, conv->name);
-    pspl_converter_progress_update(0.5);
     
     // GX doesn't support 3-component textures; insert full alpha
-    uint8_t* image_buffer = (uint8_t*)image.image_buffer;
-    if (conv->gx && image.image_type == 3) {
-        uint8_t* image_cur = (uint8_t*)image.image_buffer;
-        image_buffer = malloc(image.width * image.height * 4);
+    if (conv->gx && image->image_type == 3) {
+        uint8_t* image_cur = (uint8_t*)image->image_buffer;
+        uint8_t* image_buffer = malloc(image->width * image->height * 4);
         int i,j;
-        for (i=0 ; i<image.width*image.height ; ++i) {
+        for (i=0 ; i<image->width*image->height ; ++i) {
             for (j=0 ; j<3 ; ++j)
                 image_buffer[i*4+j] = *(image_cur++);
             image_buffer[i*4+3] = 0xff; // Full Alpha
         }
-        image.image_type = 4;
+        free(image->image_buffer);
+        image->image_buffer = image_buffer;
+        image->image_type = 4;
     }
     
+}
+
+/* Free decoded image buffers */
+static void release_image(pspl_tm_image_t* image) {
+    free(image->image_buffer);
+    free(image->index_buffer);
+    image->image_buffer = NULL;
+    image->index_buffer = NULL;
+}
+
+/* Encoder used for conversion target */
+static pspl_tm_encoder_t* select_encoder(const pspl_tm_convert_t* conv) {
+    pspl_tm_encoder_t* enc = pspl_tm_available_encoders[0];
+    if (conv->gx)
+        enc = pspl_tm_available_encoders[1];
+    if (!enc->encoder_hook)
+        pspl_error(-1, "Unimplemented encoder hook", "encoder '%s' doesn't implement encoder hook",
+                   enc->name);
+    return enc;
+}
+
+/* Mipmap (if requested) and encode decoded image into texture file buffer */
+static void encode_image(void** buf_out, size_t* len_out,
+                         const pspl_tm_image_t* image, const pspl_tm_convert_t* conv) {
+    int i;
+    uint8_t* image_buffer = image->image_buffer;
+    
     // Image series (for mipmapping)
     unsigned series_count = 1;
-    unsigned series_pixel_count = image.width * image.height;
+    unsigned series_pixel_count = image->width * image->height;
     
     // Validate and mipmap (if requested)
     if (conv->mipmap) {
         // Validate dimensions
         unsigned w_idx, h_idx;
-        if (count_bits(image.width, &w_idx) != 1)
+        if (count_bits(image->width, &w_idx) != 1)
             pspl_error(-1, "Invalid mipmap dimensions", "image `%s` has width of %u pixels; it must "
-                       "be an exponential with base 2 in order to be mipmapped", conv->name, image.width);
-        if (count_bits(image.height, &h_idx) != 1)
+                       "be an exponential with base 2 in order to be mipmapped", conv->name, image->width);
+        if (count_bits(image->height, &h_idx) != 1)
             pspl_error(-1, "Invalid mipmap dimensions", "image `%s` has height of %u pixels; it must "
-                       "be an exponential with base 2 in order to be mipmapped", conv->name, image.height);
+                       "be an exponential with base 2 in order to be mipmapped", conv->name, image->height);
         
         // Accumulate up buffer size
-        if (image.width > image.height)
+        if (image->width > image->height)
             series_count = w_idx + 1;
         else
             series_count = h_idx + 1;
@@ -165,14 +197,14 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     }
     
     // Perform mipmap
-    void* final_buf = malloc(series_pixel_count * image.image_type);
+    void* final_buf = malloc(series_pixel_count * image->image_type);
     void* final_cur = final_buf;
-    memcpy(final_cur, image_buffer, image.width * image.height * image.image_type);
-    unsigned mip_width = image.width;
-    unsigned mip_height = image.height;
+    memcpy(final_cur, image_buffer, image->width * image->height * image->image_type);
+    unsigned mip_width = image->width;
+    unsigned mip_height = image->height;
     for (i=1 ; i<series_count ; ++i) {
-        void* next_cur = final_cur + (mip_width * mip_height * image.image_type);
-        box_filter(final_cur, image.image_type, mip_width, mip_height, next_cur);
+        void* next_cur = final_cur + (mip_width * mip_height * image->image_type);
+        box_filter(final_cur, image->image_type, mip_width, mip_height, next_cur);
         if (mip_width > 1)
             mip_width /= 2;
         if (mip_height > 1)
@@ -182,12 +214,7 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     pspl_converter_progress_update(0.75);
     
     // Perform encode
-    pspl_tm_encoder_t* enc = pspl_tm_available_encoders[0];
-    if (conv->gx)
-        enc = pspl_tm_available_encoders[1];
-    if (!enc->encoder_hook)
-        pspl_error(-1, "Unimplemented encoder hook", "encoder '%s' doesn't implement encoder hook",
-                   enc->name);
+    pspl_tm_encoder_t* enc = select_encoder(conv);
     
     // Buffer array
     uint8_t** enc_bufs = calloc(series_count, sizeof(uint8_t*));
@@ -200,12 +227,12 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     
     // Iterate
     final_cur = final_buf;
-    mip_width = image.width;
-    mip_height = image.height;
+    mip_width = image->width;
+    mip_height = image->height;
     for (i=0 ; i<series_count ; ++i) {
-        void* next_cur = final_cur + (mip_width * mip_height * image.image_type);
+        void* next_cur = final_cur + (mip_width * mip_height * image->image_type);
         int err;
-        if ((err = enc->encoder_hook(&enc_ctx, final_cur, image.image_type, mip_width, mip_height, &enc_bufs[i], &enc_sizes[i])))
+        if ((err = enc->encoder_hook(&enc_ctx, final_cur, image->image_type, mip_width, mip_height, &enc_bufs[i], &enc_sizes[i])))
             pspl_error(-1, "Encoder returned error", "encoder '%s' returned error %d while processing `%s`",
                        enc->name, err, conv->name);
         total_size += enc_sizes[i];
@@ -222,11 +249,11 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     memset(output_buf, 0, data_off + ROUND_UP_32(total_size));
     pspl_tm_texture_head_t* head = output_buf;
     head->key1 = 'T';
-    head->chan_count = image.image_type;
+    head->chan_count = image->image_type;
     head->num_mips = series_count;
     head->data_off = data_off;
-    SET_BI_U16(head->size, width, image.width);
-    SET_BI_U16(head->size, height, image.height);
+    SET_BI_U16(head->size, width, image->width);
+    SET_BI_U16(head->size, height, image->height);
     strcpy(output_buf+sizeof(pspl_tm_texture_head_t), enc->name);
     
     // Copy encoded mipmap chain
@@ -236,17 +263,6 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
         output_cur += enc_sizes[i];
     }
     
-    if (conv->gx && image.image_type == 3) {
-        uint8_t* image_cur = (uint8_t*)image.image_buffer;
-        uint8_t* new_image_cur = malloc(image.width * image.height * 4);
-        int i,j;
-        for (i=0 ; i<image.width*image.height ; ++i) {
-            for (j=0 ; j<3 ; ++j)
-                new_image_cur[i*4+j] = *(image_cur++);
-            new_image_cur[i*4+3] = 0xff; // Full Alpha
-        }
-    }
-    
     // Done with malloc context
     free(final_buf);
     free(enc_bufs);
@@ -257,17 +273,440 @@ static int sample_converter(void** buf_out, size_t* len_out, const char* path_in
     *buf_out = output_buf;
     *len_out = data_off + ROUND_UP_32(total_size);
     
+}
+
+#pragma mark Conversion Cache
+
+/* Encoded textures are cached in the staging directory, keyed by a hash
+ * of the decoded pixels and every setting affecting the encode. Sources
+ * re-saved with identical pixels (or the same image sampled alike from
+ * several PSPLs) then skip mipmapping and encoding entirely.
+ * The cache is bounded; once over budget, it is pruned to 3/4 of the
+ * budget at first use, least-recently-hit entries going first */
+
+#define CACHE_MAX_BYTES (512*1024*1024)
+
+/* Cache directory (within staging directory, with trailing slash);
+ * made on first conversion, once the staging directory exists */
+static char cache_dir[MAXPATHLEN];
+static uint8_t cache_dir_made;
+
+/* Cache file record for pruning */
+typedef struct {
+    time_t mtime;
+    off_t size;
+    char name[PSPL_HASH_STRING_LEN];
+} cache_file_t;
+
+static int cache_file_cmp(const void* a, const void* b) {
+    const cache_file_t* fa = a;
+    const cache_file_t* fb = b;
+    if (fa->mtime != fb->mtime)
+        return (fa->mtime < fb->mtime) ? -1 : 1;
+    return 0;
+}
+
+/* Prune least-recently-hit entries while cache is over budget */
+static void cache_prune() {
+    DIR* dir = opendir(cache_dir);
+    if (!dir)
+        return;
+    
+    unsigned count = 0, cap = 64;
+    cache_file_t* files = malloc(cap * sizeof(cache_file_t));
+    off_t total = 0;
+    char path[MAXPATHLEN];
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+        
+        // Entries are named by key hash (skips dot-entries and partial stores)
+        if (strlen(ent->d_name) != PSPL_HASH_STRING_LEN-1)
+            continue;
+        int len = snprintf(path, MAXPATHLEN, "%s%s", cache_dir, ent->d_name);
+        struct stat st;
+        if (len < 0 || len >= MAXPATHLEN || stat(path, &st))
+            continue;
+        
+        if (count == cap) {
+            cap *= 2;
+            files = realloc(files, cap * sizeof(cache_file_t));
+        }
+        files[count].mtime = st.st_mtime;
+        files[count].size = st.st_size;
+        strcpy(files[count].name, ent->d_name);
+        total += st.st_size;
+        ++count;
+    }
+    closedir(dir);
+    
+    if (total > CACHE_MAX_BYTES) {
+        qsort(files, count, sizeof(cache_file_t), cache_file_cmp);
+        unsigned i;
+        for (i=0 ; i<count && total > CACHE_MAX_BYTES/4*3 ; ++i) {
+            snprintf(path, MAXPATHLEN, "%s%s", cache_dir, files[i].name);
+            if (!unlink(path))
+                total -= files[i].size;
+        }
+    }
+    
+    free(files);
+}
+
+static int ensure_cache_dir() {
+    if (cache_dir_made)
+        return 0;
+#   ifdef _WIN32
+    if (mkdir(cache_dir))
+#   else
+    if (mkdir(cache_dir, 0755))
+#   endif
+        if (errno != EEXIST) {
+            pspl_warn("Unable to create texture cache", "`%s` inaccessible; errno %d (%s)",
+                      cache_dir, errno, strerror(errno));
+            cache_dir[0] = '\0';
+            return -1;
+        }
+    cache_dir_made = 1;
+    cache_prune();
+    return 0;
+}
+
+/* Form cache file path for image/settings pairing (returns 0 if path fits) */
+static int cache_path(char* path_out, const pspl_tm_image_t* image, const pspl_tm_convert_t* conv) {
+    pspl_tm_encoder_t* enc = select_encoder(conv);
+    uint32_t dims[3] = {image->width, image->height, image->image_type};
+    
+    pspl_hash_ctx_t hash_ctx;
+    pspl_hash_init(&hash_ctx);
+    pspl_hash_write(&hash_ctx, dims, sizeof(dims));
+    pspl_hash_write(&hash_ctx, &conv->mipmap, 1);
+    pspl_hash_write(&hash_ctx, &conv->gx, 1);
+    pspl_hash_write(&hash_ctx, enc->name, strlen(enc->name)+1);
+    pspl_hash_write(&hash_ctx, image->image_buffer,
+                    image->width * image->height * image->image_type);
+    pspl_hash* key_hash;
+    pspl_hash_result(&hash_ctx, key_hash);
+    
+    char key_str[PSPL_HASH_STRING_LEN];
+    pspl_hash_fmt(key_str, key_hash);
+    int len = snprintf(path_out, MAXPATHLEN, "%s%s", cache_dir, key_str);
+    return (len < 0 || len >= MAXPATHLEN) ? -1 : 0;
+}
+
+/* Load cached encode (returns 0 if hit) */
+static int cache_load(void** buf_out, size_t* len_out, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    size_t len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* buf = malloc(len);
+    if (!len || fread(buf, 1, len, file) != len) {
+        free(buf);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    utime(path, NULL); // Refresh for pruning order
+    *buf_out = buf;
+    *len_out = len;
+    return 0;
+}
+
+/* Store encode (written aside and renamed into place) */
+static void cache_store(const void* buf, size_t len, const char* path) {
+    char tmp_path[MAXPATHLEN];
+    int tmp_len = snprintf(tmp_path, MAXPATHLEN, "%s.%d", path, (int)getpid());
+    if (tmp_len < 0 || tmp_len >= MAXPATHLEN)
+        return;
+    FILE* file = fopen(tmp_path, "w");
+    if (!file)
+        return;
+    size_t wrote = fwrite(buf, 1, len, file);
+    fclose(file);
+    if (wrote != len || rename(tmp_path, path))
+        unlink(tmp_path);
+}
+
+/* Encode through cache */
+static void encode_image_cached(void** buf_out, size_t* len_out,
+                                const pspl_tm_image_t* image, const pspl_tm_convert_t* conv) {
+    if (!cache_dir[0] || ensure_cache_dir()) {
+        encode_image(buf_out, len_out, image, conv);
+        return;
+    }
+    char path[MAXPATHLEN];
+    if (cache_path(path, image, conv)) {
+        encode_image(buf_out, len_out, image, conv);
+        return;
+    }
+    if (!cache_load(buf_out, len_out, path))
+        return;
+    encode_image(buf_out, len_out, image, conv);
+    cache_store(*buf_out, *len_out, path);
+}
+
+
+/* Converter hook */
+static int sample_converter(void** buf_out, size_t* len_out, const char* path_in, pspl_tm_convert_t* conv) {
+    
+    pspl_tm_image_t image;
+    pspl_converter_progress_update(0.05);
+    decode_image(path_in, conv, &image);
+    pspl_converter_progress_update(0.5);
+    encode_image_cached(buf_out, len_out, &image, conv);
+    release_image(&image);
+    
+    return 0;
+}
+
+
+#pragma mark Atlas Packing
+
+/* Samples marked `ATLAS` are deferred until the PSPLC finishes; small,
+ * non-mipmapped images sharing a channel count are then shelf-packed into
+ * shared textures. Each packed sample embeds a `pspl_tm_atlas_ref_t`
+ * (atlas hash and UV transform) in place of a plain texture hash */
+
+#define ATLAS_MAX_DIM 1024
+#define ATLAS_MAX_ENTRY_DIM 256
+#define ATLAS_GUTTER 2
+
+typedef struct {
+    pspl_tm_convert_t conv;
+    unsigned tex_idx;
+    const char* abs_path;
+    pspl_tm_image_t image;
+    unsigned atlas_idx;
+    unsigned x, y;
+} pspl_tm_atlas_entry_t;
+
+typedef struct {
+    pspl_tm_convert_t conv;
+    unsigned chan_count;
+    unsigned width, height;
+    unsigned entry_count;
+    pspl_tm_atlas_entry_t** entries;
+} pspl_tm_atlas_t;
+
+/* Deferred atlas candidates (each allocated along with copies of its names) */
+static pspl_malloc_context_t atlas_candidates;
+
+/* Edge-extend entry into its gutter to keep filtering from bleeding */
+static void atlas_blit(uint8_t* atlas_buf, const pspl_tm_atlas_t* atlas, const pspl_tm_atlas_entry_t* ent) {
+    int y,x;
+    unsigned cc = atlas->chan_count;
+    int w = ent->image.width;
+    int h = ent->image.height;
+    for (y=-ATLAS_GUTTER ; y<h+ATLAS_GUTTER ; ++y) {
+        int sy = (y<0)?0:((y>=h)?h-1:y);
+        int ay = (int)ent->y + y;
+        if (ay < 0 || ay >= atlas->height)
+            continue;
+        for (x=-ATLAS_GUTTER ; x<w+ATLAS_GUTTER ; ++x) {
+            int sx = (x<0)?0:((x>=w)?w-1:x);
+            int ax = (int)ent->x + x;
+            if (ax < 0 || ax >= atlas->width)
+                continue;
+            memcpy(&atlas_buf[(ay*atlas->width+ax)*cc], &ent->image.image_buffer[(sy*w+sx)*cc], cc);
+        }
+    }
+}
+
+/* Atlas converter hook */
+static int atlas_converter(void** buf_out, size_t* len_out, const char* path_in, pspl_tm_atlas_t* atlas) {
+    int i;
+    
+    pspl_tm_image_t image = {
+        .image_type = atlas->chan_count,
+        .width = atlas->width,
+        .height = atlas->height,
+        .image_buffer = calloc(atlas->width * atlas->height, atlas->chan_count),
+        .index_buffer = NULL
+    };
+    for (i=0 ; i<atlas->entry_count ; ++i)
+        atlas_blit(image.image_buffer, atlas, atlas->entries[i]);
+    pspl_converter_progress_update(0.5);
+    
+    encode_image_cached(buf_out, len_out, &image, &atlas->conv);
+    free(image.image_buffer);
     
     return 0;
 }
 
+/* Descending-height order for shelf packing */
+static int atlas_entry_cmp(const void* a, const void* b) {
+    const pspl_tm_atlas_entry_t* ea = *(pspl_tm_atlas_entry_t**)a;
+    const pspl_tm_atlas_entry_t* eb = *(pspl_tm_atlas_entry_t**)b;
+    if (ea->image.height != eb->image.height)
+        return (int)eb->image.height - (int)ea->image.height;
+    return (int)eb->image.width - (int)ea->image.width;
+}
+
+/* Embed plain (unpacked) sample */
+static void embed_single_sample(const pspl_platform_t** plats, pspl_tm_atlas_entry_t* ent) {
+    pspl_hash* hash;
+    pspl_package_membuf_augment(plats, ent->abs_path, ent->conv.name_ext,
+                                (pspl_converter_membuf_hook)sample_converter, &ent->conv, &hash);
+    pspl_embed_integer_keyed_object(plats, ent->tex_idx, hash, hash, sizeof(pspl_hash));
+}
+
+/* Pack and embed atlas candidates for one platform class */
+static void pack_atlases(const pspl_toolchain_context_t* driver_context,
+                         const pspl_platform_t** plats, uint8_t gx) {
+    int i,j;
+    unsigned cand_c = 0;
+    pspl_tm_atlas_entry_t** cands = calloc(atlas_candidates.object_num+1, sizeof(pspl_tm_atlas_entry_t*));
+    
+    // Decode candidates for this platform class
+    for (i=0 ; i<atlas_candidates.object_num ; ++i) {
+        pspl_tm_atlas_entry_t* ent = atlas_candidates.object_arr[i];
+        if (!ent)
+            continue;
+        ent->conv.gx = gx;
+        decode_image(ent->abs_path, &ent->conv, &ent->image);
+        if (ent->image.width > ATLAS_MAX_ENTRY_DIM || ent->image.height > ATLAS_MAX_ENTRY_DIM ||
+            ent->image.image_type < 1 || ent->image.image_type > 4) {
+            release_image(&ent->image);
+            embed_single_sample(plats, ent);
+            continue;
+        }
+        cands[cand_c++] = ent;
+    }
+    qsort(cands, cand_c, sizeof(pspl_tm_atlas_entry_t*), atlas_entry_cmp);
+    
+    // Shelf-pack each channel-count group
+    unsigned chan_count;
+    for (chan_count=1 ; chan_count<=4 ; ++chan_count) {
+        unsigned atlas_c = 0;
+        unsigned atlas_cap = 4;
+        pspl_tm_atlas_t* atlases = calloc(atlas_cap, sizeof(pspl_tm_atlas_t));
+        unsigned shelf_x = ATLAS_MAX_DIM, shelf_y = 0, shelf_h = 0;
+        
+        for (i=0 ; i<cand_c ; ++i) {
+            pspl_tm_atlas_entry_t* ent = cands[i];
+            if (ent->image.image_type != chan_count)
+                continue;
+            unsigned cell_w = ent->image.width + ATLAS_GUTTER*2;
+            unsigned cell_h = ent->image.height + ATLAS_GUTTER*2;
+            
+            // Next shelf, or next atlas
+            if (shelf_x + cell_w > ATLAS_MAX_DIM) {
+                shelf_x = 0;
+                shelf_y += shelf_h;
+                shelf_h = cell_h;
+            }
+            if (!atlas_c || shelf_y + cell_h > ATLAS_MAX_DIM) {
+                if (atlas_c == atlas_cap) {
+                    atlas_cap *= 2;
+                    atlases = realloc(atlases, atlas_cap*sizeof(pspl_tm_atlas_t));
+                }
+                memset(&atlases[atlas_c], 0, sizeof(pspl_tm_atlas_t));
+                atlases[atlas_c].chan_count = chan_count;
+                atlases[atlas_c].entries = calloc(cand_c, sizeof(pspl_tm_atlas_entry_t*));
+                ++atlas_c;
+                shelf_x = 0;
+                shelf_y = 0;
+                shelf_h = cell_h;
+            }
+            
+            pspl_tm_atlas_t* atlas = &atlases[atlas_c-1];
+            ent->atlas_idx = atlas_c-1;
+            ent->x = shelf_x + ATLAS_GUTTER;
+            ent->y = shelf_y + ATLAS_GUTTER;
+            shelf_x += cell_w;
+            if (shelf_x > atlas->width)
+                atlas->width = shelf_x;
+            if (shelf_y + cell_h > atlas->height)
+                atlas->height = shelf_y + cell_h;
+            atlas->entries[atlas->entry_count++] = ent;
+        }
+        
+        // Convert and embed each atlas
+        for (i=0 ; i<atlas_c ; ++i) {
+            pspl_tm_atlas_t* atlas = &atlases[i];
+            
+            // Lone entries gain nothing from packing
+            if (atlas->entry_count == 1) {
+                release_image(&atlas->entries[0]->image);
+                embed_single_sample(plats, atlas->entries[0]);
+                free(atlas->entries);
+                continue;
+            }
+            
+            // Block-compressed formats want 8-texel multiples
+            atlas->width = (atlas->width + 7) & ~7;
+            atlas->height = (atlas->height + 7) & ~7;
+            
+            // Atlas is staged under its newest member's path; the
+            // composition string keys it apart from other packings
+            // (and re-packs it whenever any member changes)
+            const char* newest_path = atlas->entries[0]->abs_path;
+            time_t newest_time = 0;
+            char* composition = malloc(64 + atlas->entry_count * 64);
+            size_t comp_len = snprintf(composition, 64, "ATLAS%c%ux%u", gx?'G':'N',
+                                       atlas->width, atlas->height);
+            for (j=0 ; j<atlas->entry_count ; ++j) {
+                pspl_tm_atlas_entry_t* ent = atlas->entries[j];
+                struct stat st;
+                if (!stat(ent->abs_path, &st) && st.st_mtime >= newest_time) {
+                    newest_time = st.st_mtime;
+                    newest_path = ent->abs_path;
+                }
+                pspl_hash_ctx_t name_ctx;
+                pspl_hash_init(&name_ctx);
+                pspl_hash_write(&name_ctx, ent->abs_path, strlen(ent->abs_path));
+                if (ent->conv.name_ext)
+                    pspl_hash_write(&name_ctx, ent->conv.name_ext, strlen(ent->conv.name_ext));
+                pspl_hash* name_hash;
+                pspl_hash_result(&name_ctx, name_hash);
+                comp_len += snprintf(composition+comp_len, 64, "_%08x@%u,%u",
+                                     name_hash->w[0], ent->x, ent->y);
+            }
+            
+            atlas->conv.name = newest_path;
+            atlas->conv.name_ext = composition;
+            atlas->conv.name_fext = NULL;
+            atlas->conv.mipmap = 0;
+            atlas->conv.gx = gx;
+            
+            pspl_hash* hash;
+            pspl_package_membuf_augment(plats, newest_path, composition,
+                                        (pspl_converter_membuf_hook)atlas_converter, atlas, &hash);
+            
+            // Embed per-sample atlas reference
+            for (j=0 ; j<atlas->entry_count ; ++j) {
+                pspl_tm_atlas_entry_t* ent = atlas->entries[j];
+                pspl_tm_atlas_ref_t ref;
+                pspl_hash_cpy(&ref.atlas_hash, hash);
+                SET_BI_FLOAT(ref.uv, scale[0], ent->image.width / (float)atlas->width);
+                SET_BI_FLOAT(ref.uv, scale[1], ent->image.height / (float)atlas->height);
+                SET_BI_FLOAT(ref.uv, offset[0], ent->x / (float)atlas->width);
+                SET_BI_FLOAT(ref.uv, offset[1], ent->y / (float)atlas->height);
+                pspl_embed_integer_keyed_object(plats, ent->tex_idx, &ref, &ref, sizeof(pspl_tm_atlas_ref_t));
+                
+                // Pixels now live in the atlas (dimensions are kept)
+                release_image(&ent->image);
+            }
+            
+            free(composition);
+            free(atlas->entries);
+        }
+        free(atlases);
+    }
+    
+    free(cands);
+}
+
+
 /* SAMPLE preprocessor directive handling */
 static void sample_direc(const pspl_toolchain_context_t* driver_context,
                          unsigned int argc, const char** argv) {
     if (!argc)
         pspl_error(-1, "Incomplete use of [SAMPLE] directive",
                    "must follow `SAMPLE <tex_file> [LAYER <layer_name>] "
-                   "[MIPMAP] UV <texcoord_index>` syntax");
+                   "[MIPMAP] [ATLAS] UV <texcoord_index>` syntax");
     
     int i;
     
@@ -295,6 +734,9 @@ static void sample_direc(const pspl_toolchain_context_t* driver_context,
     // Mipmap arg
     convert_state.mipmap = 0;
     
+    // Atlas arg
+    uint8_t atlas = 0;
+    
     // Ensure name has an extension
     convert_state.name_fext = strrchr(convert_state.name, '.');
     if (!convert_state.name_fext)
@@ -312,9 +754,18 @@ static void sample_direc(const pspl_toolchain_context_t* driver_context,
             ++i;
         } else if (!strcasecmp(argv[i], "MIPMAP")) {
             convert_state.mipmap = 1;
+        } else if (!strcasecmp(argv[i], "ATLAS")) {
+            atlas = 1;
         }
     }
     
+    // Mip chains can't share an atlas
+    if (atlas && convert_state.mipmap) {
+        pspl_warn("Ignoring ATLAS in [SAMPLE] directive",
+                  "`%s` is mipmapped; it will be sampled from its own texture", convert_state.name);
+        atlas = 0;
+    }
+    
     // We need UV
     if (!uv)
         pspl_error(-1, "Incomplete use of [SAMPLE] directive",
@@ -350,6 +801,32 @@ static void sample_direc(const pspl_toolchain_context_t* driver_context,
             sprintf(name_buf, "%s%s", convert_state.name, convert_state.name_ext);
         }
         
+        // Defer atlas candidates until PSPLC finishes
+        if (atlas) {
+            size_t ext_len = convert_state.name_ext ? strlen(convert_state.name_ext) + 1 : 0;
+            pspl_tm_atlas_entry_t* ent = pspl_malloc(&atlas_candidates, sizeof(pspl_tm_atlas_entry_t) +
+                                                     name_len + 1 + ext_len);
+            memset(ent, 0, sizeof(pspl_tm_atlas_entry_t));
+            ent->conv = convert_state;
+            char* name_copy = (char*)(ent + 1);
+            strcpy(name_copy, convert_state.name);
+            ent->conv.name = name_copy;
+            ent->conv.name_fext = name_copy + (convert_state.name_fext - convert_state.name);
+            if (convert_state.name_ext) {
+                strcpy(name_copy + name_len + 1, convert_state.name_ext);
+                ent->conv.name_ext = name_copy + name_len + 1;
+            }
+            ent->tex_idx = tex_idx;
+            if (convert_state.name[0] == '/')
+                ent->abs_path = strdup(convert_state.name);
+            else {
+                char* abs_path = malloc(strlen(driver_context->pspl_enclosing_dir) + name_len + 1);
+                sprintf(abs_path, "%s%s", driver_context->pspl_enclosing_dir, convert_state.name);
+                ent->abs_path = abs_path;
+            }
+            return;
+        }
+        
         pspl_hash* hash;
         
         if (make_general) {
@@ -437,10 +914,49 @@ static void PP_hook(const pspl_toolchain_context_t* driver_context,
 
 static int init_hook(const pspl_toolchain_context_t* driver_context) {
     pspl_malloc_context_init(&converted_names);
+    pspl_malloc_context_init(&atlas_candidates);
+    
+    // Conversion cache lives alongside staged files
+    cache_dir[0] = '\0';
+    cache_dir_made = 0;
+    if (driver_context->staging_path) {
+        int len = snprintf(cache_dir, MAXPATHLEN, "%sTMCache/", driver_context->staging_path);
+        if (len < 0 || len >= MAXPATHLEN) {
+            pspl_warn("Unable to use texture cache", "staging path too long for `TMCache/`");
+            cache_dir[0] = '\0';
+        }
+    }
+    
     return 0;
 }
 
 static void finish_hook(const pspl_toolchain_context_t* driver_context) {
+    int i;
+    
+    // Platforms to pack for
+    uint8_t make_general = 0;
+    uint8_t make_gx = 0;
+    for (i=0 ; i<driver_context->target_runtime_platforms_c; ++i) {
+        const pspl_platform_t* plat = driver_context->target_runtime_platforms[i];
+        if (plat == &GL2_platform || plat == &D3D11_platform)
+            make_general = 1;
+        else if (plat == &GX_platform)
+            make_gx = 1;
+    }
+    
+    if (atlas_candidates.object_num) {
+        if (make_general)
+            pack_atlases(driver_context, general_plats, 0);
+        if (make_gx)
+            pack_atlases(driver_context, gx_plats, 1);
+        for (i=0 ; i<atlas_candidates.object_num ; ++i) {
+            pspl_tm_atlas_entry_t* ent = atlas_candidates.object_arr[i];
+            if (ent)
+                free((char*)ent->abs_path);
+        }
+    }
+    
+    pspl_malloc_context_destroy(&atlas_candidates);
     pspl_malloc_context_destroy(&converted_names);
 }
 
@@ -11,7 +11,8 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
-#include <PSPL/PSPLCommon.h>
+#define PSPL_INTERNAL
+#include "PSPLInternal.h"
 
 #pragma mark Hash Manipulation
 
@@ -88,6 +89,162 @@ void pspl_malloc_free(pspl_malloc_context_t* context, void* ptr) {
 }
 
 
+#pragma mark LZ4 Block Codec
+
+/* Minimal LZ4 block-format codec for archived file compression
+ * (greedy single-probe matcher; blocks decode with any LZ4 decoder) */
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+static inline uint32_t lz4_read32(const uint8_t* ptr) {
+    uint32_t val;
+    memcpy(&val, ptr, 4);
+    return val;
+}
+
+static inline unsigned lz4_hash(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Extended length bytes (for literal/match lengths of 15 or more) */
+static uint8_t* lz4_write_len(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* Token, literals and (optionally) match of one sequence */
+static uint8_t* lz4_write_seq(uint8_t* op, const uint8_t* lit, size_t lit_len,
+                              size_t offset, size_t match_len) {
+    uint8_t* token = op++;
+    *token = ((lit_len >= 15)?15:lit_len) << 4;
+    if (lit_len >= 15)
+        op = lz4_write_len(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (!offset)
+        return op;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    match_len -= LZ4_MIN_MATCH;
+    *token |= (match_len >= 15)?15:match_len;
+    if (match_len >= 15)
+        op = lz4_write_len(op, match_len - 15);
+    return op;
+}
+
+size_t pspl_lz4_compress(const void* src_in, size_t src_len, void* dst_out) {
+    const uint8_t* src = src_in;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + src_len;
+    uint8_t* op = dst_out;
+    
+    if (src_len > LZ4_MF_LIMIT) {
+        uint32_t table[1<<LZ4_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const uint8_t* mf_limit = end - LZ4_MF_LIMIT;
+        const uint8_t* match_limit = end - LZ4_LAST_LITERALS;
+        
+        while (ip < mf_limit) {
+            uint32_t seq = lz4_read32(ip);
+            unsigned h = lz4_hash(seq);
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != seq) {
+                ++ip;
+                continue;
+            }
+            
+            // Extend match both ways
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            const uint8_t* mp = ip + LZ4_MIN_MATCH;
+            const uint8_t* rp = ref + LZ4_MIN_MATCH;
+            while (mp < match_limit && *mp == *rp) {
+                ++mp;
+                ++rp;
+            }
+            
+            op = lz4_write_seq(op, anchor, ip - anchor, ip - ref, mp - ip);
+            ip = mp;
+            anchor = ip;
+        }
+    }
+    
+    // Final literals
+    op = lz4_write_seq(op, anchor, end - anchor, 0, 0);
+    return op - (uint8_t*)dst_out;
+}
+
+int pspl_lz4_decompress(const void* src_in, size_t src_len, void* dst_out, size_t dst_len) {
+    const uint8_t* ip = src_in;
+    const uint8_t* iend = ip + src_len;
+    uint8_t* dst = dst_out;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+    
+    while (ip < iend) {
+        unsigned token = *ip++;
+        uint8_t b;
+        
+        // Literals
+        size_t len = token >> 4;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > iend - ip || len > oend - op)
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        
+        // Last sequence has no match
+        if (ip >= iend)
+            break;
+        
+        // Match
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > op - dst)
+            return -1;
+        len = token & 15;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > oend - op)
+            return -1;
+        const uint8_t* ref = op - offset;
+        while (len--)
+            *op++ = *ref++;
+    }
+    
+    return (op == oend)?0:-1;
+}
+
+
 #pragma mark Windows Support Stuff
 
 #ifdef _WIN32
@@ -20,7 +20,7 @@ extern const char* PSPL_MAGIC; // Set to PSPL_MAGIC_DEF
 #define PSPL_MAGIC_DEF "PSPL"
 #define PSPL_PSPLC 0
 #define PSPL_PSPLP 1
-#define PSPL_VERSION 1
+#define PSPL_VERSION 2
 
 
 #pragma mark Common Types
@@ -168,12 +168,44 @@ typedef struct {
         uint32_t file_len;
     };
     
+    // Codec archived file data is stored with (always `PSPL_CODEC_NONE`
+    // in PSPLCs) and length of file data once decoded
+    uint32_t file_codec;
+    uint32_t file_raw_len;
+    
 } pspl_file_stub_t;
 typedef DEF_BI_OBJ_TYPE(pspl_file_stub_t) pspl_file_stub_bi_t;
 #define SWAP_PSPL_FILE_STUB_T(ptr) \
 (ptr)->platform_availability_bits = swap_uint32((ptr)->platform_availability_bits);\
 (ptr)->file_path_off = swap_uint32((ptr)->file_path_off);\
-(ptr)->file_path_ext_off = swap_uint32((ptr)->file_path_ext_off)
+(ptr)->file_path_ext_off = swap_uint32((ptr)->file_path_ext_off);\
+(ptr)->file_codec = swap_uint32((ptr)->file_codec);\
+(ptr)->file_raw_len = swap_uint32((ptr)->file_raw_len)
+
+
+#pragma mark Archived File Compression
+
+/* Archived file codecs */
+#define PSPL_CODEC_NONE 0
+#define PSPL_CODEC_LZ4  1
+
+/* LZ4-coded files are split into independently-coded chunks of this
+ * (decoded) size so they may be decoded in parallel. The file data
+ * begins with a little-endian `uint32_t` table holding the end offset
+ * of each coded chunk (relative to the end of the table) */
+#define PSPL_CODEC_CHUNK_SIZE 65536
+#define PSPL_CODEC_CHUNK_COUNT(raw_len) (((raw_len)+PSPL_CODEC_CHUNK_SIZE-1)/PSPL_CODEC_CHUNK_SIZE)
+
+/* Worst-case LZ4 block size for `src_len` bytes of input */
+#define pspl_lz4_compress_bound(src_len) ((src_len) + (src_len)/255 + 16)
+
+/* Code one LZ4 block; returns coded length
+ * (`dst` must hold `pspl_lz4_compress_bound(src_len)` bytes) */
+size_t pspl_lz4_compress(const void* src, size_t src_len, void* dst);
+
+/* Decode one LZ4 block of exactly `dst_len` decoded bytes;
+ * returns 0 if successful, negative if block is malformed */
+int pspl_lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_len);
 
 
 /* Tier 3 (per-object) Extension object entry (concrete)
@@ -17,13 +17,33 @@
 #    include <OpenGL/gl.h>
 #  endif
 #else
+/* GL 2.0 entry points are only prototyped by glext.h off Apple */
+#  ifndef GL_GLEXT_PROTOTYPES
+#    define GL_GLEXT_PROTOTYPES 1
+#  endif
 #  include <GL/gl.h>
+#  include <GL/glext.h>
 #endif
 
 #include "gl_common.h"
 
+/* Instanced drawing entry points (EXT_instanced_arrays on ES, or
+ * ARB_instanced_arrays with ARB_draw_instanced); availability in the
+ * current context is checked at runtime (see `pspl_gl2_instanced_shader`) */
+#if GL_EXT_instanced_arrays
+#  define GLINST(name) name##EXT
+#  define PSPL_GL2_INSTANCING 1
+#elif GL_ARB_instanced_arrays && GL_ARB_draw_instanced
+#  define GLINST(name) name##ARB
+#  define PSPL_GL2_INSTANCING 1
+#endif
+
+/* First of the 8 attribute locations holding per-instance transforms
+ * (modelview, then its inverse-transpose; each a mat4 of 4 locations) */
+#define PSPL_GL2_INSTANCE_ATTRIB 8
+
 /* OpenGL-specific type for shader object */
-typedef struct {
+typedef struct GL2_shader_object {
     
     // Program object
     GLuint program;
@@ -42,7 +62,59 @@ typedef struct {
     GLint mv_mtx_uni, mv_invxpose_uni;
     GLint proj_mtx_uni;
     GLint tc_genmtx_arr;
+    GLint pos_dequant_uni;
+    
+    // Bone palette last loaded into bone uniforms (and its generation);
+    // lets rigged draws skip re-uploading an unchanged palette
+    const void* loaded_bone_palette;
+    unsigned loaded_bone_palette_gen;
+    
+    // Source (and generation) of transform uniforms last loaded into program
+    // (see `pspl_gl2_stamp_uniforms`)
+    const void* loaded_uniform_source;
+    unsigned loaded_uniform_gen;
+    
+    // Vertex dequantisation terms last loaded into program
+    // (NULL while holding the identity terms of float vertices)
+    const void* loaded_dequant;
+    
+    // Vertex source (kept for building the instanced variant)
+    const char* vertex_source;
+    
+    // Instanced variant (transforms read from per-instance attributes);
+    // built on first request
+    struct GL2_shader_object* instanced;
+    int instanced_unavailable;
     
 } GL2_shader_object_t;
 
+/* Counters of GL calls issued and filtered by the redundant-state cache */
+typedef struct {
+    unsigned program_binds, program_skips;
+    unsigned capability_sets, capability_skips;
+    unsigned texture_binds, texture_skips;
+    unsigned uniform_loads, uniform_skips;
+} GL2_state_stats_t;
+
+/* State-filtered equivalents of `glUseProgram` and
+ * `glActiveTexture`+`glBindTexture(GL_TEXTURE_2D)`; use these for all
+ * main-context binds so the shadow state stays accurate */
+void pspl_gl2_use_program(GLuint program);
+void pspl_gl2_bind_texture(unsigned unit, GLuint texture);
+
+/* Returns 1 if transform uniforms from `source` at `generation` must be
+ * loaded into `shader` (stamping it as loaded), 0 if it already holds them */
+int pspl_gl2_stamp_uniforms(GL2_shader_object_t* shader, const void* source, unsigned generation);
+
+/* Instanced variant of shader (sharing its fragment stage and config), or
+ * NULL when the context lacks instancing or the shader predates it. Bind the
+ * object as usual, then `pspl_gl2_use_program` the variant's program */
+GL2_shader_object_t* pspl_gl2_instanced_shader(GL2_shader_object_t* shader);
+
+/* Mark shadow state unknown (call after issuing GL state outside PSPL) */
+void pspl_gl2_invalidate_state();
+
+/* Copy out filtering counters (optionally resetting them) */
+void pspl_gl2_get_state_stats(GL2_state_stats_t* stats_out, int reset);
+
 #endif
@@ -7,6 +7,7 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include <PSPLExtension.h>
 #include <PSPL/PSPL_IR.h>
 #include "gl_common.h"
@@ -40,12 +41,118 @@ void gl_set_load_context() {
 #endif
 #endif
 
+static void init_instancing();
 static int init(const pspl_platform_t* platform) {
     // Init Load Context
     gl_init_load_context();
+    init_instancing();
     return 0;
 }
 
+#pragma mark Redundant-State Filtering
+
+/* Validity bits of shadowed state */
+enum gl_state_bits {
+    GL_STATE_PROGRAM     = 1,
+    GL_STATE_DEPTH_WRITE = (1<<1),
+    GL_STATE_DEPTH_TEST  = (1<<2),
+    GL_STATE_BLEND       = (1<<3),
+    GL_STATE_BLEND_FUNC  = (1<<4),
+    GL_STATE_ACTIVE_UNIT = (1<<5)
+};
+
+/* Shadow copy of (main context) GL state last issued through this platform;
+ * calls matching the shadow are filtered out */
+static struct {
+    unsigned valid_bits;
+    GLuint program;
+    GLboolean depth_write;
+    GLboolean depth_test;
+    GLboolean blend;
+    GLenum blend_src, blend_dest;
+    unsigned active_unit;
+    unsigned valid_unit_bits;
+    GLuint unit_textures[MAX_TEX_MAPS];
+} gl_state;
+
+static GL2_state_stats_t gl_stats;
+
+void pspl_gl2_invalidate_state() {
+    gl_state.valid_bits = 0;
+    gl_state.valid_unit_bits = 0;
+}
+
+void pspl_gl2_get_state_stats(GL2_state_stats_t* stats_out, int reset) {
+    if (stats_out)
+        *stats_out = gl_stats;
+    if (reset)
+        memset(&gl_stats, 0, sizeof(gl_stats));
+}
+
+void pspl_gl2_use_program(GLuint program) {
+    if ((gl_state.valid_bits & GL_STATE_PROGRAM) && gl_state.program == program) {
+        ++gl_stats.program_skips;
+        return;
+    }
+    glUseProgram(program);
+    gl_state.program = program;
+    gl_state.valid_bits |= GL_STATE_PROGRAM;
+    ++gl_stats.program_binds;
+}
+
+/* Delete program, dropping it from the shadow if bound (its name may be
+ * handed out again) */
+static void delete_program(GLuint program) {
+    if ((gl_state.valid_bits & GL_STATE_PROGRAM) && gl_state.program == program)
+        gl_state.valid_bits &= ~GL_STATE_PROGRAM;
+    glDeleteProgram(program);
+}
+
+void pspl_gl2_bind_texture(unsigned unit, GLuint texture) {
+    if ((gl_state.valid_unit_bits & (1<<unit)) && gl_state.unit_textures[unit] == texture) {
+        ++gl_stats.texture_skips;
+        return;
+    }
+    if (!(gl_state.valid_bits & GL_STATE_ACTIVE_UNIT) || gl_state.active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0+unit);
+        gl_state.active_unit = unit;
+        gl_state.valid_bits |= GL_STATE_ACTIVE_UNIT;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state.unit_textures[unit] = texture;
+    gl_state.valid_unit_bits |= (1<<unit);
+    ++gl_stats.texture_binds;
+}
+
+int pspl_gl2_stamp_uniforms(GL2_shader_object_t* shader, const void* source, unsigned generation) {
+    if (shader->loaded_uniform_source == source && shader->loaded_uniform_gen == generation) {
+        ++gl_stats.uniform_skips;
+        return 0;
+    }
+    shader->loaded_uniform_source = source;
+    shader->loaded_uniform_gen = generation;
+    ++gl_stats.uniform_loads;
+    return 1;
+}
+
+/* Set a capability through the shadow */
+static void set_capability(enum gl_state_bits bit, GLboolean* shadow, GLenum cap, GLboolean value) {
+    if ((gl_state.valid_bits & bit) && *shadow == value) {
+        ++gl_stats.capability_skips;
+        return;
+    }
+    if (value)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    *shadow = value;
+    gl_state.valid_bits |= bit;
+    ++gl_stats.capability_sets;
+}
+
+
+#pragma mark Shader Objects
+
 static const char* HEAD = "#version 120";
  
 static const GLint TEX_IDX_ARRAY[16] = {
@@ -53,8 +160,87 @@ static const GLint TEX_IDX_ARRAY[16] = {
     8,9,10,11,12,13,14,15
 };
 
-static void load_object(pspl_runtime_psplc_t* object) {
+/* Bind vertex attribute locations of a (not yet linked) program */
+static void bind_attribs(GLuint program, const gl_config_t* config) {
     int i;
+    glBindAttribLocation(program, 0, "pos");
+    glBindAttribLocation(program, 1, "norm");
+    for (i=0 ; i<config->uv_attr_count ; ++i) {
+        char uv[8];
+        snprintf(uv, 8, "uv%u", i);
+        glBindAttribLocation(program, 2+i, uv);
+    }
+}
+
+/* Compile shader stage; returns 0 (and the log) on failure */
+static GLuint compile_stage(GLenum type, GLsizei source_count, const GLchar** source, char** log_out) {
+    GLint compile_result;
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, source_count, source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_result);
+    if (compile_result != GL_TRUE) {
+        GLint log_len = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
+        *log_out = malloc(log_len+1);
+        glGetShaderInfoLog(shader, log_len+1, NULL, *log_out);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+/* Link program; returns 0 (and the log) on failure */
+static int link_program(GLuint program, char** log_out) {
+    GLint link_result;
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &link_result);
+    if (link_result != GL_TRUE) {
+        GLint log_len = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_len);
+        *log_out = malloc(log_len+1);
+        glGetProgramInfoLog(program, log_len+1, NULL, *log_out);
+        return 0;
+    }
+    return 1;
+}
+
+/* Look up uniforms of linked program and load their initial values */
+static void init_uniforms(GL2_shader_object_t* shader) {
+    glUseProgram(shader->program);
+    
+    // Matrix uniforms
+    shader->bone_mat_uni = glGetUniformLocation(shader->program, "bone_mat");
+    shader->bone_base_uni = glGetUniformLocation(shader->program, "bone_base");
+    shader->mv_mtx_uni = glGetUniformLocation(shader->program, "modelview_mat");
+    shader->mv_invxpose_uni = glGetUniformLocation(shader->program, "modelview_invtrans_mat");
+    shader->proj_mtx_uni = glGetUniformLocation(shader->program, "projection_mat");
+    shader->tc_genmtx_arr = glGetUniformLocation(shader->program, "tc_generator_mats");
+    shader->pos_dequant_uni = glGetUniformLocation(shader->program, "pos_dequant");
+    shader->loaded_bone_palette = NULL;
+    shader->loaded_bone_palette_gen = 0;
+    shader->loaded_uniform_source = NULL;
+    shader->loaded_uniform_gen = 0;
+    
+    // Identity vertex dequantisation (float vertex buffers)
+    static const GLfloat IDENTITY_DEQUANT[] = {1.0, 1.0, 1.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    glUniform4fv(shader->pos_dequant_uni, 2, IDENTITY_DEQUANT);
+    shader->loaded_dequant = NULL;
+    
+    // Texture map uniforms
+    GLint texs_uniform = glGetUniformLocation(shader->program, "tex_map");
+    if (texs_uniform >= 0) {
+        GLsizei map_count = (shader->config->texmap_count>16)?
+                            16:shader->config->texmap_count;
+        glUniform1iv(texs_uniform, map_count, TEX_IDX_ARRAY);
+    }
+    
+    // Program was bound directly above
+    gl_state.valid_bits &= ~GL_STATE_PROGRAM;
+}
+
+static void load_object(pspl_runtime_psplc_t* object) {
+    char* log;
     
     // Config structure
     pspl_data_object_t config_struct;
@@ -63,138 +249,174 @@ static void load_object(pspl_runtime_psplc_t* object) {
     
     // Generate platform shader objects
     object->native_shader.program = glCreateProgram();
-    glBindAttribLocation(object->native_shader.program, 0, "pos");
-    glBindAttribLocation(object->native_shader.program, 1, "norm");
-    for (i=0 ; i<object->native_shader.config->uv_attr_count ; ++i) {
-        char uv[8];
-        snprintf(uv, 8, "uv%u", i);
-        glBindAttribLocation(object->native_shader.program, 2+i, uv);
-    }
-    GLint compile_result;
+    bind_attribs(object->native_shader.program, object->native_shader.config);
     
     // Vertex
-    object->native_shader.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     pspl_data_object_t vertex_source;
     pspl_runtime_get_embedded_data_object_from_integer(object, GL_VERTEX_SOURCE, &vertex_source);
     const GLchar* vsource[] = {HEAD, vertex_source.object_data};
-    glShaderSource(object->native_shader.vertex_shader, 2, vsource, NULL);
-    glCompileShader(object->native_shader.vertex_shader);
-    glGetShaderiv(object->native_shader.vertex_shader, GL_COMPILE_STATUS, &compile_result);
-    if (compile_result != GL_TRUE) {
-        GLint log_len = 0;
-        glGetShaderiv(object->native_shader.vertex_shader, GL_INFO_LOG_LENGTH, &log_len);
-        char* log = malloc(log_len);
-        glGetShaderInfoLog(object->native_shader.vertex_shader, log_len, NULL, log);
-        pspl_error(-1, "GLSL Vertex Shader Compile Failure", "%.*s", log_len, log);
-    }
+    object->native_shader.vertex_shader = compile_stage(GL_VERTEX_SHADER, 2, vsource, &log);
+    if (!object->native_shader.vertex_shader)
+        pspl_error(-1, "GLSL Vertex Shader Compile Failure", "%s", log);
     glAttachShader(object->native_shader.program, object->native_shader.vertex_shader);
+    object->native_shader.vertex_source = vertex_source.object_data;
     
     // Fragment
-    object->native_shader.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
     pspl_data_object_t fragment_source;
     pspl_runtime_get_embedded_data_object_from_integer(object, GL_FRAGMENT_SOURCE, &fragment_source);
     const GLchar* fsource[] = {HEAD, fragment_source.object_data};
-    glShaderSource(object->native_shader.fragment_shader, 2, fsource, NULL);
-    glCompileShader(object->native_shader.fragment_shader);
-    glGetShaderiv(object->native_shader.fragment_shader, GL_COMPILE_STATUS, &compile_result);
-    if (compile_result != GL_TRUE) {
-        GLint log_len = 0;
-        glGetShaderiv(object->native_shader.fragment_shader, GL_INFO_LOG_LENGTH, &log_len);
-        char* log = malloc(log_len);
-        glGetShaderInfoLog(object->native_shader.fragment_shader, log_len, NULL, log);
-        pspl_error(-1, "GLSL Fragment Shader Compile Failure", "%.*s", log_len, log);
-    }
+    object->native_shader.fragment_shader = compile_stage(GL_FRAGMENT_SHADER, 2, fsource, &log);
+    if (!object->native_shader.fragment_shader)
+        pspl_error(-1, "GLSL Fragment Shader Compile Failure", "%s", log);
     glAttachShader(object->native_shader.program, object->native_shader.fragment_shader);
     
     // Link
-    glLinkProgram(object->native_shader.program);
-    glGetProgramiv(object->native_shader.program, GL_LINK_STATUS, &compile_result);
-    if (compile_result != GL_TRUE) {
-        GLint log_len = 0;
-        glGetProgramiv(object->native_shader.program, GL_INFO_LOG_LENGTH, &log_len);
-        char* log = malloc(log_len);
-        glGetProgramInfoLog(object->native_shader.program, log_len, NULL, log);
-        pspl_error(-1, "GLSL Program Link Failure", "%.*s", log_len, log);
-    }
-    glUseProgram(object->native_shader.program);
+    if (!link_program(object->native_shader.program, &log))
+        pspl_error(-1, "GLSL Program Link Failure", "%s", log);
     
-    // Matrix uniforms
-    object->native_shader.bone_mat_uni = glGetUniformLocation(object->native_shader.program, "bone_mat");
-    object->native_shader.bone_base_uni = glGetUniformLocation(object->native_shader.program, "bone_base");
-    object->native_shader.mv_mtx_uni = glGetUniformLocation(object->native_shader.program, "modelview_mat");
-    object->native_shader.mv_invxpose_uni = glGetUniformLocation(object->native_shader.program, "modelview_invtrans_mat");
-    object->native_shader.proj_mtx_uni = glGetUniformLocation(object->native_shader.program, "projection_mat");
-    object->native_shader.tc_genmtx_arr = glGetUniformLocation(object->native_shader.program, "tc_generator_mats");
-    
-    // Texture map uniforms
-    GLint texs_uniform = glGetUniformLocation(object->native_shader.program, "tex_map");
-    if (texs_uniform >= 0) {
-        GLsizei map_count = (object->native_shader.config->texmap_count>16)?
-                            16:object->native_shader.config->texmap_count;
-        glUniform1iv(texs_uniform, map_count, TEX_IDX_ARRAY);
-    }
+    init_uniforms(&object->native_shader);
+    object->native_shader.instanced = NULL;
+    object->native_shader.instanced_unavailable = 0;
     
 }
 
 static void unload_object(pspl_runtime_psplc_t* object) {
     
-    glDeleteProgram(object->native_shader.program);
+    GL2_shader_object_t* instanced = object->native_shader.instanced;
+    if (instanced) {
+        delete_program(instanced->program);
+        glDeleteShader(instanced->vertex_shader);
+        free(instanced);
+    }
+    delete_program(object->native_shader.program);
     glDeleteShader(object->native_shader.vertex_shader);
     glDeleteShader(object->native_shader.fragment_shader);
     
 }
 
-static pspl_platform_shader_object_t* bound_shader = NULL;
+
+#pragma mark Instancing
+
+/* Set at init if the context draws instanced with enough attributes */
+static int instancing_supported = 0;
+
+static void init_instancing() {
+#   if PSPL_GL2_INSTANCING
+        const char* exts = (const char*)glGetString(GL_EXTENSIONS);
+        GLint max_attribs = 0;
+        glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attribs);
+        instancing_supported = exts && max_attribs >= PSPL_GL2_INSTANCE_ATTRIB+8 &&
+                               (strstr(exts, "GL_EXT_instanced_arrays") ||
+                                (strstr(exts, "GL_ARB_instanced_arrays") &&
+                                 strstr(exts, "GL_ARB_draw_instanced")));
+#   endif
+}
+
+GL2_shader_object_t* pspl_gl2_instanced_shader(GL2_shader_object_t* shader) {
+    if (shader->instanced || shader->instanced_unavailable)
+        return shader->instanced;
+    shader->instanced_unavailable = 1;
+    if (!instancing_supported || 2+shader->config->uv_attr_count > PSPL_GL2_INSTANCE_ATTRIB)
+        return NULL;
+    
+    // Same source, with transforms switched to per-instance attributes
+    char* log;
+    const GLchar* vsource[] = {HEAD, "\n#define PSPL_INSTANCED 1\n", shader->vertex_source};
+    GLuint vertex_shader = compile_stage(GL_VERTEX_SHADER, 3, vsource, &log);
+    if (!vertex_shader) {
+        pspl_warn("GLSL Instanced Vertex Shader Compile Failure", "%s", log);
+        free(log);
+        return NULL;
+    }
+    GLuint program = glCreateProgram();
+    bind_attribs(program, shader->config);
+    glBindAttribLocation(program, PSPL_GL2_INSTANCE_ATTRIB, "instance_mv");
+    glBindAttribLocation(program, PSPL_GL2_INSTANCE_ATTRIB+4, "instance_mv_invtrans");
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, shader->fragment_shader);
+    if (!link_program(program, &log)) {
+        pspl_warn("GLSL Instanced Program Link Failure", "%s", log);
+        free(log);
+        delete_program(program);
+        glDeleteShader(vertex_shader);
+        return NULL;
+    }
+    
+    // Sources generated before instancing lack the attributes
+    if (glGetAttribLocation(program, "instance_mv") != PSPL_GL2_INSTANCE_ATTRIB) {
+        delete_program(program);
+        glDeleteShader(vertex_shader);
+        return NULL;
+    }
+    
+    GL2_shader_object_t* instanced = malloc(sizeof(GL2_shader_object_t));
+    *instanced = *shader;
+    instanced->program = program;
+    instanced->vertex_shader = vertex_shader;
+    instanced->instanced = NULL;
+    init_uniforms(instanced);
+    shader->instanced = instanced;
+    shader->instanced_unavailable = 0;
+    return instanced;
+}
+
+/* Resolve config blend factor to GL enum */
+static GLenum resolve_blend_factor(uint8_t factor, GLenum default_fac) {
+    unsigned data_source = factor & 0x3;
+    unsigned inverse = factor & 0x4;
+    if (data_source == SRC_COLOUR)
+        return (inverse)?GL_ONE_MINUS_SRC_COLOR:GL_SRC_COLOR;
+    else if (data_source == DST_COLOUR)
+        return (inverse)?GL_ONE_MINUS_DST_COLOR:GL_DST_COLOR;
+    else if (data_source == SRC_ALPHA)
+        return (inverse)?GL_ONE_MINUS_SRC_ALPHA:GL_SRC_ALPHA;
+    else if (data_source == DST_ALPHA)
+        return (inverse)?GL_ONE_MINUS_DST_ALPHA:GL_DST_ALPHA;
+    return default_fac;
+}
+
 static void bind_object(pspl_runtime_psplc_t* object) {
+    const gl_config_t* config = object->native_shader.config;
     
-    glUseProgram(object->native_shader.program);
+    pspl_gl2_use_program(object->native_shader.program);
     
-    if (object->native_shader.config->depth_write == ENABLED)
-        glDepthMask(GL_TRUE);
-    else if (object->native_shader.config->depth_write == DISABLED)
-        glDepthMask(GL_FALSE);
+    if (config->depth_write == ENABLED || config->depth_write == DISABLED) {
+        GLboolean depth_write = (config->depth_write == ENABLED)?GL_TRUE:GL_FALSE;
+        if ((gl_state.valid_bits & GL_STATE_DEPTH_WRITE) && gl_state.depth_write == depth_write)
+            ++gl_stats.capability_skips;
+        else {
+            glDepthMask(depth_write);
+            gl_state.depth_write = depth_write;
+            gl_state.valid_bits |= GL_STATE_DEPTH_WRITE;
+            ++gl_stats.capability_sets;
+        }
+    }
     
-    if (object->native_shader.config->depth_test == ENABLED)
-        glEnable(GL_DEPTH_TEST);
-    else if (object->native_shader.config->depth_test == DISABLED)
-        glDisable(GL_DEPTH_TEST);
+    if (config->depth_test == ENABLED)
+        set_capability(GL_STATE_DEPTH_TEST, &gl_state.depth_test, GL_DEPTH_TEST, GL_TRUE);
+    else if (config->depth_test == DISABLED)
+        set_capability(GL_STATE_DEPTH_TEST, &gl_state.depth_test, GL_DEPTH_TEST, GL_FALSE);
     
-    if (object->native_shader.config->blending == ENABLED) {
-        glEnable(GL_BLEND);
-        
-        GLenum src_fac = GL_SRC_ALPHA;
-        unsigned data_source = object->native_shader.config->source_factor & 0x3;
-        unsigned inverse = object->native_shader.config->source_factor & 0x4;
-        if (data_source == SRC_COLOUR)
-            src_fac = (inverse)?GL_ONE_MINUS_SRC_COLOR:GL_SRC_COLOR;
-        else if (data_source == DST_COLOUR)
-            src_fac = (inverse)?GL_ONE_MINUS_DST_COLOR:GL_DST_COLOR;
-        else if (data_source == SRC_ALPHA)
-            src_fac = (inverse)?GL_ONE_MINUS_SRC_ALPHA:GL_SRC_ALPHA;
-        else if (data_source == DST_ALPHA)
-            src_fac = (inverse)?GL_ONE_MINUS_DST_ALPHA:GL_DST_ALPHA;
-        
-        GLenum dest_fac = GL_ONE_MINUS_SRC_ALPHA;
-        data_source = object->native_shader.config->dest_factor & 0x3;
-        inverse = object->native_shader.config->dest_factor & 0x4;
-        if (data_source == SRC_COLOUR)
-            dest_fac = (inverse)?GL_ONE_MINUS_SRC_COLOR:GL_SRC_COLOR;
-        else if (data_source == DST_COLOUR)
-            dest_fac = (inverse)?GL_ONE_MINUS_DST_COLOR:GL_DST_COLOR;
-        else if (data_source == SRC_ALPHA)
-            dest_fac = (inverse)?GL_ONE_MINUS_SRC_ALPHA:GL_SRC_ALPHA;
-        else if (data_source == DST_ALPHA)
-            dest_fac = (inverse)?GL_ONE_MINUS_DST_ALPHA:GL_DST_ALPHA;
+    if (config->blending == ENABLED) {
+        set_capability(GL_STATE_BLEND, &gl_state.blend, GL_BLEND, GL_TRUE);
         
-        glBlendFunc(src_fac, dest_fac);
-    } else if (object->native_shader.config->blending == DISABLED)
-        glDisable(GL_BLEND);
-    
-    bound_shader = &object->native_shader;
+        GLenum src_fac = resolve_blend_factor(config->source_factor, GL_SRC_ALPHA);
+        GLenum dest_fac = resolve_blend_factor(config->dest_factor, GL_ONE_MINUS_SRC_ALPHA);
+        if ((gl_state.valid_bits & GL_STATE_BLEND_FUNC) &&
+            gl_state.blend_src == src_fac && gl_state.blend_dest == dest_fac)
+            ++gl_stats.capability_skips;
+        else {
+            glBlendFunc(src_fac, dest_fac);
+            gl_state.blend_src = src_fac;
+            gl_state.blend_dest = dest_fac;
+            gl_state.valid_bits |= GL_STATE_BLEND_FUNC;
+            ++gl_stats.capability_sets;
+        }
+    } else if (config->blending == DISABLED)
+        set_capability(GL_STATE_BLEND, &gl_state.blend, GL_BLEND, GL_FALSE);
     
 }
 
-
 pspl_runtime_platform_t GL2_runplat = {
     .init_hook = init,
     .load_object_hook = load_object,
@@ -47,12 +47,20 @@ static void generate_vertex(const pspl_toolchain_context_t* driver_context,
     
     
     
-    // Modelview transform uniform
+    // Modelview transform uniform (per-instance attributes in the runtime's
+    // instanced variant)
     char temp[256];
+    pspl_buffer_addstr(vert, "#ifdef PSPL_INSTANCED\n");
+    pspl_buffer_addstr(vert, "attribute mat4 instance_mv;\n");
+    pspl_buffer_addstr(vert, "attribute mat4 instance_mv_invtrans;\n");
+    pspl_buffer_addstr(vert, "#define modelview_mat instance_mv\n");
+    pspl_buffer_addstr(vert, "#define modelview_invtrans_mat instance_mv_invtrans\n");
+    pspl_buffer_addstr(vert, "#else\n");
     snprintf(temp, 256, "uniform mat4 modelview_mat;\n");
     pspl_buffer_addstr(vert, temp);
     snprintf(temp, 256, "uniform mat4 modelview_invtrans_mat;\n");
     pspl_buffer_addstr(vert, temp);
+    pspl_buffer_addstr(vert, "#endif\n");
     
     // Bone transforms and base coordinates
     if (ir_state->vertex.bone_count) {
@@ -65,6 +73,10 @@ static void generate_vertex(const pspl_toolchain_context_t* driver_context,
     // Projection transform uniform
     pspl_buffer_addstr(vert, "uniform mat4 projection_mat;\n");
     
+    // Vertex dequantisation terms (scale.w selects octahedral normals);
+    // identity for float vertex buffers
+    pspl_buffer_addstr(vert, "uniform vec4 pos_dequant[2];\n");
+    
     // Texcoord generator transform uniforms
     if (ir_state->vertex.tc_count) {
         char uniform[64];
@@ -113,9 +125,21 @@ static void generate_vertex(const pspl_toolchain_context_t* driver_context,
     pspl_buffer_addstr(vert, "\n");
     
     
+    // Octahedral normal decode
+    pspl_buffer_addstr(vert, "vec3 oct_normal(vec2 e) {\n");
+    pspl_buffer_addstr(vert, "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n");
+    pspl_buffer_addstr(vert, "    n.xy += max(-n.z, 0.0) * (1.0 - 2.0 * step(0.0, n.xy));\n");
+    pspl_buffer_addstr(vert, "    return normalize(n);\n");
+    pspl_buffer_addstr(vert, "}\n\n");
+    
+    
     // Main vertex code
     pspl_buffer_addstr(vert, "void main() {\n\n");
     
+    // Dequantise position and normal
+    pspl_buffer_addstr(vert, "    vec3 vert_pos = pos * pos_dequant[0].xyz + pos_dequant[1].xyz;\n");
+    pspl_buffer_addstr(vert, "    vec3 vert_norm = mix(norm, oct_normal(norm.xy), pos_dequant[0].w);\n\n");
+    
     // Pre-vertex code
     pspl_buffer_addstr(vert, ir_state->vertex.glsl_pre.buf);
     pspl_buffer_addchar(vert, '\n');
@@ -123,21 +147,21 @@ static void generate_vertex(const pspl_toolchain_context_t* driver_context,
     // Position and normal (if no bones)
     if (!ir_state->vertex.bone_count) {
         pspl_buffer_addstr(vert, "    // Non-rigged position and normal\n");
-        pspl_buffer_addstr(vert, "    gl_Position = vec4(pos.xyz, 1.0) * modelview_mat * projection_mat;\n");
-        pspl_buffer_addstr(vert, "    normal = norm * mat3(modelview_invtrans_mat);\n");
+        pspl_buffer_addstr(vert, "    gl_Position = vec4(vert_pos, 1.0) * modelview_mat * projection_mat;\n");
+        pspl_buffer_addstr(vert, "    normal = vert_norm * mat3(modelview_invtrans_mat);\n");
     } else { // Bones
         pspl_buffer_addstr(vert, "    // Rigged position and normal\n");
         pspl_buffer_addstr(vert, "    gl_Position = vec4(0.0,0.0,0.0,0.0);\n");
         pspl_buffer_addstr(vert, "    normal = vec4(0.0,0.0,0.0,0.0);\n\n");
         pspl_buffer_addstr(vert, "    // First bone weight is the identity blend value (weight remainder)\n");
-        pspl_buffer_addstr(vert, "    gl_Position += vec4(pos.xyz, 1.0) * bone_weights0[0];\n");
-        pspl_buffer_addstr(vert, "    normal += vec4(norm * bone_weights0[0], 0.0);\n    \n");
+        pspl_buffer_addstr(vert, "    gl_Position += vec4(vert_pos, 1.0) * bone_weights0[0];\n");
+        pspl_buffer_addstr(vert, "    normal += vec4(vert_norm * bone_weights0[0], 0.0);\n    \n");
         unsigned bone_idx = 0;
         for (j=1 ; j<=ir_state->vertex.bone_count ; ++j) {
             char bone[256];
-            snprintf(bone, 256, "    gl_Position += ((vec4(pos.xyz, 1.0) - bone_base[%u]) * bone_mat[%u]) * bone_weights%u[%u];\n", j-1, j-1, bone_idx, j%4);
+            snprintf(bone, 256, "    gl_Position += ((vec4(vert_pos, 1.0) - bone_base[%u]) * bone_mat[%u]) * bone_weights%u[%u];\n", j-1, j-1, bone_idx, j%4);
             pspl_buffer_addstr(vert, bone);
-            snprintf(bone, 256, "    normal += vec4(((norm * mat3(bone_mat[%u])) * bone_weights%u[%u]).xyz, 0.0);\n", j-1, bone_idx, j%4);
+            snprintf(bone, 256, "    normal += vec4(((vert_norm * mat3(bone_mat[%u])) * bone_weights%u[%u]).xyz, 0.0);\n", j-1, bone_idx, j%4);
             pspl_buffer_addstr(vert, bone);
             if (j && !(j%4)) {++bone_idx;}
         }
@@ -149,14 +173,14 @@ static void generate_vertex(const pspl_toolchain_context_t* driver_context,
     
     // Texcoords
     for (j=0 ; j<ir_state->vertex.tc_count ; ++j) {
-        char assign[64];
+        char assign[128];
         if (ir_state->vertex.tc_array[j].tc_source == TEXCOORD_UV)
-            snprintf(assign, 64, "    tex_coords[%u] = (vec4(uv%u,0,0) * tc_generator_mats[%u]).xy;\n", j,
+            snprintf(assign, 128, "    tex_coords[%u] = (vec4(uv%u,0,0) * tc_generator_mats[%u]).xy;\n", j,
                      ir_state->vertex.tc_array[j].uv_idx, j);
         else if (ir_state->vertex.tc_array[j].tc_source == TEXCOORD_POS)
-            snprintf(assign, 64, "    tex_coords[%u] = (vec4(pos.xyz, 1.0) * tc_generator_mats[%u]).xy;\n", j, j);
+            snprintf(assign, 128, "    tex_coords[%u] = (vec4(vert_pos, 1.0) * tc_generator_mats[%u]).xy;\n", j, j);
         else if (ir_state->vertex.tc_array[j].tc_source == TEXCOORD_NORM)
-            snprintf(assign, 64, "    tex_coords[%u] = (normal * tc_generator_mats[%u]).xy;\n", j, j);
+            snprintf(assign, 128, "    tex_coords[%u] = (normal * tc_generator_mats[%u]).xy;\n", j, j);
         pspl_buffer_addstr(vert, assign);
     }
     
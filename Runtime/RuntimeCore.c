@@ -78,6 +78,14 @@ uint8_t xterm_colour = 0;
 static void _pspl_runtime_release_psplc(pspl_runtime_psplc_t* psplc, int total);
 static void _pspl_runtime_release_archived_file(const pspl_runtime_arc_file_t* file, int total);
 
+/* Workers decoding chunks of coded archived files */
+#ifdef HW_RVL
+#define PSPL_RUNTIME_DECODE_THREADS 0
+#else
+#define PSPL_RUNTIME_DECODE_THREADS 4
+#endif
+static pspl_thread_pool_t* decode_pool = NULL;
+
 /* Thread-specific API state setters */
 extern void pspl_api_set_load_state(intptr_t state);
 extern void pspl_api_set_load_subject_index(intptr_t index);
@@ -358,6 +366,11 @@ typedef struct {
     // File offset
     uint32_t file_off;
     
+    // Codec and coded length of file data
+    // (`public.file_len` is always the decoded length)
+    uint32_t file_codec;
+    uint32_t file_coded_len;
+    
 } _pspl_runtime_arc_file_t;
 
 /* Package representation type */
@@ -670,6 +683,11 @@ int pspl_runtime_init(const pspl_platform_t** platform_out) {
     // Init package mem context
     pspl_malloc_context_init(&package_mem_ctx);
     
+    // Start archived file decoders
+    decode_pool = pspl_thread_pool_create(PSPL_RUNTIME_DECODE_THREADS, NULL, NULL);
+    if (!decode_pool)
+        return -1;
+    
     // This platform
     const pspl_platform_t* plat = pspl_runtime_platform;
     int err;
@@ -715,6 +733,10 @@ void pspl_runtime_shutdown() {
     // Destroy package mem context
     pspl_malloc_context_destroy(&package_mem_ctx);
     
+    // Stop archived file decoders
+    pspl_thread_pool_destroy(decode_pool);
+    decode_pool = NULL;
+    
     // Final extensions
     const pspl_extension_t** ext_arr = pspl_available_extensions;
     const pspl_extension_t* ext;
@@ -1202,11 +1224,23 @@ static int load_psplp(pspl_runtime_package_t* package) {
             // Populate file record
             _pspl_runtime_arc_file_t* dest = &dest_table[file_count++];
             pspl_hash_cpy((pspl_hash*)&dest->public.hash, hash);
-            dest->public.file_len = ent->file_len;
             dest->public.file_data = NULL;
             dest->public.parent = package;
             dest->ref_count = 0;
             dest->file_off = ent->file_off;
+            dest->file_codec = ent->file_codec;
+            dest->file_coded_len = ent->file_len;
+            if (ent->file_codec == PSPL_CODEC_NONE)
+                dest->public.file_len = ent->file_len;
+            else if (ent->file_codec == PSPL_CODEC_LZ4)
+                dest->public.file_len = ent->file_raw_len;
+            else {
+                char hash_str[PSPL_HASH_STRING_LEN];
+                pspl_hash_fmt(hash_str, hash);
+                pspl_warn("Unsupported archived file codec",
+                          "file '%s' uses codec %u; skipping", hash_str, ent->file_codec);
+                --file_count;
+            }
         }
         
         // Free file table if loaded using stdio
@@ -1397,6 +1431,23 @@ static const pspl_data_provider_t membuf = {
     .destroy_duplicate_handle = mem_destroy_duplicate_handle
 };
 
+/* Decoded archived file (accessed handle owns decoded buffer) */
+static void decoded_destroy_duplicate_handle(pspl_dup_data_provider_handle_t* dup_handle) {
+    struct mem_handle* dup_mem = ((struct mem_handle*)dup_handle);
+    pspl_free_media_block(dup_mem->data);
+}
+static const pspl_data_provider_t decoded_membuf = {
+    .open = mem_open,
+    .close = mem_close,
+    .len = mem_len,
+    .seek = mem_seek,
+    .tell = mem_tell,
+    .read = mem_read,
+    .read_direct = mem_read_direct,
+    .duplicate_handle = mem_duplicate_handle,
+    .destroy_duplicate_handle = decoded_destroy_duplicate_handle
+};
+
 /**
  * Load a PSPLP package file from application-provided memory buffer
  *
@@ -1767,6 +1818,104 @@ void pspl_runtime_bind_psplc(const pspl_runtime_psplc_t* psplc) {
 
 #pragma mark Archived Files
 
+/* One chunk of a coded archived file */
+struct decode_chunk {
+    pspl_job_t job;
+    const void* coded;
+    size_t coded_len;
+    void* raw;
+    size_t raw_len;
+    volatile int32_t* err_count;
+};
+
+static void decode_chunk_job(struct decode_chunk* chunk) {
+    if (pspl_lz4_decompress(chunk->coded, chunk->coded_len, chunk->raw, chunk->raw_len))
+        pspl_atomic_inc(chunk->err_count);
+}
+
+/* Decode coded archived file data; chunks are spread across the
+ * decode pool while the calling thread waits on their fence */
+static int decode_archived_file(const _pspl_runtime_arc_file_t* obj, const void* coded_data, void* raw_out) {
+    int i;
+    size_t raw_len = obj->public.file_len;
+    unsigned chunk_count = PSPL_CODEC_CHUNK_COUNT(raw_len);
+    size_t table_len = chunk_count * sizeof(uint32_t);
+    if (obj->file_codec != PSPL_CODEC_LZ4 || table_len > obj->file_coded_len)
+        return -1;
+    const uint32_t* chunk_ends = coded_data;
+    const uint8_t* chunk_base = (uint8_t*)coded_data + table_len;
+    size_t chunks_len = obj->file_coded_len - table_len;
+    
+    struct decode_chunk* chunks = malloc(chunk_count * sizeof(struct decode_chunk));
+    pspl_fence_t fence = 0;
+    volatile int32_t err_count = 0;
+    size_t coded_off = 0;
+    for (i=0 ; i<chunk_count ; ++i) {
+#       if __BIG_ENDIAN__
+        size_t coded_end = swap_uint32(chunk_ends[i]);
+#       else
+        size_t coded_end = chunk_ends[i];
+#       endif
+        if (coded_end < coded_off || coded_end > chunks_len) {
+            ++err_count;
+            break;
+        }
+        size_t raw_off = (size_t)i * PSPL_CODEC_CHUNK_SIZE;
+        struct decode_chunk* chunk = &chunks[i];
+        chunk->job.func = (void(*)(void*))decode_chunk_job;
+        chunk->job.usr_ptr = chunk;
+        chunk->job.priority = PSPL_JOB_PRIORITY_HIGH;
+        chunk->job.fence = &fence;
+        chunk->coded = chunk_base + coded_off;
+        chunk->coded_len = coded_end - coded_off;
+        chunk->raw = (uint8_t*)raw_out + raw_off;
+        chunk->raw_len = (raw_len - raw_off > PSPL_CODEC_CHUNK_SIZE)?PSPL_CODEC_CHUNK_SIZE:(raw_len - raw_off);
+        chunk->err_count = &err_count;
+        pspl_thread_pool_submit(decode_pool, &chunk->job);
+        coded_off = coded_end;
+    }
+    pspl_fence_wait(&fence);
+    free(chunks);
+    
+    if (err_count) {
+        char hash_str[PSPL_HASH_STRING_LEN];
+        pspl_hash_fmt(hash_str, &obj->public.hash);
+        pspl_warn("Corrupt archived file", "unable to decode file '%s'", hash_str);
+        return -1;
+    }
+    return 0;
+}
+
+/* Read coded archived file and decode into newly-allocated media block
+ * (reads through a duplicate handle; may be called from any thread) */
+static void* read_decoded_archived_file(const _pspl_runtime_arc_file_t* obj) {
+    const pspl_runtime_package_t* package = obj->public.parent;
+    const pspl_data_provider_t* hooks = package->provider_hooks;
+    pspl_dup_data_provider_handle_t provider_handle;
+    hooks->duplicate_handle(&provider_handle, PACKAGE_PROVIDER(package));
+    
+    // Coded data is read in place for membuf packages
+    void* coded_data;
+    hooks->seek(&provider_handle, obj->file_off);
+    if (hooks == &membuf)
+        hooks->read(&provider_handle, obj->file_coded_len, &coded_data);
+    else {
+        coded_data = malloc(obj->file_coded_len);
+        hooks->read_direct(&provider_handle, obj->file_coded_len, coded_data);
+    }
+    hooks->destroy_duplicate_handle(&provider_handle);
+    
+    void* raw_data = pspl_allocate_media_block(obj->public.file_len);
+    if (decode_archived_file(obj, coded_data, raw_data)) {
+        pspl_free_media_block(raw_data);
+        raw_data = NULL;
+    }
+    
+    if (package->provider_hooks != &membuf)
+        free(coded_data);
+    return raw_data;
+}
+
 /**
  * Count archived files within package
  *
@@ -1855,6 +2004,10 @@ void pspl_runtime_retain_archived_file(const pspl_runtime_arc_file_t* file) {
         ++obj->ref_count;
         
         // Load data objects
+        if (obj->file_codec != PSPL_CODEC_NONE) {
+            obj->public.file_data = read_decoded_archived_file(obj);
+            return;
+        }
         file->parent->provider_hooks->seek(package_provider, obj->file_off);
         if (file->parent->provider_hooks == &membuf)
             file->parent->provider_hooks->read(package_provider, obj->public.file_len, &obj->public.file_data);
@@ -1885,8 +2038,9 @@ static void _pspl_runtime_release_archived_file(const pspl_runtime_arc_file_t* f
     if (obj->ref_count == 1 || total) {
         --obj->ref_count;
         
-        // Free data buffer if allocated with stdio
-        if (file->parent->provider_hooks != &membuf)
+        // Free data buffer if allocated with stdio (or decoded)
+        if (obj->public.file_data &&
+            (file->parent->provider_hooks != &membuf || obj->file_codec != PSPL_CODEC_NONE))
             pspl_free_media_block(obj->public.file_data);
         obj->public.file_data = NULL;
         
@@ -1910,6 +2064,9 @@ void pspl_runtime_release_archived_file(const pspl_runtime_arc_file_t* file) {
  *
  * The handle is duplicated so that it may be used from a different thread (if need be)
  *
+ * Coded (compressed) files are decoded up-front; the returned handle then
+ * reads from the decoded buffer, which is freed once unaccessed
+ *
  * @param file Archived file object
  * @param provider_hooks_out Hook structure used to access data
  * @param provider_handle_out File instance containing requested data (pre-seeked)
@@ -1923,6 +2080,22 @@ int pspl_runtime_access_archived_file(const pspl_runtime_arc_file_t* file,
     if (!file || !provider_handle_out || !provider_hooks_out)
         return -1;
     const _pspl_runtime_arc_file_t* obj = (_pspl_runtime_arc_file_t*)file;
+    
+    // Coded files are accessed through their decoded buffer
+    if (obj->file_codec != PSPL_CODEC_NONE) {
+        void* raw_data = read_decoded_archived_file(obj);
+        if (!raw_data)
+            return -1;
+        struct mem_handle* dup_mem = (struct mem_handle*)provider_handle_out;
+        dup_mem->data = raw_data;
+        dup_mem->cur = raw_data;
+        dup_mem->len = obj->public.file_len;
+        *provider_hooks_out = &decoded_membuf;
+        if (len_out)
+            *len_out = obj->public.file_len;
+        return 0;
+    }
+    
     *provider_hooks_out = file->parent->provider_hooks;
     const void* provider_handle = PACKAGE_PROVIDER(file->parent);
     (*provider_hooks_out)->duplicate_handle(provider_handle_out, provider_handle);
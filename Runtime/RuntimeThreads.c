@@ -6,6 +6,7 @@
 //
 //
 
+#include <stdlib.h>
 #include <PSPL/PSPLCommon.h>
 #include <PSPL/PSPLRuntimeThreads.h>
 
@@ -52,19 +53,32 @@ struct thread {
     intptr_t indices;
 };
 static void* run_thread(void* thread) {
-    pthread_setspecific(api_load_states, (void*)((struct thread*)thread)->states);
-    pthread_setspecific(api_load_subject_indices, (void*)((struct thread*)thread)->indices);
-    ((struct thread*)thread)->func(((struct thread*)thread)->usr_ptr);
+    struct thread th = *(struct thread*)thread;
+    free(thread);
+    pthread_setspecific(api_load_states, (void*)th.states);
+    pthread_setspecific(api_load_subject_indices, (void*)th.indices);
+    th.func(th.usr_ptr);
     return NULL;
 }
 int pspl_thread_fork(void(*func)(void*), void* usr_ptr) {
-    struct thread th = {
-        .func = func,
-        .usr_ptr = usr_ptr,
-        .states = pspl_api_load_state(),
-        .indices = pspl_api_load_subject_index()
-    };
-    return pthread_create(NULL, NULL, run_thread, &th);
+    
+    // Thread record must outlive this call; `run_thread` frees it
+    struct thread* th = malloc(sizeof(struct thread));
+    if (!th)
+        return -1;
+    th->func = func;
+    th->usr_ptr = usr_ptr;
+    th->states = pspl_api_load_state();
+    th->indices = pspl_api_load_subject_index();
+    
+    pthread_t handle;
+    int err;
+    if ((err = pthread_create(&handle, NULL, run_thread, th))) {
+        free(th);
+        return err;
+    }
+    pthread_detach(handle);
+    return 0;
 }
 
 
@@ -102,9 +116,11 @@ struct thread {
 };
 #define STACK_SIZE 16384
 static void* run_thread(void* thread) {
-    api_load_states[LWP_OBJMASKID(LWP_GetSelf())] = api_load_states[((struct thread*)thread)->last_thread];
-    api_load_subject_indices[LWP_OBJMASKID(LWP_GetSelf())] = api_load_subject_indices[((struct thread*)thread)->last_thread];
-    ((struct thread*)thread)->func(((struct thread*)thread)->usr_ptr);
+    struct thread th = *(struct thread*)thread;
+    free(thread);
+    api_load_states[LWP_OBJMASKID(LWP_GetSelf())] = api_load_states[th.last_thread];
+    api_load_subject_indices[LWP_OBJMASKID(LWP_GetSelf())] = api_load_subject_indices[th.last_thread];
+    th.func(th.usr_ptr);
     u32 level = IRQ_Disable();
     void* hi = SYS_GetArenaHi();
     hi += STACK_SIZE;
@@ -113,9 +129,13 @@ static void* run_thread(void* thread) {
     return NULL;
 }
 int pspl_thread_fork(void(*func)(void*), void* usr_ptr) {
+    struct thread* th = malloc(sizeof(struct thread));
+    if (!th)
+        return -1;
     u32 level = IRQ_Disable();
     if (SYS_GetArenaSize() < STACK_SIZE) {
         IRQ_Restore(level);
+        free(th);
         pspl_error(-1, "Thread-fork error",
                    "unable to allocate space for forked-thread stack");
         return -1;
@@ -124,12 +144,11 @@ int pspl_thread_fork(void(*func)(void*), void* usr_ptr) {
     hi -= STACK_SIZE;
     SYS_SetArenaHi(hi);
     IRQ_Restore(level);
-    struct thread th = {
-        .func = func,
-        .usr_ptr = usr_ptr,
-        .last_thread = LWP_OBJMASKID(LWP_GetSelf())
-    };
-    return LWP_CreateThread(NULL, run_thread, &th, hi, STACK_SIZE, 64);
+    th->func = func;
+    th->usr_ptr = usr_ptr;
+    th->last_thread = LWP_OBJMASKID(LWP_GetSelf());
+    lwp_t handle;
+    return LWP_CreateThread(&handle, run_thread, th, hi, STACK_SIZE, 64);
 }
 
 
@@ -162,20 +181,27 @@ struct thread {
     intptr_t indices;
 };
 static DWORD run_thread(LPVOID thread) {
-    TlsSetValue(api_load_states, (LPVOID)((struct thread*)thread)->states);
-    TlsSetValue(api_load_subject_indices, (LPVOID)((struct thread*)thread)->indices);
-    ((struct thread*)thread)->func(((struct thread*)thread)->usr_ptr);
+    struct thread th = *(struct thread*)thread;
+    free(thread);
+    TlsSetValue(api_load_states, (LPVOID)th.states);
+    TlsSetValue(api_load_subject_indices, (LPVOID)th.indices);
+    th.func(th.usr_ptr);
     return 0;
 }
 int pspl_thread_fork(void(*func)(void*), void* usr_ptr) {
-    struct thread th = {
-        .func = func,
-        .usr_ptr = usr_ptr,
-        .states = pspl_api_load_state(),
-        .indices = pspl_api_load_subject_index()
-    };
-    if (!CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)run_thread, &th, 0, NULL))
+    struct thread* th = malloc(sizeof(struct thread));
+    if (!th)
+        return -1;
+    th->func = func;
+    th->usr_ptr = usr_ptr;
+    th->states = pspl_api_load_state();
+    th->indices = pspl_api_load_subject_index();
+    HANDLE handle = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)run_thread, th, 0, NULL);
+    if (!handle) {
+        free(th);
         return -1;
+    }
+    CloseHandle(handle);
     return 0;
 }
 
@@ -201,3 +227,213 @@ intptr_t pspl_api_load_subject_index() {
 
 
 #endif
+
+
+#pragma mark Worker Pool
+
+/* Producers push onto `inbox` (lock-free LIFO). Whichever worker holds
+ * `consumer_lock` swaps the whole inbox out and sorts it into per-priority
+ * FIFOs; since the inbox is only ever pushed to or emptied whole, the
+ * exchange is free of ABA hazards */
+struct _pspl_thread_pool {
+    pspl_job_t* volatile inbox;
+    pspl_mutex_t consumer_lock;
+    pspl_job_t* queue_head[PSPL_JOB_PRIORITY_COUNT];
+    pspl_job_t* queue_tail[PSPL_JOB_PRIORITY_COUNT];
+    pspl_sem_t job_sem;
+    unsigned thread_count;
+    volatile int32_t live_threads;
+    volatile int32_t quit;
+    void(*thread_init)(void*);
+    void* init_ptr;
+};
+
+/* Atomically take entire inbox (consumer-lock held) */
+static void pool_drain_inbox(pspl_thread_pool_t* pool) {
+    pspl_job_t* batch;
+    do {
+        batch = pool->inbox;
+    } while (batch && !pspl_atomic_cas(&pool->inbox, batch, NULL));
+    
+    // Inbox is LIFO; reverse to restore submission order
+    pspl_job_t* ordered = NULL;
+    while (batch) {
+        pspl_job_t* next = batch->next;
+        batch->next = ordered;
+        ordered = batch;
+        batch = next;
+    }
+    
+    // Append to priority FIFOs
+    while (ordered) {
+        pspl_job_t* next = ordered->next;
+        enum pspl_job_priority pri = ordered->priority;
+        if (pri >= PSPL_JOB_PRIORITY_COUNT)
+            pri = PSPL_JOB_PRIORITY_LOW;
+        ordered->next = NULL;
+        if (pool->queue_tail[pri])
+            pool->queue_tail[pri]->next = ordered;
+        else
+            pool->queue_head[pri] = ordered;
+        pool->queue_tail[pri] = ordered;
+        ordered = next;
+    }
+}
+
+static pspl_job_t* pool_next_job(pspl_thread_pool_t* pool) {
+    int i;
+    pspl_job_t* job = NULL;
+    pspl_mutex_lock(&pool->consumer_lock);
+    pool_drain_inbox(pool);
+    for (i=0 ; i<PSPL_JOB_PRIORITY_COUNT ; ++i) {
+        if ((job = pool->queue_head[i])) {
+            if (!(pool->queue_head[i] = job->next))
+                pool->queue_tail[i] = NULL;
+            break;
+        }
+    }
+    pspl_mutex_unlock(&pool->consumer_lock);
+    return job;
+}
+
+static void run_job(pspl_job_t* job) {
+    // Job record may be reused once its fence drops
+    pspl_fence_t* fence = job->fence;
+    job->func(job->usr_ptr);
+    if (fence)
+        pspl_atomic_dec(fence);
+}
+
+static void pool_worker(void* pool_ptr) {
+    pspl_thread_pool_t* pool = pool_ptr;
+    if (pool->thread_init)
+        pool->thread_init(pool->init_ptr);
+    for (;;) {
+        pspl_sem_wait(&pool->job_sem);
+        if (pool->quit)
+            break;
+        pspl_job_t* job = pool_next_job(pool);
+        if (job)
+            run_job(job);
+    }
+    pspl_atomic_dec(&pool->live_threads);
+}
+
+pspl_thread_pool_t* pspl_thread_pool_create(unsigned thread_count,
+                                            void(*thread_init)(void*), void* init_ptr) {
+    int i;
+    pspl_thread_pool_t* pool = calloc(1, sizeof(pspl_thread_pool_t));
+    if (!pool)
+        return NULL;
+    pool->thread_count = thread_count;
+    pool->thread_init = thread_init;
+    pool->init_ptr = init_ptr;
+    if (!thread_count)
+        return pool;
+    
+    pspl_mutex_init(&pool->consumer_lock);
+    pspl_sem_init(&pool->job_sem);
+    for (i=0 ; i<thread_count ; ++i) {
+        pspl_atomic_inc(&pool->live_threads);
+        if (pspl_thread_fork(pool_worker, pool)) {
+            pspl_atomic_dec(&pool->live_threads);
+            pspl_warn("Thread-pool error", "unable to fork worker %d of %u", i, thread_count);
+            break;
+        }
+    }
+    if (!pool->live_threads)
+        pool->thread_count = 0;
+    
+    return pool;
+}
+
+void pspl_thread_pool_destroy(pspl_thread_pool_t* pool) {
+    int i;
+    if (!pool)
+        return;
+    if (pool->thread_count) {
+        pool->quit = 1;
+        pspl_atomic_barrier();
+        for (i=0 ; i<pool->thread_count ; ++i)
+            pspl_sem_post(&pool->job_sem);
+        while (pool->live_threads)
+            pspl_thread_yield();
+        
+        // Jobs still queued are dropped; release their fences
+        pool_drain_inbox(pool);
+        for (i=0 ; i<PSPL_JOB_PRIORITY_COUNT ; ++i) {
+            pspl_job_t* job = pool->queue_head[i];
+            while (job) {
+                pspl_job_t* next = job->next;
+                if (job->fence)
+                    pspl_atomic_dec(job->fence);
+                job = next;
+            }
+            pool->queue_head[i] = pool->queue_tail[i] = NULL;
+        }
+        
+        pspl_sem_destroy(&pool->job_sem);
+        pspl_mutex_destroy(&pool->consumer_lock);
+    }
+    free(pool);
+}
+
+void pspl_thread_pool_submit(pspl_thread_pool_t* pool, pspl_job_t* job) {
+    if (!pool || !job)
+        return;
+    if (job->fence)
+        pspl_atomic_inc(job->fence);
+    
+    // No workers; run in place
+    if (!pool->thread_count) {
+        run_job(job);
+        return;
+    }
+    
+    pspl_job_t* head;
+    do {
+        head = pool->inbox;
+        job->next = head;
+    } while (!pspl_atomic_cas(&pool->inbox, head, job));
+    pspl_sem_post(&pool->job_sem);
+}
+
+int pspl_thread_pool_cancel(pspl_thread_pool_t* pool, pspl_fence_t* fence) {
+    int i, removed = 0;
+    if (!pool || !fence || !pool->thread_count)
+        return 0;
+    
+    pspl_mutex_lock(&pool->consumer_lock);
+    pool_drain_inbox(pool);
+    for (i=0 ; i<PSPL_JOB_PRIORITY_COUNT ; ++i) {
+        pspl_job_t* prev = NULL;
+        pspl_job_t* job = pool->queue_head[i];
+        while (job) {
+            pspl_job_t* next = job->next;
+            if (job->fence == fence) {
+                if (prev)
+                    prev->next = next;
+                else
+                    pool->queue_head[i] = next;
+                if (pool->queue_tail[i] == job)
+                    pool->queue_tail[i] = prev;
+                pspl_atomic_dec(fence);
+                ++removed;
+            } else
+                prev = job;
+            job = next;
+        }
+    }
+    pspl_mutex_unlock(&pool->consumer_lock);
+    
+    // Surplus semaphore counts simply wake workers to an empty queue
+    return removed;
+}
+
+void pspl_fence_wait(pspl_fence_t* fence) {
+    if (!fence)
+        return;
+    while (*fence)
+        pspl_thread_yield();
+}
+
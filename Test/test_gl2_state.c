@@ -0,0 +1,177 @@
+//
+//  test_gl2_state.c
+//  PSPL
+//
+//  Counts the GL calls the GL2 platform's redundant-state cache issues
+//  through a stub GL loader (the stub entry points below stand in for the
+//  GL library's), checking them against the cache's own counters and
+//  against what unfiltered binds would have issued
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PSPLRuntime.h>
+#include <PSPL/PSPLRuntimeExtension.h>
+#include "test_pmdl.h"
+
+extern pspl_runtime_platform_t GL2_runplat;
+
+/* GL calls reaching the stub loader */
+static struct {
+    unsigned use_program;
+    unsigned enable, disable;
+    unsigned depth_mask, blend_func;
+    unsigned active_texture, bind_texture;
+    unsigned delete_program;
+} gl_calls;
+
+void glUseProgram(GLuint program) {++gl_calls.use_program;}
+void glEnable(GLenum cap) {++gl_calls.enable;}
+void glDisable(GLenum cap) {++gl_calls.disable;}
+void glDepthMask(GLboolean flag) {++gl_calls.depth_mask;}
+void glBlendFunc(GLenum sfactor, GLenum dfactor) {++gl_calls.blend_func;}
+void glActiveTexture(GLenum texture) {++gl_calls.active_texture;}
+void glBindTexture(GLenum target, GLuint texture) {++gl_calls.bind_texture;}
+void glDeleteProgram(GLuint program) {++gl_calls.delete_program;}
+void glDeleteShader(GLuint shader) {}
+
+static unsigned capability_calls() {
+    return gl_calls.enable + gl_calls.disable + gl_calls.depth_mask + gl_calls.blend_func;
+}
+
+/* Opaque (depth write and test, no blending) and blended (depth test,
+ * alpha blending) configurations; two programs of each */
+static gl_config_t opaque_config = {
+    .depth_write = ENABLED, .depth_test = ENABLED, .blending = DISABLED
+};
+static gl_config_t blend_config = {
+    .depth_write = DISABLED, .depth_test = ENABLED, .blending = ENABLED,
+    .source_factor = SRC_ALPHA, .dest_factor = SRC_ALPHA | ONE_MINUS
+};
+static pspl_runtime_psplc_t shaders[4];
+
+/* Unfiltered binds issue a program and depth write, depth test and blend
+ * calls; blended ones add the blend function */
+#define OPAQUE_CALLS 4
+#define BLEND_CALLS 5
+
+static void bind(unsigned shader_idx) {
+    GL2_runplat.bind_object_hook(&shaders[shader_idx]);
+}
+
+static void check_shader_binds() {
+    unsigned i;
+    for (i=0 ; i<4 ; ++i) {
+        shaders[i].native_shader.program = i+1;
+        shaders[i].native_shader.config = (i < 2) ? &opaque_config : &blend_config;
+    }
+
+    // Opaque 0 twice, opaque 1, back to 0, then blended 2 and 3 and back
+    static const unsigned sequence[] = {0, 0, 1, 0, 2, 3, 2, 0};
+    static const unsigned seq_count = sizeof(sequence) / sizeof(*sequence);
+    unsigned unfiltered = 0;
+    memset(&gl_calls, 0, sizeof(gl_calls));
+    pspl_gl2_invalidate_state();
+    pspl_gl2_get_state_stats(NULL, 1);
+    for (i=0 ; i<seq_count ; ++i) {
+        bind(sequence[i]);
+        unfiltered += (sequence[i] < 2) ? OPAQUE_CALLS : BLEND_CALLS;
+    }
+
+    GL2_state_stats_t stats;
+    pspl_gl2_get_state_stats(&stats, 1);
+    TEST_CHECK(gl_calls.use_program == 7, "%u programs used, want 7 (one per change)", gl_calls.use_program);
+    TEST_CHECK(gl_calls.depth_mask == 3, "%u depth masks set, want 3", gl_calls.depth_mask);
+    TEST_CHECK(gl_calls.enable == 2 && gl_calls.disable == 2, "%u enables and %u disables, want 2 of each",
+               gl_calls.enable, gl_calls.disable);
+    TEST_CHECK(gl_calls.blend_func == 1, "%u blend functions set, want 1", gl_calls.blend_func);
+
+    // Counters agree with the calls issued; skips cover the rest
+    TEST_CHECK(stats.program_binds == gl_calls.use_program && stats.program_binds + stats.program_skips == seq_count,
+               "program binds %u, skips %u", stats.program_binds, stats.program_skips);
+    TEST_CHECK(stats.capability_sets == capability_calls(), "%u capability sets counted, %u issued",
+               stats.capability_sets, capability_calls());
+    unsigned issued = gl_calls.use_program + capability_calls();
+    TEST_CHECK(issued + stats.program_skips + stats.capability_skips == unfiltered,
+               "%u calls issued and %u skipped, unfiltered binds issue %u",
+               issued, stats.program_skips + stats.capability_skips, unfiltered);
+    printf("shader binds: %u of %u GL calls issued\n", issued, unfiltered);
+
+    // Invalidated state is reissued in full
+    memset(&gl_calls, 0, sizeof(gl_calls));
+    pspl_gl2_invalidate_state();
+    bind(0);
+    TEST_CHECK(gl_calls.use_program + capability_calls() == OPAQUE_CALLS,
+               "%u calls issued after invalidation, want %u", gl_calls.use_program + capability_calls(), OPAQUE_CALLS);
+    pspl_gl2_get_state_stats(NULL, 1);
+}
+
+static void check_program_delete() {
+    
+    // Unloading the bound object's program forgets it; an object given the
+    // recycled program name must still be bound
+    memset(&gl_calls, 0, sizeof(gl_calls));
+    pspl_gl2_invalidate_state();
+    bind(0);
+    GL2_runplat.unload_object_hook(&shaders[0]);
+    bind(0);
+    TEST_CHECK(gl_calls.delete_program == 1, "%u programs deleted, want 1", gl_calls.delete_program);
+    TEST_CHECK(gl_calls.use_program == 2, "%u programs used across deletion, want 2", gl_calls.use_program);
+    
+    // Deleting an unbound program leaves the bound one in place
+    GL2_runplat.unload_object_hook(&shaders[1]);
+    bind(0);
+    TEST_CHECK(gl_calls.use_program == 2, "%u programs used after unbound deletion, want 2", gl_calls.use_program);
+    pspl_gl2_get_state_stats(NULL, 1);
+}
+
+static void check_texture_binds() {
+
+    // Unit 0 twice, unit 1, unit 0 unchanged, unit 0 changed, unit 1 unchanged
+    static const unsigned binds[][2] = {{0,10}, {0,10}, {1,11}, {0,10}, {0,12}, {1,11}};
+    memset(&gl_calls, 0, sizeof(gl_calls));
+    pspl_gl2_invalidate_state();
+    unsigned i;
+    for (i=0 ; i<6 ; ++i)
+        pspl_gl2_bind_texture(binds[i][0], binds[i][1]);
+
+    GL2_state_stats_t stats;
+    pspl_gl2_get_state_stats(&stats, 1);
+    TEST_CHECK(gl_calls.bind_texture == 3 && gl_calls.active_texture == 3,
+               "%u textures bound on %u unit switches, want 3 and 3", gl_calls.bind_texture, gl_calls.active_texture);
+    TEST_CHECK(stats.texture_binds == 3 && stats.texture_skips == 3, "texture binds %u, skips %u",
+               stats.texture_binds, stats.texture_skips);
+}
+
+static void check_uniform_stamps() {
+    GL2_shader_object_t shader;
+    memset(&shader, 0, sizeof(shader));
+    int source_a, source_b;
+
+    // Loads on a new source or generation only
+    TEST_CHECK(pspl_gl2_stamp_uniforms(&shader, &source_a, 1), "first stamp skipped");
+    TEST_CHECK(!pspl_gl2_stamp_uniforms(&shader, &source_a, 1), "unchanged stamp loaded");
+    TEST_CHECK(pspl_gl2_stamp_uniforms(&shader, &source_a, 2), "new generation skipped");
+    TEST_CHECK(pspl_gl2_stamp_uniforms(&shader, &source_b, 2), "new source skipped");
+    TEST_CHECK(!pspl_gl2_stamp_uniforms(&shader, &source_b, 2), "unchanged stamp loaded");
+
+    GL2_state_stats_t stats;
+    pspl_gl2_get_state_stats(&stats, 1);
+    TEST_CHECK(stats.uniform_loads == 3 && stats.uniform_skips == 2, "uniform loads %u, skips %u",
+               stats.uniform_loads, stats.uniform_skips);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    check_shader_binds();
+    check_program_delete();
+    check_texture_binds();
+    check_uniform_stamps();
+
+    if (test_failures)
+        fprintf(stderr, "%u GL state check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
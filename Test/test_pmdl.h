@@ -0,0 +1,148 @@
+//
+//  test_pmdl.h
+//  PSPL
+//
+//  Shared helpers for headless PMDL runtime tests
+//
+
+#ifndef PSPL_test_pmdl_h
+#define PSPL_test_pmdl_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Runtime heaps (normally set up by `pspl_runtime_init`, which needs a
+ * rendering context) */
+void _pspl_mem_init();
+
+/* Failed checks are reported and counted; tests return `test_failures` */
+static unsigned test_failures = 0;
+#define TEST_CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check `%s` failed: ", __FILE__, __LINE__, #cond); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        ++test_failures; \
+    } \
+} while (0)
+
+/* Deterministic uniform random in [lo, hi] (identical on every host) */
+static uint32_t test_rand_state = 1;
+static inline float test_rand(float lo, float hi) {
+    test_rand_state = test_rand_state * 1664525 + 1013904223;
+    return lo + (hi - lo) * ((test_rand_state >> 8) / (float)(1 << 24));
+}
+
+#ifdef PSPL_PMDLRuntime_h
+
+/* Perspective context whose model space is view space (camera at origin
+ * looking down -Z, +Y up); the view matrix is set directly, undoing the
+ * runtime's right-to-left-handed swizzle, and `model_mtx` may then be
+ * changed with `PMDL_INVALIDATE_MODEL` updates */
+static inline pmdl_draw_ctx* test_view_space_ctx(float fov, float aspect, float near, float far) {
+    pmdl_draw_ctx* ctx = pmdl_new_draw_context();
+    memset(&ctx->cached_view_mtx, 0, sizeof(ctx->cached_view_mtx));
+    ctx->cached_view_mtx.m[0][0] = -1;
+    ctx->cached_view_mtx.m[1][2] = 1;
+    ctx->cached_view_mtx.m[2][1] = 1;
+    ctx->projection_type = PMDL_PERSPECTIVE;
+    ctx->projection.perspective.fov = fov;
+    ctx->projection.perspective.aspect = aspect;
+    ctx->projection.perspective.near = near;
+    ctx->projection.perspective.far = far;
+    pmdl_update_context(ctx, PMDL_INVALIDATE_MODEL | PMDL_INVALIDATE_PROJECTION);
+    return ctx;
+}
+
+#if defined(PSPL_PMDLCommon_h) && defined(PSPL_PMDLRuntimeProcessing_h)
+
+/* Mesh header as laid out in a drawing index (see `pmdl_mesh_header`) */
+typedef struct {
+    float aabb[2][3];
+    int32_t shader_index;
+    const pspl_runtime_psplc_t* shader_pointer;
+} test_mesh_header;
+
+/* In-memory general-format model without shaders or vertex data (meshes
+ * have no primitives); only fit for headless drawing with a recorder set */
+typedef struct {
+    uint8_t data[8192] __attribute__ ((aligned (32)));
+    pspl_runtime_arc_file_t file;
+    pmdl_t pmdl;
+} test_model;
+
+static inline uint32_t test_model_align(uint32_t off) {return (off + 31) & ~31;}
+
+/* Build `sub_type` ('0' or '2') model; collection `c` holds `mesh_counts[c]`
+ * meshes, whose AABBs are taken in order from `mesh_aabbs`. The master AABB
+ * bounds every mesh; PAR2 models carry `octree_len` bytes of `octree` after
+ * the header. Returns `pmdl_init_fixup` result */
+static inline int test_model_init(test_model* model, char sub_type, unsigned collection_count,
+                                  const unsigned* mesh_counts, float (*mesh_aabbs)[2][3],
+                                  const void* octree, uint32_t octree_len) {
+    memset(model, 0, sizeof(*model));
+    pmdl_header* header = (pmdl_header*)model->data;
+    memcpy(header->magic, "PMDL", 4);
+    memcpy(header->endianness, "_LIT", 4);
+    header->pointer_size = sizeof(void*);
+    memcpy(header->sub_type_prefix, "PAR", 3);
+    header->sub_type_num = sub_type;
+    memcpy(header->draw_format, "_GEN", 4);
+    if (octree_len)
+        memcpy(model->data + sizeof(pmdl_header), octree, octree_len);
+
+    // Collection headers, then each drawing index (mesh headers, GL buffer
+    // names and primitive counts)
+    header->collection_offset = test_model_align(sizeof(pmdl_header) + octree_len);
+    header->collection_count = collection_count;
+    pmdl_col_header* collection_headers = (pmdl_col_header*)(model->data + header->collection_offset);
+    uint32_t off = test_model_align(sizeof(pmdl_col_header) * collection_count);
+    unsigned c, m, a = 0;
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        header->master_aabb[0][i] = mesh_aabbs[0][0][i];
+        header->master_aabb[1][i] = mesh_aabbs[0][1][i];
+    }
+    for (c=0 ; c<collection_count ; ++c) {
+        collection_headers[c].draw_idx_off = off;
+        uint8_t* index_buf = model->data + header->collection_offset + off;
+        uint32_t index_buf_offset = 8 + sizeof(test_mesh_header) * mesh_counts[c];
+        ((uint32_t*)index_buf)[0] = mesh_counts[c];
+        ((uint32_t*)index_buf)[1] = index_buf_offset;
+        test_mesh_header* mesh_heads = (test_mesh_header*)(index_buf + 8);
+        for (m=0 ; m<mesh_counts[c] ; ++m, ++a) {
+            memcpy(mesh_heads[m].aabb, mesh_aabbs[a], sizeof(mesh_heads[m].aabb));
+            mesh_heads[m].shader_index = -1;
+            for (i=0 ; i<3 ; ++i) {
+                if (mesh_aabbs[a][0][i] < header->master_aabb[0][i])
+                    header->master_aabb[0][i] = mesh_aabbs[a][0][i];
+                if (mesh_aabbs[a][1][i] > header->master_aabb[1][i])
+                    header->master_aabb[1][i] = mesh_aabbs[a][1][i];
+            }
+        }
+        off = test_model_align(off + index_buf_offset + sizeof(void*)*3 + sizeof(uint32_t) * mesh_counts[c]);
+    }
+
+    // Empty shader table
+    header->shader_table_offset = header->collection_offset + off;
+
+    model->file.file_len = header->shader_table_offset + sizeof(uint32_t);
+    model->file.file_data = model->data;
+    model->pmdl.file_ptr = &model->file;
+    return pmdl_init_fixup(&model->pmdl);
+}
+
+/* Mesh headers of collection */
+static inline test_mesh_header* test_model_meshes(test_model* model, unsigned collection_idx) {
+    pmdl_header* header = (pmdl_header*)model->data;
+    pmdl_col_header* collection_headers = (pmdl_col_header*)(model->data + header->collection_offset);
+    return (test_mesh_header*)(model->data + header->collection_offset +
+                               collection_headers[collection_idx].draw_idx_off + 8);
+}
+
+#endif
+
+#endif
+
+#endif
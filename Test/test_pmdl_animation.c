@@ -0,0 +1,222 @@
+//
+//  test_pmdl_animation.c
+//  PSPL
+//
+//  Checks batched animation evaluation (SoA lanes across worker jobs)
+//  against per-context evaluation, bone matrix for bone matrix and palette
+//  for palette, over several skeletons, lane fills and batch sizes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include <PMDLRuntimeRigging.h>
+#include "PMDLRuntimeProcessing.h"
+#include "test_pmdl.h"
+
+#define RIG_COUNT 3
+#define MAX_BONES 24
+#define KF_COUNT 6
+#define CTX_COUNT 41
+
+/* Skeletons; parent of each bone (-1 for roots), parents preceding children */
+static const unsigned RIG_BONE_COUNTS[RIG_COUNT] = {1, 12, 24};
+
+static uint8_t rig_data[RIG_COUNT][1 << 16];
+static size_t rig_len = 0;
+static uint8_t* rig_cur = NULL;
+
+static void* emit(const void* data, size_t len) {
+    void* dst = &rig_cur[rig_len];
+    memcpy(dst, data, len);
+    rig_len += len;
+    return dst;
+}
+static uint32_t* emit_u32(uint32_t val) {return emit(&val, sizeof(val));}
+static void emit_f32(float val) {emit(&val, sizeof(val));}
+
+/* Fcurve of `KF_COUNT` keyframes one frame apart, valued within [lo, hi] */
+static void emit_curve(float lo, float hi) {
+    int k;
+    emit_u32(KF_COUNT);
+    for (k=0 ; k<KF_COUNT ; ++k) {
+        float value = test_rand(lo, hi);
+        pmdl_curve_keyframe kf = {
+            .left_handle = {k - 0.3f, value + test_rand(-0.1f, 0.1f)},
+            .main_handle = {k, value},
+            .right_handle = {k + 0.3f, value + test_rand(-0.1f, 0.1f)}
+        };
+        emit(&kf, sizeof(kf));
+    }
+}
+
+/* Rigging data as `pmdl_rigging_init` reads it: a skeleton of random
+ * hierarchy, one skin entry over every other bone, and two actions; the
+ * first animates scale, rotation and location of every bone, the second
+ * rotates every third bone (leaving the rest un-animated) */
+static void build_rigging(unsigned rig_idx) {
+    unsigned bone_count = RIG_BONE_COUNTS[rig_idx];
+    int parents[MAX_BONES];
+    unsigned child_counts[MAX_BONES] = {0};
+    unsigned i, j;
+    for (i=0 ; i<bone_count ; ++i) {
+        parents[i] = (i && test_rand(0.0f, 1.0f) < 0.9f) ? (int)test_rand(0.0f, i - 0.01f) : -1;
+        if (parents[i] >= 0)
+            ++child_counts[parents[i]];
+    }
+    rig_cur = rig_data[rig_idx];
+    rig_len = 0;
+
+    // Skeleton
+    uint32_t* skel_len = emit_u32(0);
+    emit_u32(bone_count);
+    uint32_t bone_off = 0;
+    for (i=0 ; i<bone_count ; ++i) {
+        emit_u32(bone_off);
+        bone_off += 24 + 4*child_counts[i];
+    }
+    for (i=0 ; i<bone_count ; ++i) {
+        emit_u32(0);
+        emit_f32(test_rand(-1.0f, 1.0f)); emit_f32(test_rand(-1.0f, 1.0f)); emit_f32(test_rand(-1.0f, 1.0f));
+        emit_u32((uint32_t)parents[i]);
+        emit_u32(child_counts[i]);
+        for (j=0 ; j<bone_count ; ++j)
+            if (parents[j] == (int)i)
+                emit_u32(j);
+    }
+    *skel_len = rig_len;
+
+    // Skinning
+    size_t skin_off = rig_len;
+    uint32_t* skin_len = emit_u32(0);
+    emit_u32(1);
+    emit_u32(0);
+    emit_u32((bone_count + 1) / 2);
+    for (i=0 ; i<bone_count ; i+=2)
+        emit_u32(i);
+    *skin_len = rig_len - skin_off;
+
+    // Animation
+    size_t anim_off = rig_len;
+    emit_u32(2);
+    uint32_t* strings_off = emit_u32(0);
+    uint32_t* action_offs = emit_u32(0);
+    emit_u32(0);
+    size_t actions_off = rig_len;
+    emit_u32(bone_count);
+    emit_f32(KF_COUNT - 1);
+    for (i=0 ; i<bone_count ; ++i) {
+        emit_u32(0xE0000000 | i);
+        for (j=0 ; j<3 ; ++j)
+            emit_curve(0.5f, 1.5f);
+        for (j=0 ; j<4 ; ++j)
+            emit_curve(-1.0f, 1.0f);
+        for (j=0 ; j<3 ; ++j)
+            emit_curve(-1.0f, 1.0f);
+    }
+    action_offs[1] = rig_len - actions_off;
+    emit_u32((bone_count + 2) / 3);
+    emit_f32(KF_COUNT - 1);
+    for (i=0 ; i<bone_count ; i+=3) {
+        emit_u32(0x40000000 | i);
+        for (j=0 ; j<4 ; ++j)
+            emit_curve(-1.0f, 1.0f);
+    }
+    *strings_off = rig_len - anim_off;
+    emit_u32(0);
+    emit_u32(4);
+    emit("act", 4);
+    emit("rot", 4);
+}
+
+static pmdl_rigging_ctx* rig_ctxs[RIG_COUNT];
+static pmdl_action_ctx* action_ctxs[CTX_COUNT];
+static pmdl_animation_ctx* anim_ctxs[CTX_COUNT];
+
+/* Per-context evaluation results */
+static pspl_matrix34_t want_bones[CTX_COUNT][MAX_BONES];
+static pspl_matrix44_t want_palettes[CTX_COUNT][MAX_BONES];
+
+/* Animation contexts in runs over each skeleton (runs of 1 to 7, so lanes
+ * are filled to every count), each playing one action at its own time */
+static void build_contexts() {
+    unsigned i = 0, r = 0;
+    while (i < CTX_COUNT) {
+        unsigned run = 1 + (unsigned)test_rand(0.0f, 6.99f);
+        for (; run && i<CTX_COUNT ; --run, ++i) {
+            const pmdl_rigging_ctx* rig_ctx = rig_ctxs[r % RIG_COUNT];
+            action_ctxs[i] = pmdl_action_init(&rig_ctx->action_array[i % 2]);
+            action_ctxs[i]->loop_flag = 1;
+            pmdl_action_advance(action_ctxs[i], test_rand(0.0f, KF_COUNT - 1));
+            anim_ctxs[i] = pmdl_animation_initv(action_ctxs[i], NULL);
+        }
+        ++r;
+    }
+}
+
+/* Evaluate each of first `count` contexts alone, then together as a batch,
+ * and compare exactly */
+static void check_batch(const char* name, unsigned count) {
+    unsigned i, b;
+    for (i=0 ; i<count ; ++i) {
+        pmdl_animation_evaluate(anim_ctxs[i]);
+        const pmdl_rigging_ctx* rig_ctx = anim_ctxs[i]->parent_ctx;
+        for (b=0 ; b<rig_ctx->bone_count ; ++b) {
+            want_bones[i][b] = *anim_ctxs[i]->fk_instance_array[b].bone_matrix;
+            memset(anim_ctxs[i]->fk_instance_array[b].bone_matrix, 0xff, sizeof(pspl_matrix34_t));
+        }
+        memcpy(want_palettes[i], anim_ctxs[i]->skin_palette_array, sizeof(pspl_matrix44_t)*rig_ctx->skin_palette_count);
+        memset(anim_ctxs[i]->skin_palette_array, 0xff, sizeof(pspl_matrix44_t)*rig_ctx->skin_palette_count);
+    }
+
+    pmdl_animation_evaluate_batch(anim_ctxs, count);
+
+    for (i=0 ; i<count ; ++i) {
+        const pmdl_rigging_ctx* rig_ctx = anim_ctxs[i]->parent_ctx;
+        for (b=0 ; b<rig_ctx->bone_count ; ++b)
+            TEST_CHECK(!memcmp(&want_bones[i][b], anim_ctxs[i]->fk_instance_array[b].bone_matrix, sizeof(pspl_matrix34_t)),
+                       "%s of %u: context %u bone %u differs (%g, %g, %g, %g per context)", name, count, i, b,
+                       want_bones[i][b].m[0][0], want_bones[i][b].m[0][3],
+                       anim_ctxs[i]->fk_instance_array[b].bone_matrix->m[0][0],
+                       anim_ctxs[i]->fk_instance_array[b].bone_matrix->m[0][3]);
+        TEST_CHECK(!memcmp(want_palettes[i], anim_ctxs[i]->skin_palette_array,
+                           sizeof(pspl_matrix44_t)*rig_ctx->skin_palette_count),
+                   "%s of %u: context %u palette differs", name, count, i);
+    }
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    unsigned i;
+    for (i=0 ; i<RIG_COUNT ; ++i) {
+        build_rigging(i);
+        pmdl_rigging_init(&rig_ctxs[i], rig_data[i], "bone");
+    }
+    build_contexts();
+
+    // Inline, then across worker jobs; every batch size up to a few jobs
+    for (i=1 ; i<=CTX_COUNT ; ++i)
+        check_batch("inline batch", i);
+    if (pmdl_animation_pool_init()) {
+        fprintf(stderr, "unable to start animation workers\n");
+        return 1;
+    }
+    for (i=1 ; i<=CTX_COUNT ; ++i)
+        check_batch("pooled batch", i);
+    pmdl_animation_pool_shutdown();
+
+    for (i=0 ; i<CTX_COUNT ; ++i) {
+        pmdl_animation_destroy(anim_ctxs[i]);
+        pmdl_action_destroy(action_ctxs[i]);
+    }
+    for (i=0 ; i<RIG_COUNT ; ++i)
+        pmdl_rigging_destroy(rig_ctxs[i]);
+
+    if (test_failures)
+        fprintf(stderr, "%u animation check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
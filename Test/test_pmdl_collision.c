@@ -0,0 +1,332 @@
+//
+//  test_pmdl_collision.c
+//  PSPL
+//
+//  Checks hierarchy-accelerated collision queries against exhaustive
+//  per-triangle tests, and validation of mapped `_COL` hierarchies
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLCommon.h"
+#include "test_pmdl.h"
+
+#define TRI_COUNT 1000
+#define RAY_COUNT 2000
+#define SWEEP_COUNT 300
+#define BOX_COUNT 200
+
+/* Distance tolerance between traversal and exhaustive results */
+#define T_EPSILON 1e-4f
+
+static float positions[TRI_COUNT*9];
+static uint32_t indices[TRI_COUNT*3];
+
+/* One collision object per triangle; queries against these visit a single
+ * leaf, so their minimum is the exhaustive answer */
+static pmdl_collision singles[TRI_COUNT];
+
+/* Möller-Trumbore, independent of the runtime's SIMD leaf tests */
+static int ray_tri(const pmdl_ray* ray, const float* v0, const float* v1, const float* v2, float* t_out) {
+    float e1[3], e2[3], p[3], s[3], q[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        e1[i] = v1[i] - v0[i];
+        e2[i] = v2[i] - v0[i];
+        s[i] = ray->origin[i] - v0[i];
+    }
+    p[0] = ray->dir[1]*e2[2] - ray->dir[2]*e2[1];
+    p[1] = ray->dir[2]*e2[0] - ray->dir[0]*e2[2];
+    p[2] = ray->dir[0]*e2[1] - ray->dir[1]*e2[0];
+    float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if (fabsf(det) < 1e-12f)
+        return 0;
+    float inv_det = 1.0f / det;
+    float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return 0;
+    q[0] = s[1]*e1[2] - s[2]*e1[1];
+    q[1] = s[2]*e1[0] - s[0]*e1[2];
+    q[2] = s[0]*e1[1] - s[1]*e1[0];
+    float v = (ray->dir[0]*q[0] + ray->dir[1]*q[1] + ray->dir[2]*q[2]) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return 0;
+    float t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inv_det;
+    if (t < 0.0f || t > ray->t_max)
+        return 0;
+    *t_out = t;
+    return 1;
+}
+
+/* Compare a traversal hit with the exhaustive nearest (ties may pick either triangle) */
+static int hit_matches(const pmdl_collision_hit* hit, uint32_t tri, float t) {
+    if (tri == PMDL_COLLISION_MISS)
+        return hit->triangle == PMDL_COLLISION_MISS;
+    return hit->triangle != PMDL_COLLISION_MISS && fabsf(hit->t - t) <= T_EPSILON * (1.0f + t);
+}
+
+static void test_rays(const pmdl_collision* col) {
+    static pmdl_ray rays[RAY_COUNT];
+    static pmdl_collision_hit hits[RAY_COUNT], packet_hits[RAY_COUNT];
+    unsigned i,t;
+    for (i=0 ; i<RAY_COUNT ; ++i) {
+        pmdl_ray* ray = &rays[i];
+        ray->origin[0] = -15.0f;
+        ray->origin[1] = test_rand(-2.0f, 2.0f);
+        ray->origin[2] = test_rand(-2.0f, 2.0f);
+        ray->dir[0] = 1.0f;
+        ray->dir[1] = test_rand(-0.5f, 0.5f);
+        ray->dir[2] = test_rand(-0.5f, 0.5f);
+        ray->t_max = (i % 7) ? 100.0f : 12.0f;
+    }
+    unsigned hit_count = pmdl_collision_raycast_batch(col, rays, RAY_COUNT, hits);
+    unsigned packet_count = pmdl_collision_raycast_packets(col, rays, RAY_COUNT-3, packet_hits);
+
+    unsigned brute_count = 0;
+    for (i=0 ; i<RAY_COUNT ; ++i) {
+        float t_best = FLT_MAX;
+        uint32_t tri_best = PMDL_COLLISION_MISS;
+        for (t=0 ; t<TRI_COUNT ; ++t) {
+            float tt;
+            if (ray_tri(&rays[i], &positions[t*9], &positions[t*9+3], &positions[t*9+6], &tt) && tt < t_best) {
+                t_best = tt;
+                tri_best = t;
+            }
+        }
+        brute_count += (tri_best != PMDL_COLLISION_MISS);
+        TEST_CHECK(hit_matches(&hits[i], tri_best, t_best),
+                   "ray %u hit %u at %f; exhaustive %u at %f", i, hits[i].triangle, hits[i].t, tri_best, t_best);
+        if (i < RAY_COUNT-3)
+            TEST_CHECK(packet_hits[i].triangle == hits[i].triangle && packet_hits[i].t == hits[i].t,
+                       "ray %u packet hit %u, single hit %u", i, packet_hits[i].triangle, hits[i].triangle);
+        if (hits[i].triangle != PMDL_COLLISION_MISS) {
+            const float* n = hits[i].normal;
+            TEST_CHECK(n[0]*rays[i].dir[0] + n[1]*rays[i].dir[1] + n[2]*rays[i].dir[2] <= 0.0f,
+                       "ray %u normal faces away", i);
+        }
+    }
+    TEST_CHECK(hit_count == brute_count, "%u ray hits; exhaustive %u", hit_count, brute_count);
+    TEST_CHECK(hit_count > RAY_COUNT/4, "only %u rays hit (scene not exercised)", hit_count);
+    TEST_CHECK(packet_count <= hit_count, "%u packet hits of %u", packet_count, hit_count);
+}
+
+static void test_sweeps(const pmdl_collision* col) {
+    static pmdl_sphere_sweep sweeps[SWEEP_COUNT];
+    static pmdl_collision_hit hits[SWEEP_COUNT];
+    unsigned i,t;
+    for (i=0 ; i<SWEEP_COUNT ; ++i) {
+        pmdl_sphere_sweep* sweep = &sweeps[i];
+        sweep->origin[0] = -15.0f;
+        sweep->origin[1] = test_rand(-5.0f, 5.0f);
+        sweep->origin[2] = test_rand(-5.0f, 5.0f);
+        sweep->dir[0] = 1.0f;
+        sweep->dir[1] = test_rand(-0.5f, 0.5f);
+        sweep->dir[2] = test_rand(-0.5f, 0.5f);
+        sweep->t_max = 40.0f;
+        sweep->radius = test_rand(0.0f, 0.8f);
+    }
+    unsigned hit_count = pmdl_collision_sweep_batch(col, sweeps, SWEEP_COUNT, hits);
+
+    unsigned brute_count = 0;
+    for (i=0 ; i<SWEEP_COUNT ; ++i) {
+        float t_best = FLT_MAX;
+        uint32_t tri_best = PMDL_COLLISION_MISS;
+        for (t=0 ; t<TRI_COUNT ; ++t) {
+            pmdl_collision_hit hit;
+            if (pmdl_collision_sweep_batch(&singles[t], &sweeps[i], 1, &hit) && hit.t < t_best) {
+                t_best = hit.t;
+                tri_best = t;
+            }
+        }
+        brute_count += (tri_best != PMDL_COLLISION_MISS);
+        TEST_CHECK(hit_matches(&hits[i], tri_best, t_best),
+                   "sweep %u hit %u at %f; exhaustive %u at %f", i, hits[i].triangle, hits[i].t, tri_best, t_best);
+    }
+    TEST_CHECK(hit_count == brute_count, "%u sweep hits; exhaustive %u", hit_count, brute_count);
+}
+
+static void test_boxes(const pmdl_collision* col) {
+    static uint32_t overlaps[TRI_COUNT];
+    pmdl_aabb_soa_t soa;
+    unsigned i,t,k;
+    soa.count = BOX_COUNT;
+    for (k=0 ; k<3 ; ++k) {
+        soa.centre[k] = malloc(sizeof(float)*BOX_COUNT);
+        soa.extent[k] = malloc(sizeof(float)*BOX_COUNT);
+    }
+    uint32_t expect_bits[(BOX_COUNT+31)/32] = {0};
+    uint32_t bits[(BOX_COUNT+31)/32];
+    unsigned expect_hits = 0;
+    for (i=0 ; i<BOX_COUNT ; ++i) {
+        float aabb[2][3];
+        for (k=0 ; k<3 ; ++k) {
+            float c = test_rand(-10.0f, 10.0f), e = test_rand(0.0f, 1.5f);
+            aabb[0][k] = c - e;
+            aabb[1][k] = c + e;
+        }
+        pmdl_aabb_soa_set(&soa, i, aabb);
+
+        unsigned count = pmdl_collision_aabb_query(col, aabb, overlaps, TRI_COUNT);
+        unsigned brute_count = 0;
+        for (t=0 ; t<TRI_COUNT ; ++t)
+            if (pmdl_collision_aabb_query(&singles[t], aabb, NULL, 0)) {
+                ++brute_count;
+                unsigned j;
+                for (j=0 ; j<count && overlaps[j] != t ; ++j) {}
+                TEST_CHECK(j < count, "box %u misses overlapping triangle %u", i, t);
+            }
+        TEST_CHECK(count == brute_count, "box %u overlaps %u; exhaustive %u", i, count, brute_count);
+        TEST_CHECK(pmdl_collision_aabb_query(col, aabb, NULL, 0) == (brute_count != 0),
+                   "box %u any-overlap query disagrees", i);
+        if (brute_count) {
+            expect_bits[i/32] |= 1 << (i%32);
+            ++expect_hits;
+        }
+    }
+    unsigned hit_count = pmdl_collision_aabb_test_batch(col, &soa, bits);
+    TEST_CHECK(hit_count == expect_hits, "%u boxes overlap; exhaustive %u", hit_count, expect_hits);
+    TEST_CHECK(!memcmp(bits, expect_bits, sizeof(bits)), "batch overlap bits differ");
+    for (k=0 ; k<3 ; ++k) {
+        free(soa.centre[k]);
+        free(soa.extent[k]);
+    }
+}
+
+/* `_COL` PMDL holding the test triangles and `node_count` hierarchy nodes */
+static void* make_col_file(const pmdl_bvh_node* nodes, uint32_t node_count,
+                           const uint32_t* elems, size_t* len_out) {
+    size_t vert_len = sizeof(positions), elem_len = sizeof(indices);
+    size_t len = sizeof(pmdl_header) + sizeof(pmdl_col_header) + vert_len + elem_len +
+                 8 + sizeof(pmdl_bvh_node) * node_count;
+    void* file = calloc(1, len);
+    pmdl_header* header = file;
+    memcpy(header->magic, "PMDL", 4);
+#   if __LITTLE_ENDIAN__
+        memcpy(header->endianness, "_LIT", 4);
+#   elif __BIG_ENDIAN__
+        memcpy(header->endianness, "_BIG", 4);
+#   endif
+    memcpy(header->draw_format, "_COL", 4);
+    header->collection_count = 1;
+    header->collection_offset = sizeof(pmdl_header);
+    pmdl_col_header* col_header = file + header->collection_offset;
+    col_header->vert_buf_off = sizeof(pmdl_col_header);
+    col_header->vert_buf_len = vert_len;
+    col_header->elem_buf_off = col_header->vert_buf_off + vert_len;
+    col_header->elem_buf_len = elem_len;
+    col_header->draw_idx_off = col_header->elem_buf_off + elem_len;
+    memcpy((void*)col_header + col_header->vert_buf_off, positions, vert_len);
+    memcpy((void*)col_header + col_header->elem_buf_off, elems, elem_len);
+    *(uint32_t*)((void*)col_header + col_header->draw_idx_off) = node_count;
+    memcpy((void*)col_header + col_header->draw_idx_off + 8, nodes, sizeof(pmdl_bvh_node) * node_count);
+    *len_out = len;
+    return file;
+}
+
+/* Inner nodes whose second child continues the chain; leaves hold triangle 0 */
+static pmdl_bvh_node* make_chain(unsigned depth, uint32_t* count_out) {
+    unsigned i, count = depth*2 + 1;
+    pmdl_bvh_node* nodes = calloc(count, sizeof(pmdl_bvh_node));
+    for (i=0 ; i<count ; ++i) {
+        nodes[i].aabb[0][0] = nodes[i].aabb[0][1] = nodes[i].aabb[0][2] = -20.0f;
+        nodes[i].aabb[1][0] = nodes[i].aabb[1][1] = nodes[i].aabb[1][2] = 20.0f;
+        if ((i & 1) || i == count-1) {
+            nodes[i].first = 0;
+            nodes[i].count = 1;
+        } else
+            nodes[i].first = i + 1;
+    }
+    *count_out = count;
+    return nodes;
+}
+
+static void test_file(const pmdl_collision* col) {
+    size_t len;
+    pmdl_collision fc;
+
+    // Prebuilt hierarchy is mapped as-is
+    void* file = make_col_file((const pmdl_bvh_node*)col->node_arr, col->node_count, col->index_arr, &len);
+    TEST_CHECK(!pmdl_collision_init_file(&fc, file, len), "valid `_COL` rejected");
+    TEST_CHECK(!fc.owned_nodes && fc.node_count == col->node_count, "valid hierarchy was rebuilt");
+    pmdl_ray ray = {{-15.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, 100.0f};
+    pmdl_collision_hit a, b;
+    pmdl_collision_raycast_batch(col, &ray, 1, &a);
+    pmdl_collision_raycast_batch(&fc, &ray, 1, &b);
+    TEST_CHECK(a.t == b.t, "mapped hierarchy hit %f; built %f", b.t, a.t);
+    pmdl_collision_destroy(&fc);
+
+    // A child preceding its parent could cycle; such hierarchies are rebuilt
+    pmdl_bvh_node* nodes = malloc(sizeof(pmdl_bvh_node) * col->node_count);
+    memcpy(nodes, col->node_arr, sizeof(pmdl_bvh_node) * col->node_count);
+    unsigned i;
+    for (i=col->node_count-1 ; i>0 && nodes[i].count ; --i) {}
+    TEST_CHECK(i > 0, "no inner node past the root");
+    nodes[i].first = i - 1;
+    free(file);
+    file = make_col_file(nodes, col->node_count, col->index_arr, &len);
+    TEST_CHECK(!pmdl_collision_init_file(&fc, file, len), "cyclic `_COL` rejected outright");
+    TEST_CHECK(fc.owned_nodes != NULL, "cyclic hierarchy was mapped");
+    pmdl_collision_raycast_batch(&fc, &ray, 1, &b);
+    TEST_CHECK(a.t == b.t, "rebuilt hierarchy hit %f; built %f", b.t, a.t);
+    pmdl_collision_destroy(&fc);
+    free(nodes);
+    free(file);
+
+    // Deepest chain whose traversal fits the stacks is mapped; one deeper is rebuilt
+    uint32_t count;
+    nodes = make_chain(95, &count);
+    file = make_col_file(nodes, count, indices, &len);
+    TEST_CHECK(!pmdl_collision_init_file(&fc, file, len) && !fc.owned_nodes, "95-deep chain rebuilt");
+    TEST_CHECK(pmdl_collision_raycast_batch(&fc, &ray, 1, &b) ==
+               pmdl_collision_raycast_batch(&singles[0], &ray, 1, &a), "95-deep chain traversal");
+    pmdl_collision_destroy(&fc);
+    free(nodes);
+    free(file);
+
+    nodes = make_chain(96, &count);
+    file = make_col_file(nodes, count, indices, &len);
+    TEST_CHECK(!pmdl_collision_init_file(&fc, file, len) && fc.owned_nodes, "96-deep chain mapped");
+    pmdl_collision_destroy(&fc);
+    free(nodes);
+    free(file);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+    unsigned t,v,k;
+
+    // Random triangle soup in a 20-unit cube
+    for (t=0 ; t<TRI_COUNT ; ++t) {
+        float c[3] = {test_rand(-10.0f, 10.0f), test_rand(-10.0f, 10.0f), test_rand(-10.0f, 10.0f)};
+        for (v=0 ; v<3 ; ++v) {
+            for (k=0 ; k<3 ; ++k)
+                positions[(t*3+v)*3+k] = c[k] + test_rand(-1.0f, 1.0f);
+            indices[t*3+v] = t*3+v;
+        }
+    }
+    pmdl_collision col;
+    if (pmdl_collision_init(&col, positions, TRI_COUNT*3, indices, TRI_COUNT)) {
+        fprintf(stderr, "Unable to init collision\n");
+        return 1;
+    }
+    static const uint32_t single_indices[3] = {0, 1, 2};
+    for (t=0 ; t<TRI_COUNT ; ++t)
+        pmdl_collision_init(&singles[t], &positions[t*9], 3, single_indices, 1);
+
+    test_rays(&col);
+    test_sweeps(&col);
+    test_boxes(&col);
+    test_file(&col);
+
+    for (t=0 ; t<TRI_COUNT ; ++t)
+        pmdl_collision_destroy(&singles[t]);
+    pmdl_collision_destroy(&col);
+    printf("%u collision check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,150 @@
+//
+//  test_pmdl_context.c
+//  PSPL
+//
+//  Checks batched draw-context updates (modelviews gathered per shared
+//  camera) against updating each context alone, bit for bit, across
+//  camera runs, camera-less contexts, deferred bits and camera changes
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "test_pmdl.h"
+
+#define CAMERA_COUNT 3
+#define CTX_COUNT 300
+
+static pmdl_camera* cameras[CAMERA_COUNT];
+
+/* Contexts updated as an array, and the same contexts updated alone */
+static pmdl_draw_ctx* batch_ctxs;
+static pmdl_draw_ctx* single_ctxs;
+static unsigned last_generations[2][CTX_COUNT];
+
+static void random_view(pspl_camera_view_t* view) {
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        view->pos.f[i] = test_rand(-10.0f, 10.0f);
+        view->look.f[i] = test_rand(-1.0f, 1.0f);
+        view->up.f[i] = 0;
+    }
+    view->up.f[2] = 1;
+}
+
+static void random_model(pspl_matrix34_t* mtx) {
+    int i, j;
+    for (i=0 ; i<3 ; ++i)
+        for (j=0 ; j<4 ; ++j)
+            mtx->m[i][j] = (j < 3) ? test_rand(-2.0f, 2.0f) : test_rand(-20.0f, 20.0f);
+}
+
+/* Contexts in runs over each camera (runs of 1 to 9), with every fifth
+ * run left without a camera and given a view and projection of its own */
+static void build_contexts() {
+    unsigned i = 0, r = 0;
+    while (i < CTX_COUNT) {
+        unsigned run = 1 + (unsigned)test_rand(0.0f, 8.99f);
+        for (; run && i<CTX_COUNT ; --run, ++i) {
+            pmdl_draw_ctx* ctx = &batch_ctxs[i];
+            random_model(&ctx->model_mtx);
+            if (r % 5 == 4) {
+                ctx->camera = NULL;
+                random_view(&ctx->camera_view);
+                ctx->projection.perspective.fov = test_rand(30.0f, 90.0f);
+            } else
+                ctx->camera = cameras[r % CAMERA_COUNT];
+            single_ctxs[i] = *ctx;
+        }
+        ++r;
+    }
+}
+
+/* Update both copies, then compare cached state exactly; contexts are
+ * restamped by both paths or by neither */
+static void check_update(const char* name, enum pmdl_invalidate_bits inv_bits) {
+    unsigned i;
+    pmdl_update_context_array(batch_ctxs, CTX_COUNT, inv_bits);
+    for (i=0 ; i<CTX_COUNT ; ++i)
+        pmdl_update_context(&single_ctxs[i], inv_bits);
+
+    for (i=0 ; i<CTX_COUNT ; ++i) {
+        const pmdl_draw_ctx* batch = &batch_ctxs[i];
+        const pmdl_draw_ctx* single = &single_ctxs[i];
+        TEST_CHECK(!memcmp(&batch->cached_view_mtx, &single->cached_view_mtx, sizeof(batch->cached_view_mtx)),
+                   "%s: context %u view differs", name, i);
+        TEST_CHECK(!memcmp(&batch->cached_modelview_mtx, &single->cached_modelview_mtx, sizeof(batch->cached_modelview_mtx)),
+                   "%s: context %u modelview differs (%g, %g batched; %g, %g alone)", name, i,
+                   batch->cached_modelview_mtx.m[0][0], batch->cached_modelview_mtx.m[2][3],
+                   single->cached_modelview_mtx.m[0][0], single->cached_modelview_mtx.m[2][3]);
+        TEST_CHECK(!memcmp(&batch->cached_modelview_invxpose_mtx, &single->cached_modelview_invxpose_mtx,
+                           sizeof(batch->cached_modelview_invxpose_mtx)),
+                   "%s: context %u inverse-transpose modelview differs", name, i);
+        TEST_CHECK(!memcmp(&batch->cached_projection_mtx, &single->cached_projection_mtx, sizeof(batch->cached_projection_mtx)),
+                   "%s: context %u projection differs", name, i);
+        TEST_CHECK(!memcmp(&batch->f_tanv, &single->f_tanv, sizeof(float)) &&
+                   !memcmp(&batch->f_tanh, &single->f_tanh, sizeof(float)),
+                   "%s: context %u frustum tangents differ", name, i);
+        TEST_CHECK(!memcmp(batch->cached_frustum_planes, single->cached_frustum_planes, sizeof(batch->cached_frustum_planes)),
+                   "%s: context %u frustum planes differ", name, i);
+        TEST_CHECK((batch->cached_generation != last_generations[0][i]) ==
+                   (single->cached_generation != last_generations[1][i]),
+                   "%s: context %u updated by one path only", name, i);
+        last_generations[0][i] = batch->cached_generation;
+        last_generations[1][i] = single->cached_generation;
+    }
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    unsigned i, c;
+    for (c=0 ; c<CAMERA_COUNT ; ++c) {
+        cameras[c] = pmdl_new_camera();
+        random_view(&cameras[c]->camera_view);
+        cameras[c]->projection.perspective.fov = test_rand(30.0f, 90.0f);
+        pmdl_update_camera(cameras[c], PMDL_INVALIDATE_ALL);
+    }
+    batch_ctxs = pmdl_new_draw_context_array(CTX_COUNT);
+    single_ctxs = pmdl_new_draw_context_array(CTX_COUNT);
+    build_contexts();
+
+    // Full update (scratch grown on first use)
+    check_update("full update", PMDL_INVALIDATE_ALL);
+
+    // Nothing to do; no context is restamped
+    check_update("idle update", PMDL_INVALIDATE_NONE);
+
+    // Deferred model changes on a scattering of contexts
+    for (i=0 ; i<CTX_COUNT ; ++i) {
+        if (test_rand(0.0f, 1.0f) < 0.3f) {
+            random_model(&batch_ctxs[i].model_mtx);
+            single_ctxs[i].model_mtx = batch_ctxs[i].model_mtx;
+            pmdl_invalidate_context(&batch_ctxs[i], PMDL_INVALIDATE_MODEL);
+            pmdl_invalidate_context(&single_ctxs[i], PMDL_INVALIDATE_MODEL);
+        }
+    }
+    check_update("deferred model update", PMDL_INVALIDATE_NONE);
+
+    // One camera moved, another re-projected
+    random_view(&cameras[0]->camera_view);
+    pmdl_update_camera(cameras[0], PMDL_INVALIDATE_VIEW);
+    cameras[1]->projection.perspective.fov = test_rand(30.0f, 90.0f);
+    pmdl_update_camera(cameras[1], PMDL_INVALIDATE_PROJECTION);
+    check_update("camera update", PMDL_INVALIDATE_NONE);
+
+    // Bits not touching the modelview
+    check_update("texture matrix update", PMDL_INVALIDATE_TEXMTXS);
+
+    pmdl_free_draw_context_array(batch_ctxs);
+    pmdl_free_draw_context_array(single_ctxs);
+    for (c=0 ; c<CAMERA_COUNT ; ++c)
+        pmdl_free_camera(cameras[c]);
+
+    if (test_failures)
+        fprintf(stderr, "%u context check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,161 @@
+//
+//  test_pmdl_frustum.c
+//  PSPL
+//
+//  Checks the batched SoA frustum test against the scalar per-plane test
+//  and against exact corner classification
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "test_pmdl.h"
+
+/* Not a multiple of 4 or 8, so vector and remainder paths both run */
+#define BOX_COUNT 1003
+
+/* Fused multiply-add would change the scalar test's rounding */
+#pragma STDC FP_CONTRACT OFF
+
+static float box_arr[BOX_COUNT][2][3];
+static float soa_arr[6][BOX_COUNT];
+
+/* Scalar six-plane test (as the runtime's per-AABB classification) */
+static int scalar_visible(const pmdl_draw_ctx* ctx, const float aabb[2][3]) {
+    float centre[3], extent[3];
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        centre[i] = (aabb[0][i] + aabb[1][i]) * 0.5f;
+        extent[i] = (aabb[1][i] - aabb[0][i]) * 0.5f;
+    }
+    for (i=0 ; i<6 ; ++i) {
+        const float* plane = ctx->cached_frustum_planes[i].ABCD.f;
+        float dist = plane[0]*centre[0] + plane[1]*centre[1] + plane[2]*centre[2] + plane[3];
+        float radius = fabsf(plane[0])*extent[0] + fabsf(plane[1])*extent[1] + fabsf(plane[2])*extent[2];
+        if (dist < -radius)
+            return 0;
+    }
+    return 1;
+}
+
+/* Exact classification in double precision: -1 if all corners are behind
+ * one plane, 1 if clearly not (by `margin`), 0 if too close to call */
+static int corner_class(const pmdl_draw_ctx* ctx, const float aabb[2][3], double margin) {
+    int i, c, result = 1;
+    for (i=0 ; i<6 ; ++i) {
+        const float* plane = ctx->cached_frustum_planes[i].ABCD.f;
+        double nearest = -HUGE_VAL;
+        for (c=0 ; c<8 ; ++c) {
+            double d = (double)plane[0]*aabb[(c>>2)&1][0] + (double)plane[1]*aabb[(c>>1)&1][1] +
+                       (double)plane[2]*aabb[c&1][2] + plane[3];
+            if (d > nearest)
+                nearest = d;
+        }
+        if (nearest < -margin)
+            return -1;
+        if (nearest < margin)
+            result = 0;
+    }
+    return result;
+}
+
+static void random_boxes() {
+    unsigned i;
+    int j;
+    for (i=0 ; i<BOX_COUNT ; ++i) {
+        for (j=0 ; j<3 ; ++j) {
+            float c = test_rand(-60.0f, 60.0f);
+            float e = test_rand(0.0f, 8.0f);
+            box_arr[i][0][j] = c - e;
+            box_arr[i][1][j] = c + e;
+        }
+
+        // Every eighth box is flat along one axis
+        if (!(i & 7))
+            box_arr[i][1][i%3] = box_arr[i][0][i%3];
+    }
+}
+
+/* Batch over first `count` boxes against scalar results */
+static void check_batch(const pmdl_draw_ctx* ctx, unsigned count, const char* name) {
+    pmdl_aabb_soa_t aabbs = {
+        .count = count,
+        .centre = {soa_arr[0], soa_arr[1], soa_arr[2]},
+        .extent = {soa_arr[3], soa_arr[4], soa_arr[5]}
+    };
+    unsigned i;
+    for (i=0 ; i<count ; ++i)
+        pmdl_aabb_soa_set(&aabbs, i, box_arr[i]);
+
+    uint32_t bits[(BOX_COUNT+31)/32+1];
+    unsigned words = (count+31)/32;
+    memset(bits, 0xff, sizeof(bits));
+    unsigned vis_count = pmdl_aabb_frustum_test_batch(ctx, &aabbs, bits);
+
+    unsigned want_count = 0, mismatches = 0;
+    for (i=0 ; i<count ; ++i) {
+        int want = scalar_visible(ctx, box_arr[i]);
+        int got = (bits[i/32] >> (i%32)) & 1;
+        want_count += want;
+        if (got != want && ++mismatches <= 4)
+            TEST_CHECK(got == want, "%s: box %u batch %d, scalar %d", name, i, got, want);
+
+        // Conservative against exact corners; clear cases must agree
+        int exact = corner_class(ctx, box_arr[i], 1e-3);
+        TEST_CHECK(exact != 1 || got, "%s: box %u inside frustum culled", name, i);
+        TEST_CHECK(exact != -1 || !got, "%s: box %u outside frustum kept", name, i);
+    }
+    TEST_CHECK(!mismatches, "%s: %u of %u boxes differ from scalar test", name, mismatches, count);
+    TEST_CHECK(vis_count == want_count, "%s: visible count %u, scalar %u", name, vis_count, want_count);
+
+    // Unused bits of the last word are clear; the word after is untouched
+    if (count % 32)
+        TEST_CHECK(!(bits[words-1] >> (count%32)), "%s: bits set past count", name);
+    TEST_CHECK(bits[words] == 0xffffffff, "%s: wrote past last word", name);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    pmdl_draw_ctx* ctx = test_view_space_ctx(60.0f, 1.5f, 1.0f, 50.0f);
+    random_boxes();
+
+    // Remainder lengths of the 8- and 4-wide paths
+    unsigned count;
+    char name[64];
+    for (count=BOX_COUNT-8 ; count<=BOX_COUNT ; ++count) {
+        snprintf(name, sizeof(name), "view space, %u boxes", count);
+        check_batch(ctx, count, name);
+    }
+
+    // Oblique model transform (rotated, scaled and translated planes)
+    float ang = 0.7f;
+    memset(&ctx->model_mtx, 0, sizeof(ctx->model_mtx));
+    ctx->model_mtx.m[0][0] = cosf(ang) * 1.5f; ctx->model_mtx.m[0][2] = sinf(ang) * 1.5f;
+    ctx->model_mtx.m[1][1] = 0.75f;
+    ctx->model_mtx.m[2][0] = -sinf(ang); ctx->model_mtx.m[2][2] = cosf(ang);
+    ctx->model_mtx.m[0][3] = 3.0f; ctx->model_mtx.m[1][3] = -2.0f; ctx->model_mtx.m[2][3] = -20.0f;
+    pmdl_update_context(ctx, PMDL_INVALIDATE_MODEL);
+    check_batch(ctx, BOX_COUNT, "oblique model");
+
+    // Orthographic projection
+    ctx->projection_type = PMDL_ORTHOGRAPHIC;
+    ctx->projection.orthographic.left = -30.0f;
+    ctx->projection.orthographic.right = 20.0f;
+    ctx->projection.orthographic.top = 25.0f;
+    ctx->projection.orthographic.bottom = -15.0f;
+    ctx->projection.orthographic.near = 1.0f;
+    ctx->projection.orthographic.far = 40.0f;
+    pmdl_update_context(ctx, PMDL_INVALIDATE_PROJECTION);
+    check_batch(ctx, BOX_COUNT, "orthographic");
+
+    pmdl_free_draw_context(ctx);
+
+    if (test_failures)
+        fprintf(stderr, "%u frustum check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
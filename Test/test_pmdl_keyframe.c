@@ -0,0 +1,242 @@
+//
+//  test_pmdl_keyframe.c
+//  PSPL
+//
+//  Checks keyframe curve playback (Newton-Raphson segment solve and cached
+//  keyframe cursors) against a double-precision bisection solve; run with
+//  `bench` to time curve evaluation
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include <PMDLRuntimeRigging.h>
+#include "PMDLRuntimeProcessing.h"
+#include "test_pmdl.h"
+
+/* Location-animated bones (3 curves each) and keyframes per curve */
+#define BONE_COUNT 8
+#define KF_COUNT 40
+
+/* Largest value error against the bisection reference
+ * (keyframe values lie in [-1,1], one frame apart) */
+#define VALUE_TOLERANCE 1e-4
+
+#define TICK_COUNT 20000
+
+static uint8_t rig_data[1 << 16];
+static size_t rig_len = 0;
+
+static void* emit(const void* data, size_t len) {
+    void* dst = &rig_data[rig_len];
+    memcpy(dst, data, len);
+    rig_len += len;
+    return dst;
+}
+static uint32_t* emit_u32(uint32_t val) {return emit(&val, sizeof(val));}
+static void emit_f32(float val) {emit(&val, sizeof(val));}
+
+/* Fcurve of `KF_COUNT` keyframes roughly one frame apart, spanning
+ * [0, `duration`]; interior handles reach 5-50% into each neighbouring
+ * span, so every segment stays a function of time */
+static void emit_curve(float duration) {
+    float times[KF_COUNT], values[KF_COUNT], right[KF_COUNT], left[KF_COUNT];
+    int k;
+    for (k=0 ; k<KF_COUNT ; ++k) {
+        times[k] = (k == KF_COUNT-1) ? duration : k + ((k) ? test_rand(-0.3f, 0.3f) : 0.0f);
+        values[k] = test_rand(-1.0f, 1.0f);
+    }
+    for (k=0 ; k<KF_COUNT ; ++k) {
+        left[k] = (k) ? times[k] - test_rand(0.05f, 0.5f) * (times[k] - times[k-1]) : times[k] - 0.5f;
+        right[k] = (k+1<KF_COUNT) ? times[k] + test_rand(0.05f, 0.5f) * (times[k+1] - times[k]) : times[k] + 0.5f;
+    }
+    emit_u32(KF_COUNT);
+    for (k=0 ; k<KF_COUNT ; ++k) {
+        pmdl_curve_keyframe kf = {
+            .left_handle = {left[k], values[k] + test_rand(-0.5f, 0.5f)},
+            .main_handle = {times[k], values[k]},
+            .right_handle = {right[k], values[k] + test_rand(-0.5f, 0.5f)}
+        };
+        emit(&kf, sizeof(kf));
+    }
+}
+
+/* Rigging data as `pmdl_rigging_init` reads it: skeleton, (empty)
+ * skinning and animation sections */
+static void build_rigging(float duration) {
+    int i, j;
+
+    // Skeleton; root bones without children
+    uint32_t* skel_len = emit_u32(0);
+    emit_u32(BONE_COUNT);
+    for (i=0 ; i<BONE_COUNT ; ++i)
+        emit_u32(i * 24);
+    for (i=0 ; i<BONE_COUNT ; ++i) {
+        emit_u32(0);
+        emit_f32(0.0f); emit_f32(0.0f); emit_f32(0.0f);
+        emit_u32((uint32_t)-1);
+        emit_u32(0);
+    }
+    *skel_len = rig_len;
+
+    // Skinning
+    emit_u32(8);
+    emit_u32(0);
+
+    // Animation; one action with a location track per bone
+    size_t anim_off = rig_len;
+    emit_u32(1);
+    uint32_t* strings_off = emit_u32(0);
+    emit_u32(0);
+    emit_u32(BONE_COUNT);
+    emit_f32(duration);
+    for (i=0 ; i<BONE_COUNT ; ++i) {
+        emit_u32(0x80000000 | i);
+        for (j=0 ; j<3 ; ++j)
+            emit_curve(duration);
+    }
+    *strings_off = rig_len - anim_off;
+    emit_u32(0);
+    emit("act", 4);
+}
+
+/* Reference value of curve at `time`; segment parameter bisected in
+ * double precision from the keyframe handles */
+static double reference_value(const pmdl_curve* curve, double time) {
+    const pmdl_curve_keyframe* kf = curve->keyframe_array;
+    unsigned count = curve->keyframe_count;
+    if (time <= kf[0].main_handle[0])
+        return kf[0].main_handle[1];
+    if (time > kf[count-1].main_handle[0])
+        return kf[count-1].main_handle[1];
+    unsigned j = 0;
+    while (time > kf[j+1].main_handle[0])
+        ++j;
+
+    double p[2][4];
+    int k;
+    for (k=0 ; k<2 ; ++k) {
+        p[k][0] = kf[j].main_handle[k];
+        p[k][1] = kf[j].right_handle[k];
+        p[k][2] = kf[j+1].left_handle[k];
+        p[k][3] = kf[j+1].main_handle[k];
+    }
+    double lo = 0.0, hi = 1.0, t = 0.5;
+    for (k=0 ; k<60 ; ++k) {
+        t = (lo + hi) * 0.5;
+        double u = 1.0 - t;
+        double x = u*u*u*p[0][0] + 3.0*u*u*t*p[0][1] + 3.0*u*t*t*p[0][2] + t*t*t*p[0][3];
+        if (x < time)
+            lo = t;
+        else
+            hi = t;
+    }
+    double u = 1.0 - t;
+    return u*u*u*p[1][0] + 3.0*u*u*t*p[1][1] + 3.0*u*t*t*p[1][2] + t*t*t*p[1][3];
+}
+
+/* Compare every curve's cached value at the context's current time */
+static double worst_error = 0.0;
+static void check_values(const pmdl_action_ctx* ctx, const char* name, unsigned tick) {
+    unsigned i;
+    for (i=0 ; i<ctx->curve_instance_count ; ++i) {
+        const pmdl_curve_playback* inst = &ctx->curve_instance_array[i];
+        double want = reference_value(inst->curve, (float)ctx->current_time);
+        double err = fabs(inst->cached_value - want);
+        if (err > worst_error)
+            worst_error = err;
+        TEST_CHECK(err <= VALUE_TOLERANCE, "%s tick %u: curve %u at %g is %g, want %g",
+                   name, tick, i, ctx->current_time, inst->cached_value, want);
+    }
+}
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    float duration = KF_COUNT - 1;
+    build_rigging(duration);
+    pmdl_rigging_ctx* rig_ctx;
+    pmdl_rigging_init(&rig_ctx, rig_data, "bone");
+    pmdl_action_ctx* ctx = pmdl_action_init(&rig_ctx->action_array[0]);
+    TEST_CHECK(ctx->curve_instance_count == BONE_COUNT*3, "%u curve instances", ctx->curve_instance_count);
+    ctx->loop_flag = 1;
+
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+
+        // Playback throughput; a quarter frame per tick
+        unsigned tick, i;
+        double t = now();
+        for (tick=0 ; tick<TICK_COUNT*10 ; ++tick)
+            pmdl_action_advance(ctx, 0.25);
+        t = now() - t;
+        printf("curve playback: %.1f ns per curve\n",
+               t * 1e9 / ((double)TICK_COUNT*10 * ctx->curve_instance_count));
+
+        // Bisection reference, for scale
+        double sum = 0.0;
+        t = now();
+        for (tick=0 ; tick<TICK_COUNT/10 ; ++tick)
+            for (i=0 ; i<ctx->curve_instance_count ; ++i)
+                sum += reference_value(ctx->curve_instance_array[i].curve, fmod(tick * 0.25, duration));
+        t = now() - t;
+        printf("bisection reference: %.1f ns per curve (%g)\n",
+               t * 1e9 / ((double)TICK_COUNT/10 * ctx->curve_instance_count), sum);
+
+        pmdl_action_destroy(ctx);
+        pmdl_rigging_destroy(rig_ctx);
+        return 0;
+    }
+
+    // Values before any advance are the first keyframes
+    unsigned tick;
+    check_values(ctx, "initial", 0);
+
+    // Forward playback at less than a frame per tick, looping
+    for (tick=0 ; tick<TICK_COUNT ; ++tick) {
+        pmdl_action_advance(ctx, 0.37);
+        check_values(ctx, "forward", tick);
+    }
+
+    // Seeking both ways by up to several segments (cursor moves backwards too)
+    pmdl_action_rewind(ctx);
+    pmdl_action_advance(ctx, duration * 0.5);
+    for (tick=0 ; tick<TICK_COUNT ; ++tick) {
+        double delta = test_rand(-6.0f, 6.0f);
+        if (ctx->current_time + delta < 0.0)
+            delta = -ctx->current_time;
+        pmdl_action_advance(ctx, delta);
+        check_values(ctx, "seek", tick);
+    }
+
+    // Keyframe times themselves, and the ends of the action
+    pmdl_action_rewind(ctx);
+    pmdl_action_advance(ctx, 0.0);
+    check_values(ctx, "start", 0);
+    pmdl_action_advance(ctx, duration);
+    check_values(ctx, "end", 0);
+    pmdl_action_rewind(ctx);
+    for (tick=1 ; tick<KF_COUNT ; ++tick) {
+        pmdl_action_advance(ctx, 1.0);
+        check_values(ctx, "whole frames", tick);
+    }
+
+    printf("curve playback: worst error %.3g\n", worst_error);
+
+    pmdl_action_destroy(ctx);
+    pmdl_rigging_destroy(rig_ctx);
+
+    if (test_failures)
+        fprintf(stderr, "%u keyframe check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,410 @@
+//
+//  test_pmdl_linalg.c
+//  PSPL
+//
+//  Checks PMDL matrix and vector routines bit-for-bit against the reference
+//  C term order and within tolerance of double-precision results; run with
+//  `bench` to time them against the scalar reference
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "test_pmdl.h"
+
+/* Fused multiply-add would change the reference rounding */
+#pragma STDC FP_CONTRACT OFF
+
+#define CASE_COUNT 100000
+#define BATCH_COUNT 1027
+
+/* Relative tolerances against double precision (of the largest result
+ * element); products accumulate at most 4 terms, the inverse and quaternion
+ * routines also round a reciprocal */
+#define MUL_TOLERANCE 1e-6
+#define INVXPOSE_TOLERANCE 1e-5
+#define QUAT_TOLERANCE 2e-6
+
+#pragma mark Reference Term Order
+
+/* Same expressions (and evaluation order) as PMDLRuntimeLinAlgebraRef.c */
+
+static void ref_matrix34_mul(const pspl_matrix34_t* a, const pspl_matrix34_t* b, pspl_matrix34_t* ab) {
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        ab->m[i][0] = a->m[i][0]*b->m[0][0] + a->m[i][1]*b->m[1][0] + a->m[i][2]*b->m[2][0];
+        ab->m[i][1] = a->m[i][0]*b->m[0][1] + a->m[i][1]*b->m[1][1] + a->m[i][2]*b->m[2][1];
+        ab->m[i][2] = a->m[i][0]*b->m[0][2] + a->m[i][1]*b->m[1][2] + a->m[i][2]*b->m[2][2];
+        ab->m[i][3] = a->m[i][0]*b->m[0][3] + a->m[i][1]*b->m[1][3] + a->m[i][2]*b->m[2][3] + a->m[i][3];
+    }
+}
+
+static void ref_matrix44_mul(const pspl_matrix44_t* a, const pspl_matrix44_t* b, pspl_matrix44_t* ab, int rows) {
+    int i, j;
+    for (i=0 ; i<rows ; ++i)
+        for (j=0 ; j<4 ; ++j)
+            ab->m[i][j] = a->m[i][0]*b->m[0][j] + a->m[i][1]*b->m[1][j] + a->m[i][2]*b->m[2][j] + a->m[i][3]*b->m[3][j];
+}
+
+static void ref_matrix34_invxpose(const pspl_matrix34_t* src, pspl_matrix34_t* m) {
+    float det =   src->m[0][0]*src->m[1][1]*src->m[2][2] + src->m[0][1]*src->m[1][2]*src->m[2][0] + src->m[0][2]*src->m[1][0]*src->m[2][1]
+    - src->m[2][0]*src->m[1][1]*src->m[0][2] - src->m[1][0]*src->m[0][1]*src->m[2][2] - src->m[0][0]*src->m[2][1]*src->m[1][2];
+    det = 1.0f / det;
+    m->m[0][0] =  (src->m[1][1]*src->m[2][2] - src->m[2][1]*src->m[1][2]) * det;
+    m->m[0][1] = -(src->m[1][0]*src->m[2][2] - src->m[2][0]*src->m[1][2]) * det;
+    m->m[0][2] =  (src->m[1][0]*src->m[2][1] - src->m[2][0]*src->m[1][1]) * det;
+    m->m[1][0] = -(src->m[0][1]*src->m[2][2] - src->m[2][1]*src->m[0][2]) * det;
+    m->m[1][1] =  (src->m[0][0]*src->m[2][2] - src->m[2][0]*src->m[0][2]) * det;
+    m->m[1][2] = -(src->m[0][0]*src->m[2][1] - src->m[2][0]*src->m[0][1]) * det;
+    m->m[2][0] =  (src->m[0][1]*src->m[1][2] - src->m[1][1]*src->m[0][2]) * det;
+    m->m[2][1] = -(src->m[0][0]*src->m[1][2] - src->m[1][0]*src->m[0][2]) * det;
+    m->m[2][2] =  (src->m[0][0]*src->m[1][1] - src->m[1][0]*src->m[0][1]) * det;
+    m->m[0][3] = m->m[1][3] = m->m[2][3] = 0.0f;
+}
+
+static void ref_vector3_matrix_mul(const pspl_matrix34_t* mt, const float* src, float* dst) {
+    float x = src[0], y = src[1], z = src[2];
+    dst[0] = mt->m[0][0]*x + mt->m[0][1]*y + mt->m[0][2]*z + mt->m[0][3];
+    dst[1] = mt->m[1][0]*x + mt->m[1][1]*y + mt->m[1][2]*z + mt->m[1][3];
+    dst[2] = mt->m[2][0]*x + mt->m[2][1]*y + mt->m[2][2]*z + mt->m[2][3];
+}
+
+static void ref_matrix34_quat(pspl_matrix34_t* m, const float* q) {
+    float n = 1.0f/sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    float a[4] = {q[0]*n, q[1]*n, q[2]*n, q[3]*n};
+    m->m[0][0] = 1.0f - (2.0f*a[1]*a[1]) - (2.0f*a[2]*a[2]);
+    m->m[1][0] = (2.0f*a[0]*a[1]) - (2.0f*a[2]*a[3]);
+    m->m[2][0] = (2.0f*a[0]*a[2]) + (2.0f*a[1]*a[3]);
+    m->m[0][1] = (2.0f*a[0]*a[1]) + (2.0f*a[2]*a[3]);
+    m->m[1][1] = 1.0f - (2.0f*a[0]*a[0]) - (2.0f*a[2]*a[2]);
+    m->m[2][1] = (2.0f*a[2]*a[1]) - (2.0f*a[0]*a[3]);
+    m->m[0][2] = (2.0f*a[0]*a[2]) - (2.0f*a[1]*a[3]);
+    m->m[1][2] = (2.0f*a[2]*a[1]) + (2.0f*a[0]*a[3]);
+    m->m[2][2] = 1.0f - (2.0f*a[0]*a[0]) - (2.0f*a[1]*a[1]);
+}
+
+static void ref_quat_mul(const float* a, const float* b, float* r) {
+    r[3] = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+    r[0] = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+    r[1] = a[3]*b[1] + a[1]*b[3] + a[2]*b[0] - a[0]*b[2];
+    r[2] = a[3]*b[2] + a[2]*b[3] + a[0]*b[1] - a[1]*b[0];
+}
+
+#pragma mark Double Precision
+
+/* Relative error of `count` floats against doubles */
+static double rel_error(const float* got, const double* want, unsigned count) {
+    double max_err = 0.0, max_mag = 1e-30;
+    unsigned i;
+    for (i=0 ; i<count ; ++i) {
+        if (fabs(want[i]) > max_mag)
+            max_mag = fabs(want[i]);
+        if (fabs(got[i] - want[i]) > max_err)
+            max_err = fabs(got[i] - want[i]);
+    }
+    return max_err / max_mag;
+}
+
+static void dbl_matrix34_mul(const pspl_matrix34_t* a, const pspl_matrix34_t* b, double ab[3][4]) {
+    int i, j;
+    for (i=0 ; i<3 ; ++i)
+        for (j=0 ; j<4 ; ++j)
+            ab[i][j] = (double)a->m[i][0]*b->m[0][j] + (double)a->m[i][1]*b->m[1][j] +
+                       (double)a->m[i][2]*b->m[2][j] + ((j == 3) ? a->m[i][3] : 0.0);
+}
+
+static void dbl_matrix34_invxpose(const pspl_matrix34_t* s, double m[3][4]) {
+    int i, j;
+    double det = (double)s->m[0][0]*((double)s->m[1][1]*s->m[2][2] - (double)s->m[2][1]*s->m[1][2]) -
+                 (double)s->m[0][1]*((double)s->m[1][0]*s->m[2][2] - (double)s->m[2][0]*s->m[1][2]) +
+                 (double)s->m[0][2]*((double)s->m[1][0]*s->m[2][1] - (double)s->m[2][0]*s->m[1][1]);
+    for (i=0 ; i<3 ; ++i) {
+        int i1 = (i+1)%3, i2 = (i+2)%3;
+        for (j=0 ; j<3 ; ++j) {
+            int j1 = (j+1)%3, j2 = (j+2)%3;
+            m[i][j] = ((double)s->m[i1][j1]*s->m[i2][j2] - (double)s->m[i1][j2]*s->m[i2][j1]) / det;
+        }
+        m[i][3] = 0.0;
+    }
+}
+
+static void dbl_matrix34_quat(const float* q, double m[3][4]) {
+    double n = sqrt((double)q[0]*q[0] + (double)q[1]*q[1] + (double)q[2]*q[2] + (double)q[3]*q[3]);
+    double x = q[0]/n, y = q[1]/n, z = q[2]/n, w = q[3]/n;
+    m[0][0] = 1.0 - 2.0*(y*y + z*z); m[0][1] = 2.0*(x*y + z*w);       m[0][2] = 2.0*(x*z - y*w);
+    m[1][0] = 2.0*(x*y - z*w);       m[1][1] = 1.0 - 2.0*(x*x + z*z); m[1][2] = 2.0*(y*z + x*w);
+    m[2][0] = 2.0*(x*z + y*w);       m[2][1] = 2.0*(y*z - x*w);       m[2][2] = 1.0 - 2.0*(x*x + y*y);
+}
+
+#pragma mark Cases
+
+static void random_matrix34(pspl_matrix34_t* m) {
+    int i, j;
+    for (i=0 ; i<3 ; ++i)
+        for (j=0 ; j<4 ; ++j)
+            m->m[i][j] = test_rand(-4.0f, 4.0f);
+}
+
+static void random_matrix44(pspl_matrix44_t* m) {
+    int i, j;
+    for (i=0 ; i<4 ; ++i)
+        for (j=0 ; j<4 ; ++j)
+            m->m[i][j] = test_rand(-4.0f, 4.0f);
+}
+
+static void random_quat(pspl_vector4_t* q) {
+    int i;
+    for (i=0 ; i<4 ; ++i)
+        q->f[i] = test_rand(-1.0f, 1.0f);
+}
+
+#define SAME(a, b, n) (!memcmp((a), (b), sizeof(float)*(n)))
+
+static void check_matrix_mul() {
+    unsigned c;
+    double worst = 0.0;
+    for (c=0 ; c<CASE_COUNT ; ++c) {
+        pspl_matrix34_t a, b, ab, want;
+        double dbl[3][4];
+        random_matrix34(&a);
+        random_matrix34(&b);
+        pmdl_matrix34_mul(&a, &b, &ab);
+        ref_matrix34_mul(&a, &b, &want);
+        TEST_CHECK(SAME(ab.m, want.m, 12), "matrix34_mul case %u differs from reference", c);
+        dbl_matrix34_mul(&a, &b, dbl);
+        double err = rel_error(&ab.m[0][0], &dbl[0][0], 12);
+        if (err > worst)
+            worst = err;
+
+        // In place
+        pmdl_matrix34_mul(&a, &b, &a);
+        TEST_CHECK(SAME(a.m, want.m, 12), "matrix34_mul case %u differs in place", c);
+
+        pspl_matrix44_t a4, b4, ab4, want4;
+        random_matrix44(&a4);
+        random_matrix44(&b4);
+        pmdl_matrix44_mul(&a4, &b4, &ab4);
+        ref_matrix44_mul(&a4, &b4, &want4, 4);
+        TEST_CHECK(SAME(ab4.m, want4.m, 16), "matrix44_mul case %u differs from reference", c);
+
+        // 3x4 by 4x4 keeps the bottom row of `b`
+        pspl_matrix44_t a34 = a4;
+        pmdl_matrix3444_mul(&a34.m34, &b4, &ab4);
+        ref_matrix44_mul(&a34, &b4, &want4, 3);
+        memcpy(want4.m[3], b4.m[3], sizeof(want4.m[3]));
+        TEST_CHECK(SAME(ab4.m, want4.m, 16), "matrix3444_mul case %u differs from reference", c);
+    }
+    TEST_CHECK(worst <= MUL_TOLERANCE, "matrix34_mul relative error %g", worst);
+    printf("matrix multiply: worst relative error %.3g\n", worst);
+}
+
+static void check_invxpose() {
+    unsigned c;
+    double worst = 0.0;
+    for (c=0 ; c<CASE_COUNT ; ++c) {
+        pspl_matrix34_t src, got, want;
+        double dbl[3][4];
+
+        // Well-conditioned: rotation-scale plus noise
+        pspl_vector4_t q;
+        random_quat(&q);
+        memset(&src, 0, sizeof(src));
+        pmdl_matrix34_quat(&src, &q);
+        int i, j;
+        for (i=0 ; i<3 ; ++i)
+            for (j=0 ; j<4 ; ++j)
+                src.m[i][j] = src.m[i][j] * 2.0f + test_rand(-0.25f, 0.25f);
+
+        pmdl_matrix34_invxpose(&src, &got);
+        ref_matrix34_invxpose(&src, &want);
+        TEST_CHECK(SAME(got.m, want.m, 12), "matrix34_invxpose case %u differs from reference", c);
+        dbl_matrix34_invxpose(&src, dbl);
+        double err = rel_error(&got.m[0][0], &dbl[0][0], 12);
+        if (err > worst)
+            worst = err;
+
+        pmdl_matrix34_invxpose(&src, &src);
+        TEST_CHECK(SAME(src.m, want.m, 12), "matrix34_invxpose case %u differs in place", c);
+    }
+    TEST_CHECK(worst <= INVXPOSE_TOLERANCE, "matrix34_invxpose relative error %g", worst);
+    printf("inverse transpose: worst relative error %.3g\n", worst);
+
+    // Singular input leaves the destination untouched
+    pspl_matrix34_t sing = {.m = {{1,2,3,0},{2,4,6,0},{0,0,1,0}}};
+    pspl_matrix34_t dst = {.m = {{7,7,7,7},{7,7,7,7},{7,7,7,7}}};
+    pspl_matrix34_t dst_copy = dst;
+    pmdl_matrix34_invxpose(&sing, &dst);
+    TEST_CHECK(SAME(dst.m, dst_copy.m, 12), "matrix34_invxpose wrote singular result");
+}
+
+static void check_quat() {
+    unsigned c;
+    double worst = 0.0;
+    for (c=0 ; c<CASE_COUNT ; ++c) {
+        pspl_vector4_t a, b, ab;
+        float want[4];
+        random_quat(&a);
+        random_quat(&b);
+        pmdl_quat_mul(&a, &b, &ab);
+        ref_quat_mul(a.f, b.f, want);
+        TEST_CHECK(SAME(ab.f, want, 4), "quat_mul case %u differs from reference", c);
+        pmdl_quat_mul(&a, &b, &a);
+        TEST_CHECK(SAME(a.f, want, 4), "quat_mul case %u differs in place", c);
+
+        // Rotation part only; location column is preserved
+        pspl_matrix34_t m, want_m;
+        double dbl[3][4];
+        random_matrix34(&m);
+        want_m = m;
+        pmdl_matrix34_quat(&m, &b);
+        ref_matrix34_quat(&want_m, b.f);
+        TEST_CHECK(SAME(m.m, want_m.m, 12), "matrix34_quat case %u differs from reference", c);
+        dbl_matrix34_quat(b.f, dbl);
+        dbl[0][3] = want_m.m[0][3];
+        dbl[1][3] = want_m.m[1][3];
+        dbl[2][3] = want_m.m[2][3];
+        double err = rel_error(&m.m[0][0], &dbl[0][0], 12);
+        if (err > worst)
+            worst = err;
+    }
+    TEST_CHECK(worst <= QUAT_TOLERANCE, "matrix34_quat relative error %g", worst);
+    printf("quaternion matrix: worst relative error %.3g\n", worst);
+}
+
+static void check_vector() {
+    unsigned c;
+    for (c=0 ; c<CASE_COUNT ; ++c) {
+        pspl_matrix34_t m;
+        pspl_vector3_t v, got;
+        float want[3];
+        random_matrix34(&m);
+        v.f[0] = test_rand(-100.0f, 100.0f);
+        v.f[1] = test_rand(-100.0f, 100.0f);
+        v.f[2] = test_rand(-100.0f, 100.0f);
+        pmdl_vector3_matrix_mul(&m, &v, &got);
+        ref_vector3_matrix_mul(&m, v.f, want);
+        TEST_CHECK(SAME(got.f, want, 3), "vector3_matrix_mul case %u differs from reference", c);
+    }
+}
+
+/* Batches must equal single calls element for element, for every remainder
+ * length and in place */
+static void check_batch() {
+    static pspl_matrix34_t a_arr[BATCH_COUNT], ab_arr[BATCH_COUNT];
+    static float src[BATCH_COUNT*3+1], dst[BATCH_COUNT*3+1];
+    pspl_matrix34_t b;
+    unsigned i, count;
+    random_matrix34(&b);
+    for (i=0 ; i<BATCH_COUNT ; ++i)
+        random_matrix34(&a_arr[i]);
+    for (i=0 ; i<BATCH_COUNT*3 ; ++i)
+        src[i] = test_rand(-100.0f, 100.0f);
+
+    for (count=BATCH_COUNT-4 ; count<=BATCH_COUNT ; ++count) {
+
+        // Guard element past the end stays untouched
+        dst[count*3] = 12345.0f;
+        pmdl_matrix34_mul_batch(a_arr, &b, ab_arr, count);
+        pmdl_vector3_matrix_mul_batch(&b, src, dst, count);
+        for (i=0 ; i<count ; ++i) {
+            pspl_matrix34_t want;
+            float want_v[3];
+            pmdl_matrix34_mul(&a_arr[i], &b, &want);
+            TEST_CHECK(SAME(ab_arr[i].m, want.m, 12), "matrix34_mul_batch[%u] of %u differs", i, count);
+            ref_vector3_matrix_mul(&b, &src[i*3], want_v);
+            TEST_CHECK(SAME(&dst[i*3], want_v, 3), "vector3_matrix_mul_batch[%u] of %u differs", i, count);
+        }
+        TEST_CHECK(dst[count*3] == 12345.0f, "vector3_matrix_mul_batch of %u overran", count);
+    }
+
+    // In place
+    memcpy(ab_arr, a_arr, sizeof(a_arr));
+    pmdl_matrix34_mul_batch(ab_arr, &b, ab_arr, BATCH_COUNT);
+    memcpy(dst, src, sizeof(src));
+    pmdl_vector3_matrix_mul_batch(&b, dst, dst, BATCH_COUNT);
+    for (i=0 ; i<BATCH_COUNT ; ++i) {
+        pspl_matrix34_t want;
+        float want_v[3];
+        pmdl_matrix34_mul(&a_arr[i], &b, &want);
+        TEST_CHECK(SAME(ab_arr[i].m, want.m, 12), "matrix34_mul_batch[%u] differs in place", i);
+        ref_vector3_matrix_mul(&b, &src[i*3], want_v);
+        TEST_CHECK(SAME(&dst[i*3], want_v, 3), "vector3_matrix_mul_batch[%u] differs in place", i);
+    }
+}
+
+#pragma mark Benchmark
+
+#define BENCH_ROUNDS 2000
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Timings only; never fails */
+static void bench() {
+    static pspl_matrix34_t a_arr[BATCH_COUNT], ab_arr[BATCH_COUNT];
+    static float src[BATCH_COUNT*3], dst[BATCH_COUNT*3];
+    pspl_matrix34_t b;
+    unsigned r, i;
+    double t, t_ref, t_single, t_batch;
+    random_matrix34(&b);
+    for (i=0 ; i<BATCH_COUNT ; ++i)
+        random_matrix34(&a_arr[i]);
+    for (i=0 ; i<BATCH_COUNT*3 ; ++i)
+        src[i] = test_rand(-100.0f, 100.0f);
+
+    t = now();
+    for (r=0 ; r<BENCH_ROUNDS ; ++r)
+        for (i=0 ; i<BATCH_COUNT ; ++i)
+            ref_matrix34_mul(&a_arr[i], &b, &ab_arr[i]);
+    t_ref = now() - t;
+    t = now();
+    for (r=0 ; r<BENCH_ROUNDS ; ++r)
+        for (i=0 ; i<BATCH_COUNT ; ++i)
+            pmdl_matrix34_mul(&a_arr[i], &b, &ab_arr[i]);
+    t_single = now() - t;
+    t = now();
+    for (r=0 ; r<BENCH_ROUNDS ; ++r)
+        pmdl_matrix34_mul_batch(a_arr, &b, ab_arr, BATCH_COUNT);
+    t_batch = now() - t;
+    printf("matrix34_mul x%u: reference %.3fs, single %.3fs, batch %.3fs (%.2fx)\n",
+           BENCH_ROUNDS*BATCH_COUNT, t_ref, t_single, t_batch, t_ref / t_batch);
+
+    t = now();
+    for (r=0 ; r<BENCH_ROUNDS ; ++r)
+        for (i=0 ; i<BATCH_COUNT ; ++i)
+            ref_vector3_matrix_mul(&b, &src[i*3], &dst[i*3]);
+    t_ref = now() - t;
+    t = now();
+    for (r=0 ; r<BENCH_ROUNDS ; ++r)
+        pmdl_vector3_matrix_mul_batch(&b, src, dst, BATCH_COUNT);
+    t_batch = now() - t;
+    printf("vector3_matrix_mul x%u: reference %.3fs, batch %.3fs (%.2fx)\n",
+           BENCH_ROUNDS*BATCH_COUNT, t_ref, t_batch, t_ref / t_batch);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench();
+        return 0;
+    }
+
+    check_matrix_mul();
+    check_invxpose();
+    check_quat();
+    check_vector();
+    check_batch();
+
+    if (test_failures)
+        fprintf(stderr, "%u linear algebra check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
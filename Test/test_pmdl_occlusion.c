@@ -0,0 +1,170 @@
+//
+//  test_pmdl_occlusion.c
+//  PSPL
+//
+//  Checks the software occlusion rasteriser, its hierarchical depth level
+//  and AABB queries for full, partial and near-plane-crossing coverage
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "test_pmdl.h"
+
+/* 90-degree square frustum into a 64x64 buffer; view X and Y of +-w map to
+ * the buffer edges, and depth is 1/w */
+#define BUF_SIZE 64
+#define TILE 8
+
+/* Occluder plane distance */
+#define OCC_Z (-10.0f)
+
+static pmdl_occlusion_buffer buf;
+static pmdl_draw_ctx* ctx;
+
+/* Rasterise view-aligned quad [x0,x1]x[y0,y1] at depth `z` as two triangles */
+static void add_quad(float x0, float x1, float y0, float y1, float z) {
+    float pos[4][3] = {{x0,y0,z}, {x1,y0,z}, {x1,y1,z}, {x0,y1,z}};
+    uint16_t idx[6] = {0,1,2, 0,2,3};
+    pmdl_occlusion_add_triangles(&buf, ctx, &pos[0][0], sizeof(pos[0]), idx, 2);
+}
+
+static int box_visible(float x0, float y0, float z0, float x1, float y1, float z1) {
+    float aabb[2][3] = {{x0,y0,z0}, {x1,y1,z1}};
+    return pmdl_occlusion_test_aabb(&buf, ctx, aabb);
+}
+
+/* Every tile holds the farthest depth of its pixels */
+static void check_tiles(const char* name) {
+    unsigned tx,ty,x,y;
+    for (ty=0 ; ty<buf.tiles_y ; ++ty) {
+        for (tx=0 ; tx<buf.tiles_x ; ++tx) {
+            float farthest = FLT_MAX;
+            for (y=ty*TILE ; y<(ty+1)*TILE ; ++y)
+                for (x=tx*TILE ; x<(tx+1)*TILE ; ++x)
+                    farthest = fminf(farthest, buf.depth_arr[y*buf.width+x]);
+            TEST_CHECK(buf.tile_depth_arr[ty*buf.tiles_x+tx] == farthest,
+                       "%s: tile %u,%u holds %g (farthest pixel %g)", name, tx, ty,
+                       buf.tile_depth_arr[ty*buf.tiles_x+tx], farthest);
+        }
+    }
+}
+
+/* Count pixels matching coverage predicate; covered pixels must hold the
+ * occluder's depth, uncovered ones the clear depth */
+static unsigned check_coverage(const char* name, float depth, int (*covered)(unsigned x, unsigned y)) {
+    unsigned x,y,bad = 0;
+    for (y=0 ; y<buf.height ; ++y) {
+        for (x=0 ; x<buf.width ; ++x) {
+            float d = buf.depth_arr[y*buf.width+x];
+            if (covered(x, y) ? !(fabsf(d - depth) <= 1e-6f) : (d != -FLT_MAX))
+                ++bad;
+        }
+    }
+    TEST_CHECK(!bad, "%s: %u pixel(s) with wrong depth", name, bad);
+    return bad;
+}
+
+static int cover_all(unsigned x, unsigned y) {return 1;}
+static int cover_left(unsigned x, unsigned y) {return x < BUF_SIZE/2;}
+static int cover_none(unsigned x, unsigned y) {return 0;}
+
+/* Occluder covering the whole screen */
+static void check_full_screen() {
+    pmdl_occlusion_begin(&buf, ctx);
+    add_quad(-1000.0f, 1000.0f, -1000.0f, 1000.0f, OCC_Z);
+    pmdl_occlusion_end(&buf);
+    check_coverage("full screen", -1.0f / OCC_Z, cover_all);
+    check_tiles("full screen");
+
+    TEST_CHECK(!box_visible(-1,-1,-20, 1,1,-15), "full screen: box behind occluder visible");
+    TEST_CHECK(!box_visible(-200,-1,-20, 0,1,-15), "full screen: box leaving screen behind occluder visible");
+    TEST_CHECK(!box_visible(-1,-1,-20, 1,1,-10.5f), "full screen: box just behind occluder visible");
+    TEST_CHECK(box_visible(-1,-1,-8, 1,1,-5), "full screen: box in front of occluder hidden");
+    TEST_CHECK(box_visible(-1,-1,-20, 1,1,-5), "full screen: box through occluder hidden");
+
+    // Offscreen boxes are left to the frustum test
+    TEST_CHECK(box_visible(50,50,-20, 60,60,-15), "full screen: offscreen box reported hidden");
+}
+
+/* Occluder covering the left half of the screen */
+static void check_partial() {
+    pmdl_occlusion_begin(&buf, ctx);
+    add_quad(-1000.0f, 0.0f, -1000.0f, 1000.0f, OCC_Z);
+    pmdl_occlusion_end(&buf);
+    check_coverage("left half", -1.0f / OCC_Z, cover_left);
+    check_tiles("left half");
+
+    TEST_CHECK(!box_visible(-3,-1,-20, -1,1,-15), "left half: box behind covered half visible");
+    TEST_CHECK(box_visible(-1,-1,-20, 1,1,-15), "left half: box straddling cover edge hidden");
+    TEST_CHECK(box_visible(1,-1,-20, 3,1,-15), "left half: box behind uncovered half hidden");
+    TEST_CHECK(box_visible(-3,-1,-8, -1,1,-5), "left half: box in front of occluder hidden");
+
+    // A gap straddling a tile boundary leaves both tiles partly covered,
+    // so boxes behind it are resolved per pixel
+    pmdl_occlusion_begin(&buf, ctx);
+    add_quad(-1000.0f, -0.5f, -1000.0f, 1000.0f, OCC_Z);
+    add_quad(0.5f, 1000.0f, -1000.0f, 1000.0f, OCC_Z);
+    pmdl_occlusion_end(&buf);
+    check_tiles("split cover");
+    TEST_CHECK(box_visible(-0.5f,-0.5f,-20, 0.5f,0.5f,-15), "split cover: box behind gap hidden");
+    TEST_CHECK(!box_visible(-4,-1,-20, -2,1,-15), "split cover: box behind left cover visible");
+}
+
+/* Geometry crossing the near plane (at w=1) */
+static void check_near_plane() {
+
+    // Queried boxes reaching the near plane are always visible
+    pmdl_occlusion_begin(&buf, ctx);
+    add_quad(-1000.0f, 1000.0f, -1000.0f, 1000.0f, OCC_Z);
+    pmdl_occlusion_end(&buf);
+    TEST_CHECK(box_visible(-1,-1,-20, 1,1,-0.5f), "near plane: crossing box hidden");
+    TEST_CHECK(box_visible(-1,-1,-0.9f, 1,1,-0.5f), "near plane: box before near plane hidden");
+
+    // Occluder faces crossing the near plane are skipped; only the
+    // solid box's far face (wholly beyond the near plane) is drawn
+    float occ_aabb[2][3] = {{-1000,-1000,-30}, {1000,1000,-0.5f}};
+    pmdl_occlusion_begin(&buf, ctx);
+    pmdl_occlusion_add_aabb(&buf, ctx, occ_aabb);
+    pmdl_occlusion_end(&buf);
+    check_coverage("crossing occluder", 1.0f / 30.0f, cover_all);
+    check_tiles("crossing occluder");
+    TEST_CHECK(box_visible(-1,-1,-20, 1,1,-15), "crossing occluder: box inside occluder hidden");
+    TEST_CHECK(!box_visible(-1,-1,-50, 1,1,-40), "crossing occluder: box behind far face visible");
+
+    // Occluder triangles with any vertex before the near plane draw nothing
+    pmdl_occlusion_begin(&buf, ctx);
+    float pos[3][3] = {{-1000,-1000,-5}, {1000,-1000,-5}, {0,1000,-0.5f}};
+    uint16_t idx[3] = {0,1,2};
+    pmdl_occlusion_add_triangles(&buf, ctx, &pos[0][0], sizeof(pos[0]), idx, 1);
+    pmdl_occlusion_end(&buf);
+    check_coverage("crossing triangle", 0.0f, cover_none);
+    TEST_CHECK(box_visible(-1,-1,-20, 1,1,-15), "crossing triangle: box hidden");
+
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    ctx = test_view_space_ctx(90.0f, 1.0f, 1.0f, 100.0f);
+    if (pmdl_occlusion_buffer_init(&buf, BUF_SIZE, BUF_SIZE)) {
+        fprintf(stderr, "unable to init occlusion buffer\n");
+        return 1;
+    }
+
+    check_full_screen();
+    check_partial();
+    check_near_plane();
+
+    pmdl_occlusion_buffer_destroy(&buf);
+    pmdl_free_draw_context(ctx);
+
+    if (test_failures)
+        fprintf(stderr, "%u occlusion check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,327 @@
+//
+//  test_pmdl_optimiser.c
+//  PSPL
+//
+//  Runs the toolchain's vertex-cache optimisation pass over a General PAR0
+//  file of strip, shuffled-list and fan meshes; checks drawn triangles are
+//  kept, vertices are renumbered by first use and the ACMR of the drawn
+//  triangle lists (by an independent FIFO count) is reduced
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <PSPLRuntime.h>
+#include "PMDLCommon.h"
+#include "PMDLToolchainOptimiser.h"
+#include "test_pmdl.h"
+
+#define PMDL_PATH "pmdl-optimiser-test.pmdl"
+
+/* FIFO size ACMR (average cache-miss ratio) is counted against */
+#define ACMR_FIFO_SIZE 16
+
+/* Strip grid, shuffled triangle-list grid and fan rim (vertices per side
+ * and rim vertex count); fans revisit their centre vertex, so they alone
+ * miss more often as decoded triangles than as raw elements */
+#define STRIP_GRID 12
+#define LIST_GRID 16
+#define FAN_RIM 100
+
+#define MESH_COUNT 3
+#define VERT_COUNT (STRIP_GRID*STRIP_GRID + LIST_GRID*LIST_GRID + FAN_RIM+1)
+#define MAX_ELEMS 4096
+#define MAX_PRIMS 64
+
+/* Position and normal (float layout without UVs or bones) */
+typedef struct {
+    float pos[3];
+    float norm[3];
+} opt_vert;
+
+/* Mesh header as laid out in a drawing index (see `pmdl_mesh_header`) */
+typedef struct {
+    float aabb[2][3];
+    int32_t shader_index;
+    const void* shader_pointer;
+} opt_mesh_header;
+
+static opt_vert verts[VERT_COUNT];
+static unsigned vert_count = 0;
+static uint16_t elems[MAX_ELEMS];
+static unsigned elem_count = 0;
+static pmdl_general_prim prims[MESH_COUNT][MAX_PRIMS];
+static unsigned prim_counts[MESH_COUNT];
+
+static uint16_t add_vert(float x, float y, float z) {
+    opt_vert* vert = &verts[vert_count];
+    vert->pos[0] = x; vert->pos[1] = y; vert->pos[2] = z;
+    vert->norm[0] = 0.0f; vert->norm[1] = 0.0f; vert->norm[2] = 1.0f;
+    return vert_count++;
+}
+
+static void begin_prim(unsigned mesh, uint32_t prim_type) {
+    pmdl_general_prim* prim = &prims[mesh][prim_counts[mesh]++];
+    prim->prim_type = prim_type;
+    prim->prim_start_idx = elem_count;
+    prim->prim_count = 0;
+}
+static void add_elem(unsigned mesh, uint16_t elem) {
+    elems[elem_count++] = elem;
+    ++prims[mesh][prim_counts[mesh]-1].prim_count;
+}
+
+static void build_meshes() {
+    unsigned r, c, i;
+
+    // One strip per grid row
+    uint16_t base = vert_count;
+    for (r=0 ; r<STRIP_GRID ; ++r)
+        for (c=0 ; c<STRIP_GRID ; ++c)
+            add_vert(c, r, 0.0f);
+    for (r=0 ; r+1<STRIP_GRID ; ++r) {
+        begin_prim(0, PMDL_TRIANGLE_STRIPS);
+        for (c=0 ; c<STRIP_GRID ; ++c) {
+            add_elem(0, base + (r+1)*STRIP_GRID + c);
+            add_elem(0, base + r*STRIP_GRID + c);
+        }
+    }
+
+    // Grid triangles in random order, each starting at a random corner
+    base = vert_count;
+    for (r=0 ; r<LIST_GRID ; ++r)
+        for (c=0 ; c<LIST_GRID ; ++c)
+            add_vert(c, r, 1.0f);
+    uint16_t tris[(LIST_GRID-1)*(LIST_GRID-1)*2][3];
+    unsigned tri_count = 0;
+    for (r=0 ; r+1<LIST_GRID ; ++r)
+        for (c=0 ; c+1<LIST_GRID ; ++c) {
+            uint16_t a = base + r*LIST_GRID + c, b = a+1, d = a+LIST_GRID, e = d+1;
+            uint16_t t0[3] = {a,b,e}, t1[3] = {a,e,d};
+            memcpy(tris[tri_count++], t0, sizeof(t0));
+            memcpy(tris[tri_count++], t1, sizeof(t1));
+        }
+    for (i=tri_count-1 ; i>0 ; --i) {
+        unsigned j = (unsigned)test_rand(0.0f, i + 0.999f);
+        uint16_t swap[3];
+        memcpy(swap, tris[i], sizeof(swap));
+        memcpy(tris[i], tris[j], sizeof(swap));
+        memcpy(tris[j], swap, sizeof(swap));
+    }
+    begin_prim(1, PMDL_TRIANGLES);
+    for (i=0 ; i<tri_count ; ++i) {
+        unsigned rot = (unsigned)test_rand(0.0f, 2.999f);
+        for (c=0 ; c<3 ; ++c)
+            add_elem(1, tris[i][(c+rot)%3]);
+    }
+
+    // Closed fan around a centre vertex
+    base = vert_count;
+    add_vert(0.0f, 0.0f, 2.0f);
+    for (i=0 ; i<FAN_RIM ; ++i)
+        add_vert(cosf(i * 6.2831853f / FAN_RIM), sinf(i * 6.2831853f / FAN_RIM), 2.0f);
+    begin_prim(2, PMDL_TRIANGLE_FANS);
+    for (i=0 ; i<=FAN_RIM+1 ; ++i)
+        add_elem(2, base + ((i) ? 1 + (i-1)%FAN_RIM : 0));
+}
+
+/* Lay out a General PAR0 file as the exporter does (headers, vertex buffer,
+ * element buffer, then the 32-aligned drawing index and shader table) */
+static size_t build_file(uint8_t* data) {
+    memset(data, 0, 65536);
+    pmdl_header* header = (pmdl_header*)data;
+    memcpy(header->magic, "PMDL", 4);
+    memcpy(header->endianness, "_LIT", 4);
+    header->pointer_size = sizeof(void*);
+    memcpy(header->sub_type_prefix, "PAR", 3);
+    header->sub_type_num = '0';
+    memcpy(header->draw_format, "_GEN", 4);
+    header->collection_offset = sizeof(pmdl_header);
+    header->collection_count = 1;
+
+    uint8_t* collection_buf = data + header->collection_offset;
+    pmdl_col_header* col_header = (pmdl_col_header*)collection_buf;
+    col_header->vert_buf_off = ROUND_UP_32(sizeof(pmdl_col_header));
+    col_header->vert_buf_len = sizeof(opt_vert) * vert_count;
+    col_header->elem_buf_off = col_header->vert_buf_off + col_header->vert_buf_len;
+    col_header->elem_buf_len = sizeof(uint16_t) * elem_count;
+    col_header->draw_idx_off = ROUND_UP_32(col_header->elem_buf_off + col_header->elem_buf_len);
+    memcpy(collection_buf + col_header->vert_buf_off, verts, col_header->vert_buf_len);
+    memcpy(collection_buf + col_header->elem_buf_off, elems, col_header->elem_buf_len);
+
+    uint8_t* index_buf = collection_buf + col_header->draw_idx_off;
+    ((uint32_t*)index_buf)[0] = MESH_COUNT;
+    ((uint32_t*)index_buf)[1] = 8 + sizeof(opt_mesh_header) * MESH_COUNT;
+    opt_mesh_header* mesh_heads = (opt_mesh_header*)(index_buf + 8);
+    uint8_t* cur = index_buf + ((uint32_t*)index_buf)[1] + sizeof(void*)*3;
+    unsigned m;
+    for (m=0 ; m<MESH_COUNT ; ++m) {
+        mesh_heads[m].shader_index = -1;
+        memcpy(cur, &prim_counts[m], sizeof(uint32_t));
+        memcpy(cur + sizeof(uint32_t), prims[m], sizeof(pmdl_general_prim) * prim_counts[m]);
+        cur += sizeof(uint32_t) + sizeof(pmdl_general_prim) * prim_counts[m];
+    }
+
+    header->shader_table_offset = cur - data;
+    return header->shader_table_offset + sizeof(uint32_t);
+}
+
+/* Decode primitive to triangle list (as drawn; degenerate triangles dropped) */
+static unsigned decode_prim(const pmdl_general_prim* prim, const uint16_t* elem_arr, uint16_t* tris_out) {
+    unsigned i, count = 0;
+    const uint16_t* src = &elem_arr[prim->prim_start_idx];
+    for (i=2 ; i<prim->prim_count ; ++i) {
+        uint16_t a, b, c = src[i];
+        if (prim->prim_type == PMDL_TRIANGLES) {
+            if (i % 3 != 2)
+                continue;
+            a = src[i-2]; b = src[i-1];
+        } else if (prim->prim_type == PMDL_TRIANGLE_STRIPS) {
+            a = (i & 1) ? src[i-1] : src[i-2];
+            b = (i & 1) ? src[i-2] : src[i-1];
+        } else {
+            a = src[0]; b = src[i-1];
+        }
+        if (a == b || b == c || a == c)
+            continue;
+        tris_out[count*3] = a; tris_out[count*3+1] = b; tris_out[count*3+2] = c;
+        ++count;
+    }
+    return count;
+}
+
+static unsigned fifo_misses(const uint16_t* tris, unsigned index_count) {
+    int fifo[ACMR_FIFO_SIZE];
+    unsigned i, j, head = 0, misses = 0;
+    for (i=0 ; i<ACMR_FIFO_SIZE ; ++i)
+        fifo[i] = -1;
+    for (i=0 ; i<index_count ; ++i) {
+        for (j=0 ; j<ACMR_FIFO_SIZE && fifo[j] != tris[i] ; ++j);
+        if (j == ACMR_FIFO_SIZE) {
+            fifo[head] = tris[i];
+            head = (head + 1) % ACMR_FIFO_SIZE;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+/* Drawn triangles of mesh by vertex position; each rotated to start at its
+ * least vertex (winding kept), then sorted */
+typedef struct {
+    float pos[3][3];
+} pos_tri;
+
+static int compare_floats(const float* a, const float* b, unsigned count) {
+    unsigned i;
+    for (i=0 ; i<count ; ++i)
+        if (a[i] != b[i])
+            return (a[i] < b[i]) ? -1 : 1;
+    return 0;
+}
+static int compare_tris(const void* a, const void* b) {
+    return compare_floats(&((const pos_tri*)a)->pos[0][0], &((const pos_tri*)b)->pos[0][0], 9);
+}
+
+static unsigned mesh_tris(const pmdl_general_prim* prim_arr, unsigned prim_count, const uint16_t* elem_arr,
+                          const opt_vert* vert_arr, pos_tri* tris_out, unsigned* misses_out) {
+    uint16_t tris[MAX_ELEMS*3];
+    unsigned p, t, k, count = 0;
+    for (p=0 ; p<prim_count ; ++p) {
+        unsigned prim_tris = decode_prim(&prim_arr[p], elem_arr, tris);
+        *misses_out += fifo_misses(tris, prim_tris*3);
+        for (t=0 ; t<prim_tris ; ++t, ++count) {
+            unsigned first = 0;
+            for (k=1 ; k<3 ; ++k)
+                if (compare_floats(vert_arr[tris[t*3+k]].pos, vert_arr[tris[t*3+first]].pos, 3) < 0)
+                    first = k;
+            for (k=0 ; k<3 ; ++k)
+                memcpy(tris_out[count].pos[k], vert_arr[tris[t*3+(first+k)%3]].pos, sizeof(float)*3);
+        }
+    }
+    qsort(tris_out, count, sizeof(pos_tri), compare_tris);
+    return count;
+}
+
+static uint8_t file_data[65536];
+static pos_tri tris_before[MESH_COUNT][MAX_ELEMS], tris_after[MAX_ELEMS];
+
+int main(int argc, char** argv) {
+    unsigned m, p, i;
+
+    build_meshes();
+    size_t file_len = build_file(file_data);
+    FILE* file = fopen(PMDL_PATH, "wb");
+    if (!file || fwrite(file_data, 1, file_len, file) != file_len) {
+        fprintf(stderr, "unable to write `%s`\n", PMDL_PATH);
+        return 1;
+    }
+    fclose(file);
+
+    // Reference triangles and FIFO misses before
+    unsigned tri_counts[MESH_COUNT], tri_total = 0, misses_before = 0;
+    for (m=0 ; m<MESH_COUNT ; ++m) {
+        tri_counts[m] = mesh_tris(prims[m], prim_counts[m], elems, verts, tris_before[m], &misses_before);
+        tri_total += tri_counts[m];
+    }
+
+    // Optimise
+    int result = pmdl_optimise_general(PMDL_PATH);
+    TEST_CHECK(result == 0, "optimisation pass returned %d", result);
+
+    // Read back
+    file = fopen(PMDL_PATH, "rb");
+    memset(file_data, 0, sizeof(file_data));
+    file_len = (file) ? fread(file_data, 1, sizeof(file_data), file) : 0;
+    if (file)
+        fclose(file);
+    pmdl_header* header = (pmdl_header*)file_data;
+    uint8_t* collection_buf = file_data + header->collection_offset;
+    pmdl_col_header* col_header = (pmdl_col_header*)collection_buf;
+    const opt_vert* new_verts = (const opt_vert*)(collection_buf + col_header->vert_buf_off);
+    const uint16_t* new_elems = (const uint16_t*)(collection_buf + col_header->elem_buf_off);
+    uint8_t* index_buf = collection_buf + col_header->draw_idx_off;
+    uint8_t* cur = index_buf + ((uint32_t*)index_buf)[1] + sizeof(void*)*3;
+    TEST_CHECK(file_len > sizeof(pmdl_header) && col_header->vert_buf_len == sizeof(opt_vert) * VERT_COUNT &&
+               ((uint32_t*)index_buf)[0] == MESH_COUNT, "optimised file layout changed");
+    if (test_failures)
+        return 1;
+
+    // Same drawn triangles per mesh, now as triangle lists
+    unsigned misses_after = 0;
+    for (m=0 ; m<MESH_COUNT ; ++m) {
+        uint32_t new_prim_count;
+        memcpy(&new_prim_count, cur, sizeof(uint32_t));
+        const pmdl_general_prim* new_prims = (const pmdl_general_prim*)(cur + sizeof(uint32_t));
+        cur += sizeof(uint32_t) + sizeof(pmdl_general_prim) * new_prim_count;
+        TEST_CHECK(new_prim_count == prim_counts[m], "mesh %u: %u primitives, was %u", m, new_prim_count, prim_counts[m]);
+        for (p=0 ; p<new_prim_count ; ++p)
+            TEST_CHECK(new_prims[p].prim_type == PMDL_TRIANGLES, "mesh %u: primitive %u not a triangle list", m, p);
+
+        unsigned count = mesh_tris(new_prims, new_prim_count, new_elems, new_verts, tris_after, &misses_after);
+        TEST_CHECK(count == tri_counts[m] && !memcmp(tris_after, tris_before[m], sizeof(pos_tri) * count),
+                   "mesh %u: drawn triangles differ (%u, was %u)", m, count, tri_counts[m]);
+    }
+
+    // Vertices numbered in order of first use
+    unsigned next_vert = 0;
+    for (i=0 ; i<col_header->elem_buf_len/sizeof(uint16_t) ; ++i) {
+        TEST_CHECK(new_elems[i] <= next_vert, "element %u fetches vertex %u before %u", i, new_elems[i], next_vert);
+        if (new_elems[i] == next_vert)
+            ++next_vert;
+    }
+
+    // ACMR of the drawn triangle lists
+    float acmr_before = misses_before / (float)tri_total;
+    float acmr_after = misses_after / (float)tri_total;
+    TEST_CHECK(acmr_after < acmr_before, "ACMR %.3f not reduced from %.3f", acmr_after, acmr_before);
+    printf("vertex cache: ACMR %.3f -> %.3f\n", acmr_before, acmr_after);
+
+    remove(PMDL_PATH);
+
+    if (test_failures)
+        fprintf(stderr, "%u optimiser check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,220 @@
+//
+//  test_pmdl_queue.c
+//  PSPL
+//
+//  Checks the deferred render queue's sorted order (shader, collection
+//  buffer, then front-to-back) and state-change counts, flushing in-memory
+//  models through the draw recorder
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLCommon.h"
+#include "PMDLRuntimeProcessing.h"
+#include "test_pmdl.h"
+
+#define MODEL_COUNT 3
+#define COLLECTION_COUNT 2
+#define MESH_COUNT 8
+#define SHADER_COUNT 3
+#define RECORD_CAP (MODEL_COUNT*COLLECTION_COUNT*MESH_COUNT)
+
+/* Stand-ins for shader objects; the queue only compares and hashes their
+ * addresses while recording */
+static pspl_runtime_psplc_t shaders[SHADER_COUNT];
+
+static test_model models[MODEL_COUNT];
+static pmdl_draw_ctx* model_ctxs[MODEL_COUNT];
+
+static pmdl_draw_record record_arr[RECORD_CAP];
+static pmdl_draw_recorder recorder = {0, RECORD_CAP, record_arr};
+
+/* Meshes scattered ahead of the camera (every seventh behind it); every
+ * fifth mesh has no shader, taking its context's default */
+static void build_models() {
+    static const unsigned mesh_counts[COLLECTION_COUNT] = {MESH_COUNT, MESH_COUNT};
+    float aabbs[COLLECTION_COUNT*MESH_COUNT][2][3];
+    unsigned m, c, j;
+    int i;
+    for (m=0 ; m<MODEL_COUNT ; ++m) {
+        for (j=0 ; j<COLLECTION_COUNT*MESH_COUNT ; ++j) {
+            float centre[3] = {test_rand(-3.0f, 3.0f), test_rand(-3.0f, 3.0f), test_rand(-60.0f, -5.0f)};
+            if (!(j % 7))
+                centre[2] = test_rand(15.0f, 20.0f);
+            for (i=0 ; i<3 ; ++i) {
+                aabbs[j][0][i] = centre[i] - 0.5f;
+                aabbs[j][1][i] = centre[i] + 0.5f;
+            }
+        }
+        if (test_model_init(&models[m], '0', COLLECTION_COUNT, mesh_counts, aabbs, NULL, 0)) {
+            fprintf(stderr, "unable to init test models\n");
+            exit(1);
+        }
+        for (c=0 ; c<COLLECTION_COUNT ; ++c) {
+            test_mesh_header* mesh_heads = test_model_meshes(&models[m], c);
+            for (j=0 ; j<MESH_COUNT ; ++j)
+                mesh_heads[j].shader_pointer = ((j+c) % 5) ? &shaders[(m+c+j) % SHADER_COUNT] : NULL;
+        }
+    }
+}
+
+/* Packet properties the sort and bind counting act on */
+typedef struct {
+    const pspl_runtime_psplc_t* shader;
+    const void* buffer;
+    const pmdl_draw_ctx* ctx;
+    float depth;
+} packet_state;
+
+static packet_state record_state(const pmdl_draw_record* record) {
+    unsigned m = 0;
+    while (record->pmdl != &models[m].pmdl)
+        ++m;
+    const test_mesh_header* mesh_head = &test_model_meshes(&models[m], record->collection_idx)[record->mesh_idx];
+    const pmdl_draw_ctx* ctx = model_ctxs[m];
+    packet_state state = {
+        .shader = (mesh_head->shader_pointer) ? mesh_head->shader_pointer : ctx->default_shader,
+        .buffer = test_model_meshes(&models[m], record->collection_idx),
+        .ctx = ctx,
+        .depth = -((mesh_head->aabb[0][2] + mesh_head->aabb[1][2]) * 0.5f + ctx->model_mtx.m[2][3])
+    };
+    return state;
+}
+
+/* Collection buffers share a sort group when their 12-bit key hashes
+ * collide (`QUEUE_BUFFER_BITS`); grouping is only checked without collisions */
+static uint64_t buffer_key(const test_model* model, unsigned collection_idx) {
+    const pmdl_header* header = (const pmdl_header*)model->data;
+    const void* collection_header = model->data + header->collection_offset + sizeof(pmdl_col_header)*collection_idx;
+    return ((uint64_t)(uintptr_t)collection_header * 0x9E3779B97F4A7C15ull) >> (64 - 12);
+}
+static int buffer_keys_collide() {
+    unsigned a, b;
+    for (a=0 ; a<MODEL_COUNT*COLLECTION_COUNT ; ++a)
+        for (b=a+1 ; b<MODEL_COUNT*COLLECTION_COUNT ; ++b)
+            if (buffer_key(&models[a/COLLECTION_COUNT], a%COLLECTION_COUNT) ==
+                buffer_key(&models[b/COLLECTION_COUNT], b%COLLECTION_COUNT))
+                return 1;
+    return 0;
+}
+
+/* Submit every model, flush and check the recorded order against the stats
+ * (which are returned) */
+static pmdl_queue_stats check_flush(const char* name) {
+    unsigned m, c, j, i, k;
+    unsigned visible = 0;
+    for (m=0 ; m<MODEL_COUNT ; ++m) {
+        pmdl_submit(model_ctxs[m], &models[m].pmdl);
+        for (c=0 ; c<COLLECTION_COUNT ; ++c)
+            for (j=0 ; j<MESH_COUNT ; ++j)
+                visible += test_model_meshes(&models[m], c)[j].aabb[1][2] + model_ctxs[m]->model_mtx.m[2][3] < 0.0f;
+    }
+
+    pmdl_queue_stats stats;
+    recorder.record_count = 0;
+    pmdl_flush_queue(&stats);
+    unsigned count = recorder.record_count;
+    TEST_CHECK(count == visible, "%s: %u meshes recorded, want %u", name, count, visible);
+    TEST_CHECK(stats.packet_count == count, "%s: %u packets, %u recorded", name, stats.packet_count, count);
+    if (count > RECORD_CAP)
+        return stats;
+
+    // Each visible mesh once
+    for (i=0 ; i<count ; ++i)
+        for (k=i+1 ; k<count ; ++k)
+            TEST_CHECK(record_arr[i].pmdl != record_arr[k].pmdl ||
+                       record_arr[i].collection_idx != record_arr[k].collection_idx ||
+                       record_arr[i].mesh_idx != record_arr[k].mesh_idx, "%s: records %u and %u repeat", name, i, k);
+
+    // State changes along the recorded order, and distinct groups
+    packet_state states[RECORD_CAP];
+    unsigned shader_changes = 0, buffer_changes = 0, ctx_loads = 0;
+    unsigned shader_groups = 0, buffer_groups = 0;
+    for (i=0 ; i<count ; ++i) {
+        states[i] = record_state(&record_arr[i]);
+        int shader_changed = !i || states[i].shader != states[i-1].shader;
+        int buffer_changed = !i || states[i].buffer != states[i-1].buffer;
+        shader_changes += shader_changed;
+        buffer_changes += buffer_changed;
+        ctx_loads += shader_changed || states[i].ctx != states[i-1].ctx;
+
+        int new_shader = 1, new_buffer = 1;
+        for (k=0 ; k<i ; ++k) {
+            if (states[k].shader == states[i].shader) {
+                new_shader = 0;
+                if (states[k].buffer == states[i].buffer)
+                    new_buffer = 0;
+            }
+        }
+        shader_groups += new_shader;
+        buffer_groups += new_buffer;
+
+        // Front-to-back within a shader and buffer
+        if (!shader_changed && !buffer_changed)
+            TEST_CHECK(states[i].depth >= states[i-1].depth, "%s: record %u at depth %g after %g",
+                       name, i, states[i].depth, states[i-1].depth);
+    }
+    TEST_CHECK(stats.shader_binds == shader_changes, "%s: %u shader binds, %u changes recorded",
+               name, stats.shader_binds, shader_changes);
+    TEST_CHECK(stats.buffer_binds == buffer_changes, "%s: %u buffer binds, %u changes recorded",
+               name, stats.buffer_binds, buffer_changes);
+    TEST_CHECK(stats.context_loads == ctx_loads, "%s: %u context loads, %u changes recorded",
+               name, stats.context_loads, ctx_loads);
+
+    // Each shader bound once; each of its buffers bound once
+    TEST_CHECK(shader_changes == shader_groups, "%s: %u shader binds for %u shaders",
+               name, shader_changes, shader_groups);
+    if (!buffer_keys_collide())
+        TEST_CHECK(buffer_changes == buffer_groups, "%s: %u buffer binds for %u shader and buffer pairs",
+                   name, buffer_changes, buffer_groups);
+
+    // The queue is left empty
+    pmdl_queue_stats empty_stats;
+    pmdl_flush_queue(&empty_stats);
+    TEST_CHECK(empty_stats.packet_count == 0 && empty_stats.shader_binds == 0, "%s: queue not emptied", name);
+    return stats;
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    build_models();
+
+    // Two contexts; the second is moved back, with a default shader
+    pmdl_draw_ctx* ctx_a = test_view_space_ctx(60.0f, 1.0f, 1.0f, 100.0f);
+    pmdl_draw_ctx* ctx_b = test_view_space_ctx(60.0f, 1.0f, 1.0f, 100.0f);
+    ctx_b->model_mtx.m[2][3] = -10.0f;
+    pmdl_update_context(ctx_b, PMDL_INVALIDATE_MODEL);
+    ctx_b->default_shader = &shaders[1];
+
+    pmdl_set_draw_recorder(&recorder);
+
+    model_ctxs[0] = model_ctxs[1] = model_ctxs[2] = ctx_a;
+    check_flush("one context");
+    model_ctxs[1] = ctx_b;
+    check_flush("two contexts");
+    
+    // Both contexts sharing one shader; the shader is bound once, but each
+    // context reloads its state within the shader group
+    unsigned m, c, j;
+    for (m=0 ; m<MODEL_COUNT ; ++m)
+        for (c=0 ; c<COLLECTION_COUNT ; ++c)
+            for (j=0 ; j<MESH_COUNT ; ++j)
+                test_model_meshes(&models[m], c)[j].shader_pointer = &shaders[0];
+    pmdl_queue_stats stats = check_flush("shared shader");
+    TEST_CHECK(stats.shader_binds == 1 && stats.context_loads >= 2,
+               "shared shader: %u shader binds and %u context loads, want 1 and at least 2",
+               stats.shader_binds, stats.context_loads);
+
+    pmdl_set_draw_recorder(NULL);
+    pmdl_free_draw_context(ctx_a);
+    pmdl_free_draw_context(ctx_b);
+
+    if (test_failures)
+        fprintf(stderr, "%u queue check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
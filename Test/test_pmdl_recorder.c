@@ -0,0 +1,305 @@
+//
+//  test_pmdl_recorder.c
+//  PSPL
+//
+//  Replays headless draws of in-memory PAR0 and PAR2 models through the
+//  draw recorder, checking the recorded meshes against per-mesh frustum,
+//  octree and per-instance culling expectations, and the recorded levels
+//  against level-of-detail selection
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLCommon.h"
+#include "PMDLRuntimeProcessing.h"
+#include "test_pmdl.h"
+
+#define RECORD_CAP 32
+
+static pmdl_draw_record record_arr[RECORD_CAP+1];
+static pmdl_draw_recorder recorder = {0, RECORD_CAP, record_arr};
+
+static test_model par0_model, par2_model, lod_models[2];
+
+/* PAR0 meshes (60-degree square frustum from the origin down -Z, near 1,
+ * far 100); collection 0 then collection 1 */
+static const unsigned PAR0_MESH_COUNTS[] = {4, 2};
+static float par0_aabbs[][2][3] = {
+    {{-1,-1,-12}, {1,1,-8}},         // Ahead
+    {{-1,-1,2}, {1,1,8}},            // Behind camera
+    {{-101,-1,-12}, {-99,1,-8}},     // Far left
+    {{-7,-1,-12}, {-5,1,-8}},        // Straddling left plane
+    {{-1,-1,-150}, {1,1,-120}},      // Beyond far plane
+    {{-5,-5,-55}, {5,5,-45}}         // Ahead, further
+};
+
+/* PAR2 octree; the root splits the master AABB ([-100,20] x [-5,5] x
+ * [-25,-15]) at X=-40. Leaf 0 (low octant, outside the frustum) and leaf 4
+ * (high-X octant) both reference the mesh spanning the split. Root node
+ * (children 0 and 4 of type 2, leaf), then the two leaves */
+static const uint32_t PAR2_OCTREE[] = {
+    (2 << 0) | (2 << 8), 12, 32,
+    2, 0,0, 0,2,
+    3, 0,1, 0,2, 1,0
+};
+static const unsigned PAR2_MESH_COUNTS[] = {3, 1};
+static float par2_aabbs[][2][3] = {
+    {{-100,-5,-25}, {-60,0,-20}},
+    {{-10,-5,-25}, {20,0,-20}},
+    {{-50,-5,-25}, {-30,5,-15}},
+    {{-30,0,-20}, {10,5,-15}}
+};
+
+typedef struct {
+    unsigned collection_idx, mesh_idx;
+} expected_record;
+
+/* Replay must have recorded exactly `expected` (in order) */
+static void check_records(const char* name, const pmdl_t* pmdl,
+                          const expected_record* expected, unsigned count) {
+    TEST_CHECK(recorder.record_count == count, "%s: %u records, want %u", name, recorder.record_count, count);
+    unsigned i;
+    for (i=0 ; i<count && i<recorder.record_count ; ++i) {
+        const pmdl_draw_record* record = &record_arr[i];
+        TEST_CHECK(record->pmdl == pmdl && record->lod_level == 0, "%s: record %u model or level wrong", name, i);
+        TEST_CHECK(record->collection_idx == expected[i].collection_idx && record->mesh_idx == expected[i].mesh_idx,
+                   "%s: record %u is mesh %u,%u, want %u,%u", name, i, record->collection_idx, record->mesh_idx,
+                   expected[i].collection_idx, expected[i].mesh_idx);
+    }
+    recorder.record_count = 0;
+}
+
+static void set_model_z(pmdl_draw_ctx* ctx, float z) {
+    ctx->model_mtx.m[2][3] = z;
+    pmdl_update_context(ctx, PMDL_INVALIDATE_MODEL);
+}
+
+static void check_par0(pmdl_draw_ctx* ctx) {
+    const pmdl_t* pmdl = &par0_model.pmdl;
+
+    // Per-mesh frustum culling, in collection and mesh order
+    static const expected_record visible[] = {{0,0}, {0,3}, {1,1}};
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR0", pmdl, visible, 3);
+
+    // Moving the model behind the camera culls it by master AABB
+    set_model_z(ctx, 200.0f);
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR0 behind camera", pmdl, NULL, 0);
+    set_model_z(ctx, 0.0f);
+
+    // Records past capacity are counted, but not written
+    memset(record_arr, 0xff, sizeof(record_arr));
+    recorder.record_cap = 2;
+    pmdl_draw(ctx, pmdl);
+    TEST_CHECK(recorder.record_count == 3, "capped: %u records counted, want 3", recorder.record_count);
+    TEST_CHECK(record_arr[1].collection_idx == 0 && record_arr[1].mesh_idx == 3, "capped: second record wrong");
+    TEST_CHECK(record_arr[2].pmdl == (const pmdl_t*)(uintptr_t)-1, "capped: record written past capacity");
+    recorder.record_cap = RECORD_CAP;
+    recorder.record_count = 0;
+}
+
+static void check_par0_instanced(pmdl_draw_ctx* ctx) {
+    const pmdl_t* pmdl = &par0_model.pmdl;
+
+    // Model in place, moved off to the side (culled whole) and moved
+    // 20 ahead (bringing the mesh behind the camera into view)
+    pspl_matrix34_t instance_mtxs[3];
+    memset(instance_mtxs, 0, sizeof(instance_mtxs));
+    unsigned i;
+    for (i=0 ; i<3 ; ++i) {
+        instance_mtxs[i].m[0][0] = 1;
+        instance_mtxs[i].m[1][1] = 1;
+        instance_mtxs[i].m[2][2] = 1;
+    }
+    instance_mtxs[1].m[0][3] = 1000.0f;
+    instance_mtxs[2].m[2][3] = -20.0f;
+
+    // Meshes are recorded once per instance they are visible in
+    static const expected_record visible[] = {{0,0}, {0,0}, {0,1}, {0,3}, {0,3}, {1,1}, {1,1}};
+    pmdl_draw_instanced(ctx, pmdl, instance_mtxs, 3);
+    check_records("PAR0 instanced", pmdl, visible, 7);
+
+    // Other sub-types replay one draw per instance
+    static const expected_record par2_visible[] = {{0,1}, {0,2}, {1,0}, {0,1}, {0,2}, {1,0}};
+    pmdl_draw_instanced(ctx, &par2_model.pmdl, instance_mtxs, 2);
+    check_records("PAR2 instanced", &par2_model.pmdl, par2_visible, 3);
+    instance_mtxs[1].m[0][3] = 0.0f;
+    pmdl_draw_instanced(ctx, &par2_model.pmdl, instance_mtxs, 2);
+    check_records("PAR2 instanced twice", &par2_model.pmdl, par2_visible, 6);
+}
+
+static void check_par2(pmdl_draw_ctx* ctx) {
+    const pmdl_t* pmdl = &par2_model.pmdl;
+
+    // Meshes of the visible leaf only; the mesh shared by both leaves is
+    // recorded once, and draw bits are reset for the next draw
+    static const expected_record visible[] = {{0,1}, {0,2}, {1,0}};
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR2", pmdl, visible, 3);
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR2 redrawn", pmdl, visible, 3);
+
+    unsigned c, m;
+    for (c=0 ; c<2 ; ++c)
+        for (m=0 ; m<PAR2_MESH_COUNTS[c] ; ++m)
+            TEST_CHECK(test_model_meshes(&par2_model, c)[m].shader_index >= 0,
+                       "PAR2: mesh %u,%u draw bit left set", c, m);
+
+    set_model_z(ctx, 200.0f);
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR2 behind camera", pmdl, NULL, 0);
+    set_model_z(ctx, 0.0f);
+}
+
+/* Append a relocation table to the PAR2 model patching each mesh's shader
+ * pointer, with mesh shader indices as exported for shaderless meshes (-1,
+ * whose MSB is the draw bit); `last_offset` overrides the final entry's
+ * offset when nonzero. Returns `pmdl_init_fixup` result */
+static int relocate_par2(uint32_t last_offset) {
+    pmdl_header* header = (pmdl_header*)par2_model.data;
+    uint32_t table_off = test_model_align(par2_model.file.file_len);
+    uint32_t* table = (uint32_t*)(par2_model.data + table_off);
+    pmdl_reloc_entry* relocs = (pmdl_reloc_entry*)(table + 1);
+    unsigned c, m, r = 0;
+    for (c=0 ; c<2 ; ++c) {
+        test_mesh_header* mesh_heads = test_model_meshes(&par2_model, c);
+        for (m=0 ; m<PAR2_MESH_COUNTS[c] ; ++m, ++r) {
+            mesh_heads[m].shader_index = -1;
+            relocs[r].offset = (uint32_t)((uint8_t*)&mesh_heads[m].shader_pointer - par2_model.data);
+            relocs[r].shader_index = -1;
+        }
+    }
+    if (last_offset)
+        relocs[r-1].offset = last_offset;
+    table[0] = r;
+    header->reloc_table_offset = table_off;
+    par2_model.file.file_len = table_off + sizeof(uint32_t) + sizeof(pmdl_reloc_entry) * r;
+    return pmdl_init_fixup(&par2_model.pmdl);
+}
+
+static void check_par2_relocated(pmdl_draw_ctx* ctx) {
+    const pmdl_t* pmdl = &par2_model.pmdl;
+    
+    // Entries patching past end of file reject the model
+    TEST_CHECK(relocate_par2(sizeof(par2_model.data) - 4) != 0, "PAR2 relocated: out-of-bounds entry accepted");
+    
+    // Shaderless meshes have their indices normalised with draw bits clear,
+    // and are culled as without the table
+    TEST_CHECK(relocate_par2(0) == 0, "PAR2 relocated: init failed");
+    unsigned c, m;
+    for (c=0 ; c<2 ; ++c)
+        for (m=0 ; m<PAR2_MESH_COUNTS[c] ; ++m)
+            TEST_CHECK(test_model_meshes(&par2_model, c)[m].shader_index == 0x7fffffff &&
+                       !test_model_meshes(&par2_model, c)[m].shader_pointer,
+                       "PAR2 relocated: mesh %u,%u shader index %x", c, m,
+                       test_model_meshes(&par2_model, c)[m].shader_index);
+    
+    static const expected_record visible[] = {{0,1}, {0,2}, {1,0}};
+    pmdl_draw(ctx, pmdl);
+    check_records("PAR2 relocated", pmdl, visible, 3);
+}
+
+/* PAR0 model of one mesh (a 2-unit cube about the origin) with two reduced
+ * levels linked as section `_LOD`, of errors 0.01 and 0.04; `run_offset`
+ * is both levels' (unread) primitive-run offset. Returns `pmdl_init_fixup`
+ * result */
+static const unsigned LOD_MESH_COUNTS[] = {1};
+static float lod_aabbs[][2][3] = {
+    {{-1,-1,-1}, {1,1,1}}
+};
+static int lod_model_init(test_model* model, uint32_t run_offset) {
+    int err = test_model_init(model, '0', 1, LOD_MESH_COUNTS, lod_aabbs, NULL, 0);
+    if (err)
+        return err;
+    pmdl_header* header = (pmdl_header*)model->data;
+    
+    // Empty relocation table, `_LOD` link, level table, then a run table per level
+    uint32_t reloc_off = test_model_align(model->file.file_len);
+    uint32_t lod_off = reloc_off + sizeof(uint32_t) + sizeof(pmdl_section_link);
+    *(uint32_t*)(model->data + reloc_off) = 0;
+    pmdl_section_link* link = (pmdl_section_link*)(model->data + reloc_off + sizeof(uint32_t));
+    memcpy(link->tag, "_LOD", 4);
+    link->offset = lod_off;
+    *(uint32_t*)(model->data + lod_off) = 2;
+    pmdl_lod_level* levels = (pmdl_lod_level*)(model->data + lod_off + sizeof(uint32_t));
+    uint32_t run_table_off = lod_off + sizeof(uint32_t) + sizeof(pmdl_lod_level) * 2;
+    unsigned l;
+    for (l=0 ; l<2 ; ++l) {
+        levels[l].error = (l) ? 0.04f : 0.01f;
+        levels[l].run_table_offset = run_table_off + sizeof(uint32_t) * l;
+        *(uint32_t*)(model->data + levels[l].run_table_offset) = run_offset;
+    }
+    header->reloc_table_offset = reloc_off;
+    model->file.file_len = run_table_off + sizeof(uint32_t) * 2;
+    return pmdl_init_fixup(&model->pmdl);
+}
+
+/* Draw LOD model `model_idx` at `depth` ahead; it must record at `level` */
+static void check_lod_level(pmdl_draw_ctx* ctx, unsigned model_idx, float depth, unsigned level) {
+    set_model_z(ctx, -depth);
+    pmdl_draw(ctx, &lod_models[model_idx].pmdl);
+    TEST_CHECK(recorder.record_count == 1 && record_arr[0].pmdl == &lod_models[model_idx].pmdl &&
+               record_arr[0].lod_level == level, "LOD: model %u at depth %g recorded level %u, want %u",
+               model_idx, depth, (recorder.record_count) ? record_arr[0].lod_level : ~0u, level);
+    recorder.record_count = 0;
+}
+
+static void check_lod(pmdl_draw_ctx* ctx) {
+    
+    // Run offsets at or past end of file reject the model
+    TEST_CHECK(lod_model_init(&lod_models[0], sizeof(lod_models[0].data)) != 0, "LOD: out-of-bounds run accepted");
+    TEST_CHECK(!lod_model_init(&lod_models[0], 0) && !lod_model_init(&lod_models[1], 0), "LOD: init failed");
+    
+    // The cube projects to 3/depth of viewport height (60-degree view), so
+    // level 1 is within tolerance 0.01 from depth 3 and level 2 from depth
+    // 12; coarsening takes depths of 4 and 16 (25% hysteresis margin)
+    ctx->lod_tolerance = 0.01f;
+    check_lod_level(ctx, 0, 2.0f, 0);
+    check_lod_level(ctx, 0, 3.5f, 0);
+    check_lod_level(ctx, 0, 5.0f, 1);
+    check_lod_level(ctx, 0, 3.5f, 1);
+    check_lod_level(ctx, 0, 2.5f, 0);
+    check_lod_level(ctx, 0, 20.0f, 2);
+    check_lod_level(ctx, 0, 14.0f, 2);
+    
+    // Models sharing the context keep their own hysteresis
+    check_lod_level(ctx, 1, 14.0f, 1);
+    check_lod_level(ctx, 0, 14.0f, 2);
+    check_lod_level(ctx, 1, 14.0f, 1);
+    
+    // Zero tolerance always draws full detail
+    ctx->lod_tolerance = 0.0f;
+    check_lod_level(ctx, 0, 20.0f, 0);
+    set_model_z(ctx, 0.0f);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    if (test_model_init(&par0_model, '0', 2, PAR0_MESH_COUNTS, par0_aabbs, NULL, 0) ||
+        test_model_init(&par2_model, '2', 2, PAR2_MESH_COUNTS, par2_aabbs, PAR2_OCTREE, sizeof(PAR2_OCTREE))) {
+        fprintf(stderr, "unable to init test models\n");
+        return 1;
+    }
+
+    pmdl_draw_ctx* ctx = test_view_space_ctx(60.0f, 1.0f, 1.0f, 100.0f);
+    pmdl_set_draw_recorder(&recorder);
+
+    check_par0(ctx);
+    check_par0_instanced(ctx);
+    check_par2(ctx);
+    check_par2_relocated(ctx);
+    check_lod(ctx);
+
+    pmdl_set_draw_recorder(NULL);
+    pmdl_free_draw_context(ctx);
+
+    if (test_failures)
+        fprintf(stderr, "%u recorder check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
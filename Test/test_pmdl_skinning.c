@@ -0,0 +1,370 @@
+//
+//  test_pmdl_skinning.c
+//  PSPL
+//
+//  Checks CPU skinning of in-memory PAR1 collections (float and quantised
+//  vertices) against the vertex shader's skinning formula evaluated per
+//  primitive skin entry, along with shared-vertex rejection and
+//  double-buffered output
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <PSPLRuntime.h>
+#include <PMDLRuntime.h>
+#include "PMDLCommon.h"
+#include "PMDLRuntimeProcessing.h"
+#include "test_pmdl.h"
+
+#define BONE_COUNT 6
+#define SKIN_COUNT 3
+#define WEIGHT_COUNT 4
+#define ENTRY_VERTS 800
+#define VERT_COUNT (ENTRY_VERTS*SKIN_COUNT + 200)
+#define ELEM_COUNT (ENTRY_VERTS*SKIN_COUNT*2)
+
+/* Skin entries (bones of each, in weight order); entry `e` owns vertices
+ * from `e*ENTRY_VERTS`, the last 200 vertices are referenced by no primitive */
+static const unsigned SKIN_BONES[SKIN_COUNT][WEIGHT_COUNT-1] = {{0,1,2}, {3,1}, {4,5,0}};
+static const unsigned SKIN_BONE_COUNTS[SKIN_COUNT] = {3, 2, 3};
+
+/* Rigging and animation contexts as CPU skinning reads them */
+static pmdl_bone bones[BONE_COUNT];
+static pspl_vector4_t bone_bases[BONE_COUNT];
+static const pmdl_bone* skin_bone_arrs[SKIN_COUNT][WEIGHT_COUNT-1];
+static pmdl_skin_entry skin_entries[SKIN_COUNT];
+static pmdl_rigging_ctx rig_ctx;
+static pspl_matrix34_t bone_mats[BONE_COUNT];
+static pmdl_fk_playback fk_instances[BONE_COUNT];
+static pmdl_animation_ctx anim_ctx;
+
+static void build_rig() {
+    unsigned i, j, k;
+    for (i=0 ; i<BONE_COUNT ; ++i) {
+        bones[i].bone_index = i;
+        for (j=0 ; j<3 ; ++j)
+            bone_bases[i].f[j] = test_rand(-1.0f, 1.0f);
+        bones[i].base_vector = &bone_bases[i];
+        fk_instances[i].bone = &bones[i];
+        fk_instances[i].bone_matrix = &bone_mats[i];
+    }
+    for (i=0 ; i<SKIN_COUNT ; ++i) {
+        for (k=0 ; k<SKIN_BONE_COUNTS[i] ; ++k)
+            skin_bone_arrs[i][k] = &bones[SKIN_BONES[i][k]];
+        skin_entries[i].bone_count = SKIN_BONE_COUNTS[i];
+        skin_entries[i].bone_array = skin_bone_arrs[i];
+    }
+    rig_ctx.bone_count = BONE_COUNT;
+    rig_ctx.bone_array = bones;
+    rig_ctx.skin_entry_count = SKIN_COUNT;
+    rig_ctx.skin_entry_array = skin_entries;
+    anim_ctx.parent_ctx = &rig_ctx;
+    anim_ctx.fk_instance_count = BONE_COUNT;
+    anim_ctx.fk_instance_array = fk_instances;
+}
+
+/* Random bone matrices (linear parts near a rotation-free scale) */
+static void pose_rig() {
+    unsigned i, r, c;
+    for (i=0 ; i<BONE_COUNT ; ++i)
+        for (r=0 ; r<3 ; ++r)
+            for (c=0 ; c<4 ; ++c)
+                bone_mats[i].m[r][c] = (c == 3) ? test_rand(-2.0f, 2.0f) :
+                                       (r == c) + test_rand(-0.5f, 0.5f);
+}
+
+/* In-memory PAR1 model; collection 0 holds float vertices, collection 1
+ * quantised vertices, both skinned by the same primitives */
+static uint8_t model_data[1 << 18] __attribute__ ((aligned (32)));
+static uint32_t model_len = 0;
+static pspl_runtime_arc_file_t model_file;
+static pmdl_t model;
+static uint16_t* elem_arrs[2];
+
+static void* model_alloc(uint32_t len) {
+    model_len = test_model_align(model_len);
+    void* block = model_data + model_len;
+    model_len += len;
+    return block;
+}
+
+static const pmdl_quant_head QUANT = {
+    .scale = {2.0f, 3.0f, 1.5f, 1.0f},
+    .bias = {0.5f, -0.5f, 0.25f, 0.0f}
+};
+
+/* Vertex weights (identity blend first); weights past the skin entry's
+ * bones are zero, as the GPU reads palette entries for them regardless */
+static void vertex_weights(unsigned vert_idx, float weights[WEIGHT_COUNT]) {
+    unsigned entry = vert_idx / ENTRY_VERTS;
+    unsigned bone_count = (entry < SKIN_COUNT) ? SKIN_BONE_COUNTS[entry] : 0;
+    float total = 0.0f;
+    unsigned j;
+    for (j=0 ; j<WEIGHT_COUNT ; ++j) {
+        weights[j] = (j <= bone_count && test_rand(0.0f, 1.0f) < 0.8f) ? test_rand(0.0f, 1.0f) : 0.0f;
+        total += weights[j];
+    }
+    for (j=0 ; j<WEIGHT_COUNT && total>0.0f ; ++j)
+        weights[j] /= total;
+}
+
+static void build_collection(pmdl_col_header* col_head, uint8_t* collection_buf, int quantised) {
+    unsigned i, j;
+    col_head->uv_count = (quantised) ? PMDL_COL_QUANTISED : 0;
+    col_head->bone_count = WEIGHT_COUNT;
+    unsigned stride = pmdl_general_vert_stride(col_head);
+
+    // Vertices
+    col_head->vert_buf_len = pmdl_general_vert_base(col_head) + stride*VERT_COUNT;
+    uint8_t* vert_buf = model_alloc(col_head->vert_buf_len);
+    col_head->vert_buf_off = (uint32_t)(vert_buf - collection_buf);
+    if (quantised) {
+        memcpy(vert_buf, &QUANT, sizeof(QUANT));
+        vert_buf += sizeof(QUANT);
+    }
+    for (i=0 ; i<VERT_COUNT ; ++i) {
+        uint8_t* vert = vert_buf + stride*i;
+        float weights[WEIGHT_COUNT];
+        vertex_weights(i, weights);
+        if (quantised) {
+            int16_t* comps = (int16_t*)vert;
+            for (j=0 ; j<3 ; ++j)
+                comps[j] = (int16_t)test_rand(-32768.0f, 32767.99f);
+            comps[4] = (int16_t)test_rand(-32767.0f, 32767.0f);
+            comps[5] = (int16_t)test_rand(-32767.0f, 32767.0f);
+            for (j=0 ; j<WEIGHT_COUNT ; ++j)
+                vert[12+j] = (uint8_t)(weights[j] * 255.0f + 0.5f);
+        } else {
+            float* comps = (float*)vert;
+            for (j=0 ; j<6 ; ++j)
+                comps[j] = test_rand(-2.0f, 2.0f);
+            memcpy(comps+6, weights, sizeof(weights));
+        }
+    }
+
+    // Elements; each skin entry's vertices ascending, then descending
+    uint16_t* elems = model_alloc(sizeof(uint16_t)*ELEM_COUNT);
+    col_head->elem_buf_off = (uint32_t)((uint8_t*)elems - collection_buf);
+    col_head->elem_buf_len = sizeof(uint16_t)*ELEM_COUNT;
+    for (i=0 ; i<SKIN_COUNT ; ++i)
+        for (j=0 ; j<ENTRY_VERTS ; ++j) {
+            elems[2*ENTRY_VERTS*i + j] = ENTRY_VERTS*i + j;
+            elems[2*ENTRY_VERTS*i + ENTRY_VERTS + j] = ENTRY_VERTS*i + ENTRY_VERTS-1 - j;
+        }
+    elem_arrs[quantised] = elems;
+
+    // Drawing index; mesh 0 draws skin entries 0 and 1, mesh 1 entry 2
+    uint32_t index_buf_offset = 8 + sizeof(test_mesh_header)*2;
+    uint8_t* index_buf = model_alloc(index_buf_offset + sizeof(void*)*3 +
+                                     sizeof(uint32_t)*2 + sizeof(pmdl_general_prim_par1)*2*SKIN_COUNT);
+    col_head->draw_idx_off = (uint32_t)(index_buf - collection_buf);
+    ((uint32_t*)index_buf)[0] = 2;
+    ((uint32_t*)index_buf)[1] = index_buf_offset;
+    uint8_t* prim_cur = index_buf + index_buf_offset + sizeof(void*)*3;
+    unsigned entry = 0;
+    for (i=0 ; i<2 ; ++i) {
+        uint32_t prim_count = (i) ? 2 : 4;
+        memcpy(prim_cur, &prim_count, sizeof(prim_count));
+        pmdl_general_prim_par1* prims = (pmdl_general_prim_par1*)(prim_cur + sizeof(uint32_t));
+        for (j=0 ; j<prim_count ; ++j) {
+            if (j == 2)
+                ++entry;
+            prims[j].skin_idx = entry;
+            prims[j].prim.prim_type = PMDL_POINTS;
+            prims[j].prim.prim_start_idx = 2*ENTRY_VERTS*entry + ENTRY_VERTS*(j%2);
+            prims[j].prim.prim_count = ENTRY_VERTS;
+        }
+        ++entry;
+        prim_cur += sizeof(uint32_t) + sizeof(pmdl_general_prim_par1)*prim_count;
+    }
+}
+
+static void build_model() {
+    pmdl_header* header = model_alloc(sizeof(pmdl_header));
+    memcpy(header->magic, "PMDL", 4);
+    memcpy(header->endianness, "_LIT", 4);
+    header->pointer_size = sizeof(void*);
+    memcpy(header->sub_type_prefix, "PAR", 3);
+    header->sub_type_num = '1';
+    memcpy(header->draw_format, "_GEN", 4);
+
+    pmdl_col_header* col_heads = model_alloc(sizeof(pmdl_col_header)*2);
+    header->collection_offset = (uint32_t)((uint8_t*)col_heads - model_data);
+    header->collection_count = 2;
+    build_collection(&col_heads[0], (uint8_t*)col_heads, 0);
+    build_collection(&col_heads[1], (uint8_t*)col_heads, 1);
+
+    model_file.file_data = model_data;
+    model_file.file_len = model_len;
+    model.file_ptr = &model_file;
+    model.rigging_ptr = &rig_ctx;
+}
+
+/* Vertex as the vertex shader decodes and skins it with skin entry `entry`
+ * (none for unreferenced vertices, which pass through): identity-blended
+ * position plus each bone's weighted transform of the position relative to
+ * bone base, likewise for normal (re-normalised) */
+static void reference_vertex(unsigned collection_idx, unsigned vert_idx, int entry,
+                             double pos_out[3], double norm_out[3]) {
+    const pmdl_header* header = (pmdl_header*)model_data;
+    const pmdl_col_header* col_head = &((pmdl_col_header*)(model_data + header->collection_offset))[collection_idx];
+    const uint8_t* vert = model_data + header->collection_offset + col_head->vert_buf_off +
+                          pmdl_general_vert_base(col_head) + pmdl_general_vert_stride(col_head)*vert_idx;
+    double pos[3], norm[3], weights[WEIGHT_COUNT];
+    unsigned i, j;
+    if (collection_idx) {
+        const int16_t* comps = (const int16_t*)vert;
+        for (i=0 ; i<3 ; ++i)
+            pos[i] = fmax(comps[i] / 32767.0, -1.0) * QUANT.scale[i] + QUANT.bias[i];
+
+        // Octahedral normal (`oct_normal` of the vertex shader)
+        double e[2] = {fmax(comps[4] / 32767.0, -1.0), fmax(comps[5] / 32767.0, -1.0)};
+        norm[2] = 1.0 - fabs(e[0]) - fabs(e[1]);
+        for (i=0 ; i<2 ; ++i)
+            norm[i] = e[i] + fmax(-norm[2], 0.0) * (1.0 - 2.0 * (e[i] >= 0.0));
+        double len = sqrt(norm[0]*norm[0] + norm[1]*norm[1] + norm[2]*norm[2]);
+        for (i=0 ; i<3 ; ++i)
+            norm[i] /= len;
+        for (j=0 ; j<WEIGHT_COUNT ; ++j)
+            weights[j] = vert[12+j] / 255.0;
+    } else {
+        const float* comps = (const float*)vert;
+        for (i=0 ; i<3 ; ++i) {
+            pos[i] = comps[i];
+            norm[i] = comps[3+i];
+        }
+        for (j=0 ; j<WEIGHT_COUNT ; ++j)
+            weights[j] = comps[6+j];
+    }
+
+    if (entry < 0) {
+        for (i=0 ; i<3 ; ++i) {
+            pos_out[i] = pos[i];
+            norm_out[i] = norm[i];
+        }
+    } else {
+        for (i=0 ; i<3 ; ++i) {
+            pos_out[i] = pos[i] * weights[0];
+            norm_out[i] = norm[i] * weights[0];
+        }
+        for (j=0 ; j<SKIN_BONE_COUNTS[entry] ; ++j) {
+            unsigned bone = SKIN_BONES[entry][j];
+            const pspl_matrix34_t* mtx = &bone_mats[bone];
+            double rel[3] = {pos[0] - bone_bases[bone].f[0], pos[1] - bone_bases[bone].f[1],
+                             pos[2] - bone_bases[bone].f[2]};
+            for (i=0 ; i<3 ; ++i) {
+                pos_out[i] += (mtx->m[i][0]*rel[0] + mtx->m[i][1]*rel[1] + mtx->m[i][2]*rel[2] + mtx->m[i][3]) *
+                              weights[j+1];
+                norm_out[i] += (mtx->m[i][0]*norm[0] + mtx->m[i][1]*norm[1] + mtx->m[i][2]*norm[2]) *
+                               weights[j+1];
+            }
+        }
+    }
+    double len = sqrt(norm_out[0]*norm_out[0] + norm_out[1]*norm_out[1] + norm_out[2]*norm_out[2]);
+    if (len > 0.0)
+        for (i=0 ; i<3 ; ++i)
+            norm_out[i] /= len;
+}
+
+static float skinned_pos[VERT_COUNT*3], skinned_norm[VERT_COUNT*3];
+
+/* Skin collection, comparing each vertex with the reference */
+static void check_collection(const char* name, unsigned collection_idx) {
+    memset(skinned_pos, 0xff, sizeof(skinned_pos));
+    memset(skinned_norm, 0xff, sizeof(skinned_norm));
+    TEST_CHECK(pmdl_skin_collection(&model, collection_idx, &anim_ctx, skinned_pos, skinned_norm) == 0,
+               "%s collection %u: skinning failed", name, collection_idx);
+
+    unsigned v, i, failures = 0;
+    for (v=0 ; v<VERT_COUNT ; ++v) {
+        double pos[3], norm[3];
+        reference_vertex(collection_idx, v, (v < ENTRY_VERTS*SKIN_COUNT) ? (int)(v / ENTRY_VERTS) : -1, pos, norm);
+        for (i=0 ; i<3 ; ++i) {
+            if (!(fabs(skinned_pos[3*v+i] - pos[i]) <= 1e-4 * (1.0 + fabs(pos[i]))) ||
+                !(fabs(skinned_norm[3*v+i] - norm[i]) <= 1e-4)) {
+                if (!failures++)
+                    TEST_CHECK(0, "%s collection %u: vertex %u component %u is (%g, %g), want (%g, %g)",
+                               name, collection_idx, v, i, skinned_pos[3*v+i], skinned_norm[3*v+i], pos[i], norm[i]);
+                break;
+            }
+        }
+    }
+    TEST_CHECK(!failures, "%s collection %u: %u vertices differ", name, collection_idx, failures);
+}
+
+static void check_shared_vertex() {
+
+    // A skin entry 1 element referencing a skin entry 0 vertex has no
+    // single skinned result; the collection is rejected
+    uint16_t* elem = &elem_arrs[0][2*ENTRY_VERTS + 10];
+    uint16_t saved = *elem;
+    *elem = 5;
+    TEST_CHECK(pmdl_skin_collection(&model, 0, &anim_ctx, skinned_pos, skinned_norm) != 0,
+               "vertex shared across skin entries accepted");
+    *elem = saved;
+
+    // Sharing within one skin entry is fine
+    elem = &elem_arrs[0][10];
+    saved = *elem;
+    *elem = 5;
+    TEST_CHECK(pmdl_skin_collection(&model, 0, &anim_ctx, skinned_pos, skinned_norm) == 0,
+               "vertex shared within a skin entry rejected");
+    *elem = saved;
+}
+
+static void check_skin_buffer() {
+    static float prev_pos[VERT_COUNT*3];
+    pmdl_skin_buffer buf;
+    TEST_CHECK(pmdl_skin_buffer_init(&buf, &model, 1) == 0 && buf.vert_count == VERT_COUNT,
+               "skin buffer init failed");
+
+    // Each swap skins into the back arrays and presents them, leaving the
+    // previous front as it was
+    TEST_CHECK(pmdl_skin_buffer_swap(&buf, &model, &anim_ctx) == 0, "skin buffer swap failed");
+    unsigned first = buf.front;
+    pmdl_skin_collection(&model, 1, &anim_ctx, skinned_pos, skinned_norm);
+    TEST_CHECK(!memcmp(buf.position_arr[first], skinned_pos, sizeof(skinned_pos)) &&
+               !memcmp(buf.normal_arr[first], skinned_norm, sizeof(skinned_norm)),
+               "skin buffer front differs from direct skinning");
+    memcpy(prev_pos, buf.position_arr[first], sizeof(prev_pos));
+
+    pose_rig();
+    TEST_CHECK(pmdl_skin_buffer_swap(&buf, &model, &anim_ctx) == 0 && buf.front != first,
+               "second skin buffer swap failed");
+    TEST_CHECK(!memcmp(buf.position_arr[first], prev_pos, sizeof(prev_pos)), "previous front overwritten");
+    pmdl_skin_collection(&model, 1, &anim_ctx, skinned_pos, skinned_norm);
+    TEST_CHECK(!memcmp(buf.position_arr[buf.front], skinned_pos, sizeof(skinned_pos)),
+               "skin buffer front differs from direct skinning after repose");
+    pmdl_skin_buffer_destroy(&buf);
+}
+
+int main(int argc, char** argv) {
+    _pspl_mem_init();
+
+    build_rig();
+    build_model();
+    TEST_CHECK(pmdl_collection_vertex_count(&model, 0) == VERT_COUNT &&
+               pmdl_collection_vertex_count(&model, 1) == VERT_COUNT, "collection vertex counts wrong");
+
+    // Inline, then across worker jobs
+    pose_rig();
+    check_collection("inline", 0);
+    check_collection("inline", 1);
+    check_shared_vertex();
+    if (pmdl_animation_pool_init()) {
+        fprintf(stderr, "unable to start animation workers\n");
+        return 1;
+    }
+    pose_rig();
+    check_collection("pooled", 0);
+    check_collection("pooled", 1);
+    check_skin_buffer();
+    pmdl_animation_pool_shutdown();
+
+    if (test_failures)
+        fprintf(stderr, "%u skinning check(s) failed\n", test_failures);
+    return test_failures != 0;
+}
@@ -361,7 +361,7 @@ static void print_help(const char* prog_name) {
         // Now print usage info
         fprintf(stdout, BOLD BLUE"Command Synopsis:\n"NORMAL);
         const char* help =
-        wrap_string("pspl ["BOLD"-o"NORMAL" "UNDERLINE"out-path"NORMAL"] ["BOLD"-E"NORMAL"|"BOLD"-c"NORMAL"] ["BOLD"-G"NORMAL" "UNDERLINE"reflist-out-path"NORMAL"] ["BOLD"-S"NORMAL" "UNDERLINE"staging-root-path"NORMAL"] ["BOLD"-D"NORMAL" "UNDERLINE"def-name"NORMAL"[="UNDERLINE"def-value"NORMAL"]]... ["BOLD"-T"NORMAL" "UNDERLINE"target-platform"NORMAL"]... ["BOLD"-e"NORMAL" <"UNDERLINE"LITTLE"NORMAL","UNDERLINE"BIG"NORMAL","UNDERLINE"BI"NORMAL">] "UNDERLINE"source1"NORMAL" ["UNDERLINE"source2"NORMAL" ["UNDERLINE"sourceN"NORMAL"]]...", 1);
+        wrap_string("pspl ["BOLD"-o"NORMAL" "UNDERLINE"out-path"NORMAL"] ["BOLD"-E"NORMAL"|"BOLD"-c"NORMAL"] ["BOLD"-G"NORMAL" "UNDERLINE"reflist-out-path"NORMAL"] ["BOLD"-S"NORMAL" "UNDERLINE"staging-root-path"NORMAL"] ["BOLD"-D"NORMAL" "UNDERLINE"def-name"NORMAL"[="UNDERLINE"def-value"NORMAL"]]... ["BOLD"-T"NORMAL" "UNDERLINE"target-platform"NORMAL"]... ["BOLD"-e"NORMAL" <"UNDERLINE"LITTLE"NORMAL","UNDERLINE"BIG"NORMAL","UNDERLINE"BI"NORMAL">] ["BOLD"-z"NORMAL"] "UNDERLINE"source1"NORMAL" ["UNDERLINE"source2"NORMAL" ["UNDERLINE"sourceN"NORMAL"]]...", 1);
         fprintf(stdout, "%s\n\n\n", help);
         free((char*)help);
         
@@ -408,7 +408,7 @@ static void print_help(const char* prog_name) {
         // Now print usage info
         fprintf(stdout, "Command Synopsis:\n");
         const char* help =
-        wrap_string("pspl [-o out-path] [-E|-c] [-G reflist-out-path] [-S staging-root-path] [-D def-name[=def-value]]... [-T target-platform]... [-e <LITTLE,BIG,BI>] source1 [source2 [sourceN]]...", 1);
+        wrap_string("pspl [-o out-path] [-E|-c] [-G reflist-out-path] [-S staging-root-path] [-D def-name[=def-value]]... [-T target-platform]... [-e <LITTLE,BIG,BI>] [-z] source1 [source2 [sourceN]]...", 1);
         fprintf(stdout, "%s\n\n\n", help);
         free((char*)help);
                 
@@ -1020,6 +1020,11 @@ int main(int argc, char** argv) {
                 else
                     expected_arg = token_char;
                 
+            } else if (token_char == 'z') {
+                
+                expected_arg = 0;
+                driver_opts.compress_files = 1;
+                
             } else
                 pspl_error(-1, "Unrecognised argument flag",
                            "`-%c` flag not recognised by PSPL", token_char);
@@ -1175,7 +1180,8 @@ int main(int argc, char** argv) {
         .def_c = driver_opts.def_c,
         .def_k = driver_opts.def_k,
         .def_v = driver_opts.def_v,
-        .output_path = driver_opts.out_path
+        .output_path = driver_opts.out_path,
+        .staging_path = driver_state.staging_path
     };
     driver_state.tool_ctx = &tool_ctx;
     
@@ -1417,7 +1423,8 @@ int main(int argc, char** argv) {
         
         // Full Package
         driver_state.pspl_phase = PSPL_PHASE_PACKAGE;
-        pspl_packager_write_psplp(&packager_ctx, driver_opts.default_endianness, out_file);
+        pspl_packager_write_psplp(&packager_ctx, driver_opts.default_endianness,
+                                  driver_opts.compress_files, out_file);
         
     }
     
@@ -100,6 +100,9 @@ typedef struct {
     // Default endianness
     unsigned int default_endianness;
     
+    // Compress archived files within package
+    uint8_t compress_files;
+    
 } pspl_toolchain_driver_opts_t;
 
 /* State for a per-line preprocessor run */
@@ -2440,6 +2440,8 @@ void pspl_indexer_write_psplc(pspl_indexer_context_t* ctx,
         } else {
             SET_BI_U32(stub_record, file_path_ext_off, 0);
         }
+        SET_BI_U32(stub_record, file_codec, PSPL_CODEC_NONE);
+        SET_BI_U32(stub_record, file_raw_len, 0);
         
         // Write data hash
         fwrite(&ent->object_hash, 1, sizeof(pspl_hash), psplc_file_out);
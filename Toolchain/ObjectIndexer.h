@@ -64,6 +64,12 @@ typedef struct {
     uint32_t file_off;
     uint32_t file_padding;
     
+    // Archived file codec, decoded length and coded data
+    // (coded data is NULL when file is stored as-is)
+    uint32_t file_codec;
+    uint32_t file_raw_len;
+    void* file_coded_data;
+    
 } pspl_indexer_entry_t;
 
 /* PSPLC Indexer context type */
@@ -119,8 +119,60 @@ void pspl_packager_indexer_augment(pspl_packager_context_t* ctx,
     
 }
 
+/* Archived files are only stored coded if it saves at least 1/16th */
+#define CODEC_MIN_SAVING(raw_len) ((raw_len)/16)
+
+/* LZ4-code staged file in independent chunks */
+static void code_staged_file(pspl_indexer_entry_t* ent) {
+    int i;
+    
+    // Read whole file
+    size_t raw_len = ent->object_len;
+    if (!raw_len)
+        return;
+    uint8_t* raw_buf = malloc(raw_len);
+    FILE* file = fopen(ent->file_path, "r");
+    if (!file || fread(raw_buf, 1, raw_len, file) != raw_len)
+        pspl_error(-1, "Unable to read staged file",
+                   "`%s` unable to be read for compression; errno %d (%s)",
+                   ent->file_path, errno, strerror(errno));
+    fclose(file);
+    
+    // Chunk end table, then coded chunks
+    unsigned chunk_count = PSPL_CODEC_CHUNK_COUNT(raw_len);
+    size_t table_len = chunk_count * sizeof(uint32_t);
+    uint8_t* coded_buf = malloc(table_len + pspl_lz4_compress_bound(raw_len) + 16 * chunk_count);
+    uint32_t* chunk_ends = (uint32_t*)coded_buf;
+    size_t coded_len = 0;
+    for (i=0 ; i<chunk_count ; ++i) {
+        size_t chunk_off = (size_t)i * PSPL_CODEC_CHUNK_SIZE;
+        size_t chunk_len = raw_len - chunk_off;
+        if (chunk_len > PSPL_CODEC_CHUNK_SIZE)
+            chunk_len = PSPL_CODEC_CHUNK_SIZE;
+        coded_len += pspl_lz4_compress(raw_buf + chunk_off, chunk_len,
+                                       coded_buf + table_len + coded_len);
+#       if __BIG_ENDIAN__
+        chunk_ends[i] = swap_uint32((uint32_t)coded_len);
+#       else
+        chunk_ends[i] = (uint32_t)coded_len;
+#       endif
+    }
+    free(raw_buf);
+    coded_len += table_len;
+    
+    // Keep only if worthwhile
+    if (coded_len + CODEC_MIN_SAVING(raw_len) >= raw_len) {
+        free(coded_buf);
+        return;
+    }
+    ent->file_codec = PSPL_CODEC_LZ4;
+    ent->file_coded_data = coded_buf;
+    ent->object_len = coded_len;
+    
+}
+
 /* Prepare staged file for packaging */
-static void prepare_staged_file(pspl_indexer_entry_t* ent) {
+static void prepare_staged_file(pspl_indexer_entry_t* ent, uint8_t compress_files) {
     
     // Concatenate together path
     char* path = ent->file_path;
@@ -183,11 +235,19 @@ static void prepare_staged_file(pspl_indexer_entry_t* ent) {
     ent->object_len = ftell(file);
     fclose(file);
     
+    // Code if requested
+    ent->file_codec = PSPL_CODEC_NONE;
+    ent->file_raw_len = (uint32_t)ent->object_len;
+    ent->file_coded_data = NULL;
+    if (compress_files)
+        code_staged_file(ent);
+    
 }
 
 /* Write out to PSPLP file */
 void pspl_packager_write_psplp(pspl_packager_context_t* ctx,
                                uint8_t psplp_endianness,
+                               uint8_t compress_files,
                                FILE* psplp_file_out) {
     
     int i,j,k;
@@ -332,7 +392,7 @@ void pspl_packager_write_psplp(pspl_packager_context_t* ctx,
     for (i=0 ; i<ctx->stubs_count ; ++i) {
         pspl_indexer_entry_t* file_ent = ctx->stubs_array[i];
         file_ent->file_off = extension_name_table_off;
-        prepare_staged_file(file_ent);
+        prepare_staged_file(file_ent, compress_files);
         extension_name_table_off += file_ent->object_len;
         uint32_t padding_diff = extension_name_table_off;
         extension_name_table_off = ROUND_UP_32(extension_name_table_off);
@@ -443,6 +503,8 @@ void pspl_packager_write_psplp(pspl_packager_context_t* ctx,
                    union_plat_bits((pspl_indexer_globals_t*)ctx, ent->parent, ent->platform_availability_bits));
         SET_BI_U32(stub_record, file_off, ent->file_off);
         SET_BI_U32(stub_record, file_len, (uint32_t)ent->object_len);
+        SET_BI_U32(stub_record, file_codec, ent->file_codec);
+        SET_BI_U32(stub_record, file_raw_len, ent->file_raw_len);
         
         // Write data hash
         fwrite(&ent->object_hash, 1, sizeof(pspl_hash), psplp_file_out);
@@ -471,7 +533,17 @@ void pspl_packager_write_psplp(pspl_packager_context_t* ctx,
     
     // Write all file data blobs
     for (i=0 ; i<ctx->stubs_count ; ++i) {
-        const pspl_indexer_entry_t* ent = ctx->stubs_array[i];
+        pspl_indexer_entry_t* ent = ctx->stubs_array[i];
+        
+        // Coded file data is already in memory
+        if (ent->file_coded_data) {
+            fwrite(ent->file_coded_data, 1, ent->object_len, psplp_file_out);
+            free(ent->file_coded_data);
+            ent->file_coded_data = NULL;
+            for (j=0 ; j<ent->file_padding ; ++j)
+                fwrite("", 1, 1, psplp_file_out);
+            continue;
+        }
         
         // Copy in file data
         uint8_t buf[8196];
@@ -45,9 +45,11 @@ void pspl_packager_init(pspl_packager_context_t* ctx,
 void pspl_packager_indexer_augment(pspl_packager_context_t* ctx,
                                    pspl_indexer_context_t* indexer);
 
-/* Write out to PSPLP file */
+/* Write out to PSPLP file
+ * (`compress_files` LZ4-codes archived files that benefit from it) */
 void pspl_packager_write_psplp(pspl_packager_context_t* ctx,
                                uint8_t psplp_endianness,
+                               uint8_t compress_files,
                                FILE* psplp_file_out);
 
 #endif // PSPL_INTERNAL
@@ -54,6 +54,37 @@ typedef struct {
     pspl_vector4_t ABCD;
 } pmdl_plane_t;
 
+/* Camera shared by any number of draw contexts; view and projection
+ * work is done once here and picked up by bound contexts on update */
+typedef struct {
+    
+    /* Camera view */
+    pspl_camera_view_t camera_view;
+    
+    /* Projection transform */
+    enum pmdl_projection_type projection_type; // Enumerated projection type
+    union {
+        pspl_perspective_t perspective;
+        pspl_orthographic_t orthographic;
+    } projection;
+    
+    /* DO NOT EDIT FIELDS BELOW!! - Automatically set by update routine */
+    
+    /* View matrix (and view matrix with RH->LH swizzle applied) */
+    pspl_matrix34_t cached_view_mtx;
+    pspl_matrix34_t cached_view_swizzle_mtx;
+    
+    /* Cached frustum tangents (half-angle) */
+    float f_tanv, f_tanh;
+    
+    /* Projection matrix */
+    pspl_matrix44_t cached_projection_mtx;
+    
+    /* Process-unique numbers assigned when view or projection is updated */
+    unsigned view_generation, projection_generation;
+    
+} pmdl_camera;
+
 /* This type allows the PMDL-using application to establish
  * a drawing context (containing master transform info)
  * to use against an initialised PMDL model */
@@ -78,8 +109,22 @@ typedef struct {
     /* Default shader, if model doesn't specify one */
     const pspl_runtime_psplc_t* default_shader;
     
+    /* Largest acceptable level-of-detail error, as a fraction of viewport
+     * height (0 always draws full detail) */
+    float lod_tolerance;
+    
+    /* Shared camera; when set, view and projection fields above are
+     * taken from it (NULL uses this context's own view and projection) */
+    const pmdl_camera* camera;
+    
     /* DO NOT EDIT FIELDS BELOW!! - Automatically set by update routine */
     
+    /* Invalidation bits deferred by `pmdl_invalidate_context` */
+    unsigned pending_inv_bits;
+    
+    /* Camera generations this context was last updated against */
+    unsigned camera_view_generation, camera_projection_generation;
+    
     /* View matrix */
     pspl_matrix34_t cached_view_mtx;
     
@@ -87,12 +132,19 @@ typedef struct {
     pspl_matrix44_t cached_modelview_mtx;
     pspl_matrix44_t cached_modelview_invxpose_mtx;
     
-    /* Cached frustum tangents */
+    /* Cached frustum tangents (half-angle) */
     float f_tanv, f_tanh;
     
+    /* Cached model-space frustum planes (indexed by `pmdl_plane_indices`) */
+    pmdl_plane_t cached_frustum_planes[6];
+    
     /* Projection matrix */
     pspl_matrix44_t cached_projection_mtx;
     
+    /* Process-unique number assigned at each update (lets platforms
+     * skip reloading transforms a shader already holds) */
+    unsigned cached_generation;
+    
 } pmdl_draw_ctx;
 
 /* Routine to allocate and return a new draw context */
@@ -118,19 +170,261 @@ enum pmdl_invalidate_bits {
 };
 void pmdl_update_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits);
 
+/* Defer invalidation of draw context until next array update */
+static inline void pmdl_invalidate_context(pmdl_draw_ctx* ctx, enum pmdl_invalidate_bits inv_bits) {
+    ctx->pending_inv_bits |= inv_bits;
+}
+
+/* Update array of draw contexts; `inv_bits` applies to every context in
+ * addition to its deferred bits and any change of its camera. Contexts
+ * with nothing to do are skipped, and modelviews of contexts sharing a
+ * camera are computed in batch */
+void pmdl_update_context_array(pmdl_draw_ctx* array, unsigned count, enum pmdl_invalidate_bits inv_bits);
+
+/* Routine to allocate and return a new camera */
+pmdl_camera* pmdl_new_camera();
+
+/* Routine to free camera */
+void pmdl_free_camera(pmdl_camera* camera);
+
+/* Invalidate camera transformation cache (if view or projection updated);
+ * bound draw contexts pick up the change at their next update */
+void pmdl_update_camera(pmdl_camera* camera, enum pmdl_invalidate_bits inv_bits);
+
+/* Structure-of-arrays AABB set for batched frustum testing;
+ * AABBs are in the draw context's model space, given as centre and
+ * half-extent per axis (X, Y, Z) */
+typedef struct {
+    unsigned count;
+    float* centre[3];
+    float* extent[3];
+} pmdl_aabb_soa_t;
+
+/* Store min/max AABB into SoA set at index */
+static inline void pmdl_aabb_soa_set(pmdl_aabb_soa_t* aabbs, unsigned idx, const float aabb[2][3]) {
+    int i;
+    for (i=0 ; i<3 ; ++i) {
+        aabbs->centre[i][idx] = (aabb[0][i] + aabb[1][i]) * 0.5f;
+        aabbs->extent[i][idx] = (aabb[1][i] - aabb[0][i]) * 0.5f;
+    }
+}
+
+/* Batched frustum test against planes cached by `pmdl_update_context`;
+ * sets bit (i%32) of `vis_bits_out[i/32]` for each visible AABB
+ * (`vis_bits_out` holds `(count+31)/32` words) and returns visible count */
+unsigned pmdl_aabb_frustum_test_batch(const pmdl_draw_ctx* ctx, const pmdl_aabb_soa_t* aabbs,
+                                      uint32_t* vis_bits_out);
+
 /* Lookup routine to get PMDL file reference from PSPLC */
 const pmdl_t* pmdl_lookup(const pspl_runtime_psplc_t* pspl_object, const char* pmdl_name);
     
 /* Lookup PMDL rigging action */
 const pmdl_action* pmdl_action_lookup(const pmdl_t* pmdl, const char* action_name);
 
-/* Master draw routine */
+/* Lookup PMDL rigging bone */
+const pmdl_bone* pmdl_bone_lookup(const pmdl_t* pmdl, const char* bone_name);
+
+/* Name key for the hashed lookups below; compute once for names looked up often */
+uint32_t pmdl_name_hash(const char* name);
+
+/* Lookup variants taking a precomputed `pmdl_name_hash` key
+ * (the key alone identifies the name; no string comparison is made) */
+const pmdl_action* pmdl_action_lookup_hash(const pmdl_t* pmdl, uint32_t name_hash);
+const pmdl_bone* pmdl_bone_lookup_hash(const pmdl_t* pmdl, uint32_t name_hash);
+
+/* Master draw routine; models with a level-of-detail chain draw the coarsest
+ * level whose error (scaled by the projected master-AABB size) is within
+ * `lod_tolerance`. Moving to a coarser level needs a margin below tolerance,
+ * so models near a threshold don't flicker between levels (the last level is
+ * remembered per context and model; any number of models may share a context) */
 void pmdl_draw(pmdl_draw_ctx* ctx, const pmdl_t* pmdl_file);
 
-/* Rigged master draw routine */
+/* Instanced draw routine; each instance matrix stands in for the context's
+ * model matrix. PAR0 instances are culled together by master AABB, then per
+ * mesh AABB; each mesh binds its buffers and shader once and is drawn for its
+ * visible instances (one instanced draw where the GL context supports it).
+ * Other sub-types fall back to one `pmdl_draw` per instance */
+void pmdl_draw_instanced(pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
+                         const pspl_matrix34_t* instance_mtxs, unsigned count);
+
+/* Rigged master draw routine (selects level of detail as `pmdl_draw` does) */
 void pmdl_draw_rigged(const pmdl_draw_ctx* ctx, const pmdl_t* pmdl,
                       const pmdl_animation_ctx* anim_ctx);
 
+/* Headless draw recording; while a recorder is set, `pmdl_draw` performs
+ * its culling as usual for PAR0 and PAR2 models, but appends each mesh
+ * that would be drawn to the recorder instead of issuing GPU commands.
+ * `record_count` keeps counting past `record_cap` (records beyond
+ * capacity are dropped). `lod_level` is the level of detail selected
+ * (0 for full detail) */
+typedef struct {
+    const pmdl_t* pmdl;
+    unsigned collection_idx;
+    unsigned mesh_idx;
+    unsigned lod_level;
+} pmdl_draw_record;
+typedef struct {
+    unsigned record_count;
+    unsigned record_cap;
+    pmdl_draw_record* record_arr;
+} pmdl_draw_recorder;
+
+/* Set active draw recorder (NULL restores GPU drawing) */
+void pmdl_set_draw_recorder(pmdl_draw_recorder* recorder);
+
+/* Deferred render queue; `pmdl_submit` culls a PAR0 or PAR2 model and queues
+ * its visible meshes as draw packets with 64-bit sort keys (shader, collection
+ * buffer, depth front-to-back). `pmdl_flush_queue` radix-sorts the packets and
+ * draws them, binding shaders, buffers and context transforms only when they
+ * change. `ctx` must stay unchanged until the flush; PAR1 models are drawn
+ * immediately. While a draw recorder is set, flushing records meshes in
+ * sorted order instead of drawing (the state-change counts are still
+ * reported). The queue is not thread-safe */
+typedef struct {
+    unsigned packet_count;
+    unsigned shader_binds;
+    unsigned buffer_binds;
+    unsigned context_loads;
+} pmdl_queue_stats;
+void pmdl_submit(pmdl_draw_ctx* ctx, const pmdl_t* pmdl);
+void pmdl_flush_queue(pmdl_queue_stats* stats_out);
+
+/* Vertex count of collection (size of CPU skinning output arrays, in xyz triples) */
+unsigned pmdl_collection_vertex_count(const pmdl_t* pmdl, unsigned collection_idx);
+
+/* CPU skinning of a PAR1 collection's positions and normals with the bone
+ * matrices last evaluated in `anim_ctx` (no per-draw bone limit; needs no GPU).
+ * Outputs are tightly-packed xyz arrays of `pmdl_collection_vertex_count`
+ * entries; vertices are split across the animation workers. Each vertex takes
+ * the skin entry of the primitives referencing it; collections with a vertex
+ * shared by primitives of different skin entries can't be CPU-skinned.
+ * Returns 0 on success */
+int pmdl_skin_collection(const pmdl_t* pmdl, unsigned collection_idx,
+                         const pmdl_animation_ctx* anim_ctx,
+                         float* position_out, float* normal_out);
+
+/* Double-buffered skinning output; `pmdl_skin_buffer_swap` skins into the back
+ * arrays and then makes them the front, leaving the previous front intact
+ * for readers still consuming it (e.g. an in-flight buffer upload) */
+typedef struct {
+    unsigned collection_idx;
+    unsigned vert_count;
+    unsigned front;
+    float* position_arr[2];
+    float* normal_arr[2];
+} pmdl_skin_buffer;
+int pmdl_skin_buffer_init(pmdl_skin_buffer* buf, const pmdl_t* pmdl, unsigned collection_idx);
+void pmdl_skin_buffer_destroy(pmdl_skin_buffer* buf);
+int pmdl_skin_buffer_swap(pmdl_skin_buffer* buf, const pmdl_t* pmdl,
+                          const pmdl_animation_ctx* anim_ctx);
+
+/* Software occlusion culling; occluders (large, solid geometry) are
+ * rasterised on the CPU into a screen-linear depth buffer between
+ * `pmdl_occlusion_begin` and `pmdl_occlusion_end`, which also builds a
+ * per-tile (8x8) level holding each tile's farthest occluder depth.
+ * While set with `pmdl_set_occlusion_buffer`, drawing, submission, octree
+ * traversal and instance culling also skip AABBs hidden behind occluders.
+ * Occluder triangles crossing the near plane are skipped, so results are
+ * conservative. Dimensions round up to multiples of 8 */
+typedef struct {
+    unsigned width, height;
+    unsigned tiles_x, tiles_y;
+    float* depth_arr;
+    float* tile_depth_arr;
+    
+    // Projection taken from context at `pmdl_occlusion_begin`
+    int perspective;
+    float near;
+    float scale[2];
+    float offset[2];
+} pmdl_occlusion_buffer;
+int pmdl_occlusion_buffer_init(pmdl_occlusion_buffer* buf, unsigned width, unsigned height);
+void pmdl_occlusion_buffer_destroy(pmdl_occlusion_buffer* buf);
+void pmdl_occlusion_begin(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx);
+void pmdl_occlusion_add_aabb(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const float aabb[2][3]);
+void pmdl_occlusion_add_triangles(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx,
+                                  const float* positions, unsigned stride,
+                                  const uint16_t* indices, unsigned tri_count);
+int pmdl_occlusion_add_pmdl(pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const pmdl_t* pmdl);
+void pmdl_occlusion_end(pmdl_occlusion_buffer* buf);
+
+/* Returns non-zero if AABB (in `ctx` model space) may be visible */
+int pmdl_occlusion_test_aabb(const pmdl_occlusion_buffer* buf, const pmdl_draw_ctx* ctx, const float aabb[2][3]);
+
+/* Set occlusion buffer used while drawing (NULL disables occlusion culling) */
+void pmdl_set_occlusion_buffer(const pmdl_occlusion_buffer* buf);
+
+/* CPU collision queries over triangle meshes, accelerated by a SAH bounding-
+ * volume hierarchy. `pmdl_collision_init` copies positions and builds the
+ * hierarchy over a caller's triangle list; `pmdl_collision_init_file` maps a
+ * `_COL` PMDL's buffers and prebuilt hierarchy (building one if absent), so
+ * the file must outlive the collision object. Hit triangles index the
+ * caller's list or the file's element buffer */
+struct pmdl_bvh_node;
+typedef struct {
+    unsigned tri_count;
+    unsigned node_count;
+    const float* position_arr;
+    const uint32_t* index_arr;
+    const struct pmdl_bvh_node* node_arr;
+    
+    // Leaf-order triangle terms (SoA) and remapping to caller indices
+    float* tri_soa;
+    uint32_t* tri_id_arr;
+    
+    // Blocks allocated by runtime builds
+    float* owned_positions;
+    uint32_t* owned_indices;
+    struct pmdl_bvh_node* owned_nodes;
+} pmdl_collision;
+int pmdl_collision_init(pmdl_collision* col, const float* positions, unsigned vert_count,
+                        const uint32_t* indices, unsigned tri_count);
+int pmdl_collision_init_file(pmdl_collision* col, const void* file_data, size_t file_len);
+void pmdl_collision_destroy(pmdl_collision* col);
+
+/* Rays reach `origin + dir * t` for `t` in [0, `t_max`]; sweeps move a
+ * sphere of `radius` along the same path */
+typedef struct {
+    float origin[3];
+    float dir[3];
+    float t_max;
+} pmdl_ray;
+typedef struct {
+    float origin[3];
+    float dir[3];
+    float t_max;
+    float radius;
+} pmdl_sphere_sweep;
+
+/* Nearest contact; `normal` faces the query (for sweeps, from the touched
+ * point to the sphere centre) */
+#define PMDL_COLLISION_MISS 0xffffffff
+typedef struct {
+    float t;
+    uint32_t triangle;
+    float normal[3];
+} pmdl_collision_hit;
+
+/* Batched queries fill one hit per ray/sweep (`triangle` is
+ * `PMDL_COLLISION_MISS` on a miss) and return the hit count.
+ * `pmdl_collision_raycast_packets` traverses rays in packets of 4, which
+ * pays off when neighbouring rays are coherent (shared origin, similar direction) */
+unsigned pmdl_collision_raycast_batch(const pmdl_collision* col, const pmdl_ray* rays,
+                                      unsigned count, pmdl_collision_hit* hits);
+unsigned pmdl_collision_raycast_packets(const pmdl_collision* col, const pmdl_ray* rays,
+                                        unsigned count, pmdl_collision_hit* hits);
+unsigned pmdl_collision_sweep_batch(const pmdl_collision* col, const pmdl_sphere_sweep* sweeps,
+                                    unsigned count, pmdl_collision_hit* hits);
+
+/* Writes up to `tri_cap` triangles overlapping AABB and returns the total
+ * overlap count (or 0/1 when `tri_out` is NULL) */
+unsigned pmdl_collision_aabb_query(const pmdl_collision* col, const float aabb[2][3],
+                                   uint32_t* tri_out, unsigned tri_cap);
+
+/* Sets bit for each AABB overlapping any triangle and returns the count */
+unsigned pmdl_collision_aabb_test_batch(const pmdl_collision* col, const pmdl_aabb_soa_t* aabbs,
+                                        uint32_t* hit_bits);
+
 
 
 #pragma mark Linear Argebra
@@ -242,6 +536,12 @@ void pmdl_quat_mul(pspl_vector4_t* a, pspl_vector4_t* b, pspl_vector4_t* ab);
 
 #endif
 
+/* Batch variants; `ab_arr[i] = a_arr[i] * b` and `dst = mtx * src` over
+ * packed XYZ triples (arrays may alias in place) */
+void pmdl_matrix34_mul_batch(const pspl_matrix34_t* a_arr, const pspl_matrix34_t* b,
+                             pspl_matrix34_t* ab_arr, unsigned count);
+void pmdl_vector3_matrix_mul_batch(const pspl_matrix34_t* mtx, const float* src, float* dst, unsigned count);
+
 #define pmdl_matrix_lookat(m, view) _pmdl_matrix_lookat((m), &(view).pos, &(view).up, &(view).look)
 #define pmdl_matrix_orthographic(m, ortho) _pmdl_matrix_orthographic((m), (ortho).top, (ortho).bottom, (ortho).left, (ortho).right, (ortho).near, (ortho).far)
 #define pmdl_matrix_perspective(m, persp) _pmdl_matrix_perspective((m), (persp).fov, (persp).aspect, (persp).near, (persp).far)
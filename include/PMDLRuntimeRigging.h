@@ -13,6 +13,7 @@
 
 struct pmdl_rigging_ctx;
 struct pmdl_action_ctx;
+struct pmdl_ctx_pool;
 
 #pragma mark Skeleton
 
@@ -35,6 +36,10 @@ typedef struct pmdl_bone {
     // Base vector (Copied from file for alignment purposes)
     const pspl_vector4_t* base_vector;
     
+    // Bind-pose AABB of vertices weighted to this bone
+    // (NULL if not stored in file; empty if min exceeds max)
+    const float (*vert_aabb)[3];
+    
 } pmdl_bone;
 
 
@@ -47,6 +52,9 @@ typedef struct {
     unsigned bone_count;
     const pmdl_bone** bone_array;
     
+    // Index of first bone within skin palettes (see `skin_palette_array`)
+    unsigned palette_offset;
+    
 } pmdl_skin_entry;
 
 
@@ -78,6 +86,9 @@ typedef struct {
     // Property curves being animated (unavailable curves set to NULL)
     unsigned property_count;
     
+    // Index of this track's first curve-playback instance within action contexts
+    unsigned first_curve_index;
+    
     const pmdl_curve* scale_x;
     const pmdl_curve* scale_y;
     const pmdl_curve* scale_z;
@@ -109,11 +120,23 @@ typedef struct {
     unsigned bone_track_count;
     const pmdl_action_bone_track* bone_track_array;
     
+    // Track of each bone (original bone indexing; NULL if bone isn't animated)
+    const pmdl_action_bone_track* const* bone_track_lut;
+    
 } pmdl_action;
 
 
 #pragma mark Root Rigging Context
 
+/* Open-addressed name table slot (see `pmdl_name_hash`);
+ * `index` is one past the named array index, 0 marks an empty slot */
+typedef struct {
+    
+    uint32_t name_hash;
+    uint32_t index;
+    
+} pmdl_name_slot;
+
 /* In-memory rigging context (one for each loaded PAR1 PMDL) */
 typedef struct pmdl_rigging_ctx {
     
@@ -125,19 +148,46 @@ typedef struct pmdl_rigging_ctx {
     unsigned root_bone_count;
     const pmdl_bone** root_bone_array;
     
+    // Bone indices sorted parents-before-children (for iterative FK evaluation)
+    const unsigned* fk_order_array;
+    
     // Skin entry array (with indexing utilised by geometry data)
     unsigned skin_entry_count;
     const pmdl_skin_entry* skin_entry_array;
     
+    // Bone base vectors of all skin entries, contiguous in palette order
+    unsigned skin_palette_count;
+    const pspl_vector4_t* skin_base_array;
+    
     // Action array (with original indexing from file)
     unsigned action_count;
     const pmdl_action* action_array;
     
+    // Hashed bone and action name tables (power-of-two sizes, linearly probed)
+    unsigned bone_name_mask;
+    const pmdl_name_slot* bone_name_table;
+    unsigned action_name_mask;
+    const pmdl_name_slot* action_name_table;
+    
+    // Fixed-size pools backing this rigging context's action and animation contexts
+    // (released along with the rigging context)
+    struct pmdl_ctx_pool* action_ctx_pool;
+    struct pmdl_ctx_pool* animation_ctx_pool;
+    
 } pmdl_rigging_ctx;
 
 
 #pragma mark Action API Context
 
+/* Power-basis cubic coefficients of one keyframe segment
+ * (component(t) = ((c[0]*t + c[1])*t + c[2])*t + c[3] for t in [0,1]) */
+typedef struct {
+    
+    float x[4];
+    float y[4];
+    
+} pmdl_curve_segment;
+
 /* Curve context representation (for animating bézier curve instances) */
 typedef struct {
     
@@ -147,6 +197,12 @@ typedef struct {
     // Curve being animated
     const pmdl_curve* curve;
     
+    // Segment coefficients (one fewer than keyframes; computed at init)
+    const pmdl_curve_segment* segment_array;
+    
+    // Left keyframe index of segment evaluated at last advance
+    unsigned keyframe_cursor;
+    
     // Cached value computed with bézier function at last advance
     float cached_value;
     
@@ -191,7 +247,7 @@ void pmdl_action_destroy(pmdl_action_ctx* ctx_ptr);
 void pmdl_action_advance(pmdl_action_ctx* ctx_ptr, double time_delta);
 
 /* Routine to rewind action context (call advance afterwards before drawing) */
-#define pmdl_action_rewind(ctx_ptr) (ctx_ptr)->have_abs_time = 0
+#define pmdl_action_rewind(ctx_ptr) (ctx_ptr)->current_time = 0.0
 
 
 #pragma mark Animation API Context
@@ -228,9 +284,6 @@ typedef struct pmdl_fk_playback {
     // Cumulative bone transformation matrix
     pspl_matrix34_t* bone_matrix;
     
-    // Evaluation flip-bit (alternates 0/1 to synchronise with other FK instances)
-    char eval_flip_bit;
-    
 } pmdl_fk_playback;
 
 /* Structure to represent animation context
@@ -249,8 +302,10 @@ typedef struct {
     unsigned fk_instance_count;
     pmdl_fk_playback* fk_instance_array;
     
-    // Master FK flip-bit
-    char master_fk_flip_bit;
+    // Evaluated bone matrices of all skin entries (homogenous; ready for upload),
+    // rebuilt at each evaluation along with a process-unique generation number
+    pspl_matrix44_t* skin_palette_array;
+    unsigned palette_generation;
     
 } pmdl_animation_ctx;
 
@@ -265,6 +320,11 @@ pmdl_animation_ctx* pmdl_animation_initv(const pmdl_action_ctx* first_action_ctx
  * Call *before* drawing a rigged model */
 void pmdl_animation_evaluate(pmdl_animation_ctx* ctx_ptr);
 
+/* Evaluates many animation contexts at once; contexts sharing a rigging context
+ * are evaluated four at a time and the array is split across worker threads
+ * (a context must not appear in the array more than once) */
+void pmdl_animation_evaluate_batch(pmdl_animation_ctx** ctx_arr, unsigned ctx_count);
+
 /* Routine to destroy animation context */
 void pmdl_animation_destroy(pmdl_animation_ctx* ctx_ptr);
  
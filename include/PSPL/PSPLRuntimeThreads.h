@@ -6,7 +6,8 @@
 //
 //
 
-/* A simple, fork-based, common multi-threading API with mutexes */
+/* A simple, fork-based, common multi-threading API with mutexes,
+ * semaphores and a persistent worker-pool */
 
 #ifndef PSPL_PSPLRuntimeThreads_h
 #define PSPL_PSPLRuntimeThreads_h
@@ -21,6 +22,13 @@ typedef dispatch_semaphore_t pspl_mutex_t;
 #define pspl_mutex_trylock(mutex) dispatch_semaphore_wait(*mutex, DISPATCH_TIME_NOW)
 #define pspl_mutex_unlock(mutex) dispatch_semaphore_signal(*mutex)
 #define pspl_mutex_destroy(mutex) dispatch_release(*mutex)
+typedef dispatch_semaphore_t pspl_sem_t;
+#define pspl_sem_init(sem) *sem = dispatch_semaphore_create(0)
+#define pspl_sem_wait(sem) dispatch_semaphore_wait(*sem, DISPATCH_TIME_FOREVER)
+#define pspl_sem_post(sem) dispatch_semaphore_signal(*sem)
+#define pspl_sem_destroy(sem) dispatch_release(*sem)
+#include <sched.h>
+#define pspl_thread_yield() sched_yield()
 
 #elif defined(PSPL_THREADING_PTHREAD)
 #include <pthread.h>
@@ -30,6 +38,14 @@ typedef pthread_mutex_t pspl_mutex_t;
 #define pspl_mutex_trylock(mutex) pthread_mutex_trylock(mutex)
 #define pspl_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
 #define pspl_mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+#include <semaphore.h>
+typedef sem_t pspl_sem_t;
+#define pspl_sem_init(sem) sem_init(sem, 0, 0)
+#define pspl_sem_wait(sem) sem_wait(sem)
+#define pspl_sem_post(sem) sem_post(sem)
+#define pspl_sem_destroy(sem) sem_destroy(sem)
+#include <sched.h>
+#define pspl_thread_yield() sched_yield()
 
 #elif defined(PSPL_THREADING_OGC)
 #include <ogc/lwp.h>
@@ -40,6 +56,13 @@ typedef mutex_t pspl_mutex_t;
 #define pspl_mutex_trylock(mutex) LWP_MutexTryLock(*mutex)
 #define pspl_mutex_unlock(mutex) LWP_MutexUnlock(*mutex)
 #define pspl_mutex_destroy(mutex) LWP_MutexDestroy(*mutex)
+#include <ogc/semaphore.h>
+typedef sem_t pspl_sem_t;
+#define pspl_sem_init(sem) LWP_SemInit(sem, 0, 0x7fffffff)
+#define pspl_sem_wait(sem) LWP_SemWait(*sem)
+#define pspl_sem_post(sem) LWP_SemPost(*sem)
+#define pspl_sem_destroy(sem) LWP_SemDestroy(*sem)
+#define pspl_thread_yield() LWP_YieldThread()
 
 #elif defined(PSPL_THREADING_WINDOWS)
 #include <winbase.h>
@@ -49,11 +72,69 @@ typedef CRITICAL_SECTION pspl_mutex_t;
 #define pspl_mutex_trylock(mutex) TryEnterCriticalSection(mutex)
 #define pspl_mutex_unlock(mutex) LeaveCriticalSection(mutex)
 #define pspl_mutex_destroy(mutex) DeleteCriticalSection(mutex)
+typedef HANDLE pspl_sem_t;
+#define pspl_sem_init(sem) *sem = CreateSemaphore(NULL, 0, 0x7fffffff, NULL)
+#define pspl_sem_wait(sem) WaitForSingleObject(*sem, INFINITE)
+#define pspl_sem_post(sem) ReleaseSemaphore(*sem, 1, NULL)
+#define pspl_sem_destroy(sem) CloseHandle(*sem)
+#define pspl_thread_yield() SwitchToThread()
 
 #endif
 
+/* Atomic primitives (full barriers; GCC/Clang builtins) */
+#define pspl_atomic_inc(ptr) __sync_add_and_fetch(ptr, 1)
+#define pspl_atomic_dec(ptr) __sync_sub_and_fetch(ptr, 1)
+#define pspl_atomic_cas(ptr, old_val, new_val) __sync_bool_compare_and_swap(ptr, old_val, new_val)
+#define pspl_atomic_barrier() __sync_synchronize()
+
 int pspl_thread_fork(void(*func)(void*), void* usr_ptr);
 
+
+#pragma mark Worker Pool
+
+/* Job priority levels (lower value runs first) */
+enum pspl_job_priority {
+    PSPL_JOB_PRIORITY_HIGH   = 0,
+    PSPL_JOB_PRIORITY_NORMAL = 1,
+    PSPL_JOB_PRIORITY_LOW    = 2,
+    PSPL_JOB_PRIORITY_COUNT  = 3
+};
+
+/* Completion fence; counts outstanding jobs submitted against it */
+typedef volatile int32_t pspl_fence_t;
+
+/* Intrusive job record; owned by the submitter and untouched by the
+ * pool once its fence has been decremented */
+typedef struct _pspl_job {
+    struct _pspl_job* next;
+    void(*func)(void*);
+    void* usr_ptr;
+    enum pspl_job_priority priority;
+    pspl_fence_t* fence;
+} pspl_job_t;
+
+typedef struct _pspl_thread_pool pspl_thread_pool_t;
+
+/* Create pool of `thread_count` persistent workers; `thread_init` (optional)
+ * runs once on each worker before it accepts jobs. A pool of zero threads
+ * runs every submitted job synchronously on the submitting thread */
+pspl_thread_pool_t* pspl_thread_pool_create(unsigned thread_count,
+                                            void(*thread_init)(void*), void* init_ptr);
+
+/* Stop workers and free pool (jobs still queued are discarded, releasing
+ * their fences) */
+void pspl_thread_pool_destroy(pspl_thread_pool_t* pool);
+
+/* Queue job for execution (lock-free; callable from any thread) */
+void pspl_thread_pool_submit(pspl_thread_pool_t* pool, pspl_job_t* job);
+
+/* Remove queued (not yet running) jobs bearing `fence`; returns count removed */
+int pspl_thread_pool_cancel(pspl_thread_pool_t* pool, pspl_fence_t* fence);
+
+/* Block until all jobs submitted against `fence` have completed */
+void pspl_fence_wait(pspl_fence_t* fence);
+
+
 /* Thread-specific values (set on fork) */
 intptr_t pspl_api_load_state();
 intptr_t pspl_api_load_subject_index();
@@ -117,6 +117,10 @@ typedef struct {
     /**< Output path */
     const char* output_path;
     
+    /**< Absolute path of staging directory (with trailing slash);
+     * extensions may keep persistent conversion caches within */
+    const char* staging_path;
+    
 } pspl_toolchain_context_t;
 
 #pragma mark -
@@ -0,0 +1,38 @@
+//
+//  TMRuntime.h
+//  PSPL
+//
+//  Runtime interface of the TextureManager extension
+//
+//
+
+#ifndef PSPL_TMRuntime_h
+#define PSPL_TMRuntime_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <PSPLRuntime.h>
+
+/* Textures of retained PSPLCs are loaded on background threads;
+ * each texture binds as empty until its own load has completed */
+
+/* Set priority of texture loads queued by subsequent PSPLC retains */
+void pspl_tm_set_load_priority(enum pspl_job_priority priority);
+
+/* Block until all textures of PSPLC have finished loading */
+void pspl_tm_wait_psplc(const pspl_runtime_psplc_t* psplc);
+
+/* Samples declared with `ATLAS` are packed into shared textures; their
+ * texcoords must be mapped as `uv * scale + offset` before sampling.
+ * Fills `xf_out` with {scale_u, scale_v, offset_u, offset_v}
+ * (identity for unpacked samples); returns 0 on success */
+int pspl_tm_get_sample_uv_transform(const pspl_runtime_psplc_t* psplc, unsigned map_idx,
+                                    float xf_out[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif